@@ -1,9 +1,18 @@
-use criterion::{criterion_group, criterion_main, Criterion};
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion};
 use paper2::{
     log_level::LogLevel,
-    logger::{logger_thread_ctx::LoggerThreadCtx, LogData, LoggerConfig},
+    logger::{logger_thread_ctx::LoggerThreadCtx, FlushPolicy, LogData, LoggerConfig, QueueMode},
+};
+use std::{
+    fs,
+    path::PathBuf,
+    sync::{
+        atomic::{AtomicBool, Ordering},
+        Barrier,
+    },
+    thread,
+    time::{Duration, Instant},
 };
-use std::{path::PathBuf, time::Duration};
 
 fn bench_queue_log(c: &mut Criterion) {
     let config = LoggerConfig::default();
@@ -52,9 +61,174 @@ fn bench_log_100_and_flush(c: &mut Criterion) {
     });
 }
 
+// Compares the locked queue with per-thread rings while several threads log at once.
+// The producer threads are spawned once, and each burst is larger than a ring
+// so the rings spill into the shared queue as well.
+fn bench_contended_producers(c: &mut Criterion) {
+    const RING_CAPACITY: usize = 1024;
+    const LOGS_PER_THREAD: usize = 4 * RING_CAPACITY;
+
+    let mut group = c.benchmark_group("contended_producers");
+
+    let modes = [
+        ("locked", QueueMode::Locked),
+        (
+            "ring",
+            QueueMode::PerThreadRing {
+                capacity: RING_CAPACITY,
+            },
+        ),
+    ];
+
+    for (name, queue_mode) in modes {
+        let config = LoggerConfig {
+            queue_mode,
+            ..LoggerConfig::default()
+        };
+        let log_path = PathBuf::from(format!("logs/bench_contended_{name}.log"));
+        let logger = LoggerThreadCtx::new(config, log_path)
+            .unwrap()
+            .init(false)
+            .unwrap();
+
+        let log_data = LogData {
+            level: LogLevel::Info,
+            message: "Benchmark log message".to_string(),
+            ..Default::default()
+        };
+
+        for threads in [1, 4, 16, 64] {
+            // producers wait on `start` for each burst and report on `done`
+            let start = Barrier::new(threads + 1);
+            let done = Barrier::new(threads + 1);
+            let stop = AtomicBool::new(false);
+
+            thread::scope(|s| {
+                for _ in 0..threads {
+                    s.spawn(|| loop {
+                        start.wait();
+                        if stop.load(Ordering::Relaxed) {
+                            break;
+                        }
+                        for _ in 0..LOGS_PER_THREAD {
+                            logger.read().queue_log(log_data.clone());
+                        }
+                        done.wait();
+                    });
+                }
+
+                group.bench_with_input(BenchmarkId::new(name, threads), &threads, |b, _| {
+                    b.iter_custom(|iters| {
+                        let mut elapsed = Duration::ZERO;
+                        for _ in 0..iters {
+                            let burst = Instant::now();
+                            start.wait();
+                            done.wait();
+                            elapsed += burst.elapsed();
+
+                            // let the logging thread catch up outside of the measurement
+                            logger
+                                .read()
+                                .wait_for_flush_timeout(Duration::from_millis(50));
+                        }
+                        elapsed
+                    })
+                });
+
+                stop.store(true, Ordering::Relaxed);
+                start.wait();
+            });
+        }
+    }
+
+    group.finish();
+}
+
+/// Write syscalls made by this process so far, where the kernel reports them
+fn write_syscalls() -> Option<u64> {
+    fs::read_to_string("/proc/self/io")
+        .ok()?
+        .lines()
+        .find_map(|line| line.strip_prefix("syscw:"))?
+        .trim()
+        .parse()
+        .ok()
+}
+
+// A steady trickle of logs, flushed after every batch or on the default policy.
+// Prints the write syscalls each policy made next to the timings.
+fn bench_flush_policy(c: &mut Criterion) {
+    const LOGS: usize = 1_000;
+
+    let mut group = c.benchmark_group("flush_policy");
+
+    let policies = [
+        (
+            "every_batch",
+            FlushPolicy {
+                max_latency: Duration::ZERO,
+                max_dirty_bytes: 0,
+                flush_level: LogLevel::Off,
+            },
+        ),
+        ("default", FlushPolicy::default()),
+    ];
+
+    for (name, flush_policy) in policies {
+        let config = LoggerConfig {
+            flush_policy,
+            ..LoggerConfig::default()
+        };
+        let log_path = PathBuf::from(format!("logs/bench_flush_{name}.log"));
+        let logger = LoggerThreadCtx::new(config, log_path)
+            .unwrap()
+            .init(false)
+            .unwrap();
+
+        let log_data = LogData {
+            level: LogLevel::Info,
+            message: "Benchmark log message".to_string(),
+            ..Default::default()
+        };
+
+        let mut syscalls = 0;
+        let mut runs = 0;
+        group.bench_function(name, |b| {
+            b.iter_custom(|iters| {
+                let before = write_syscalls();
+                let start = Instant::now();
+                for _ in 0..iters {
+                    for _ in 0..LOGS {
+                        logger.read().queue_log(log_data.clone());
+                        thread::sleep(Duration::from_micros(100));
+                    }
+                }
+                let elapsed = start.elapsed();
+
+                // the last flush is due within the latency limit
+                thread::sleep(flush_policy.max_latency + Duration::from_millis(10));
+                if let (Some(before), Some(after)) = (before, write_syscalls()) {
+                    syscalls += after - before;
+                    runs += iters;
+                }
+                elapsed
+            })
+        });
+
+        if runs != 0 {
+            println!(
+                "flush_policy/{name}: {:.1} write syscalls per {LOGS} logs",
+                syscalls as f64 / runs as f64
+            );
+        }
+    }
+
+    group.finish();
+}
+
 criterion_group! {
     name = benches;
     config = Criterion::default().significance_level(0.1).sample_size(10);
-    targets = bench_queue_log, bench_log_100_and_flush
+    targets = bench_queue_log, bench_log_100_and_flush, bench_contended_producers, bench_flush_policy
 }
 criterion_main!(benches);
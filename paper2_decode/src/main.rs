@@ -0,0 +1,155 @@
+//! Turns binary paper2 log files back into the text format.
+
+use std::{
+    env,
+    fs::File,
+    io::{self, BufReader, BufWriter, Read, Write},
+    path::Path,
+    process::ExitCode,
+};
+
+use paper2::{
+    log_level::LogLevel,
+    logger::{
+        binary_format::{self, BinaryDecoder, RecordFilter},
+        clock::{TimestampFormatter, TimestampPrecision},
+    },
+};
+
+const USAGE: &str = "\
+Usage: paper2_decode [options] <file>...
+
+Options:
+  --level <level>       only records at or above this level (debug, info, warn, error, crit)
+  --tag <tag>           only records with this tag, may be given more than once
+  --since <time>        only records at or after this time
+  --until <time>        only records before this time
+  --precision <s|ms|us> digits after the seconds, defaults to s like text files
+
+Times are unix seconds or local `YYYY-MM-DD HH:MM:SS`.
+Files ending in .zst are decompressed first.";
+
+struct Options {
+    filter: RecordFilter,
+    precision: TimestampPrecision,
+    files: Vec<String>,
+}
+
+fn parse_level(level: &str) -> Result<LogLevel, String> {
+    match level.to_ascii_lowercase().as_str() {
+        "debug" | "d" => Ok(LogLevel::Debug),
+        "info" | "i" => Ok(LogLevel::Info),
+        "warn" | "w" => Ok(LogLevel::Warn),
+        "error" | "e" => Ok(LogLevel::Error),
+        "crit" | "c" => Ok(LogLevel::Crit),
+        _ => Err(format!("unknown level `{level}`")),
+    }
+}
+
+/// Unix nanoseconds of `time`
+fn parse_time(time: &str) -> Result<i64, String> {
+    binary_format::parse_time(time).ok_or_else(|| format!("can't read time `{time}`"))
+}
+
+fn parse_precision(precision: &str) -> Result<TimestampPrecision, String> {
+    match precision {
+        "s" => Ok(TimestampPrecision::Seconds),
+        "ms" => Ok(TimestampPrecision::Millis),
+        "us" => Ok(TimestampPrecision::Micros),
+        _ => Err(format!("unknown precision `{precision}`")),
+    }
+}
+
+fn parse_args(mut args: impl Iterator<Item = String>) -> Result<Options, String> {
+    let mut options = Options {
+        filter: RecordFilter::default(),
+        precision: TimestampPrecision::Seconds,
+        files: Vec::new(),
+    };
+
+    while let Some(arg) = args.next() {
+        let mut value = || args.next().ok_or_else(|| format!("`{arg}` needs a value"));
+
+        match arg.as_str() {
+            "--level" => options.filter.min_level = Some(parse_level(&value()?)?),
+            "--tag" => options.filter.tags.push(value()?),
+            "--since" => options.filter.since = Some(parse_time(&value()?)?),
+            "--until" => options.filter.until = Some(parse_time(&value()?)?),
+            "--precision" => options.precision = parse_precision(&value()?)?,
+            "-h" | "--help" => return Err(String::new()),
+            _ if arg.starts_with("--") => return Err(format!("unknown option `{arg}`")),
+            _ => options.files.push(arg),
+        }
+    }
+
+    if options.files.is_empty() {
+        return Err("no files given".to_string());
+    }
+
+    Ok(options)
+}
+
+fn open(path: &str) -> io::Result<Box<dyn Read>> {
+    let file = BufReader::new(File::open(path)?);
+
+    if Path::new(path).extension().is_some_and(|ext| ext == "zst") {
+        #[cfg(feature = "compress")]
+        return Ok(Box::new(zstd::Decoder::with_buffer(file)?));
+
+        #[cfg(not(feature = "compress"))]
+        return Err(io::Error::other("built without the compress feature"));
+    }
+
+    Ok(Box::new(file))
+}
+
+fn decode(path: &str, options: &Options, out: &mut impl Write) -> io::Result<()> {
+    let mut formatter = TimestampFormatter::default();
+
+    for record in BinaryDecoder::new(open(path)?)? {
+        let record = record?;
+        if options.filter.matches(&record) {
+            record.write_text(out, &mut formatter, options.precision)?;
+        }
+    }
+
+    Ok(())
+}
+
+fn main() -> ExitCode {
+    let options = match parse_args(env::args().skip(1)) {
+        Ok(options) => options,
+        Err(message) => {
+            if !message.is_empty() {
+                eprintln!("error: {message}\n");
+            }
+            eprintln!("{USAGE}");
+            return ExitCode::FAILURE;
+        }
+    };
+
+    let mut out = BufWriter::new(io::stdout().lock());
+    let mut status = ExitCode::SUCCESS;
+
+    for path in &options.files {
+        match decode(path, &options, &mut out) {
+            Ok(()) => {}
+            // the reader went away, e.g. piped into head
+            Err(e) if e.kind() == io::ErrorKind::BrokenPipe => return status,
+            Err(e) => {
+                // keep what was decoded before the error
+                let _ = out.flush();
+                eprintln!("{path}: {e}");
+                status = ExitCode::FAILURE;
+            }
+        }
+    }
+
+    match out.flush() {
+        Err(e) if e.kind() != io::ErrorKind::BrokenPipe => {
+            eprintln!("error: {e}");
+            ExitCode::FAILURE
+        }
+        _ => status,
+    }
+}
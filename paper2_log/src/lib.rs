@@ -8,9 +8,9 @@
 use log::{LevelFilter, Log, Metadata, Record};
 use paper2_ffi::{
     paper2_LogLevel, paper2_LogLevel_Debug, paper2_LogLevel_Error, paper2_LogLevel_Info,
-    paper2_LogLevel_Warn, paper2_get_inited, paper2_queue_log_ffi, paper2_wait_for_flush,
+    paper2_LogLevel_Warn, paper2_StringRef, paper2_get_inited, paper2_is_enabled,
+    paper2_queue_log_ffi_v2, paper2_wait_for_flush,
 };
-use std::ffi::CString;
 use std::os::raw::c_int;
 use std::ptr;
 
@@ -27,6 +27,20 @@ impl Paper2Logger {
     }
 }
 
+/// Borrows a string as a `paper2_StringRef`. `None` becomes a null reference.
+fn string_ref(s: Option<&str>) -> paper2_StringRef {
+    match s {
+        Some(s) => paper2_StringRef {
+            _0: s.as_ptr(),
+            _1: s.len() as _,
+        },
+        None => paper2_StringRef {
+            _0: ptr::null(),
+            _1: 0,
+        },
+    }
+}
+
 fn map_level(level: log::Level) -> paper2_LogLevel {
     use log::Level;
     match level {
@@ -41,10 +55,17 @@ fn map_level(level: log::Level) -> paper2_LogLevel {
 impl Log for Paper2Logger {
     fn enabled(&self, metadata: &Metadata) -> bool {
         metadata.level() <= log::max_level()
+            && unsafe {
+                !paper2_get_inited()
+                    || paper2_is_enabled(
+                        map_level(metadata.level()),
+                        string_ref(Some(metadata.target())),
+                    )
+            }
     }
 
     fn log(&self, record: &Record) {
-        if !self.enabled(record.metadata()) {
+        if record.level() > log::max_level() {
             return;
         }
 
@@ -54,27 +75,33 @@ impl Log for Paper2Logger {
                 return;
             }
             let level = map_level(record.level());
-            let tag_opt = record.module_path();
-            let tag_c = tag_opt.and_then(|s| CString::new(s).ok());
-            let message_c = CString::new(record.args().to_string()).ok();
-            let file_c = record.file().and_then(|s| CString::new(s).ok());
-            let function_c = record.module_path().and_then(|s| CString::new(s).ok());
-
-            let tag_ptr = tag_c.as_ref().map(|s| s.as_ptr()).unwrap_or(ptr::null());
-            let msg_ptr = message_c
-                .as_ref()
-                .map(|s| s.as_ptr())
-                .unwrap_or(ptr::null());
-            let file_ptr = file_c.as_ref().map(|s| s.as_ptr()).unwrap_or(ptr::null());
-            let func_ptr = function_c
-                .as_ref()
-                .map(|s| s.as_ptr())
-                .unwrap_or(ptr::null());
+            // logs are tagged by module, checked before formatting
+            if !paper2_is_enabled(level, string_ref(record.module_path())) {
+                return;
+            }
+
+            // static messages don't need to be formatted at all
+            let formatted;
+            let message = match record.args().as_str() {
+                Some(message) => message,
+                None => {
+                    formatted = record.args().to_string();
+                    formatted.as_str()
+                }
+            };
 
             let line = record.line().unwrap_or(0) as c_int;
 
             // Best-effort: ignore return value
-            let _ = paper2_queue_log_ffi(level, tag_ptr, msg_ptr, file_ptr, line, 0, func_ptr);
+            let _ = paper2_queue_log_ffi_v2(
+                level,
+                string_ref(record.module_path()),
+                string_ref(Some(message)),
+                string_ref(Some(record.file().unwrap_or_default())),
+                line,
+                0,
+                string_ref(record.module_path()),
+            );
         }
     }
 
@@ -90,6 +117,7 @@ impl Log for Paper2Logger {
 #[cfg(test)]
 mod tests {
     use paper2_ffi::paper2_init_logger_ffi;
+    use std::ffi::CString;
 
     use super::*;
     // Basic smoke test: using the facade directly to send a single record via FFI.
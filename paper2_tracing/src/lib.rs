@@ -1,61 +1,132 @@
 use paper2_ffi::{
-    paper2_LogLevel, paper2_LogLevel_Debug, paper2_LogLevel_Error, paper2_LogLevel_Info,
-    paper2_LogLevel_Warn,
+    paper2_FieldC, paper2_FieldKind_Bool, paper2_FieldKind_Float, paper2_FieldKind_Int,
+    paper2_FieldKind_Str, paper2_FieldKind_UInt, paper2_LogLevel, paper2_LogLevel_Debug,
+    paper2_LogLevel_Error, paper2_LogLevel_Info, paper2_LogLevel_Warn, paper2_StringRef,
 };
-use std::ffi::CString;
-use std::{fmt, ptr};
+use std::fmt::{self, Write as _};
+use std::ops::Range;
+use std::ptr;
 use tracing::{Event, Metadata};
 use tracing_subscriber::Layer;
 use tracing_subscriber::layer::{Context, SubscriberExt};
 use tracing_subscriber::util::SubscriberInitExt;
 
+/// A field's value, strings are kept in [`FieldVisitor::strings`]
+enum FieldValue {
+    Int(i64),
+    UInt(u64),
+    Float(f64),
+    Bool(bool),
+    Str(Range<usize>),
+}
+
+/// Collects the `message` of an event as text and every other field typed,
+/// leaving their rendering to the logger.
 #[derive(Default)]
-struct MessageVisitor {
-    parts: String,
+struct FieldVisitor {
+    message: String,
+    fields: Vec<(&'static str, FieldValue)>,
+    /// String values of the fields, one after the other
+    strings: String,
+}
+
+impl FieldVisitor {
+    fn push(&mut self, field: &tracing::field::Field, value: FieldValue) {
+        self.fields.push((field.name(), value));
+    }
+
+    /// The fields as passed to paper2, borrowing from the visitor
+    fn c_fields(&self) -> Vec<paper2_FieldC> {
+        self.fields
+            .iter()
+            .map(|(key, value)| {
+                let mut field = paper2_FieldC {
+                    key: string_ref(Some(key)),
+                    kind: paper2_FieldKind_Int,
+                    int_value: 0,
+                    uint_value: 0,
+                    float_value: 0.0,
+                    bool_value: false,
+                    str_value: string_ref(None),
+                };
+
+                match value {
+                    FieldValue::Int(value) => field.int_value = *value,
+                    FieldValue::UInt(value) => {
+                        field.kind = paper2_FieldKind_UInt;
+                        field.uint_value = *value;
+                    }
+                    FieldValue::Float(value) => {
+                        field.kind = paper2_FieldKind_Float;
+                        field.float_value = *value;
+                    }
+                    FieldValue::Bool(value) => {
+                        field.kind = paper2_FieldKind_Bool;
+                        field.bool_value = *value;
+                    }
+                    FieldValue::Str(range) => {
+                        field.kind = paper2_FieldKind_Str;
+                        field.str_value = string_ref(Some(&self.strings[range.clone()]));
+                    }
+                }
+
+                field
+            })
+            .collect()
+    }
 }
 
-impl tracing::field::Visit for MessageVisitor {
+impl tracing::field::Visit for FieldVisitor {
     fn record_debug(&mut self, field: &tracing::field::Field, value: &dyn fmt::Debug) {
-        if !self.parts.is_empty() {
-            self.parts.push(' ');
+        if field.name() == "message" {
+            let _ = write!(self.message, "{value:?}");
+            return;
         }
-        self.parts
-            .push_str(&format!("{}={:?}", field.name(), value));
+
+        let start = self.strings.len();
+        let _ = write!(self.strings, "{value:?}");
+        self.push(field, FieldValue::Str(start..self.strings.len()));
     }
 
     fn record_i64(&mut self, field: &tracing::field::Field, value: i64) {
-        if !self.parts.is_empty() {
-            self.parts.push(' ');
-        }
-        self.parts.push_str(&format!("{}={}", field.name(), value));
+        self.push(field, FieldValue::Int(value));
     }
 
     fn record_u64(&mut self, field: &tracing::field::Field, value: u64) {
-        if !self.parts.is_empty() {
-            self.parts.push(' ');
-        }
-        self.parts.push_str(&format!("{}={}", field.name(), value));
+        self.push(field, FieldValue::UInt(value));
     }
 
     fn record_str(&mut self, field: &tracing::field::Field, value: &str) {
-        if !self.parts.is_empty() {
-            self.parts.push(' ');
+        if field.name() == "message" {
+            self.message.push_str(value);
+            return;
         }
-        self.parts.push_str(&format!("{}={}", field.name(), value));
+
+        let start = self.strings.len();
+        self.strings.push_str(value);
+        self.push(field, FieldValue::Str(start..self.strings.len()));
     }
 
     fn record_bool(&mut self, field: &tracing::field::Field, value: bool) {
-        if !self.parts.is_empty() {
-            self.parts.push(' ');
-        }
-        self.parts.push_str(&format!("{}={}", field.name(), value));
+        self.push(field, FieldValue::Bool(value));
     }
 
     fn record_f64(&mut self, field: &tracing::field::Field, value: f64) {
-        if !self.parts.is_empty() {
-            self.parts.push(' ');
-        }
-        self.parts.push_str(&format!("{}={}", field.name(), value));
+        self.push(field, FieldValue::Float(value));
+    }
+}
+
+/// Borrows a string as a `paper2_StringRef`. `None` becomes a null reference.
+fn string_ref(s: Option<&str>) -> paper2_StringRef {
+    match s {
+        Some(s) => paper2_StringRef {
+            _0: s.as_ptr(),
+            _1: s.len() as _,
+        },
+        None => paper2_StringRef {
+            _0: ptr::null(),
+            _1: 0,
+        },
     }
 }
 
@@ -74,7 +145,7 @@ fn map_level(meta: &Metadata<'_>) -> paper2_LogLevel {
 /// A tracing subscriber layer that forwards events into the `paper2` logger.
 #[derive(Clone, Debug, Default)]
 pub struct PaperLayer {
-    tag: Option<CString>,
+    tag: Option<String>,
 }
 
 impl PaperLayer {
@@ -82,8 +153,8 @@ impl PaperLayer {
         Self { tag: None }
     }
 
-    pub fn with_tag<T: Into<Vec<u8>>>(mut self, tag: T) -> Self {
-        self.tag = Some(CString::new(tag.into()).expect("Unable to make CString tag"));
+    pub fn with_tag<T: Into<String>>(mut self, tag: T) -> Self {
+        self.tag = Some(tag.into());
         self
     }
 }
@@ -95,32 +166,37 @@ where
     fn on_event(&self, event: &Event<'_>, _ctx: Context<'_, S>) {
         let meta = event.metadata();
         let level = map_level(meta);
-        let mut visitor = MessageVisitor::default();
+        // filtered out by the level of the tag, skip visiting the fields
+        if !unsafe { paper2_ffi::paper2_is_enabled(level, string_ref(self.tag.as_deref())) } {
+            return;
+        }
+
+        let mut visitor = FieldVisitor::default();
         event.record(&mut visitor);
 
-        // If the event didn't provide a `message` field, fall back to the target and fields string.
-        let message = if !visitor.parts.is_empty() {
-            visitor.parts
+        // If the event has neither a message nor fields, fall back to the target.
+        let message = if visitor.message.is_empty() && visitor.fields.is_empty() {
+            meta.target()
         } else {
-            // Use the target as a minimal fallback
-            meta.target().to_string()
+            visitor.message.as_str()
         };
+        let fields = visitor.c_fields();
 
-        let file = meta.file().map(|s| s.to_string()).unwrap_or_default();
+        let file = meta.file().unwrap_or_default();
         let line = meta.line().unwrap_or(0);
-        let function_name = CString::new(meta.target()).expect("Function name");
 
-        // use C ABI to call FFI logging function
+        // use C ABI to call FFI logging function, the fields are typed
         unsafe {
-            let tag = self.tag.as_ref().map(|c| c.as_ptr()).unwrap_or(ptr::null());
-            paper2_ffi::paper2_queue_log_ffi(
+            paper2_ffi::paper2_queue_log_fields(
                 level,
-                tag,
-                std::ffi::CString::new(message).unwrap().as_ptr(),
-                std::ffi::CString::new(file).unwrap().as_ptr(),
+                string_ref(self.tag.as_deref()),
+                string_ref(Some(message)),
+                string_ref(Some(file)),
                 line as i32,
                 0,
-                function_name.as_ptr(),
+                string_ref(Some(meta.target())),
+                fields.as_ptr(),
+                fields.len() as _,
             )
         };
 
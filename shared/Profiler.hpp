@@ -1,14 +1,99 @@
 #pragma once
 
 #include <chrono>
+#include <memory>
 #include <string_view>
 #include <string>
 #include <optional>
 #include <vector>
 
+#if __has_include(<unistd.h>)
+#include <unistd.h>
+#endif
+
 #include "logger.hpp"
 
 namespace Paper {
+namespace detail {
+/// Zones a thread collects before handing them to the logger at once
+inline constexpr size_t TRACE_BUFFER_EVENTS = 4096;
+
+inline uint64_t traceClockNanos() noexcept {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+inline uint32_t traceThreadId() noexcept {
+#if defined(__linux__) || defined(__ANDROID__)
+  return static_cast<uint32_t>(gettid());
+#else
+  return static_cast<uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+#endif
+}
+
+/// The zones of one thread, preallocated so recording one never allocates
+struct TraceBuffer {
+  std::unique_ptr<ffi::paper2_TraceEventC[]> events = std::make_unique<ffi::paper2_TraceEventC[]>(TRACE_BUFFER_EVENTS);
+  size_t size = 0;
+  uint32_t tid = traceThreadId();
+
+  TraceBuffer() = default;
+  TraceBuffer(TraceBuffer const&) = delete;
+  TraceBuffer& operator=(TraceBuffer const&) = delete;
+
+  ~TraceBuffer() {
+    submit();
+  }
+
+  void push(std::string_view name, uint64_t start, uint64_t end) noexcept {
+    events[size++] = { toStringRef(name), start, end - start };
+    if (size == TRACE_BUFFER_EVENTS) {
+      submit();
+    }
+  }
+
+  void submit() noexcept {
+    if (size != 0) {
+      ffi::paper2_submit_trace_events(tid, events.get(), size);
+      size = 0;
+    }
+  }
+};
+
+inline TraceBuffer& traceBuffer() noexcept {
+  thread_local TraceBuffer buffer;
+  return buffer;
+}
+} // namespace detail
+
+/// Times the scope it lives in, for the trace file set with `LoggerConfig::TracePath`
+/// and the statistics enabled with `LoggerConfig::ProfileReportInterval`.
+/// Zones nest, trace viewers stack them by time. Names must be string literals, they are never copied.
+/// Zones are handed to the logger in batches, per thread; call `Logger::FlushTrace` to hand over the rest early.
+class ProfileZone {
+public:
+  template <size_t N>
+  explicit ProfileZone(char const (&name)[N]) noexcept : name(name, N - 1), start(detail::traceClockNanos()) {}
+
+  ProfileZone(ProfileZone const&) = delete;
+  ProfileZone& operator=(ProfileZone const&) = delete;
+
+  ~ProfileZone() {
+    detail::traceBuffer().push(name, start, detail::traceClockNanos());
+  }
+
+private:
+  std::string_view name;
+  uint64_t start;
+};
+
+namespace Logger {
+/// Hands the zones this thread recorded so far to the logger. Threads do this on their own when they exit
+inline void FlushTrace() {
+  detail::traceBuffer().submit();
+}
+} // namespace Logger
+
 struct ProfileData {
   std::chrono::high_resolution_clock::time_point time;
   std::string log;
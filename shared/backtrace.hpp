@@ -1,7 +1,6 @@
 #pragma once
 #include <optional>
 #include <string_view>
-#include <sstream>
 
 #include "logger.hpp"
 
@@ -12,7 +11,12 @@
 #include <link.h>
 #include <unistd.h>
 #include <unwind.h>
-#include <map>
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #define HAS_UNWIND
 #else
@@ -20,137 +24,309 @@
 #endif
 
 namespace Paper {
-namespace Logger {
 #ifdef HAS_UNWIND
+namespace detail {
 // Backtrace stuff largely written by StackDoubleFlow
 // https://github.com/sc2ad/beatsaber-hook/blob/138101a5a2b494911583b62140af6acf6e955e72/src/utils/logging.cpp#L211-L289
-namespace {
 struct BacktraceState {
-  void** current;
-  void** end;
+  uintptr_t* current;
+  uintptr_t* end;
 };
-static _Unwind_Reason_Code unwindCallback(struct _Unwind_Context* context, void* arg) {
+inline _Unwind_Reason_Code unwindCallback(struct _Unwind_Context* context, void* arg) {
   BacktraceState* state = static_cast<BacktraceState*>(arg);
   uintptr_t pc = _Unwind_GetIP(context);
   if (pc != 0U) {
     if (state->current == state->end) {
       return _URC_END_OF_STACK;
     } else {
-      *state->current++ = reinterpret_cast<void*>(pc);
+      *state->current++ = pc;
     }
   }
   return _URC_NO_REASON;
 }
-size_t captureBacktrace(void** buffer, uint16_t max) {
+inline size_t captureBacktrace(uintptr_t* buffer, size_t max) {
   BacktraceState state{ buffer, buffer + max };
   _Unwind_Backtrace(unwindCallback, &state);
 
   return state.current - buffer;
 }
 
-inline std::optional<std::string> getBuildId(std::string_view filename) {
-  std::ifstream infile(filename.data(), std::ios_base::binary);
-  if (!infile.is_open()) {
-    return std::nullopt;
+/// Frames a single backtrace holds at most
+inline constexpr uint16_t MAX_BACKTRACE_FRAMES = 256;
+
+/// What `Logger::Backtrace` hands to the logging thread, followed by `frameCount` PCs
+struct BacktraceHeader {
+  pid_t pid;
+  pid_t tid;
+  uint16_t requested;
+  uint16_t frameCount;
+};
+
+/// A loaded ELF object, as reported by `dl_iterate_phdr`
+struct LoadedModule {
+  /// Load bias, PCs are printed relative to it
+  uintptr_t base;
+  uintptr_t start;
+  uintptr_t end;
+  std::string path;
+  /// Lowercase hex, empty if the object has none
+  std::string buildId;
+};
+
+/// Every loaded module and the symbols looked up in them, shared by the whole process.
+///
+/// Build ids are read from the mapped note segments, so no file is opened. The cache is
+/// rebuilt once a module was loaded or unloaded since it was filled, or when a PC falls
+/// outside every known module.
+class ModuleCache {
+public:
+  static ModuleCache& get() {
+    static ModuleCache cache;
+    return cache;
   }
-  infile.seekg(0);
-  ElfW(Ehdr) elf;
-  infile.read(reinterpret_cast<char*>(&elf), sizeof(ElfW(Ehdr)));
-  for (int i = 0; i < elf.e_shnum; i++) {
-    infile.seekg(elf.e_shoff + i * elf.e_shentsize);
-    ElfW(Shdr) section;
-    infile.read(reinterpret_cast<char*>(&section), sizeof(ElfW(Shdr)));
-    if (section.sh_type == SHT_NOTE && section.sh_size == 0x24) {
-      char data[0x24];
-      infile.seekg(section.sh_offset);
-      infile.read(data, 0x24);
-      ElfW(Nhdr)* note = reinterpret_cast<ElfW(Nhdr)*>(data);
-      if (note->n_namesz == 4 && note->n_descsz == 20) {
-        if (memcmp(reinterpret_cast<void*>(data + 12), "GNU", 4) == 0) {
-          std::stringstream stream;
-          stream << std::hex;
-          auto buildIdAddr = reinterpret_cast<uint8_t*>(data + 16);
-          for (int i = 0; i < 5; i++) {
-            uint32_t value;
-            auto ptr = (reinterpret_cast<uint8_t*>(&value));
-            ptr[0] = *(buildIdAddr + i * sizeof(uint32_t) + 3);
-            ptr[1] = *(buildIdAddr + i * sizeof(uint32_t) + 2);
-            ptr[2] = *(buildIdAddr + i * sizeof(uint32_t) + 1);
-            ptr[3] = *(buildIdAddr + i * sizeof(uint32_t));
-            stream << std::setfill('0') << std::setw(sizeof(uint32_t) * 2) << value;
-          }
-          auto buildid = stream.str();
-          return buildid;
+
+  /// Appends the frames of a captured backtrace to `out`, one line each
+  void symbolize(fmt::memory_buffer& out, uintptr_t const* pcs, size_t count) {
+    std::lock_guard lock(mutex);
+
+    if (modules.empty() || loadGeneration() != generation) {
+      reload();
+    }
+
+    // modules loaded since the last reload only show up on a miss, unmapped PCs reload once per call
+    bool reloadedForMiss = false;
+    for (size_t i = 0; i < count; ++i) {
+      auto const* module = find(pcs[i]);
+      if (module == nullptr && !reloadedForMiss) {
+        reload();
+        reloadedForMiss = true;
+        module = find(pcs[i]);
+      }
+      if (module == nullptr) {
+        fmt::format_to(fmt::appender(out), "\n      #{:02} pc {:016x}  <unknown>", i, pcs[i]);
+        continue;
+      }
+
+      // return addresses point one instruction past the call
+      uintptr_t const pc = pcs[i] - 4;
+      fmt::format_to(fmt::appender(out), "\n      #{:02} pc {:016x}  {}", i, pc - module->base, module->path);
+
+      Dl_info info;
+      if (dladdr(reinterpret_cast<void*>(pcs[i]), &info) != 0 && info.dli_sname != nullptr) {
+        uintptr_t const offset = pc - reinterpret_cast<uintptr_t>(info.dli_saddr);
+        auto const& name = demangled(reinterpret_cast<uintptr_t>(info.dli_saddr), info.dli_sname);
+        if (offset < 10000) {
+          fmt::format_to(fmt::appender(out), " ({}+{})", name, offset);
+        } else {
+          fmt::format_to(fmt::appender(out), " ({})", name);
         }
       }
+
+      if (!module->buildId.empty()) {
+        fmt::format_to(fmt::appender(out), " (BuildId: {})", module->buildId);
+      }
     }
   }
-  return std::nullopt;
-}
-} // namespace
 
-inline void Backtrace(std::string_view const tag, uint16_t frameCount) {
-  if (frameCount <= 0) return;
-  void* buffer[frameCount + 1];
-  captureBacktrace(buffer, frameCount + 1);
-  fmtLogTag<LogLevel::DBG>("Printing backtrace with: {} max lines:", tag, frameCount);
-  fmtLogTag<LogLevel::DBG>("*** *** *** *** *** *** *** *** *** *** *** *** *** *** *** ***", tag);
-  fmtLogTag<LogLevel::DBG>("pid: {}, tid: {}", tag, getpid(), gettid());
-  std::map<char const*, std::optional<std::string>> buildIds;
-  for (uint16_t i = 0; i < frameCount; ++i) {
-    Dl_info info;
-    if (dladdr(buffer[i + 1], &info) != 0) {
-      if (!buildIds.contains(info.dli_fname)) {
-        buildIds[info.dli_fname] = getBuildId(info.dli_fname);
-      }
-      auto buildId = buildIds[info.dli_fname];
-      bool hasBuildId = buildId.has_value();
-      // Buffer points to 1 instruction ahead
-      uintptr_t addr = reinterpret_cast<char*>(buffer[i + 1]) - reinterpret_cast<char*>(info.dli_fbase) - 4;
-      uintptr_t offset = reinterpret_cast<char*>(buffer[i + 1]) - reinterpret_cast<char*>(info.dli_saddr) - 4;
-      if (info.dli_sname) {
-        int status;
-        char const* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
-        if (status) {
-          demangled = info.dli_sname;
-        }
-        if (offset < 10000) {
-          if (hasBuildId) {
-            fmtLogTag<LogLevel::DBG>("      #{:02} pc {:016x}  {} ({}+{}) (BuildId: {})", tag, i, addr, info.dli_fname,
-                                     demangled, offset, buildId->c_str());
-          } else {
-            fmtLogTag<LogLevel::DBG>("      #{:02} pc {:016x}  {} ({}+{})", tag, i, addr, info.dli_fname, demangled,
-                                     offset);
+private:
+  /// Symbols kept demangled before the cache starts over
+  static constexpr size_t MAX_SYMBOLS = 4096;
+
+  std::mutex mutex;
+  std::vector<LoadedModule> modules;
+  std::unordered_map<uintptr_t, std::string> symbols;
+  unsigned long long generation = ~0ULL;
+
+  /// Changes whenever an object is loaded or unloaded, ~0 where that isn't tracked.
+  /// glibc and bionic (Android R and later) both report the counters, older libcs pass a smaller `size`
+  static unsigned long long loadGeneration() {
+    unsigned long long counters = ~0ULL;
+    dl_iterate_phdr(
+        [](dl_phdr_info* info, size_t size, void* data) {
+          if (size >= offsetof(dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs)) {
+            *static_cast<unsigned long long*>(data) = info->dlpi_adds * 31 + info->dlpi_subs;
           }
-        } else {
-          if (hasBuildId) {
-            fmtLogTag<LogLevel::DBG>("      #{:02} pc {:016x}  {} ({}) (BuildId: {})", tag, i, addr, info.dli_fname,
-                                     demangled, buildId->c_str());
-          } else {
-            fmtLogTag<LogLevel::DBG>("      #{:02} pc {:016x}  {} ({})", tag, i, addr, info.dli_fname, demangled);
+          return 1;
+        },
+        &counters);
+    return counters;
+  }
+
+  LoadedModule const* find(uintptr_t pc) const {
+    auto it = std::upper_bound(modules.begin(), modules.end(), pc,
+                               [](uintptr_t pc, LoadedModule const& module) { return pc < module.start; });
+    if (it == modules.begin()) {
+      return nullptr;
+    }
+    --it;
+    return pc < it->end ? &*it : nullptr;
+  }
+
+  std::string const& demangled(uintptr_t address, char const* mangled) {
+    if (auto it = symbols.find(address); it != symbols.end()) {
+      return it->second;
+    }
+    if (symbols.size() >= MAX_SYMBOLS) {
+      symbols.clear();
+    }
+
+    int status;
+    char* name = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+    auto& entry = symbols[address];
+    entry = status == 0 ? name : mangled;
+    std::free(name);
+    return entry;
+  }
+
+  void reload() {
+    modules.clear();
+    symbols.clear();
+    generation = loadGeneration();
+
+    dl_iterate_phdr(
+        [](dl_phdr_info* info, size_t, void* data) {
+          auto& modules = *static_cast<std::vector<LoadedModule>*>(data);
+          LoadedModule module{ info->dlpi_addr, UINTPTR_MAX, 0, {}, {} };
+
+          for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+            auto const& phdr = info->dlpi_phdr[i];
+            if (phdr.p_type == PT_LOAD) {
+              module.start = std::min<uintptr_t>(module.start, info->dlpi_addr + phdr.p_vaddr);
+              module.end = std::max<uintptr_t>(module.end, info->dlpi_addr + phdr.p_vaddr + phdr.p_memsz);
+            } else if (phdr.p_type == PT_NOTE && module.buildId.empty()) {
+              module.buildId = readBuildId(info->dlpi_addr + phdr.p_vaddr, phdr.p_memsz);
+            }
           }
+
+          if (module.start < module.end) {
+            module.path = info->dlpi_name != nullptr && info->dlpi_name[0] != '\0' ? info->dlpi_name : executablePath();
+            modules.push_back(std::move(module));
+          }
+          return 0;
+        },
+        &modules);
+
+    std::sort(modules.begin(), modules.end(),
+              [](LoadedModule const& a, LoadedModule const& b) { return a.start < b.start; });
+  }
+
+  /// The GNU build id in a mapped note segment
+  static std::string readBuildId(uintptr_t notes, size_t size) {
+    static constexpr auto align = [](size_t size) { return (size + 3) & ~size_t(3); };
+
+    size_t offset = 0;
+    while (offset + sizeof(ElfW(Nhdr)) <= size) {
+      auto const* note = reinterpret_cast<ElfW(Nhdr) const*>(notes + offset);
+      auto const* name = reinterpret_cast<char const*>(note + 1);
+      auto const* desc = reinterpret_cast<uint8_t const*>(name + align(note->n_namesz));
+
+      if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 && std::memcmp(name, "GNU", 4) == 0) {
+        std::string buildId;
+        for (ElfW(Word) i = 0; i < note->n_descsz; ++i) {
+          fmt::format_to(std::back_inserter(buildId), "{:02x}", desc[i]);
         }
-        if (!status) {
-          free(const_cast<char*>(demangled));
-        }
-      } else {
-        if (hasBuildId) {
-          fmtLogTag<LogLevel::DBG>("      #{:02} pc {:016x}  {} (BuildId: {})", tag, i, addr, info.dli_fname,
-                                   buildId->c_str());
-        } else {
-          fmtLogTag<LogLevel::DBG>("      #{:02} pc {:016x}  {}", tag, i, addr, info.dli_fname);
-        }
+        return buildId;
       }
+
+      offset += sizeof(ElfW(Nhdr)) + align(note->n_namesz) + align(note->n_descsz);
     }
+    return {};
+  }
+
+  /// The main executable is reported without a name
+  static std::string executablePath() {
+    char path[4096];
+    auto const len = readlink("/proc/self/exe", path, sizeof(path));
+    return len > 0 ? std::string(path, len) : std::string("<executable>");
+  }
+};
+
+/// Runs on the logging thread, turns the PCs captured by `Logger::Backtrace` into one multi-line message
+inline void renderBacktrace(uint8_t const*, uintptr_t, uint8_t const* args, uintptr_t argsLen,
+                            ffi::paper2_DeferredWriteFn write, void* out) noexcept {
+  BacktraceHeader header;
+  if (argsLen < sizeof(header)) {
+    return;
+  }
+  std::memcpy(&header, args, sizeof(header));
+  if (argsLen != sizeof(header) + header.frameCount * sizeof(uintptr_t)) {
+    return;
   }
+
+  uintptr_t pcs[MAX_BACKTRACE_FRAMES];
+  std::memcpy(pcs, args + sizeof(header), header.frameCount * sizeof(uintptr_t));
+
+  fmt::memory_buffer message;
+#ifdef __EXCEPTIONS
+  try {
+#endif
+    fmt::format_to(fmt::appender(message), "Printing backtrace with: {} max lines:", header.requested);
+    fmt::format_to(fmt::appender(message),
+                   "\n*** *** *** *** *** *** *** *** *** *** *** *** *** *** *** ***\npid: {}, tid: {}", header.pid,
+                   header.tid);
+    ModuleCache::get().symbolize(message, pcs, header.frameCount);
+#ifdef __EXCEPTIONS
+  } catch (...) {
+    return;
+  }
+#endif
+
+  write(out, reinterpret_cast<uint8_t const*>(message.data()), message.size());
 }
+} // namespace detail
+
+namespace Logger {
+/// Logs the calling thread's stack as a single record. Only the raw PCs are captured here,
+/// finding modules, symbols and build ids is left to the logging thread.
+inline void Backtrace(std::string_view const tag, uint16_t frameCount) {
+  if constexpr (!detail::isCompiledIn(LogLevel::DBG)) {
+    return;
+  }
+  if (frameCount == 0 || !detail::gateAllows(detail::levelGate(tag), LogLevel::DBG)) {
+    return;
+  }
+
+  frameCount = std::min(frameCount, detail::MAX_BACKTRACE_FRAMES);
+
+  // one spare slot for this function's own frame
+  uintptr_t pcs[detail::MAX_BACKTRACE_FRAMES + 1];
+  std::array<uint8_t, sizeof(detail::BacktraceHeader) + sizeof(pcs)> buffer;
+  size_t const captured = detail::captureBacktrace(pcs, frameCount + 1);
+  size_t const count = captured > 0 ? captured - 1 : 0;
+
+  detail::BacktraceHeader const header{ getpid(), gettid(), frameCount, static_cast<uint16_t>(count) };
+  std::memcpy(buffer.data(), &header, sizeof(header));
+  std::memcpy(buffer.data() + sizeof(header), pcs + 1, count * sizeof(uintptr_t));
+  size_t const size = sizeof(header) + count * sizeof(uintptr_t);
+
+  static constexpr std::string_view format = "backtrace";
+  auto callsite = detail::callsiteId(LogLevel::DBG, sl::current(), tag);
+  if (callsite != 0 && Paper::ffi::paper2_queue_log_deferred(callsite, detail::toStringRef(format),
+                                                             &detail::renderBacktrace, buffer.data(), size)) {
+    return;
+  }
+
+  // no logging thread to defer to, symbolize here
+  std::string message;
+  detail::renderBacktrace(
+      nullptr, 0, buffer.data(), size,
+      [](void* out, uint8_t const* data, uintptr_t len) {
+        static_cast<std::string*>(out)->append(reinterpret_cast<char const*>(data), len);
+      },
+      &message);
+  fmtLogTag<LogLevel::DBG>("{}", tag, message);
+}
+} // namespace Logger
 
 #else
 
+namespace Logger {
 inline void Backtrace(std::string_view, uint16_t) {}
+} // namespace Logger
 
 #endif
 
+namespace Logger {
 inline auto Backtrace(uint16_t frameCount) {
   return Backtrace(GLOBAL_TAG, frameCount);
 }
@@ -19,6 +19,17 @@ typedef enum paper2_LogLevel {
   Off,
 } paper2_LogLevel;
 
+/**
+ * The type of a [`FieldC`]'s value.
+ */
+typedef enum paper2_FieldKind {
+  Int,
+  UInt,
+  Float,
+  Bool,
+  Str,
+} paper2_FieldKind;
+
 /**
  * FFI-safe configuration for the logger.
  *
@@ -31,6 +42,109 @@ typedef struct paper2_LoggerConfigFfi {
   unsigned long long log_max_buffer_count;
   unsigned char line_end;
   const char *context_log_path;
+  /**
+   * Capacity of each producer thread's ring buffer.
+   * 0 uses the single locked queue instead.
+   */
+  unsigned long long ring_buffer_capacity;
+  /**
+   * Digits after the seconds of timestamps.
+   * 0 for none, 1 for milliseconds, 2 for microseconds.
+   */
+  unsigned char timestamp_precision;
+  /**
+   * Size of the chunks log files are mapped and preallocated in.
+   * 0 uses buffered writes. Ignored without the `mmap` feature.
+   */
+  unsigned long long mmap_chunk_size;
+  /**
+   * Leave file writes to a dedicated I/O thread. Ignored when `mmap_chunk_size` is used.
+   */
+  bool async_file_writes;
+  /**
+   * Rotate log files once they hold this many bytes. 0 for no limit.
+   */
+  unsigned long long rotate_max_bytes;
+  /**
+   * Rotate log files once they were written to for this many seconds. 0 for no limit.
+   */
+  unsigned long long rotate_max_age_seconds;
+  /**
+   * Rotated segments kept per log file.
+   */
+  unsigned int rotate_keep;
+  /**
+   * Compress rotated segments. Ignored with a warning without the `compress` feature.
+   */
+  bool rotate_compress;
+  /**
+   * Write log files in the compact binary format instead of text.
+   */
+  bool binary_files;
+  /**
+   * What happens to new logs while the queue holds `log_max_buffer_count` logs
+   * or `queue_max_bytes` bytes. 0 lets the queue grow, 1 blocks, 2 drops new logs,
+   * 3 drops queued logs below warnings, 4 samples.
+   */
+  unsigned char overflow_policy;
+  /**
+   * With sampling, one in this many logs is kept once the queue is half full.
+   */
+  unsigned int overflow_sample_one_in;
+  /**
+   * Memory the queued logs may hold. 0 for no limit.
+   */
+  unsigned long long queue_max_bytes;
+  /**
+   * Longest a written log waits to be flushed, in milliseconds.
+   * 0 flushes after every batch.
+   */
+  unsigned int flush_max_latency_ms;
+  /**
+   * Flush once this many bytes were written since the last flush. 0 for no limit.
+   */
+  unsigned long long flush_max_dirty_bytes;
+  /**
+   * Logs at or above this level are flushed right away. `Off` for none.
+   */
+  enum paper2_LogLevel flush_level;
+  /**
+   * Recent logs kept in memory for crash dumps. 0 to keep none.
+   */
+  unsigned int flight_recorder_slots;
+  /**
+   * File the recent logs are written to when the process crashes.
+   * Null for no crash handler. Ignored without the `flight_recorder` feature.
+   */
+  const char *crash_dump_path;
+  /**
+   * File profiling zones are written to as a Chrome trace.
+   * Null for no trace. Ignored without the `file` feature.
+   */
+  const char *trace_path;
+  /**
+   * Log a summary of every profiling zone this often, in milliseconds.
+   * 0 keeps no statistics.
+   */
+  unsigned int profile_report_interval_ms;
+  /**
+   * Log the logger's own stats this often, in milliseconds. 0 for never.
+   */
+  unsigned int stats_report_interval_ms;
+  /**
+   * Give back the memory a burst of logs left pooled once the logger was idle this long,
+   * in milliseconds. 0 keeps it.
+   */
+  unsigned int trim_idle_after_ms;
+  /**
+   * Threads writing the context files. 0 writes them on the logging thread.
+   */
+  unsigned int context_writer_threads;
+  /**
+   * Write log files as JSON lines, with the fields of logs typed.
+   * `binary_files` wins if both are set.
+   */
+  bool json_files;
 } paper2_LoggerConfigFfi;
 
 /**
@@ -42,6 +156,101 @@ typedef struct paper2_StringRef {
   uintptr_t _1;
 } paper2_StringRef;
 
+/**
+ * A snapshot of the logger's counters, totals since it started.
+ */
+typedef struct paper2_LoggerStats {
+  /**
+   * Logs handed to the logger
+   */
+  uint64_t queued;
+  /**
+   * Logs the logging thread wrote
+   */
+  uint64_t written;
+  /**
+   * Logs the overflow policy dropped
+   */
+  uint64_t dropped;
+  /**
+   * Logs waiting for the logging thread
+   */
+  uint64_t queue_depth;
+  /**
+   * Batches the logging thread wrote
+   */
+  uint64_t batches;
+  /**
+   * Time spent writing batches, in nanoseconds
+   */
+  uint64_t batch_nanos_total;
+  /**
+   * Longest a single batch took, in nanoseconds
+   */
+  uint64_t batch_nanos_max;
+  /**
+   * Bytes written to the log files
+   */
+  uint64_t bytes_written;
+  uint64_t flushes;
+  /**
+   * Time spent flushing, in nanoseconds
+   */
+  uint64_t flush_nanos_total;
+  /**
+   * Longest a single flush took, in nanoseconds
+   */
+  uint64_t flush_nanos_max;
+  /**
+   * Logs sinks missed because they fell behind
+   */
+  uint64_t sink_dropped;
+  /**
+   * Failed sink calls
+   */
+  uint64_t sink_errors;
+} paper2_LoggerStats;
+
+/**
+ * A timed profiling zone.
+ */
+typedef struct paper2_TraceEventC {
+  /**
+   * Must live for the rest of the process, like a string literal.
+   */
+  struct paper2_StringRef name;
+  /**
+   * On a monotonic clock, in nanoseconds.
+   */
+  uint64_t start_nanos;
+  uint64_t duration_nanos;
+} paper2_TraceEventC;
+
+/**
+ * A message buffer from [`paper2_reserve`], which becomes the queued message itself.
+ * Hand it back with [`paper2_commit`] or [`paper2_release`].
+ */
+typedef struct paper2_MessageSlot {
+  uint8_t *data;
+  uintptr_t capacity;
+} paper2_MessageSlot;
+
+/**
+ * A key-value pair of a structured log. Only the value `kind` names is read.
+ */
+typedef struct paper2_FieldC {
+  /**
+   * Must live for the rest of the process, like a string literal.
+   */
+  struct paper2_StringRef key;
+  enum paper2_FieldKind kind;
+  int64_t int_value;
+  uint64_t uint_value;
+  double float_value;
+  bool bool_value;
+  struct paper2_StringRef str_value;
+} paper2_FieldC;
+
 typedef struct paper2_LogDataC {
   enum paper2_LogLevel level;
   struct paper2_StringRef tag;
@@ -51,6 +260,11 @@ typedef struct paper2_LogDataC {
   uint32_t line;
   uint32_t column;
   struct paper2_StringRef function_name;
+  /**
+   * The log's fields, also rendered into `message` as `key=value`. Null if it has none.
+   */
+  const struct paper2_FieldC *fields;
+  uintptr_t fields_len;
 } paper2_LogDataC;
 
 /**
@@ -60,6 +274,50 @@ typedef struct paper2_LogDataC {
  */
 typedef void (*paper2_LogCallbackC)(const struct paper2_LogDataC *log_data, void *user_data);
 
+/**
+ * Which logs a sink receives.
+ */
+typedef struct paper2_SinkFilterC {
+  /**
+   * Logs below this level are skipped
+   */
+  enum paper2_LogLevel min_level;
+  /**
+   * Only logs with this tag are passed on. Null for every tag.
+   */
+  struct paper2_StringRef tag;
+} paper2_SinkFilterC;
+
+/**
+ * Extern "C" compatible batch callback type.
+ * The callback receives `count` log lines and a user-provided context pointer.
+ */
+typedef void (*paper2_LogBatchCallbackC)(const struct paper2_LogDataC *logs,
+                                         uintptr_t count,
+                                         void *user_data);
+
+/**
+ * Identifies a registered [`Callsite`]. 0 is never a valid id.
+ */
+typedef uint32_t paper2_CallsiteId;
+
+/**
+ * Appends `len` bytes of rendered UTF-8 to the message passed as `out`.
+ * Invalid UTF-8 is replaced with U+FFFD once rendering is done.
+ */
+typedef void (*paper2_DeferredWriteFn)(void *out, const uint8_t *data, uintptr_t len);
+
+/**
+ * Formats the serialized `args` with `format`, handing the result to `write(out, ...)`.
+ * Called on the logging thread.
+ */
+typedef void (*paper2_DeferredRenderFn)(const uint8_t *format,
+                                        uintptr_t format_len,
+                                        const uint8_t *args,
+                                        uintptr_t args_len,
+                                        paper2_DeferredWriteFn write,
+                                        void *out);
+
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
@@ -105,6 +363,195 @@ bool paper2_queue_log_ffi(enum paper2_LogLevel level,
                           int column,
                           const char *function_name);
 
+/**
+ * Queues a log entry from FFI using pointer and length pairs.
+ *
+ * Unlike [`paper2_queue_log_ffi`], no string is scanned for a terminator, and the message
+ * is copied exactly once into a logger-owned buffer. Strings are checked to be UTF-8 and
+ * borrowed as they are, invalid ones are replaced with U+FFFD.
+ *
+ * # Safety
+ * - Every `StringRef` must be null or point to `len` bytes.
+ *   Invalid UTF-8 is replaced with U+FFFD.
+ * - `message` and `file` must not be null.
+ * - A null or empty `tag`/`function_name` means none was given.
+ * - `level` must be a valid `LogLevel`.
+ */
+bool paper2_queue_log_ffi_v2(enum paper2_LogLevel level,
+                             struct paper2_StringRef tag,
+                             struct paper2_StringRef message,
+                             struct paper2_StringRef file,
+                             int line,
+                             int column,
+                             struct paper2_StringRef function_name);
+
+/**
+ * Registers the static metadata of a log statement once, so later logs from it
+ * only need to send the returned id and their message.
+ * Registering the same metadata twice returns the same id.
+ *
+ * Returns 0 if the callsite could not be registered.
+ *
+ * # Safety
+ * - Every `StringRef` must be null or point to `len` bytes.
+ *   Invalid UTF-8 is replaced with U+FFFD.
+ * - `file` must not be null.
+ * - A null or empty `tag`/`function_name` means none was given.
+ */
+paper2_CallsiteId paper2_register_callsite(enum paper2_LogLevel level,
+                                           struct paper2_StringRef tag,
+                                           struct paper2_StringRef file,
+                                           int line,
+                                           int column,
+                                           struct paper2_StringRef function_name);
+
+/**
+ * Queues a log entry for a callsite registered with [`paper2_register_callsite`].
+ * Only the message is copied.
+ *
+ * # Safety
+ * - `message` must point to `len` bytes. Invalid UTF-8 is replaced with U+FFFD.
+ */
+bool paper2_queue_log_callsite(paper2_CallsiteId callsite, struct paper2_StringRef message);
+
+/**
+ * Queues a log entry with typed fields for a callsite registered with
+ * [`paper2_register_callsite`]. The fields are rendered by the logging thread.
+ *
+ * # Safety
+ * - `message` must point to `len` bytes. Invalid UTF-8 is replaced with U+FFFD.
+ * - `fields` must point to `fields_len` fields, or be null if `fields_len` is 0.
+ * - Field keys must live for the rest of the process, like string literals.
+ */
+bool paper2_queue_log_callsite_fields(paper2_CallsiteId callsite,
+                                      struct paper2_StringRef message,
+                                      const struct paper2_FieldC *fields,
+                                      uintptr_t fields_len);
+
+/**
+ * Queues a log entry with typed fields, like [`paper2_queue_log_ffi_v2`].
+ *
+ * # Safety
+ * - Every `StringRef` must be null or point to `len` bytes.
+ *   Invalid UTF-8 is replaced with U+FFFD.
+ * - `message` and `file` must not be null.
+ * - A null or empty `tag`/`function_name` means none was given.
+ * - `fields` must point to `fields_len` fields, or be null if `fields_len` is 0.
+ * - Field keys must live for the rest of the process, like string literals.
+ */
+bool paper2_queue_log_fields(enum paper2_LogLevel level,
+                             struct paper2_StringRef tag,
+                             struct paper2_StringRef message,
+                             struct paper2_StringRef file,
+                             int line,
+                             int column,
+                             struct paper2_StringRef function_name,
+                             const struct paper2_FieldC *fields,
+                             uintptr_t fields_len);
+
+/**
+ * Reserves a buffer of at least `size_hint` bytes to format a message into.
+ * Committing it queues the buffer as is, the message is never copied.
+ * Buffers of written logs are recycled, so this rarely allocates.
+ */
+struct paper2_MessageSlot paper2_reserve(uintptr_t size_hint);
+
+/**
+ * Grows `slot` to at least `capacity` bytes, keeping its first `len` bytes.
+ * The slot may move, `data` is updated.
+ *
+ * # Safety
+ * - `slot` must point to a slot from [`paper2_reserve`] whose first `len` bytes are initialized.
+ */
+bool paper2_grow(struct paper2_MessageSlot *slot, uintptr_t len, uintptr_t capacity);
+
+/**
+ * Queues the first `len` bytes of `slot` as the message of a log entry for a callsite
+ * registered with [`paper2_register_callsite`].
+ * The slot is consumed even if nothing is queued, its buffer is then recycled.
+ *
+ * # Safety
+ * - `slot` must come from [`paper2_reserve`] and not be used afterwards.
+ * - The first `len` bytes of `slot` must be initialized.
+ *   Invalid UTF-8 is replaced with U+FFFD.
+ */
+bool paper2_commit(struct paper2_MessageSlot slot, uintptr_t len, paper2_CallsiteId callsite);
+
+/**
+ * Gives back a slot that won't be committed, its buffer is recycled.
+ *
+ * # Safety
+ * - `slot` must come from [`paper2_reserve`] and not be used afterwards.
+ */
+void paper2_release(struct paper2_MessageSlot slot);
+
+/**
+ * Queues a log entry whose formatting happens later on the logging thread.
+ *
+ * The arguments are copied as opaque bytes, and `render` is called with them and
+ * `format` once the logging thread picks the entry up.
+ *
+ * # Safety
+ * - `format` must live for the rest of the process, like a string literal.
+ * Formats that are not UTF-8 are not queued.
+ * - `args` must point to `args_len` readable bytes, or be null if `args_len` is 0.
+ * - `args` must not reference memory the caller may free, it is read after this returns.
+ * - `render` must not unwind. What it writes is checked to be UTF-8.
+ */
+bool paper2_queue_log_deferred(paper2_CallsiteId callsite,
+                               struct paper2_StringRef format,
+                               paper2_DeferredRenderFn render,
+                               const uint8_t *args,
+                               uintptr_t args_len);
+
+/**
+ * Whether a log of `level` with `tag` passes the level gates, for producers that want to
+ * skip formatting. A null or empty tag checks the global level.
+ * Tags without a gate of their own follow the global level, none is created here.
+ * Gates are cached per thread, so this rarely takes a lock.
+ *
+ * # Safety
+ * - `tag` must be null or point to `len` bytes, invalid UTF-8 is replaced with U+FFFD.
+ */
+bool paper2_is_enabled(enum paper2_LogLevel level, struct paper2_StringRef tag);
+
+/**
+ * Returns the level gate of `tag`, or the global gate for a null or empty tag.
+ *
+ * The gate holds the lowest severity that is logged, ordered
+ * Debug, Info, Warn, Error, Crit, Off from 0 to 5.
+ * It stays valid for the rest of the process and should be read atomically.
+ * Past 1024 tags, new tags get the global gate unless their level was set.
+ *
+ * # Safety
+ * - `tag` must be null or point to `len` bytes, invalid UTF-8 is replaced with U+FFFD.
+ */
+const uint8_t *paper2_get_level_gate(struct paper2_StringRef tag);
+
+/**
+ * Sets the minimum level logged by every tag without its own level.
+ *
+ * # Safety
+ * - No pointers are involved.
+ */
+void paper2_set_log_level(enum paper2_LogLevel level);
+
+/**
+ * Sets the minimum level logged for `tag`, overriding the global level.
+ *
+ * # Safety
+ * - `tag` must be null or point to `len` bytes, invalid UTF-8 is replaced with U+FFFD.
+ */
+void paper2_set_tag_log_level(struct paper2_StringRef tag, enum paper2_LogLevel level);
+
+/**
+ * Makes `tag` follow the global level again.
+ *
+ * # Safety
+ * - `tag` must be null or point to `len` bytes, invalid UTF-8 is replaced with U+FFFD.
+ */
+void paper2_reset_tag_log_level(struct paper2_StringRef tag);
+
 /**
  * Waits for all logs to be flushed.
  *
@@ -113,6 +560,42 @@ bool paper2_queue_log_ffi(enum paper2_LogLevel level,
  */
 bool paper2_wait_for_flush(void);
 
+/**
+ * Writes every log queued so far to the files and cuts off what mapped files preallocated,
+ * so they end where the logs do. Waits for up to a second.
+ * Called at exit for mapped files, hosts that exit otherwise should call it at shutdown.
+ */
+bool paper2_finish_files(void);
+
+/**
+ * Writes the most recent logs to `fd`, oldest first, using only `write(2)`.
+ * Meant for crash handlers of the embedding process, it never blocks or allocates.
+ * Returns false without a logger, a flight recorder or the `flight_recorder` feature.
+ */
+bool paper2_dump_flight_recorder(int fd);
+
+/**
+ * Copies the logger's counters into `out`, totals since it started.
+ * Returns false without a logger, leaving `out` untouched.
+ *
+ * # Safety
+ * - `out` must point to writable memory for a `LoggerStats`.
+ */
+bool paper2_get_stats(struct paper2_LoggerStats *out);
+
+/**
+ * Hands the profiling zones a thread recorded to the logging thread,
+ * which appends them to the trace file.
+ * Returns false without a logger. Zones are dropped if no trace file or zone statistics
+ * are configured, or if the logging thread has too many batches waiting.
+ *
+ * # Safety
+ * - `events` must point to `len` initialized events, or be null if `len` is 0.
+ * - Every event name must live for the rest of the process.
+ *   Names that are not UTF-8 are left empty.
+ */
+bool paper2_submit_trace_events(uint32_t tid, const struct paper2_TraceEventC *events, uintptr_t len);
+
 /**
  * Gets the log directory as a C string.
  *
@@ -139,12 +622,33 @@ bool paper2_get_inited(void);
 bool paper2_wait_flush_timeout(unsigned int timeout_ms);
 
 /**
- * Shuts down the logger, flushing all logs.
+ * Adds a sink called with every log line, on a worker thread of its own.
  * # Safety
- * - Safe to call if logger is initialized.
+ * - `callback` must be safe to call from another thread with `user_data`.
  */
 bool paper2_add_log_sink(paper2_LogCallbackC callback, void *user_data);
 
+/**
+ * Adds a sink called with the lines of logs passing `filter`, on a worker thread of its own.
+ * # Safety
+ * - `callback` must be safe to call from another thread with `user_data`.
+ * - `filter.tag` must be null or point to `len` bytes.
+ */
+bool paper2_add_filtered_log_sink(paper2_LogCallbackC callback,
+                                  void *user_data,
+                                  struct paper2_SinkFilterC filter);
+
+/**
+ * Adds a sink called once per batch with the lines of every log passing `filter`,
+ * on a worker thread of its own. The records only live for the duration of the call.
+ * # Safety
+ * - `callback` must be safe to call from another thread with `user_data`.
+ * - `filter.tag` must be null or point to `len` bytes.
+ */
+bool paper2_add_log_batch_sink(paper2_LogBatchCallbackC callback,
+                               void *user_data,
+                               struct paper2_SinkFilterC filter);
+
 /**
  * Frees a C string allocated by `paper2_get_log_directory`.
  * # Safety
@@ -15,6 +15,24 @@ enum class LogLevel : uint8_t {
   OFF = Paper::ffi::paper2_LogLevel::Off
 };
 
+/// Position in the severity order, DBG is lowest. The enum values follow the FFI and are not ordered.
+constexpr uint8_t severity(LogLevel level) {
+  switch (level) {
+  case LogLevel::DBG:
+    return 0;
+  case LogLevel::INF:
+    return 1;
+  case LogLevel::WRN:
+    return 2;
+  case LogLevel::ERR:
+    return 3;
+  case LogLevel::CRIT:
+    return 4;
+  default:
+    return 5;
+  }
+}
+
 constexpr auto format_as(LogLevel level) {
   switch (level) {
   case LogLevel::DBG:
@@ -3,13 +3,17 @@
 /// DEFINE PAPER_INLINE_QUEUE to use slightly faster queue logic at the cost of
 /// bigger binary size DEFINE NO_MODLOADER_FORMAT to disable modloader include
 /// and fmt struct DEFINE NO_SL2_FORMAT to disable scotland2 include and fmt
-/// struct
+/// struct DEFINE PAPER_DEFERRED_FORMAT to format messages with only trivially
+/// copyable arguments on the logging thread instead of the caller's DEFINE
+/// PAPER_MIN_LOG_LEVEL as a LogLevel name (e.g. INF) to compile out every log
+/// below it
 
 #include "_config.h"
 #include "bindings.h"
 #include "log_level.hpp"
 #include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <fmt/base.h>
 #include <fmt/xchar.h>
 #include <thread>
@@ -22,9 +26,14 @@
 #include "feature/scotland2_fmt.hpp"
 #endif
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <filesystem>
 #include <functional>
 #include <optional>
+#include <span>
+#include <tuple>
 #include <utility>
 
 // TODO: Breaking change use std::source_location
@@ -49,6 +58,18 @@ inline constexpr size_t SOURCE_OFFSET = PAPER_ROOT_FOLDER_LENGTH;
 inline constexpr size_t SOURCE_OFFSET = 0;
 #endif
 
+#ifdef PAPER_MIN_LOG_LEVEL
+inline constexpr LogLevel MIN_LOG_LEVEL = LogLevel::PAPER_MIN_LOG_LEVEL;
+#else
+inline constexpr LogLevel MIN_LOG_LEVEL = LogLevel::DBG;
+#endif
+
+#ifdef PAPER_DEFERRED_FORMAT
+inline constexpr bool DEFERRED_FORMAT = true;
+#else
+inline constexpr bool DEFERRED_FORMAT = false;
+#endif
+
 // TODO: Inherit when NDK fixes bug
 // https://github.com/android/ndk/issues/1677
 template <typename Char, typename... TArgs> struct BasicFmtStrSrcLoc {
@@ -72,14 +93,16 @@ template <typename Char, typename... TArgs> struct BasicFmtStrSrcLoc {
   }
 
   sl sourceLocation;
+  // only compile time format strings are guaranteed to outlive the log call
+  bool staticFormat;
 
   template <typename S>
     requires(std::is_convertible_v<S const&, fmt::basic_string_view<char>>)
   consteval inline BasicFmtStrSrcLoc(S const& s, sl const& sourceL = sl::current())
-      : parentType(s), sourceLocation(sourceL) {}
+      : parentType(s), sourceLocation(sourceL), staticFormat(true) {}
 
   BasicFmtStrSrcLoc(fmt::runtime_format_string<char> r, sl const& sourceL = sl::current())
-      : parentType(r), sourceLocation(sourceL) {}
+      : parentType(r), sourceLocation(sourceL), staticFormat(false) {}
 };
 
 template <typename... Args> using FmtStrSrcLoc = BasicFmtStrSrcLoc<char, std::type_identity_t<Args>...>;
@@ -93,6 +116,8 @@ struct LogData {
   uint32_t column;
   std::optional<std::string_view> function_name;
   int64_t time;
+  /// Typed fields of the log, `message` holds them as `key=value` too
+  std::span<ffi::paper2_FieldC const> fields;
 
   LogData(Paper::ffi::paper2_LogDataC const& data)
       : level((LogLevel)data.level), line(data.line), column(data.column), time(data.timestamp) {
@@ -106,9 +131,49 @@ struct LogData {
     if (data.function_name._0 != nullptr && data.function_name._1 > 0) {
       function_name = std::string_view((char const*)data.function_name._0, data.function_name._1);
     }
+
+    if (data.fields != nullptr) {
+      fields = std::span<ffi::paper2_FieldC const>(data.fields, data.fields_len);
+    }
   }
 };
 
+using Field = ffi::paper2_FieldC;
+
+/**
+ * @brief A typed key-value pair to log along with a message, e.g. `info("player joined", kv("id", id))`.
+ * Text files get `key=value` after the message, JSON lines files and sinks get the value typed.
+ * Strings are copied by the log call, the key has to be a literal
+ *
+ */
+template <size_t N, typename T> inline Field kv(char const (&key)[N], T const& value) noexcept {
+  Field field{};
+  field.key = { reinterpret_cast<uint8_t const*>(key), N - 1 };
+
+  if constexpr (std::is_same_v<T, bool>) {
+    field.kind = ffi::paper2_FieldKind::Bool;
+    field.bool_value = value;
+  } else if constexpr (std::is_enum_v<T>) {
+    field.kind = ffi::paper2_FieldKind::Int;
+    field.int_value = static_cast<int64_t>(value);
+  } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+    field.kind = ffi::paper2_FieldKind::Int;
+    field.int_value = value;
+  } else if constexpr (std::is_integral_v<T>) {
+    field.kind = ffi::paper2_FieldKind::UInt;
+    field.uint_value = value;
+  } else if constexpr (std::is_floating_point_v<T>) {
+    field.kind = ffi::paper2_FieldKind::Float;
+    field.float_value = value;
+  } else {
+    static_assert(std::is_convertible_v<T const&, std::string_view>, "Field values are numbers, bools or strings");
+    std::string_view const str = value;
+    field.kind = ffi::paper2_FieldKind::Str;
+    field.str_value = { reinterpret_cast<uint8_t const*>(str.data()), str.size() };
+  }
+  return field;
+}
+
 ///
 /// @param originalString This param exists since strings can be splitted due to
 /// newlines etc. Use this when you need the exact printed string for this sink
@@ -116,6 +181,36 @@ struct LogData {
 /// origianl string without the initial fmt run
 using LogSink = std::function<void(Paper::LogData const& logData)>;
 
+/**
+ * @brief Which logs a sink receives
+ *
+ */
+struct SinkFilter {
+  /// Logs below this level are skipped
+  LogLevel minLevel = LogLevel::DBG;
+  /// Only logs with this tag are passed on, empty for every tag. Copied when the sink is added
+  std::string_view tag = {};
+};
+
+enum class TimestampPrecision : uint8_t { Seconds = 0, Millis = 1, Micros = 2 };
+
+/**
+ * @brief What happens to new logs while the queue is full
+ *
+ */
+enum class OverflowPolicy : uint8_t {
+  /// The queue grows without limit
+  Unbounded = 0,
+  /// Logging waits for the logging thread to make room
+  Block = 1,
+  /// New logs are dropped
+  DropNewest = 2,
+  /// Queued logs below warnings are dropped to make room, warnings and errors are kept
+  DropBelowWarn = 3,
+  /// Once the queue is half full only one in SampleOneIn logs is kept
+  Sample = 4,
+};
+
 struct LoggerConfig {
   LoggerConfig() = default;
 
@@ -135,21 +230,419 @@ struct LoggerConfig {
   uint32_t MaxStringLen = 1024;
 
   uint32_t MaximumFileLengthInLogcat = 50;
+
+  /**
+   * @brief Capacity of the lock-free queue each logging thread gets.
+   * 0 makes all threads share a single locked queue
+   *
+   */
+  uint32_t RingBufferCapacity = 0;
+
+  /**
+   * @brief Digits shown after the seconds of timestamps
+   *
+   */
+  TimestampPrecision TimePrecision = TimestampPrecision::Seconds;
+
+  /**
+   * @brief Write log files through a memory mapping, growing them this many bytes at a time.
+   * 0 uses buffered writes. Needs paper2 built with the mmap feature.
+   * Files are trimmed to their logs at exit or by `Logger::FinishFiles`, until then they end in zeroes
+   *
+   */
+  uint32_t MmapChunkSize = 0;
+
+  /**
+   * @brief Leave file writes to a dedicated I/O thread, so the logging thread never waits on disk
+   *
+   */
+  bool AsyncFileWrites = false;
+
+  /**
+   * @brief Rotate the global and context files once they hold this many bytes. 0 for no limit
+   *
+   */
+  uint64_t RotateMaxBytes = 0;
+
+  /**
+   * @brief Rotate the global and context files once they were written to for this long. 0 for no limit
+   *
+   */
+  std::chrono::seconds RotateMaxAge{ 0 };
+
+  /**
+   * @brief Rotated segments kept per file, older ones are deleted
+   *
+   */
+  uint32_t RotateKeep = 5;
+
+  /**
+   * @brief Compress rotated segments with zstd in the background. Needs paper2 built with the compress feature,
+   * without it a warning is logged and segments stay uncompressed
+   *
+   */
+  bool RotateCompress = false;
+
+  /**
+   * @brief Write log files in a compact binary format, turned back into text with paper2_decode
+   *
+   */
+  bool BinaryFiles = false;
+
+  /**
+   * @brief Write log files as JSON lines, one object per log with its `kv` fields typed. BinaryFiles wins over this
+   *
+   */
+  bool JsonFiles = false;
+
+  /**
+   * @brief What happens to new logs once the queue holds LogMaxBufferCount logs or QueueMaxBytes bytes
+   *
+   */
+  OverflowPolicy QueueOverflow = OverflowPolicy::Unbounded;
+
+  /**
+   * @brief With OverflowPolicy::Sample, one in this many logs is kept
+   *
+   */
+  uint32_t SampleOneIn = 10;
+
+  /**
+   * @brief Memory queued logs may hold. 0 for no limit
+   *
+   */
+  uint64_t QueueMaxBytes = 0;
+
+  /**
+   * @brief Longest a written log waits to be flushed to the files. 0 flushes after every batch
+   *
+   */
+  std::chrono::milliseconds FlushMaxLatency{ 50 };
+
+  /**
+   * @brief Flush once this many bytes were written since the last flush. 0 for no limit
+   *
+   */
+  uint64_t FlushMaxDirtyBytes = 256 * 1024;
+
+  /**
+   * @brief Logs at or above this level are flushed right away. LogLevel::OFF leaves them to the limits above
+   *
+   */
+  LogLevel FlushLevel = LogLevel::ERR;
+
+  /**
+   * @brief Recent logs kept in memory, written out if the process crashes. 0 to keep none.
+   * Every log queued is then also copied into a slot shared by all threads: an atomic ticket, a compare-exchange and
+   * up to 256 bytes of copying per log
+   *
+   */
+  uint32_t FlightRecorderSlots = 0;
+
+  /**
+   * @brief On SIGSEGV, SIGBUS, SIGFPE, SIGILL or SIGABRT, write the recent logs, a raw backtrace and the memory map
+   * to this file before the previous handler runs. Needs FlightRecorderSlots. Unset installs no handler
+   *
+   */
+  std::optional<std::filesystem::path> CrashDumpPath;
+
+  /**
+   * @brief Write every `ProfileZone` to this file as a Chrome trace, for chrome://tracing or Perfetto.
+   * Unset drops the zones
+   *
+   */
+  std::optional<std::filesystem::path> TracePath;
+
+  /**
+   * @brief Log count, min, mean, max, p50, p99 and p999 of every `ProfileZone` this often, under the "Profiler" tag.
+   * Covers how long logs waited in the queue too. 0 keeps no statistics
+   *
+   */
+  std::chrono::milliseconds ProfileReportInterval{ 0 };
+
+  /**
+   * @brief Log the logger's own stats, see `Logger::GetStats`, this often. 0 for never
+   *
+   */
+  std::chrono::milliseconds StatsReportInterval{ 0 };
+
+  /**
+   * @brief Give back the memory a burst of logs left pooled once the logger was idle this long. 0 keeps it
+   *
+   */
+  std::chrono::milliseconds TrimIdleAfter{ 10000 };
+
+  /**
+   * @brief Write context files on this many threads, each owning a share of the contexts.
+   * Logs of one context stay in order. 0 writes them on the logging thread, along with the global file.
+   * Their flushes are only waited for once a log at the flush level was written
+   *
+   */
+  uint32_t ContextWriterThreads = 0;
+};
+
+namespace detail {
+inline ffi::paper2_StringRef toStringRef(std::string_view const str) noexcept {
+  return { reinterpret_cast<uint8_t const*>(str.data()), str.size() };
+}
+
+inline ffi::paper2_SinkFilterC toSinkFilter(SinkFilter const& filter) noexcept {
+  return { (ffi::paper2_LogLevel)filter.minLevel,
+           filter.tag.empty() ? ffi::paper2_StringRef{ nullptr, 0 } : toStringRef(filter.tag) };
+}
+
+inline std::string_view trimmedFileName(sl const& sourceLoc) noexcept {
+  std::string_view file = sourceLoc.file_name();
+  file.remove_prefix(std::min(size_t(SOURCE_OFFSET), file.size()));
+  return file;
+}
+
+// FNV-1a, tags are short
+constexpr uint64_t hashTag(std::string_view const tag) noexcept {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (char c : tag) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3;
+  }
+  return hash;
+}
+
+/// Whether `level` survives `PAPER_MIN_LOG_LEVEL`
+constexpr bool isCompiledIn(LogLevel level) noexcept {
+  return level != LogLevel::OFF && severity(level) >= severity(MIN_LOG_LEVEL);
+}
+
+/// Gates are owned by the logger and hold the lowest severity that gets logged
+inline bool gateAllows(uint8_t const* gate, LogLevel level) noexcept {
+  return std::atomic_ref<uint8_t>(*const_cast<uint8_t*>(gate)).load(std::memory_order_relaxed) <= severity(level);
+}
+
+inline uint8_t const* globalLevelGate() noexcept {
+  static uint8_t const* gate = ffi::paper2_get_level_gate({ nullptr, 0 });
+  return gate;
+}
+
+struct LevelGateCacheEntry {
+  uint64_t tagHash = 0;
+  uint8_t const* gate = nullptr;
 };
 
+/// Returns the level gate of `tag`. Gates never move, so each thread caches the ones it used last.
+inline uint8_t const* levelGate(std::string_view const tag) noexcept {
+  if (tag.empty()) {
+    return globalLevelGate();
+  }
+
+  static constexpr size_t CACHE_SIZE = 32;
+  thread_local std::array<LevelGateCacheEntry, CACHE_SIZE> cache{};
+
+  uint64_t const tagHash = hashTag(tag);
+  auto& entry = cache[tagHash % CACHE_SIZE];
+  if (entry.gate == nullptr || entry.tagHash != tagHash) {
+    entry = { tagHash, ffi::paper2_get_level_gate(toStringRef(tag)) };
+  }
+  return entry.gate;
+}
+
+struct CallsiteCacheEntry {
+  char const* file = nullptr;
+  char const* function = nullptr;
+  uint32_t line = 0;
+  uint32_t column = 0;
+  uint64_t tagHash = 0;
+  LogLevel level{};
+  ffi::paper2_CallsiteId id = 0;
+};
+
+/// Returns the registered id of a log statement, registering it on first use.
+/// Source locations point to string literals, so their addresses identify the callsite
+/// and the cache never has to compare file or function names.
+inline ffi::paper2_CallsiteId callsiteId(LogLevel level, sl const& sourceLoc, std::string_view const tag) noexcept {
+  static constexpr size_t CACHE_SIZE = 256;
+  thread_local std::array<CallsiteCacheEntry, CACHE_SIZE> cache{};
+
+  char const* file = std::string_view(sourceLoc.file_name()).data();
+  char const* function = std::string_view(sourceLoc.function_name()).data();
+  uint32_t const line = sourceLoc.line();
+  uint32_t const column = sourceLoc.column();
+  uint64_t const tagHash = hashTag(tag);
+
+  size_t const index =
+      ((reinterpret_cast<uintptr_t>(file) >> 4) ^ (line * 31) ^ column ^ tagHash ^ size_t(level)) % CACHE_SIZE;
+  auto& entry = cache[index];
+
+  if (entry.id != 0 && entry.file == file && entry.function == function && entry.line == line &&
+      entry.column == column && entry.tagHash == tagHash && entry.level == level) {
+    return entry.id;
+  }
+
+  auto id = ffi::paper2_register_callsite((ffi::paper2_LogLevel)level, toStringRef(tag),
+                                          toStringRef(trimmedFileName(sourceLoc)), line, column,
+                                          toStringRef(sourceLoc.function_name()));
+  if (id != 0) {
+    entry = { file, function, line, column, tagHash, level, id };
+  }
+  return id;
+}
+
+/// Arguments that can be copied as raw bytes and formatted later without dangling
+template <typename T>
+inline constexpr bool isDeferrable =
+    std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_same_v<T, std::nullptr_t> ||
+    (std::is_pointer_v<T> && std::is_void_v<std::remove_cv_t<std::remove_pointer_t<T>>>);
+
+template <typename... TArgs>
+inline constexpr bool allDeferrable = sizeof...(TArgs) > 0 && (isDeferrable<std::decay_t<TArgs>> && ...);
+
+template <typename T> inline constexpr bool isField = std::is_same_v<std::remove_cvref_t<T>, Field>;
+
+template <typename... TArgs> inline constexpr size_t fieldCount = (size_t(isField<TArgs>) + ... + 0);
+
+/// The `kv` fields among the arguments of a log call, in order
+template <typename... TArgs> inline auto collectFields(TArgs const&... args) noexcept {
+  std::array<Field, fieldCount<TArgs...>> fields{};
+  size_t index = 0;
+  (
+      [&] {
+        if constexpr (isField<TArgs>) {
+          fields[index++] = args;
+        }
+      }(),
+      ...);
+  return fields;
+}
+
+/// Runs on the logging thread, rebuilds the arguments serialized by `Logger::deferredLog` and formats them
+template <typename... TArgs>
+void renderDeferred(uint8_t const* format, uintptr_t formatLen, uint8_t const* args, uintptr_t argsLen,
+                    ffi::paper2_DeferredWriteFn write, void* out) noexcept {
+  if (argsLen != (sizeof(TArgs) + ...)) {
+    return;
+  }
+
+  std::tuple<TArgs...> values;
+  size_t offset = 0;
+  std::apply([&](auto&... value) { ((std::memcpy(&value, args + offset, sizeof(value)), offset += sizeof(value)), ...); },
+             values);
+
+  fmt::memory_buffer message;
+  fmt::string_view const str(reinterpret_cast<char const*>(format), formatLen);
+#ifdef __EXCEPTIONS
+  try {
+#endif
+    std::apply([&](auto&... value) { fmt::vformat_to(fmt::appender(message), str, fmt::make_format_args(value...)); },
+               values);
+#ifdef __EXCEPTIONS
+  } catch (...) {
+    return;
+  }
+#endif
+
+  write(out, reinterpret_cast<uint8_t const*>(message.data()), message.size());
+}
+} // namespace detail
+
 namespace Logger {
 inline void vfmtLog(fmt::string_view const str, LogLevel level, sl const& sourceLoc, std::string_view const tag,
                     fmt::format_args&& args) noexcept {
-  auto message = fmt::vformat(str, args);
+  auto callsite = detail::callsiteId(level, sourceLoc, tag);
+  if (callsite != 0) {
+    // formats straight into the buffer that becomes the queued message,
+    // sized after the last message this thread logged
+    thread_local size_t lastSize = 0;
+    auto slot = Paper::ffi::paper2_reserve(std::max(lastSize, str.size()));
+
+    auto result = fmt::vformat_to_n(reinterpret_cast<char*>(slot.data), slot.capacity, str, args);
+    if (result.size > slot.capacity) {
+      Paper::ffi::paper2_grow(&slot, 0, result.size);
+      fmt::vformat_to(reinterpret_cast<char*>(slot.data), str, args);
+    }
 
-  Paper::ffi::paper2_queue_log_ffi((ffi::paper2_LogLevel)level, tag.data(), message.c_str(),
-                                   sourceLoc.file_name().data() + size_t(SOURCE_OFFSET), sourceLoc.line(),
-                                   sourceLoc.column(), sourceLoc.function_name().data());
+    lastSize = result.size;
+    Paper::ffi::paper2_commit(slot, result.size, callsite);
+    return;
+  }
+
+  // formats on the stack for typical lines, the logger copies it once
+  fmt::memory_buffer message;
+  fmt::vformat_to(fmt::appender(message), str, args);
+
+  Paper::ffi::paper2_queue_log_ffi_v2((ffi::paper2_LogLevel)level, detail::toStringRef(tag),
+                                      detail::toStringRef({ message.data(), message.size() }),
+                                      detail::toStringRef(detail::trimmedFileName(sourceLoc)), sourceLoc.line(),
+                                      sourceLoc.column(), detail::toStringRef(sourceLoc.function_name()));
+}
+
+/// Formats the message and queues it with `fields`, which the logging thread renders
+inline void vfmtLogFields(fmt::string_view const str, LogLevel level, sl const& sourceLoc, std::string_view const tag,
+                          std::span<Field const> fields, fmt::format_args&& args) noexcept {
+  fmt::memory_buffer message;
+  fmt::vformat_to(fmt::appender(message), str, args);
+  auto const messageRef = detail::toStringRef({ message.data(), message.size() });
+
+  auto callsite = detail::callsiteId(level, sourceLoc, tag);
+  if (callsite != 0) {
+    Paper::ffi::paper2_queue_log_callsite_fields(callsite, messageRef, fields.data(), fields.size());
+    return;
+  }
+
+  Paper::ffi::paper2_queue_log_fields((ffi::paper2_LogLevel)level, detail::toStringRef(tag), messageRef,
+                                      detail::toStringRef(detail::trimmedFileName(sourceLoc)), sourceLoc.line(),
+                                      sourceLoc.column(), detail::toStringRef(sourceLoc.function_name()),
+                                      fields.data(), fields.size());
+}
+
+/// Copies the arguments and leaves formatting to the logging thread.
+/// Falls back to formatting immediately if the callsite can't be registered.
+template <typename... TArgs>
+inline void deferredLog(fmt::string_view const str, LogLevel level, sl const& sourceLoc, std::string_view const tag,
+                        TArgs const&... args) noexcept {
+  auto callsite = detail::callsiteId(level, sourceLoc, tag);
+  if (callsite == 0) {
+    return Logger::vfmtLog(str, level, sourceLoc, tag, fmt::make_format_args(args...));
+  }
+
+  std::array<uint8_t, (sizeof(TArgs) + ...)> buffer;
+  size_t offset = 0;
+  ((std::memcpy(buffer.data() + offset, &args, sizeof(TArgs)), offset += sizeof(TArgs)), ...);
+
+  Paper::ffi::paper2_queue_log_deferred(callsite, detail::toStringRef({ str.data(), str.size() }),
+                                        &detail::renderDeferred<TArgs...>, buffer.data(), buffer.size());
+}
+
+/// Logs if `lvl` passes both `PAPER_MIN_LOG_LEVEL` and `gate`, the level gate of `tag`.
+/// Nothing is formatted for logs that don't pass.
+template <LogLevel lvl, typename... TArgs>
+constexpr auto fmtLogGated(FmtStrSrcLoc<TArgs...> str, uint8_t const* gate, std::string_view const tag,
+                           TArgs&&... args) {
+  if constexpr (!detail::isCompiledIn(lvl)) {
+    return;
+  } else {
+    if (!detail::gateAllows(gate, lvl)) {
+      return;
+    }
+
+    // `kv` arguments go along as typed fields, the format string may still reference them
+    if constexpr (detail::fieldCount<TArgs...> > 0) {
+      auto const fields = detail::collectFields<TArgs...>(args...);
+      return Logger::vfmtLogFields(str, lvl, str.sourceLocation, tag, fields, fmt::make_format_args(args...));
+    }
+
+    if constexpr (DEFERRED_FORMAT && detail::allDeferrable<TArgs...>) {
+      if (str.staticFormat) {
+        return Logger::deferredLog<std::decay_t<TArgs>...>(str, lvl, str.sourceLocation, tag, args...);
+      }
+    }
+    return Logger::vfmtLog(str, lvl, str.sourceLocation, tag, fmt::make_format_args(args...));
+  }
 }
 
 template <LogLevel lvl, typename... TArgs>
 constexpr auto fmtLogTag(FmtStrSrcLoc<TArgs...> str, std::string_view const tag, TArgs&&... args) {
-  return Logger::vfmtLog(str, lvl, str.sourceLocation, tag, fmt::make_format_args(args...));
+  if constexpr (!detail::isCompiledIn(lvl)) {
+    return;
+  } else {
+    return Logger::fmtLogGated<lvl, TArgs...>(str, detail::levelGate(tag), tag, std::forward<TArgs>(args)...);
+  }
 }
 
 template <LogLevel lvl, typename... TArgs> constexpr auto fmtLog(FmtStrSrcLoc<TArgs...> str, TArgs&&... args) {
@@ -180,13 +673,42 @@ inline void Init(std::string_view globalLogFile) {
   Paper::ffi::paper2_init_logger_ffi(nullptr, globalLogFile.data());
 }
 inline void Init(std::string_view logPath, LoggerConfig const& config) {
-  ffi::paper2_LoggerConfigFfi configFfi = { config.MaxStringLen, config.LogMaxBufferCount, config.lineEnd, nullptr };
+  ffi::paper2_LoggerConfigFfi configFfi = { config.MaxStringLen, config.LogMaxBufferCount, config.lineEnd, nullptr,
+                                            config.RingBufferCapacity, (uint8_t)config.TimePrecision,
+                                            config.MmapChunkSize, config.AsyncFileWrites,
+                                            config.RotateMaxBytes,
+                                            static_cast<unsigned long long>(config.RotateMaxAge.count()),
+                                            config.RotateKeep, config.RotateCompress, config.BinaryFiles,
+                                            (uint8_t)config.QueueOverflow, config.SampleOneIn,
+                                            config.QueueMaxBytes,
+                                            static_cast<unsigned int>(config.FlushMaxLatency.count()),
+                                            config.FlushMaxDirtyBytes, (ffi::paper2_LogLevel)config.FlushLevel,
+                                            config.FlightRecorderSlots,
+                                            config.CrashDumpPath ? config.CrashDumpPath->c_str() : nullptr,
+                                            config.TracePath ? config.TracePath->c_str() : nullptr,
+                                            static_cast<unsigned int>(config.ProfileReportInterval.count()),
+                                            static_cast<unsigned int>(config.StatsReportInterval.count()),
+                                            static_cast<unsigned int>(config.TrimIdleAfter.count()),
+                                            config.ContextWriterThreads, config.JsonFiles };
   Paper::ffi::paper2_init_logger_ffi(&configFfi, logPath.data());
 }
 inline bool IsInited() {
   return Paper::ffi::paper2_get_inited();
 }
 
+/// Sets the minimum level of every tag without its own level
+inline void SetLogLevel(LogLevel level) {
+  Paper::ffi::paper2_set_log_level((ffi::paper2_LogLevel)level);
+}
+/// Sets the minimum level of `tag`, overriding the global level
+inline void SetLogLevel(std::string_view const tag, LogLevel level) {
+  Paper::ffi::paper2_set_tag_log_level(detail::toStringRef(tag), (ffi::paper2_LogLevel)level);
+}
+/// Makes `tag` follow the global level again
+inline void ResetLogLevel(std::string_view const tag) {
+  Paper::ffi::paper2_reset_tag_log_level(detail::toStringRef(tag));
+}
+
 inline void RegisterFileContextId(std::string_view contextId) {
   Paper::ffi::paper2_register_context_id(contextId.data());
 }
@@ -203,18 +725,70 @@ inline void WaitForFlushTimeout(uint32_t timeout) {
   Paper::ffi::paper2_wait_flush_timeout(timeout);
 }
 
+/// The logger's own counters: queue depth, drops, batch and flush times, bytes written.
+/// Empty before the logger is initialized
+inline std::optional<ffi::paper2_LoggerStats> GetStats() {
+  ffi::paper2_LoggerStats stats;
+  if (!Paper::ffi::paper2_get_stats(&stats)) {
+    return std::nullopt;
+  }
+  return stats;
+}
+
+/// Writes every queued log to the files and trims the chunks mapped files preallocated, so they end where the logs do.
+/// Runs at exit on its own, call it when shutting down otherwise
+inline bool FinishFiles() {
+  return Paper::ffi::paper2_finish_files();
+}
+
+/// Writes the most recent logs to fd using only write(2), safe to call from a signal handler
+inline bool DumpFlightRecorder(int fd) {
+  return Paper::ffi::paper2_dump_flight_recorder(fd);
+}
+
 // defined in backtrace.hpp
 void Backtrace(std::string_view const tag, uint16_t frameCount);
 
-// TODO: Sinks
-inline void AddLogSink(LogSink tempSink) {
+/**
+ * @brief Adds a sink called with every log line passing the filter, on a worker thread of its own.
+ * The sink is moved to the heap once and called directly, without a std::function in between
+ *
+ */
+template <typename F> inline bool AddLogSink(F&& sink, SinkFilter const& filter = {}) {
+  using Sink = std::decay_t<F>;
+  auto* heapSink = new Sink(std::forward<F>(sink));
 
-  Paper::ffi::paper2_add_log_sink(
+  bool added = Paper::ffi::paper2_add_filtered_log_sink(
       +[](Paper::ffi::paper2_LogDataC const* logData, void* userData) {
-        LogSink& sink = *reinterpret_cast<LogSink*>(userData);
-        return sink(Paper::LogData(*logData));
+        (*static_cast<Sink*>(userData))(Paper::LogData(*logData));
       },
-      new LogSink(tempSink));
+      heapSink, detail::toSinkFilter(filter));
+
+  if (!added) {
+    delete heapSink;
+  }
+  return added;
+}
+
+/**
+ * @brief Adds a sink called once per batch with every log line passing the filter, on a worker thread of its own.
+ * The sink gets a std::span<ffi::paper2_LogDataC const>, the records only live for the duration of the call
+ *
+ */
+template <typename F> inline bool AddLogBatchSink(F&& sink, SinkFilter const& filter = {}) {
+  using Sink = std::decay_t<F>;
+  auto* heapSink = new Sink(std::forward<F>(sink));
+
+  bool added = Paper::ffi::paper2_add_log_batch_sink(
+      +[](Paper::ffi::paper2_LogDataC const* logs, uintptr_t count, void* userData) {
+        (*static_cast<Sink*>(userData))(std::span<Paper::ffi::paper2_LogDataC const>(logs, count));
+      },
+      heapSink, detail::toSinkFilter(filter));
+
+  if (!added) {
+    delete heapSink;
+  }
+  return added;
 }
 }; // namespace Logger
 
@@ -238,6 +812,8 @@ template <typename... TArgs> inline auto critical(FmtStrSrcLoc<TArgs...> const&
 
 template <typename Str> struct BaseLoggerContext {
   Str tag;
+  // level gate of `tag`, looked up per log while null
+  uint8_t const* levelGate = nullptr;
 
   constexpr BaseLoggerContext(Str tag) : tag(std::move(tag)) {}
   constexpr BaseLoggerContext() noexcept = default;
@@ -249,7 +825,19 @@ template <typename Str> struct BaseLoggerContext {
   BaseLoggerContext& operator=(BaseLoggerContext const& o) noexcept = default;
 
   template <LogLevel lvl, typename... TArgs> constexpr auto fmtLog(FmtStrSrcLoc<TArgs...> str, TArgs&&... args) const {
-    return Logger::fmtLogTag<lvl, TArgs...>(str, tag, std::forward<TArgs>(args)...);
+    if constexpr (!detail::isCompiledIn(lvl)) {
+      return;
+    } else {
+      auto gate = levelGate != nullptr ? levelGate : detail::levelGate(tag);
+      return Logger::fmtLogGated<lvl, TArgs...>(str, gate, tag, std::forward<TArgs>(args)...);
+    }
+  }
+
+  inline void SetLogLevel(LogLevel level) const {
+    return Logger::SetLogLevel(tag, level);
+  }
+  inline void ResetLogLevel() const {
+    return Logger::ResetLogLevel(tag);
   }
 
   template <typename Exception = std::runtime_error, typename... TArgs>
@@ -285,12 +873,16 @@ template <std::size_t sz> struct ConstLoggerContext : public BaseLoggerContext<c
 };
 
 struct LoggerContext : public BaseLoggerContext<std::string> {
-  explicit LoggerContext(std::string_view s) : BaseLoggerContext<std::string>(std::string(s)) {}
+  explicit LoggerContext(std::string_view s) : BaseLoggerContext<std::string>(std::string(s)) {
+    levelGate = ffi::paper2_get_level_gate(detail::toStringRef(tag));
+  }
 
   // allow implicit conversion
   template <typename U>
     requires(std::is_constructible_v<std::string, U>)
-  LoggerContext(BaseLoggerContext<U> const& s) : BaseLoggerContext<std::string>(s.tag) {}
+  LoggerContext(BaseLoggerContext<U> const& s) : BaseLoggerContext<std::string>(s.tag) {
+    levelGate = s.levelGate != nullptr ? s.levelGate : ffi::paper2_get_level_gate(detail::toStringRef(tag));
+  }
 };
 
 namespace Logger {
@@ -298,7 +890,11 @@ template <ConstLoggerContext ctx, bool registerFile = true> inline auto WithCont
   if constexpr (registerFile) {
     RegisterFileContextId(ctx.tag);
   }
-  return ctx;
+
+  static uint8_t const* const gate = ffi::paper2_get_level_gate(detail::toStringRef(ctx.tag));
+  auto context = ctx;
+  context.levelGate = gate;
+  return context;
 }
 template <bool registerFile = true> inline auto WithContextRuntime(std::string_view const tag) {
   if constexpr (registerFile) {
@@ -308,3 +904,22 @@ template <bool registerFile = true> inline auto WithContextRuntime(std::string_v
 }
 } // namespace Logger
 } // namespace Paper
+
+/// Formats a field as `key=value`, for format strings that reference a `kv` argument
+template <> struct fmt::formatter<Paper::Field> : formatter<string_view> {
+  template <typename FormatContext> auto format(Paper::Field const& field, FormatContext& ctx) const {
+    auto out = fmt::format_to(ctx.out(), "{}=", std::string_view((char const*)field.key._0, field.key._1));
+    switch (field.kind) {
+    case Paper::ffi::paper2_FieldKind::Int:
+      return fmt::format_to(out, "{}", field.int_value);
+    case Paper::ffi::paper2_FieldKind::UInt:
+      return fmt::format_to(out, "{}", field.uint_value);
+    case Paper::ffi::paper2_FieldKind::Float:
+      return fmt::format_to(out, "{}", field.float_value);
+    case Paper::ffi::paper2_FieldKind::Bool:
+      return fmt::format_to(out, "{}", field.bool_value);
+    default:
+      return fmt::format_to(out, "{}", std::string_view((char const*)field.str_value._0, field.str_value._1));
+    }
+  }
+};
@@ -2,9 +2,25 @@ use crate::ffi::c_str_helper::StringRef;
 use crate::get_logger;
 use crate::init_logger;
 use crate::log_level::LogLevel;
+use crate::logger::callsite::{self, CallsiteId};
+use crate::logger::deferred::{DeferredMessage, DeferredRenderFn};
+use crate::logger::fields::{Field, FieldValue};
+use crate::logger::level_filter;
+use crate::logger::message_pool;
 use crate::logger::LogData;
 use crate::logger::LoggerConfig;
+use crate::logger::FileBackend;
+use crate::logger::FileFormat;
+use crate::logger::FlushPolicy;
+use crate::logger::OverflowPolicy;
+use crate::logger::sink_dispatch::{LogLine, SinkFilter};
+use crate::logger::QueueMode;
+use crate::logger::stats::LoggerStats;
+use crate::logger::trace::{TraceBatch, TraceEvent};
+#[cfg(feature = "file")]
+use crate::logger::rotation::RotationPolicy;
 use crate::Result;
+use std::borrow::Cow;
 use std::ffi::c_uint;
 use std::ffi::{c_uchar, c_ulonglong, CStr};
 use std::os::raw::{c_char, c_int};
@@ -12,6 +28,7 @@ use std::path::PathBuf;
 use std::sync::atomic::AtomicPtr;
 use std::sync::atomic::Ordering;
 use std::sync::Arc;
+use std::time::Duration;
 
 mod c_str_helper;
 
@@ -21,6 +38,184 @@ mod c_str_helper;
 pub type LogCallbackC =
     unsafe extern "C" fn(log_data: *const LogDataC, user_data: *mut std::ffi::c_void);
 
+/// Extern "C" compatible batch callback type.
+/// The callback receives `count` log lines and a user-provided context pointer.
+pub type LogBatchCallbackC = unsafe extern "C" fn(
+    logs: *const LogDataC,
+    count: usize,
+    user_data: *mut std::ffi::c_void,
+);
+
+/// Which logs a sink receives.
+#[repr(C)]
+pub struct SinkFilterC<'a> {
+    /// Logs below this level are skipped
+    pub min_level: LogLevel,
+    /// Only logs with this tag are passed on. Null for every tag.
+    pub tag: StringRef<'a>,
+}
+
+impl Default for SinkFilterC<'_> {
+    fn default() -> Self {
+        SinkFilterC {
+            min_level: LogLevel::Debug,
+            tag: None.into(),
+        }
+    }
+}
+
+impl SinkFilterC<'_> {
+    /// # Safety
+    /// - `tag` must be null or point to `len` bytes.
+    unsafe fn to_filter(&self) -> SinkFilter {
+        SinkFilter {
+            min_level: Some(self.min_level),
+            tag: unsafe { self.tag.to_str_lossy() }
+                .filter(|tag| !tag.is_empty())
+                .map(Cow::into_owned),
+        }
+    }
+}
+
+/// A timed profiling zone.
+#[repr(C)]
+pub struct TraceEventC<'a> {
+    /// Must live for the rest of the process, like a string literal.
+    pub name: StringRef<'a>,
+    /// On a monotonic clock, in nanoseconds.
+    pub start_nanos: u64,
+    pub duration_nanos: u64,
+}
+
+/// A message buffer from [`paper2_reserve`], which becomes the queued message itself.
+/// Hand it back with [`paper2_commit`] or [`paper2_release`].
+#[repr(C)]
+pub struct MessageSlot {
+    pub data: *mut u8,
+    pub capacity: usize,
+}
+
+/// Slots are never smaller than this, so short messages don't grow
+const MIN_SLOT_CAPACITY: usize = 64;
+
+impl MessageSlot {
+    fn from_vec(vec: Vec<u8>) -> Self {
+        let mut vec = std::mem::ManuallyDrop::new(vec);
+        MessageSlot {
+            data: vec.as_mut_ptr(),
+            capacity: vec.capacity(),
+        }
+    }
+
+    /// # Safety
+    /// - The slot must come from [`paper2_reserve`] and its first `len` bytes be initialized.
+    unsafe fn into_vec(self, len: usize) -> Vec<u8> {
+        unsafe { Vec::from_raw_parts(self.data, len.min(self.capacity), self.capacity) }
+    }
+}
+
+/// The type of a [`FieldC`]'s value.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum FieldKind {
+    Int,
+    UInt,
+    Float,
+    Bool,
+    Str,
+}
+
+/// A key-value pair of a structured log. Only the value `kind` names is read.
+#[repr(C)]
+pub struct FieldC<'a> {
+    /// Must live for the rest of the process, like a string literal.
+    pub key: StringRef<'a>,
+    pub kind: FieldKind,
+    pub int_value: i64,
+    pub uint_value: u64,
+    pub float_value: f64,
+    pub bool_value: bool,
+    pub str_value: StringRef<'a>,
+}
+
+impl<'a> From<&'a Field> for FieldC<'a> {
+    fn from(field: &'a Field) -> Self {
+        let mut c_field = FieldC {
+            key: field.key.into(),
+            kind: FieldKind::Int,
+            int_value: 0,
+            uint_value: 0,
+            float_value: 0.0,
+            bool_value: false,
+            str_value: None.into(),
+        };
+
+        match &field.value {
+            FieldValue::Int(value) => c_field.int_value = *value,
+            FieldValue::UInt(value) => {
+                c_field.kind = FieldKind::UInt;
+                c_field.uint_value = *value;
+            }
+            FieldValue::Float(value) => {
+                c_field.kind = FieldKind::Float;
+                c_field.float_value = *value;
+            }
+            FieldValue::Bool(value) => {
+                c_field.kind = FieldKind::Bool;
+                c_field.bool_value = *value;
+            }
+            FieldValue::Str(value) => {
+                c_field.kind = FieldKind::Str;
+                c_field.str_value = value.as_str().into();
+            }
+        }
+
+        c_field
+    }
+}
+
+impl FieldC<'_> {
+    /// Returns `None` for a null key.
+    ///
+    /// # Safety
+    /// - `key` must be null or live for the rest of the process.
+    ///   Keys that are not UTF-8 are skipped.
+    /// - `str_value` must be null or point to `len` bytes if `kind` is `Str`.
+    unsafe fn to_field(&self) -> Option<Field> {
+        let key = unsafe { self.key.as_str() }?;
+        // SAFETY: the caller guarantees the key has static storage
+        let key: &'static str = unsafe { &*(key as *const str) };
+
+        let value = match self.kind {
+            FieldKind::Int => FieldValue::Int(self.int_value),
+            FieldKind::UInt => FieldValue::UInt(self.uint_value),
+            FieldKind::Float => FieldValue::Float(self.float_value),
+            FieldKind::Bool => FieldValue::Bool(self.bool_value),
+            FieldKind::Str => {
+                let value = unsafe { self.str_value.to_str_lossy() };
+                FieldValue::Str(value.unwrap_or_default().into_owned())
+            }
+        };
+
+        Some(Field { key, value })
+    }
+}
+
+/// Copies `len` fields from C.
+///
+/// # Safety
+/// - `fields` must point to `len` valid fields, or be null if `len` is 0.
+unsafe fn fields_from_c(fields: *const FieldC, len: usize) -> Vec<Field> {
+    if fields.is_null() || len == 0 {
+        return Vec::new();
+    }
+
+    unsafe { std::slice::from_raw_parts(fields, len) }
+        .iter()
+        .filter_map(|field| unsafe { field.to_field() })
+        .collect()
+}
+
 #[repr(C)]
 pub struct LogDataC<'a> {
     pub level: LogLevel,
@@ -32,6 +227,20 @@ pub struct LogDataC<'a> {
     pub line: u32,
     pub column: u32,
     pub function_name: StringRef<'a>,
+
+    /// The log's fields, also rendered into `message` as `key=value`. Null if it has none.
+    pub fields: *const FieldC<'a>,
+    pub fields_len: usize,
+}
+
+impl<'a> LogDataC<'a> {
+    fn with_fields(mut self, fields: &'a [FieldC<'a>]) -> Self {
+        if !fields.is_empty() {
+            self.fields = fields.as_ptr();
+            self.fields_len = fields.len();
+        }
+        self
+    }
 }
 
 #[repr(C)]
@@ -46,6 +255,63 @@ pub struct LoggerConfigFfi {
     pub log_max_buffer_count: c_ulonglong,
     pub line_end: c_uchar,
     pub context_log_path: *const c_char,
+    /// Capacity of each producer thread's ring buffer.
+    /// 0 uses the single locked queue instead.
+    pub ring_buffer_capacity: c_ulonglong,
+    /// Digits after the seconds of timestamps.
+    /// 0 for none, 1 for milliseconds, 2 for microseconds.
+    pub timestamp_precision: c_uchar,
+    /// Size of the chunks log files are mapped and preallocated in.
+    /// 0 uses buffered writes. Ignored without the `mmap` feature.
+    pub mmap_chunk_size: c_ulonglong,
+    /// Leave file writes to a dedicated I/O thread. Ignored when `mmap_chunk_size` is used.
+    pub async_file_writes: bool,
+    /// Rotate log files once they hold this many bytes. 0 for no limit.
+    pub rotate_max_bytes: c_ulonglong,
+    /// Rotate log files once they were written to for this many seconds. 0 for no limit.
+    pub rotate_max_age_seconds: c_ulonglong,
+    /// Rotated segments kept per log file.
+    pub rotate_keep: c_uint,
+    /// Compress rotated segments. Ignored with a warning without the `compress` feature.
+    pub rotate_compress: bool,
+    /// Write log files in the compact binary format instead of text.
+    pub binary_files: bool,
+    /// What happens to new logs while the queue holds `log_max_buffer_count` logs
+    /// or `queue_max_bytes` bytes. 0 lets the queue grow, 1 blocks, 2 drops new logs,
+    /// 3 drops queued logs below warnings, 4 samples.
+    pub overflow_policy: c_uchar,
+    /// With sampling, one in this many logs is kept once the queue is half full.
+    pub overflow_sample_one_in: c_uint,
+    /// Memory the queued logs may hold. 0 for no limit.
+    pub queue_max_bytes: c_ulonglong,
+    /// Longest a written log waits to be flushed, in milliseconds.
+    /// 0 flushes after every batch.
+    pub flush_max_latency_ms: c_uint,
+    /// Flush once this many bytes were written since the last flush. 0 for no limit.
+    pub flush_max_dirty_bytes: c_ulonglong,
+    /// Logs at or above this level are flushed right away. `Off` for none.
+    pub flush_level: LogLevel,
+    /// Recent logs kept in memory for crash dumps. 0 to keep none.
+    pub flight_recorder_slots: c_uint,
+    /// File the recent logs are written to when the process crashes.
+    /// Null for no crash handler. Ignored without the `flight_recorder` feature.
+    pub crash_dump_path: *const c_char,
+    /// File profiling zones are written to as a Chrome trace.
+    /// Null for no trace. Ignored without the `file` feature.
+    pub trace_path: *const c_char,
+    /// Log a summary of every profiling zone this often, in milliseconds.
+    /// 0 keeps no statistics.
+    pub profile_report_interval_ms: c_uint,
+    /// Log the logger's own stats this often, in milliseconds. 0 for never.
+    pub stats_report_interval_ms: c_uint,
+    /// Give back the memory a burst of logs left pooled once the logger was idle this long,
+    /// in milliseconds. 0 keeps it.
+    pub trim_idle_after_ms: c_uint,
+    /// Threads writing the context files. 0 writes them on the logging thread.
+    pub context_writer_threads: c_uint,
+    /// Write log files as JSON lines, with the fields of logs typed.
+    /// `binary_files` wins if both are set.
+    pub json_files: bool,
 }
 
 #[no_mangle]
@@ -97,14 +363,14 @@ pub unsafe extern "C" fn paper2_register_context_id(tag: *const c_char) {
 
     let tag = unsafe { CStr::from_ptr(tag).to_string_lossy() };
 
-    let result = logger.write().add_context(&tag);
+    let result = logger.read().add_context(&tag);
 
     if let Err(report) = result {
         logger.read().queue_log(LogData {
             level: LogLevel::Info,
             tag: None,
             message: format!("Error creating context {tag}:\n{report}"),
-            file: file!().to_string(),
+            file: file!().into(),
             line: line!(),
             column: column!(),
             function_name: None,
@@ -129,7 +395,7 @@ pub unsafe extern "C" fn paper2_unregister_context_id(tag: *const c_char) {
 
     let tag = unsafe { CStr::from_ptr(tag).to_string_lossy() };
 
-    logger.write().remove_context(&tag);
+    logger.read().remove_context(&tag);
 }
 
 #[no_mangle]
@@ -155,14 +421,15 @@ pub unsafe extern "C" fn paper2_queue_log_ffi(
         return false;
     };
 
-    let tag = unsafe {
-        tag.as_ref()
-            .map(|c_str| CStr::from_ptr(c_str))
-            .map(|c| c.to_string_lossy().into_owned())
-    };
+    let tag = unsafe { tag.as_ref().map(|c_str| CStr::from_ptr(c_str).to_string_lossy()) };
+    // filtered out by the level of its tag, nothing is copied
+    if !level_filter::is_enabled(level, tag.as_deref()) {
+        return true;
+    }
+    let tag = tag.map(|tag| tag.into_owned().into());
 
     let message = unsafe { CStr::from_ptr(message).to_string_lossy().into_owned() };
-    let file = unsafe { CStr::from_ptr(file).to_string_lossy().into_owned() };
+    let file = unsafe { CStr::from_ptr(file).to_string_lossy().into_owned().into() };
 
     let log_data = LogData {
         level,
@@ -175,7 +442,7 @@ pub unsafe extern "C" fn paper2_queue_log_ffi(
             function_name
                 .as_ref()
                 .map(|c_str| CStr::from_ptr(c_str))
-                .map(|c| c.to_string_lossy().into_owned())
+                .map(|c| c.to_string_lossy().into_owned().into())
         },
         ..Default::default()
     };
@@ -185,6 +452,423 @@ pub unsafe extern "C" fn paper2_queue_log_ffi(
     true
 }
 
+#[no_mangle]
+/// Queues a log entry from FFI using pointer and length pairs.
+///
+/// Unlike [`paper2_queue_log_ffi`], no string is scanned for a terminator, and the message
+/// is copied exactly once into a logger-owned buffer. Strings are checked to be UTF-8 and
+/// borrowed as they are, invalid ones are replaced with U+FFFD.
+///
+/// # Safety
+/// - Every `StringRef` must be null or point to `len` bytes.
+///   Invalid UTF-8 is replaced with U+FFFD.
+/// - `message` and `file` must not be null.
+/// - A null or empty `tag`/`function_name` means none was given.
+/// - `level` must be a valid `LogLevel`.
+pub unsafe extern "C" fn paper2_queue_log_ffi_v2(
+    level: LogLevel,
+    tag: StringRef,
+    message: StringRef,
+    file: StringRef,
+    line: c_int,
+    column: c_int,
+    function_name: StringRef,
+) -> bool {
+    let (Some(message), Some(file)) =
+        (unsafe { message.to_str_lossy() }, unsafe { file.to_str_lossy() })
+    else {
+        return false;
+    };
+
+    let Some(logger) = get_logger() else {
+        return false;
+    };
+
+    let tag = unsafe { tag.to_str_lossy() }.filter(|tag| !tag.is_empty());
+    // filtered out by the level of its tag, nothing is copied
+    if !level_filter::is_enabled(level, tag.as_deref()) {
+        return true;
+    }
+
+    let function_name =
+        unsafe { function_name.to_str_lossy() }.filter(|function| !function.is_empty());
+
+    let log_data = LogData {
+        level,
+        tag: tag.map(|tag| tag.into_owned().into()),
+        message: message_pool::copy(&message),
+        file: file.into_owned().into(),
+        line: line as u32,
+        column: column as u32,
+        function_name: function_name.map(|function| function.into_owned().into()),
+        ..Default::default()
+    };
+
+    logger.read().queue_log(log_data);
+
+    true
+}
+
+#[no_mangle]
+/// Registers the static metadata of a log statement once, so later logs from it
+/// only need to send the returned id and their message.
+/// Registering the same metadata twice returns the same id.
+///
+/// Returns 0 if the callsite could not be registered.
+///
+/// # Safety
+/// - Every `StringRef` must be null or point to `len` bytes.
+///   Invalid UTF-8 is replaced with U+FFFD.
+/// - `file` must not be null.
+/// - A null or empty `tag`/`function_name` means none was given.
+pub unsafe extern "C" fn paper2_register_callsite(
+    level: LogLevel,
+    tag: StringRef,
+    file: StringRef,
+    line: c_int,
+    column: c_int,
+    function_name: StringRef,
+) -> CallsiteId {
+    let Some(file) = (unsafe { file.to_str_lossy() }) else {
+        return 0;
+    };
+
+    let tag = unsafe { tag.to_str_lossy() }.filter(|tag| !tag.is_empty());
+    let function_name =
+        unsafe { function_name.to_str_lossy() }.filter(|function| !function.is_empty());
+
+    callsite::register(
+        level,
+        tag.as_deref(),
+        &file,
+        line as u32,
+        column as u32,
+        function_name.as_deref(),
+    )
+    .unwrap_or(0)
+}
+
+#[no_mangle]
+/// Queues a log entry for a callsite registered with [`paper2_register_callsite`].
+/// Only the message is copied.
+///
+/// # Safety
+/// - `message` must point to `len` bytes. Invalid UTF-8 is replaced with U+FFFD.
+pub unsafe extern "C" fn paper2_queue_log_callsite(
+    callsite: CallsiteId,
+    message: StringRef,
+) -> bool {
+    let Some(message) = (unsafe { message.to_str_lossy() }) else {
+        return false;
+    };
+
+    let Some((callsite_data, gate)) = callsite::get_gated(callsite) else {
+        return false;
+    };
+    // filtered out by the level of its tag
+    if !callsite_data.enabled(gate) {
+        return true;
+    }
+
+    let Some(logger) = get_logger() else {
+        return false;
+    };
+
+    logger.read().queue_log(LogData::from_callsite(
+        callsite,
+        callsite_data,
+        message_pool::copy(&message),
+    ));
+
+    true
+}
+
+#[no_mangle]
+/// Queues a log entry with typed fields for a callsite registered with
+/// [`paper2_register_callsite`]. The fields are rendered by the logging thread.
+///
+/// # Safety
+/// - `message` must point to `len` bytes. Invalid UTF-8 is replaced with U+FFFD.
+/// - `fields` must point to `fields_len` fields, or be null if `fields_len` is 0.
+/// - Field keys must live for the rest of the process, like string literals.
+pub unsafe extern "C" fn paper2_queue_log_callsite_fields(
+    callsite: CallsiteId,
+    message: StringRef,
+    fields: *const FieldC,
+    fields_len: usize,
+) -> bool {
+    let Some(message) = (unsafe { message.to_str_lossy() }) else {
+        return false;
+    };
+
+    let Some((callsite_data, gate)) = callsite::get_gated(callsite) else {
+        return false;
+    };
+    // filtered out by the level of its tag
+    if !callsite_data.enabled(gate) {
+        return true;
+    }
+
+    let Some(logger) = get_logger() else {
+        return false;
+    };
+
+    let mut log_data =
+        LogData::from_callsite(callsite, callsite_data, message_pool::copy(&message));
+    log_data.fields = unsafe { fields_from_c(fields, fields_len) };
+
+    logger.read().queue_log(log_data);
+
+    true
+}
+
+#[no_mangle]
+/// Queues a log entry with typed fields, like [`paper2_queue_log_ffi_v2`].
+///
+/// # Safety
+/// - Every `StringRef` must be null or point to `len` bytes.
+///   Invalid UTF-8 is replaced with U+FFFD.
+/// - `message` and `file` must not be null.
+/// - A null or empty `tag`/`function_name` means none was given.
+/// - `fields` must point to `fields_len` fields, or be null if `fields_len` is 0.
+/// - Field keys must live for the rest of the process, like string literals.
+#[allow(clippy::too_many_arguments)]
+pub unsafe extern "C" fn paper2_queue_log_fields(
+    level: LogLevel,
+    tag: StringRef,
+    message: StringRef,
+    file: StringRef,
+    line: c_int,
+    column: c_int,
+    function_name: StringRef,
+    fields: *const FieldC,
+    fields_len: usize,
+) -> bool {
+    let (Some(message), Some(file)) =
+        (unsafe { message.to_str_lossy() }, unsafe { file.to_str_lossy() })
+    else {
+        return false;
+    };
+
+    let Some(logger) = get_logger() else {
+        return false;
+    };
+
+    let tag = unsafe { tag.to_str_lossy() }.filter(|tag| !tag.is_empty());
+    // filtered out by the level of its tag, nothing is copied
+    if !level_filter::is_enabled(level, tag.as_deref()) {
+        return true;
+    }
+
+    let function_name =
+        unsafe { function_name.to_str_lossy() }.filter(|function| !function.is_empty());
+
+    let log_data = LogData {
+        level,
+        tag: tag.map(|tag| tag.into_owned().into()),
+        message: message_pool::copy(&message),
+        file: file.into_owned().into(),
+        line: line as u32,
+        column: column as u32,
+        function_name: function_name.map(|function| function.into_owned().into()),
+        fields: unsafe { fields_from_c(fields, fields_len) },
+        ..Default::default()
+    };
+
+    logger.read().queue_log(log_data);
+
+    true
+}
+
+#[no_mangle]
+/// Reserves a buffer of at least `size_hint` bytes to format a message into.
+/// Committing it queues the buffer as is, the message is never copied.
+/// Buffers of written logs are recycled, so this rarely allocates.
+pub extern "C" fn paper2_reserve(size_hint: usize) -> MessageSlot {
+    MessageSlot::from_vec(message_pool::take(size_hint.max(MIN_SLOT_CAPACITY)).into_bytes())
+}
+
+#[no_mangle]
+/// Grows `slot` to at least `capacity` bytes, keeping its first `len` bytes.
+/// The slot may move, `data` is updated.
+///
+/// # Safety
+/// - `slot` must point to a slot from [`paper2_reserve`] whose first `len` bytes are initialized.
+pub unsafe extern "C" fn paper2_grow(slot: *mut MessageSlot, len: usize, capacity: usize) -> bool {
+    let Some(slot) = (unsafe { slot.as_mut() }) else {
+        return false;
+    };
+
+    let mut vec = unsafe { std::ptr::read(slot).into_vec(len) };
+    vec.reserve(capacity.saturating_sub(vec.len()));
+    *slot = MessageSlot::from_vec(vec);
+
+    true
+}
+
+#[no_mangle]
+/// Queues the first `len` bytes of `slot` as the message of a log entry for a callsite
+/// registered with [`paper2_register_callsite`].
+/// The slot is consumed even if nothing is queued, its buffer is then recycled.
+///
+/// # Safety
+/// - `slot` must come from [`paper2_reserve`] and not be used afterwards.
+/// - The first `len` bytes of `slot` must be initialized.
+///   Invalid UTF-8 is replaced with U+FFFD.
+pub unsafe extern "C" fn paper2_commit(slot: MessageSlot, len: usize, callsite: CallsiteId) -> bool {
+    let buffer = unsafe { slot.into_vec(len) };
+
+    let Some((callsite_data, gate)) = callsite::get_gated(callsite) else {
+        message_pool::release(buffer);
+        return false;
+    };
+    // filtered out by the level of its tag
+    if !callsite_data.enabled(gate) {
+        message_pool::release(buffer);
+        return true;
+    }
+
+    let Some(logger) = get_logger() else {
+        message_pool::release(buffer);
+        return false;
+    };
+
+    let message = String::from_utf8(buffer).unwrap_or_else(|err| {
+        let message = String::from_utf8_lossy(err.as_bytes()).into_owned();
+        message_pool::release(err.into_bytes());
+        message
+    });
+
+    logger
+        .read()
+        .queue_log(LogData::from_callsite(callsite, callsite_data, message));
+
+    true
+}
+
+#[no_mangle]
+/// Gives back a slot that won't be committed, its buffer is recycled.
+///
+/// # Safety
+/// - `slot` must come from [`paper2_reserve`] and not be used afterwards.
+pub unsafe extern "C" fn paper2_release(slot: MessageSlot) {
+    message_pool::release(unsafe { slot.into_vec(0) });
+}
+
+#[no_mangle]
+/// Queues a log entry whose formatting happens later on the logging thread.
+///
+/// The arguments are copied as opaque bytes, and `render` is called with them and
+/// `format` once the logging thread picks the entry up.
+///
+/// # Safety
+/// - `format` must live for the rest of the process, like a string literal.
+/// Formats that are not UTF-8 are not queued.
+/// - `args` must point to `args_len` readable bytes, or be null if `args_len` is 0.
+/// - `args` must not reference memory the caller may free, it is read after this returns.
+/// - `render` must not unwind. What it writes is checked to be UTF-8.
+pub unsafe extern "C" fn paper2_queue_log_deferred(
+    callsite: CallsiteId,
+    format: StringRef,
+    render: DeferredRenderFn,
+    args: *const u8,
+    args_len: usize,
+) -> bool {
+    let Some(format) = (unsafe { format.as_str() }) else {
+        return false;
+    };
+
+    let Some((callsite_data, gate)) = callsite::get_gated(callsite) else {
+        return false;
+    };
+    // filtered out by the level of its tag
+    if !callsite_data.enabled(gate) {
+        return true;
+    }
+
+    let Some(logger) = get_logger() else {
+        return false;
+    };
+
+    let args = match args.is_null() {
+        true => Vec::new(),
+        false => unsafe { std::slice::from_raw_parts(args, args_len) }.to_vec(),
+    };
+
+    // SAFETY: the caller guarantees the format string has static storage
+    let format: &'static str = unsafe { &*(format as *const str) };
+
+    let mut log_data = LogData::from_callsite(callsite, callsite_data, String::new());
+    log_data.deferred = Some(DeferredMessage {
+        format,
+        args,
+        render,
+    });
+
+    logger.read().queue_log(log_data);
+
+    true
+}
+
+#[no_mangle]
+/// Whether a log of `level` with `tag` passes the level gates, for producers that want to
+/// skip formatting. A null or empty tag checks the global level.
+/// Tags without a gate of their own follow the global level, none is created here.
+/// Gates are cached per thread, so this rarely takes a lock.
+///
+/// # Safety
+/// - `tag` must be null or point to `len` bytes, invalid UTF-8 is replaced with U+FFFD.
+pub unsafe extern "C" fn paper2_is_enabled(level: LogLevel, tag: StringRef) -> bool {
+    level_filter::is_enabled(level, unsafe { tag.to_str_lossy() }.as_deref())
+}
+
+#[no_mangle]
+/// Returns the level gate of `tag`, or the global gate for a null or empty tag.
+///
+/// The gate holds the lowest severity that is logged, ordered
+/// Debug, Info, Warn, Error, Crit, Off from 0 to 5.
+/// It stays valid for the rest of the process and should be read atomically.
+/// Past 1024 tags, new tags get the global gate unless their level was set.
+///
+/// # Safety
+/// - `tag` must be null or point to `len` bytes, invalid UTF-8 is replaced with U+FFFD.
+pub unsafe extern "C" fn paper2_get_level_gate(tag: StringRef) -> *const u8 {
+    let tag = unsafe { tag.to_str_lossy() }.unwrap_or_default();
+
+    level_filter::tag_gate(&tag).as_ptr()
+}
+
+#[no_mangle]
+/// Sets the minimum level logged by every tag without its own level.
+///
+/// # Safety
+/// - No pointers are involved.
+pub unsafe extern "C" fn paper2_set_log_level(level: LogLevel) {
+    level_filter::set_global_level(level);
+}
+
+#[no_mangle]
+/// Sets the minimum level logged for `tag`, overriding the global level.
+///
+/// # Safety
+/// - `tag` must be null or point to `len` bytes, invalid UTF-8 is replaced with U+FFFD.
+pub unsafe extern "C" fn paper2_set_tag_log_level(tag: StringRef, level: LogLevel) {
+    let tag = unsafe { tag.to_str_lossy() }.unwrap_or_default();
+
+    level_filter::set_tag_level(&tag, Some(level));
+}
+
+#[no_mangle]
+/// Makes `tag` follow the global level again.
+///
+/// # Safety
+/// - `tag` must be null or point to `len` bytes, invalid UTF-8 is replaced with U+FFFD.
+pub unsafe extern "C" fn paper2_reset_tag_log_level(tag: StringRef) {
+    let tag = unsafe { tag.to_str_lossy() }.unwrap_or_default();
+
+    level_filter::set_tag_level(&tag, None);
+}
+
 #[no_mangle]
 /// Waits for all logs to be flushed.
 ///
@@ -200,6 +884,105 @@ pub unsafe extern "C" fn paper2_wait_for_flush() -> bool {
     true
 }
 
+#[no_mangle]
+/// Writes every log queued so far to the files and cuts off what mapped files preallocated,
+/// so they end where the logs do. Waits for up to a second.
+/// Called at exit for mapped files, hosts that exit otherwise should call it at shutdown.
+pub extern "C" fn paper2_finish_files() -> bool {
+    #[cfg(feature = "file")]
+    if let Some(logger) = get_logger() {
+        return logger.read().finish_files().is_ok();
+    }
+
+    false
+}
+
+#[no_mangle]
+/// Writes the most recent logs to `fd`, oldest first, using only `write(2)`.
+/// Meant for crash handlers of the embedding process, it never blocks or allocates.
+/// Returns false without a logger, a flight recorder or the `flight_recorder` feature.
+pub extern "C" fn paper2_dump_flight_recorder(fd: c_int) -> bool {
+    #[cfg(all(unix, feature = "flight_recorder"))]
+    {
+        let Some(logger) = get_logger() else {
+            return false;
+        };
+        // a crash may interrupt a thread holding the lock for writing
+        let Some(logger) = logger.try_read() else {
+            return false;
+        };
+        let Some(recorder) = logger.flight_recorder() else {
+            return false;
+        };
+
+        crate::logger::flight_recorder::dump_to_fd(recorder, fd);
+        true
+    }
+
+    #[cfg(not(all(unix, feature = "flight_recorder")))]
+    {
+        let _ = fd;
+        false
+    }
+}
+
+#[no_mangle]
+/// Copies the logger's counters into `out`, totals since it started.
+/// Returns false without a logger, leaving `out` untouched.
+///
+/// # Safety
+/// - `out` must point to writable memory for a `LoggerStats`.
+pub unsafe extern "C" fn paper2_get_stats(out: *mut LoggerStats) -> bool {
+    let Some(logger) = get_logger() else {
+        return false;
+    };
+    if out.is_null() {
+        return false;
+    }
+
+    unsafe { out.write(logger.read().stats()) };
+    true
+}
+
+#[no_mangle]
+/// Hands the profiling zones a thread recorded to the logging thread,
+/// which appends them to the trace file.
+/// Returns false without a logger. Zones are dropped if no trace file or zone statistics
+/// are configured, or if the logging thread has too many batches waiting.
+///
+/// # Safety
+/// - `events` must point to `len` initialized events, or be null if `len` is 0.
+/// - Every event name must live for the rest of the process.
+///   Names that are not UTF-8 are left empty.
+pub unsafe extern "C" fn paper2_submit_trace_events(
+    tid: u32,
+    events: *const TraceEventC,
+    len: usize,
+) -> bool {
+    let Some(logger) = get_logger() else {
+        return false;
+    };
+
+    // nothing is copied unless a trace file or zone statistics take the zones
+    if events.is_null() || len == 0 || !logger.read().wants_traces() {
+        return true;
+    }
+
+    let events = unsafe { std::slice::from_raw_parts(events, len) }
+        .iter()
+        .map(|event| TraceEvent {
+            // SAFETY: the caller guarantees names have static storage
+            name: unsafe { event.name.as_str() }
+                .map_or("", |name| unsafe { &*(name as *const str) }),
+            start_nanos: event.start_nanos,
+            duration_nanos: event.duration_nanos,
+        })
+        .collect();
+
+    logger.read().submit_trace(TraceBatch { tid, events });
+    true
+}
+
 #[no_mangle]
 /// Gets the log directory as a C string.
 ///
@@ -266,13 +1049,26 @@ pub unsafe extern "C" fn paper2_wait_flush_timeout(timeout_ms: c_uint) -> bool {
     true
 }
 
-/// Shuts down the logger, flushing all logs.
+/// Adds a sink called with every log line, on a worker thread of its own.
 /// # Safety
-/// - Safe to call if logger is initialized.
+/// - `callback` must be safe to call from another thread with `user_data`.
 #[no_mangle]
 pub unsafe extern "C" fn paper2_add_log_sink(
     callback: LogCallbackC,
     user_data: *mut std::ffi::c_void,
+) -> bool {
+    unsafe { paper2_add_filtered_log_sink(callback, user_data, SinkFilterC::default()) }
+}
+
+/// Adds a sink called with the lines of logs passing `filter`, on a worker thread of its own.
+/// # Safety
+/// - `callback` must be safe to call from another thread with `user_data`.
+/// - `filter.tag` must be null or point to `len` bytes.
+#[no_mangle]
+pub unsafe extern "C" fn paper2_add_filtered_log_sink(
+    callback: LogCallbackC,
+    user_data: *mut std::ffi::c_void,
+    filter: SinkFilterC,
 ) -> bool {
     let Some(logger) = get_logger() else {
         return false;
@@ -281,16 +1077,70 @@ pub unsafe extern "C" fn paper2_add_log_sink(
     // Wrap the user_data pointer in an Arc<AtomicPtr<c_void>> to make it Send + Sync
     let user_data_ptr = Arc::new(AtomicPtr::new(user_data));
 
-    logger
+    let added = logger
         .write()
-        .add_sink(move |data: &LogData| -> Result<()> {
-            let c_data: LogDataC = data.into();
-            let user_data = user_data_ptr.load(Ordering::SeqCst);
-            callback(&c_data, user_data);
-            Ok(())
-        });
+        .add_filtered_sink(
+            move |data: &LogData| -> Result<()> {
+                let fields: Vec<FieldC> = data.fields.iter().map(FieldC::from).collect();
+                let c_data = LogDataC::from(data).with_fields(&fields);
+                let user_data = user_data_ptr.load(Ordering::SeqCst);
+                unsafe { callback(&c_data, user_data) };
+                Ok(())
+            },
+            unsafe { filter.to_filter() },
+        )
+        .is_ok();
+    added
+}
 
-    true
+/// Adds a sink called once per batch with the lines of every log passing `filter`,
+/// on a worker thread of its own. The records only live for the duration of the call.
+/// # Safety
+/// - `callback` must be safe to call from another thread with `user_data`.
+/// - `filter.tag` must be null or point to `len` bytes.
+#[no_mangle]
+pub unsafe extern "C" fn paper2_add_log_batch_sink(
+    callback: LogBatchCallbackC,
+    user_data: *mut std::ffi::c_void,
+    filter: SinkFilterC,
+) -> bool {
+    let Some(logger) = get_logger() else {
+        return false;
+    };
+
+    let user_data_ptr = Arc::new(AtomicPtr::new(user_data));
+
+    let added = logger
+        .write()
+        .add_batch_sink(
+            move |lines: &[LogLine]| -> Result<()> {
+                // the fields of every line in one allocation
+                let c_fields: Vec<FieldC> = lines
+                    .iter()
+                    .flat_map(|line| line.log.fields.iter().map(FieldC::from))
+                    .collect();
+
+                let mut fields_start = 0;
+                let c_lines: Vec<LogDataC> = lines
+                    .iter()
+                    .map(|line| {
+                        let fields_end = fields_start + line.log.fields.len();
+                        let mut c_data =
+                            LogDataC::from(line.log).with_fields(&c_fields[fields_start..fields_end]);
+                        c_data.message = line.message.into();
+                        fields_start = fields_end;
+                        c_data
+                    })
+                    .collect();
+
+                let user_data = user_data_ptr.load(Ordering::SeqCst);
+                unsafe { callback(c_lines.as_ptr(), c_lines.len(), user_data) };
+                Ok(())
+            },
+            unsafe { filter.to_filter() },
+        )
+        .is_ok();
+    added
 }
 
 /// Frees a C string allocated by `paper2_get_log_directory`.
@@ -311,18 +1161,116 @@ pub unsafe extern "C" fn paper2_free_c_string(s: *mut c_char) {
 /// - `context_log_path` must be a valid, null-terminated C string.
 impl From<LoggerConfigFfi> for LoggerConfig {
     fn from(ffi: LoggerConfigFfi) -> Self {
+        let queue_mode = match ffi.ring_buffer_capacity {
+            0 => QueueMode::Locked,
+            capacity => QueueMode::PerThreadRing {
+                capacity: capacity as usize,
+            },
+        };
+
+        let file_backend = match ffi.mmap_chunk_size {
+            #[cfg(all(unix, feature = "mmap"))]
+            chunk_size if chunk_size != 0 => FileBackend::Mmap {
+                chunk_size: chunk_size as usize,
+            },
+            _ if ffi.async_file_writes => FileBackend::Async,
+            _ => FileBackend::Buffered,
+        };
+
+        let overflow_policy = match ffi.overflow_policy {
+            1 => OverflowPolicy::Block,
+            2 => OverflowPolicy::DropNewest,
+            3 => OverflowPolicy::DropBelowLevel {
+                keep: LogLevel::Warn,
+            },
+            4 => OverflowPolicy::Sample {
+                one_in: ffi.overflow_sample_one_in,
+            },
+            _ => OverflowPolicy::Unbounded,
+        };
+
+        let file_format = match (ffi.binary_files, ffi.json_files) {
+            (true, _) => FileFormat::Binary,
+            (false, true) => FileFormat::JsonLines,
+            (false, false) => FileFormat::Text,
+        };
+
+        let crash_dump_path = match ffi.crash_dump_path.is_null() {
+            true => None,
+            false => Some(unsafe {
+                CStr::from_ptr(ffi.crash_dump_path)
+                    .to_string_lossy()
+                    .into_owned()
+                    .into()
+            }),
+        };
+
+        let trace_path = match ffi.trace_path.is_null() {
+            true => None,
+            false => Some(unsafe {
+                CStr::from_ptr(ffi.trace_path)
+                    .to_string_lossy()
+                    .into_owned()
+                    .into()
+            }),
+        };
+
+        let profile_report_interval = match ffi.profile_report_interval_ms {
+            0 => None,
+            millis => Some(Duration::from_millis(millis as u64)),
+        };
+
+        let stats_report_interval = match ffi.stats_report_interval_ms {
+            0 => None,
+            millis => Some(Duration::from_millis(millis as u64)),
+        };
+
+        let trim_idle_after = match ffi.trim_idle_after_ms {
+            0 => None,
+            millis => Some(Duration::from_millis(millis as u64)),
+        };
+
+        let flush_policy = FlushPolicy {
+            max_latency: Duration::from_millis(ffi.flush_max_latency_ms as u64),
+            max_dirty_bytes: ffi.flush_max_dirty_bytes as usize,
+            flush_level: ffi.flush_level,
+        };
+
         #[cfg(feature = "file")]
         {
             Self {
                 max_string_len: ffi.max_string_len as usize,
                 log_max_buffer_count: ffi.log_max_buffer_count as usize,
                 line_end: ffi.line_end as char,
+                queue_mode,
+                overflow_policy,
+                queue_max_bytes: ffi.queue_max_bytes as usize,
+                timestamp_precision: ffi.timestamp_precision.into(),
+                file_backend,
+                file_format,
+                flush_policy,
+                flight_recorder_slots: ffi.flight_recorder_slots as usize,
+                crash_dump_path,
+                trace_path,
+                profile_report_interval,
+                stats_report_interval,
+                trim_idle_after,
                 context_log_path: unsafe {
                     CStr::from_ptr(ffi.context_log_path)
                         .to_string_lossy()
                         .into_owned()
                         .into()
                 },
+                context_writer_threads: ffi.context_writer_threads as usize,
+                rotation: RotationPolicy {
+                    max_bytes: ffi.rotate_max_bytes,
+                    max_age: match ffi.rotate_max_age_seconds {
+                        0 => None,
+                        seconds => Some(Duration::from_secs(seconds)),
+                    },
+                    keep: ffi.rotate_keep as usize,
+                    compress: ffi.rotate_compress,
+                },
             }
         }
 
@@ -332,6 +1280,19 @@ impl From<LoggerConfigFfi> for LoggerConfig {
                 max_string_len: ffi.max_string_len as usize,
                 log_max_buffer_count: ffi.log_max_buffer_count as usize,
                 line_end: ffi.line_end as char,
+                queue_mode,
+                overflow_policy,
+                queue_max_bytes: ffi.queue_max_bytes as usize,
+                timestamp_precision: ffi.timestamp_precision.into(),
+                file_backend,
+                file_format,
+                flush_policy,
+                flight_recorder_slots: ffi.flight_recorder_slots as usize,
+                crash_dump_path,
+                trace_path,
+                profile_report_interval,
+                stats_report_interval,
+                trim_idle_after,
             }
         }
     }
@@ -346,12 +1307,15 @@ impl<'a> From<&'a LogData> for LogDataC<'a> {
             level: data.level,
             tag: data.tag.as_deref().into(),
             message: data.message.as_str().into(),
-            timestamp: data.timestamp.timestamp(),
+            timestamp: data.timestamp.unix_seconds(),
 
-            file: data.file.as_str().into(),
+            file: data.file.as_ref().into(),
             line: data.line,
             column: data.column,
             function_name: data.function_name.as_deref().into(),
+
+            fields: std::ptr::null(),
+            fields_len: 0,
         }
     }
 }
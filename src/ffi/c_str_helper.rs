@@ -1,4 +1,6 @@
 
+use std::borrow::Cow;
+
 /// Helper struct to manage ownership of C strings across FFI boundaries.
 /// I'm not sure if I can pass a struct using CString directly, so this is a workaround.
 #[repr(C)]
@@ -18,3 +20,36 @@ impl<'a> From<Option<&'a str>> for StringRef<'a> {
         }
     }
 }
+
+impl<'a> StringRef<'a> {
+    /// Views the referenced bytes. Returns `None` for a null pointer.
+    ///
+    /// # Safety
+    /// - The pointer must be null or point to `len` bytes that outlive `'a`.
+    pub unsafe fn as_bytes(&self) -> Option<&'a [u8]> {
+        if self.0.is_null() {
+            return None;
+        }
+
+        Some(unsafe { std::slice::from_raw_parts(self.0, self.1) })
+    }
+
+    /// Views the referenced bytes as a string. Returns `None` for a null pointer
+    /// or bytes that are not UTF-8.
+    ///
+    /// # Safety
+    /// - The pointer must be null or point to `len` bytes that outlive `'a`.
+    pub unsafe fn as_str(&self) -> Option<&'a str> {
+        std::str::from_utf8(unsafe { self.as_bytes() }?).ok()
+    }
+
+    /// Views the referenced bytes as a string, borrowed if they are UTF-8 and
+    /// with invalid sequences replaced by U+FFFD otherwise.
+    /// Returns `None` for a null pointer.
+    ///
+    /// # Safety
+    /// - The pointer must be null or point to `len` bytes that outlive `'a`.
+    pub unsafe fn to_str_lossy(&self) -> Option<Cow<'a, str>> {
+        unsafe { self.as_bytes() }.map(String::from_utf8_lossy)
+    }
+}
@@ -7,6 +7,7 @@ use std::{backtrace, path::PathBuf, sync::OnceLock};
 pub mod log_level;
 pub mod logger;
 pub mod vec_pool;
+mod ring_buffer;
 mod semaphore_lite;
 
 static LOGGER: OnceLock<ThreadSafeLoggerThread> = OnceLock::new();
@@ -63,6 +64,12 @@ pub fn get_logger() -> Option<ThreadSafeLoggerThread> {
 pub fn init_logger(config: LoggerConfig, path: PathBuf) -> Result<ThreadSafeLoggerThread> {
     let res = LOGGER
         .get_or_init(|| {
+            // the logging thread never exits, mapped files are finished on exit instead
+            #[cfg(all(unix, feature = "mmap"))]
+            if matches!(config.file_backend, logger::FileBackend::Mmap { .. }) {
+                unsafe { libc::atexit(finish_files_at_exit) };
+            }
+
             let logger = LoggerThreadCtx::new(config, path).expect("Unable to create logger");
 
             logger.init(false).expect("Unable to init logger")
@@ -71,3 +78,11 @@ pub fn init_logger(config: LoggerConfig, path: PathBuf) -> Result<ThreadSafeLogg
 
     Ok(res)
 }
+
+/// Cuts off the chunks mapped files preallocated, which would otherwise end them in zeroes
+#[cfg(all(unix, feature = "mmap"))]
+extern "C" fn finish_files_at_exit() {
+    if let Some(logger) = get_logger() {
+        let _ = logger.read().finish_files();
+    }
+}
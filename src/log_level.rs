@@ -1,7 +1,7 @@
 use std::fmt::Display;
 
 #[repr(C)]
-#[derive(Debug, Clone, Copy)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
 pub enum LogLevel {
     Info,
     Warn,
@@ -12,6 +12,19 @@ pub enum LogLevel {
 }
 
 impl LogLevel {
+    /// Position in the severity order, from `Debug` (0) to `Off`.
+    /// The discriminants follow the FFI enum and are not ordered.
+    pub const fn severity(self) -> u8 {
+        match self {
+            LogLevel::Debug => 0,
+            LogLevel::Info => 1,
+            LogLevel::Warn => 2,
+            LogLevel::Error => 3,
+            LogLevel::Crit => 4,
+            LogLevel::Off => 5,
+        }
+    }
+
     pub fn short(&self) -> char {
         match self {
             LogLevel::Info => 'I',
@@ -24,6 +37,23 @@ impl LogLevel {
     }
 }
 
+impl TryFrom<u8> for LogLevel {
+    type Error = u8;
+
+    /// Reads back the discriminant of a level, as stored by `level as u8`
+    fn try_from(value: u8) -> Result<Self, u8> {
+        match value {
+            0 => Ok(LogLevel::Info),
+            1 => Ok(LogLevel::Warn),
+            2 => Ok(LogLevel::Error),
+            3 => Ok(LogLevel::Debug),
+            4 => Ok(LogLevel::Crit),
+            5 => Ok(LogLevel::Off),
+            value => Err(value),
+        }
+    }
+}
+
 impl Display for LogLevel {
     fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
         match self {
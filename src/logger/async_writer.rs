@@ -0,0 +1,209 @@
+//! Log files written by a dedicated I/O thread.
+//!
+//! The logging thread only appends to in-memory buffers. A flush swaps every file's
+//! buffer for a spare and hands all of them to the I/O thread in one request,
+//! so the logging thread keeps draining the queue while the writes happen.
+//!
+//! Only a few requests can be in flight. When the disk can't keep up the logging thread
+//! waits for the I/O thread, the queue fills and its overflow policy decides what
+//! happens to new logs, instead of the pending buffers growing without bound.
+
+use std::{
+    fs::File,
+    io::{self, IoSlice, Write},
+    mem,
+    path::Path,
+    sync::{
+        atomic::{AtomicU64, Ordering},
+        mpsc::{self, Receiver, SyncSender},
+        Arc,
+    },
+    thread,
+};
+
+use parking_lot::Mutex;
+use rustc_hash::FxHashMap;
+
+use crate::semaphore_lite::SemaphoreLite;
+
+pub type FileId = u64;
+
+/// A file's buffer is handed off early once it grows past this
+const SUBMIT_THRESHOLD: usize = 256 * 1024;
+/// Spare buffers kept around for reuse
+const MAX_SPARE_BUFFERS: usize = 64;
+/// Requests queued for the I/O thread before submitting blocks
+const MAX_PENDING_REQUESTS: usize = 8;
+
+enum IoRequest {
+    Open(FileId, File),
+    Write {
+        buffers: Vec<(FileId, Vec<u8>)>,
+        /// Signaled once every buffer of this and earlier requests was written
+        done: Option<Arc<SemaphoreLite>>,
+    },
+    Close(FileId),
+}
+
+struct IoShared {
+    spare_buffers: Mutex<Vec<Vec<u8>>>,
+    /// First write error since the last submit, reported by the next one
+    error: Mutex<Option<io::Error>>,
+}
+
+/// Handle to the I/O thread. The thread exits once every handle and file is dropped.
+#[derive(Clone)]
+pub struct IoWorker {
+    sender: SyncSender<IoRequest>,
+    shared: Arc<IoShared>,
+    next_id: Arc<AtomicU64>,
+}
+
+impl IoWorker {
+    pub fn spawn() -> io::Result<Self> {
+        let (sender, receiver) = mpsc::sync_channel(MAX_PENDING_REQUESTS);
+        let shared = Arc::new(IoShared {
+            spare_buffers: Mutex::new(Vec::new()),
+            error: Mutex::new(None),
+        });
+
+        let thread_shared = Arc::clone(&shared);
+        thread::Builder::new()
+            .name("paper2-io".to_string())
+            .spawn(move || io_thread(receiver, thread_shared))?;
+
+        Ok(IoWorker {
+            sender,
+            shared,
+            next_id: Arc::new(AtomicU64::new(0)),
+        })
+    }
+
+    fn send(&self, request: IoRequest) -> io::Result<()> {
+        self.sender
+            .send(request)
+            .map_err(|_| io::Error::new(io::ErrorKind::BrokenPipe, "I/O thread exited"))
+    }
+
+    /// Hands buffers to the I/O thread in one request, waiting while it is
+    /// [`MAX_PENDING_REQUESTS`] behind. `done` is signaled once they are written.
+    /// Reports errors of earlier writes.
+    pub fn submit(
+        &self,
+        buffers: Vec<(FileId, Vec<u8>)>,
+        done: Option<Arc<SemaphoreLite>>,
+    ) -> io::Result<()> {
+        if let Some(e) = self.shared.error.lock().take() {
+            return Err(e);
+        }
+
+        if buffers.is_empty() && done.is_none() {
+            return Ok(());
+        }
+
+        self.send(IoRequest::Write { buffers, done })
+    }
+
+    fn spare_buffer(&self) -> Vec<u8> {
+        self.shared.spare_buffers.lock().pop().unwrap_or_default()
+    }
+}
+
+fn io_thread(receiver: Receiver<IoRequest>, shared: Arc<IoShared>) {
+    let mut files: FxHashMap<FileId, File> = FxHashMap::default();
+
+    for request in receiver {
+        match request {
+            IoRequest::Open(id, file) => {
+                files.insert(id, file);
+            }
+            IoRequest::Write { buffers, done } => {
+                for (id, mut buffer) in buffers {
+                    if let Some(file) = files.get_mut(&id) {
+                        if let Err(e) = file.write_all(&buffer) {
+                            shared.error.lock().get_or_insert(e);
+                        }
+                    }
+
+                    buffer.clear();
+                    let mut spare_buffers = shared.spare_buffers.lock();
+                    if spare_buffers.len() < MAX_SPARE_BUFFERS {
+                        spare_buffers.push(buffer);
+                    }
+                }
+
+                if let Some(done) = done {
+                    done.signal();
+                }
+            }
+            IoRequest::Close(id) => {
+                files.remove(&id);
+            }
+        }
+    }
+}
+
+/// A file written by an [`IoWorker`]. Writes only append to memory.
+pub struct AsyncFile {
+    id: FileId,
+    buffer: Vec<u8>,
+    worker: IoWorker,
+}
+
+impl AsyncFile {
+    /// Creates or truncates `path`, to be written by `worker`.
+    pub fn create(path: impl AsRef<Path>, worker: &IoWorker) -> io::Result<Self> {
+        let file = File::create(path)?;
+        let id = worker.next_id.fetch_add(1, Ordering::Relaxed);
+        worker.send(IoRequest::Open(id, file))?;
+
+        Ok(AsyncFile {
+            id,
+            buffer: worker.spare_buffer(),
+            worker: worker.clone(),
+        })
+    }
+
+    /// Takes everything written since the last call, leaving a spare buffer in its place.
+    pub fn take_pending(&mut self) -> Option<(FileId, Vec<u8>)> {
+        if self.buffer.is_empty() {
+            return None;
+        }
+
+        let spare = self.worker.spare_buffer();
+        Some((self.id, mem::replace(&mut self.buffer, spare)))
+    }
+}
+
+impl Write for AsyncFile {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        self.buffer.extend_from_slice(buf);
+
+        if self.buffer.len() >= SUBMIT_THRESHOLD {
+            self.flush()?;
+        }
+
+        Ok(buf.len())
+    }
+
+    fn write_vectored(&mut self, bufs: &[IoSlice<'_>]) -> io::Result<usize> {
+        let mut written = 0;
+        for buf in bufs {
+            written += self.write(buf)?;
+        }
+        Ok(written)
+    }
+
+    /// Submits this file alone. Prefer submitting every file at once with [`IoWorker::submit`].
+    fn flush(&mut self) -> io::Result<()> {
+        let pending = self.take_pending().into_iter().collect();
+        self.worker.submit(pending, None)
+    }
+}
+
+impl Drop for AsyncFile {
+    fn drop(&mut self) {
+        let _ = self.flush();
+        let _ = self.worker.send(IoRequest::Close(self.id));
+    }
+}
@@ -0,0 +1,342 @@
+//! Compact binary log files.
+//!
+//! A file starts with [`MAGIC`], the format version and the record schema. After that it
+//! is a stream of entries, each starting with a kind byte:
+//!
+//! - `DEFINE`: a varint id and a length prefixed string. Tags, files and function names
+//!   are written once and referred to by id afterwards.
+//! - `RECORD`: the level, the zigzag varint distance in nanoseconds to the previous
+//!   record's timestamp, varint ids for tag, file and function (0 for none), varint
+//!   line and column, and the length prefixed message.
+//!
+//! Each file has its own dictionary, so a rotated segment decodes on its own.
+
+use std::{
+    borrow::Cow,
+    io::{self, Read, Write},
+    sync::Arc,
+};
+
+use chrono::{Local, NaiveDateTime, TimeZone};
+use rustc_hash::FxHashMap;
+
+use super::{
+    clock::{TimestampFormatter, TimestampPrecision},
+    log_data::DEFAULT_TAG,
+    LogData,
+};
+use crate::log_level::LogLevel;
+
+pub const MAGIC: &[u8; 8] = b"PAPER2\0B";
+pub const VERSION: u8 = 1;
+/// Describes the record layout, stored in the header for readers of other versions
+pub const SCHEMA: &str = "level:u8 time:zigzag_delta_nanos tag:str_id file:str_id \
+                          function:str_id line:u32 column:u32 message:str";
+
+const DEFINE: u8 = 1;
+const RECORD: u8 = 2;
+/// Id written for a missing tag or function
+const NONE_ID: u32 = 0;
+
+/// Writes log records in the binary format, one encoder per file.
+#[derive(Debug, Default)]
+pub struct BinaryEncoder {
+    strings: FxHashMap<Box<str>, u32>,
+    last_timestamp: i64,
+    /// Entries are assembled here and written with a single call
+    scratch: Vec<u8>,
+}
+
+impl BinaryEncoder {
+    /// The file header. Forgets everything encoded for a previous file.
+    pub fn header(&mut self) -> &[u8] {
+        self.strings.clear();
+        self.last_timestamp = 0;
+
+        self.scratch.clear();
+        self.scratch.extend_from_slice(MAGIC);
+        self.scratch.push(VERSION);
+        put_str(&mut self.scratch, SCHEMA);
+        &self.scratch
+    }
+
+    /// Encodes one line of `log`, preceded by the strings this file hasn't seen yet.
+    pub fn encode(&mut self, log: &LogData, message: &str) -> &[u8] {
+        self.scratch.clear();
+
+        let tag = self.string_id(log.tag.as_deref());
+        let file = self.string_id(Some(&log.file));
+        let function = self.string_id(log.function_name.as_deref());
+
+        let timestamp = log.timestamp.unix_nanos();
+        let delta = timestamp.wrapping_sub(self.last_timestamp);
+        self.last_timestamp = timestamp;
+
+        let out = &mut self.scratch;
+        out.push(RECORD);
+        out.push(log.level as u8);
+        put_varint(out, zigzag(delta));
+        put_varint(out, tag as u64);
+        put_varint(out, file as u64);
+        put_varint(out, function as u64);
+        put_varint(out, log.line as u64);
+        put_varint(out, log.column as u64);
+        put_str(out, message);
+
+        &self.scratch
+    }
+
+    /// Id of `string`, appending its definition to the scratch buffer the first time
+    fn string_id(&mut self, string: Option<&str>) -> u32 {
+        let Some(string) = string else {
+            return NONE_ID;
+        };
+
+        if let Some(&id) = self.strings.get(string) {
+            return id;
+        }
+
+        let id = self.strings.len() as u32 + 1;
+        self.strings.insert(string.into(), id);
+
+        self.scratch.push(DEFINE);
+        put_varint(&mut self.scratch, id as u64);
+        put_str(&mut self.scratch, string);
+        id
+    }
+}
+
+fn zigzag(value: i64) -> u64 {
+    ((value << 1) ^ (value >> 63)) as u64
+}
+
+fn unzigzag(value: u64) -> i64 {
+    (value >> 1) as i64 ^ -((value & 1) as i64)
+}
+
+fn put_varint(out: &mut Vec<u8>, mut value: u64) {
+    while value >= 0x80 {
+        out.push(value as u8 | 0x80);
+        value >>= 7;
+    }
+    out.push(value as u8);
+}
+
+fn put_str(out: &mut Vec<u8>, string: &str) {
+    put_varint(out, string.len() as u64);
+    out.extend_from_slice(string.as_bytes());
+}
+
+/// A record read back from a binary log file.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct DecodedRecord {
+    pub level: LogLevel,
+    /// Nanoseconds since the unix epoch
+    pub unix_nanos: i64,
+    pub tag: Option<Arc<str>>,
+    pub file: Arc<str>,
+    pub line: u32,
+    pub column: u32,
+    pub function_name: Option<Arc<str>>,
+    pub message: String,
+}
+
+impl DecodedRecord {
+    /// Writes the record the way the text files would have,
+    /// `I 2024-01-01 12:00:00 [tag] [file:1:2 @ function] message`.
+    pub fn write_text(
+        &self,
+        writer: &mut impl Write,
+        formatter: &mut TimestampFormatter,
+        precision: TimestampPrecision,
+    ) -> io::Result<()> {
+        writeln!(
+            writer,
+            "{level} {time} [{tag}] [{file}:{line}:{column} @ {function_name}] {message}",
+            level = self.level.short(),
+            time = formatter.format_unix(self.unix_nanos, precision),
+            tag = self.tag.as_deref().unwrap_or(DEFAULT_TAG),
+            file = self.file,
+            line = self.line,
+            column = self.column,
+            function_name = self.function_name.as_deref().unwrap_or("default"),
+            message = self.message,
+        )
+    }
+}
+
+/// Which decoded records to keep. Unset limits keep everything.
+#[derive(Debug, Default)]
+pub struct RecordFilter {
+    pub min_level: Option<LogLevel>,
+    /// Records with any of these tags, or any record if empty
+    pub tags: Vec<String>,
+    /// Unix nanoseconds of the first record kept
+    pub since: Option<i64>,
+    /// Unix nanoseconds records are kept before
+    pub until: Option<i64>,
+}
+
+impl RecordFilter {
+    pub fn matches(&self, record: &DecodedRecord) -> bool {
+        self.min_level
+            .is_none_or(|min_level| record.level.severity() >= min_level.severity())
+            && (self.tags.is_empty()
+                || record
+                    .tag
+                    .as_deref()
+                    .is_some_and(|tag| self.tags.iter().any(|wanted| wanted == tag)))
+            && self.since.is_none_or(|since| record.unix_nanos >= since)
+            && self.until.is_none_or(|until| record.unix_nanos < until)
+    }
+}
+
+/// Unix nanoseconds of `time`, given as unix seconds or local `YYYY-MM-DD HH:MM:SS`
+pub fn parse_time(time: &str) -> Option<i64> {
+    if let Ok(seconds) = time.parse::<i64>() {
+        return seconds.checked_mul(1_000_000_000);
+    }
+
+    NaiveDateTime::parse_from_str(time, "%Y-%m-%d %H:%M:%S")
+        .ok()
+        .and_then(|time| Local.from_local_datetime(&time).earliest())
+        .and_then(|time| time.timestamp_nanos_opt())
+}
+
+/// Reads the records of a binary log file.
+pub struct BinaryDecoder<R> {
+    reader: R,
+    /// Index 0 is [`NONE_ID`]
+    strings: Vec<Option<Arc<str>>>,
+    last_timestamp: i64,
+}
+
+impl<R: Read> BinaryDecoder<R> {
+    /// Reads and checks the file header.
+    pub fn new(mut reader: R) -> io::Result<Self> {
+        let mut magic = [0; MAGIC.len()];
+        reader.read_exact(&mut magic)?;
+        if &magic != MAGIC {
+            return Err(invalid_data("not a paper2 binary log"));
+        }
+
+        let mut version = [0];
+        reader.read_exact(&mut version)?;
+        if version[0] != VERSION {
+            return Err(invalid_data(format!(
+                "unsupported binary log version {}",
+                version[0]
+            )));
+        }
+
+        let mut decoder = BinaryDecoder {
+            reader,
+            strings: vec![None],
+            last_timestamp: 0,
+        };
+        // the schema only matters to other versions
+        decoder.read_string()?;
+        Ok(decoder)
+    }
+
+    /// The next record, or `None` at the end of the file.
+    /// A file cut off in the middle of a record is an error.
+    pub fn next_record(&mut self) -> io::Result<Option<DecodedRecord>> {
+        loop {
+            let mut kind = [0];
+            match self.reader.read(&mut kind) {
+                Ok(0) => return Ok(None),
+                Ok(_) => {}
+                Err(e) if e.kind() == io::ErrorKind::Interrupted => continue,
+                Err(e) => return Err(e),
+            }
+
+            match kind[0] {
+                DEFINE => {
+                    let id = self.read_varint()? as usize;
+                    let string: Arc<str> = self.read_string()?.into();
+                    if id != self.strings.len() {
+                        return Err(invalid_data(format!("string {id} defined out of order")));
+                    }
+                    self.strings.push(Some(string));
+                }
+                RECORD => return self.read_record().map(Some),
+                // the zeroed tail a memory mapped file leaves after a crash
+                0 => return Ok(None),
+                kind => return Err(invalid_data(format!("unknown entry kind {kind}"))),
+            }
+        }
+    }
+
+    fn read_record(&mut self) -> io::Result<DecodedRecord> {
+        let mut level = [0];
+        self.reader.read_exact(&mut level)?;
+        let level = LogLevel::try_from(level[0])
+            .map_err(|level| invalid_data(format!("unknown level {level}")))?;
+
+        let delta = unzigzag(self.read_varint()?);
+        self.last_timestamp = self.last_timestamp.wrapping_add(delta);
+
+        let tag = self.read_string_id()?;
+        let file = self.read_string_id()?.unwrap_or_else(|| "".into());
+        let function_name = self.read_string_id()?;
+        let line = self.read_varint()? as u32;
+        let column = self.read_varint()? as u32;
+        let message = self.read_string()?;
+
+        Ok(DecodedRecord {
+            level,
+            unix_nanos: self.last_timestamp,
+            tag,
+            file,
+            line,
+            column,
+            function_name,
+            message,
+        })
+    }
+
+    fn read_string_id(&mut self) -> io::Result<Option<Arc<str>>> {
+        let id = self.read_varint()? as usize;
+        self.strings
+            .get(id)
+            .cloned()
+            .ok_or_else(|| invalid_data(format!("undefined string {id}")))
+    }
+
+    fn read_varint(&mut self) -> io::Result<u64> {
+        let mut value = 0;
+        for shift in (0..64).step_by(7) {
+            let mut byte = [0];
+            self.reader.read_exact(&mut byte)?;
+            value |= ((byte[0] & 0x7f) as u64) << shift;
+            if byte[0] & 0x80 == 0 {
+                return Ok(value);
+            }
+        }
+        Err(invalid_data("varint too long"))
+    }
+
+    fn read_string(&mut self) -> io::Result<String> {
+        let len = self.read_varint()?;
+        // a corrupt length must not allocate more than the file holds
+        let mut bytes = Vec::new();
+        (&mut self.reader).take(len).read_to_end(&mut bytes)?;
+        if bytes.len() as u64 != len {
+            return Err(io::ErrorKind::UnexpectedEof.into());
+        }
+        String::from_utf8(bytes).map_err(|e| invalid_data(e.to_string()))
+    }
+}
+
+impl<R: Read> Iterator for BinaryDecoder<R> {
+    type Item = io::Result<DecodedRecord>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        self.next_record().transpose()
+    }
+}
+
+fn invalid_data(message: impl Into<Cow<'static, str>>) -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidData, message.into().into_owned())
+}
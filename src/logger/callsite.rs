@@ -0,0 +1,199 @@
+use std::{
+    borrow::Cow,
+    ptr,
+    sync::{
+        atomic::{AtomicPtr, Ordering},
+        LazyLock,
+    },
+};
+
+use parking_lot::Mutex;
+use rustc_hash::{FxHashMap, FxHashSet};
+
+use crate::log_level::LogLevel;
+
+use super::{
+    level_filter::{self, LevelGate},
+    LogData,
+};
+
+/// Identifies a registered [`Callsite`]. 0 is never a valid id.
+pub type CallsiteId = u32;
+
+const CHUNK_SIZE: usize = 1024;
+const MAX_CHUNKS: usize = 256;
+/// Bytes of tags, files and function names kept for the rest of the process
+const MAX_INTERNED_BYTES: usize = 4 * 1024 * 1024;
+
+type Chunk = [AtomicPtr<Registered>; CHUNK_SIZE];
+
+/// Static metadata of a log statement, registered once and shared by every log it makes.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct Callsite {
+    pub level: LogLevel,
+    pub tag: Option<&'static str>,
+    pub file: &'static str,
+    pub line: u32,
+    pub column: u32,
+    pub function_name: Option<&'static str>,
+}
+
+/// A callsite and the level gate of its tag, leaked together when registered
+struct Registered {
+    callsite: Callsite,
+    gate: &'static LevelGate,
+}
+
+#[derive(Default)]
+struct CallsiteRegistry {
+    ids: FxHashMap<Callsite, CallsiteId>,
+    strings: FxHashSet<&'static str>,
+    interned_bytes: usize,
+    len: usize,
+}
+
+/// Append-only table, so lookups never need to take a lock.
+static CHUNKS: [AtomicPtr<Chunk>; MAX_CHUNKS] = [const { AtomicPtr::new(ptr::null_mut()) }; MAX_CHUNKS];
+
+/// Serializes registration
+static REGISTRY: LazyLock<Mutex<CallsiteRegistry>> = LazyLock::new(Default::default);
+
+/// Returns a process lifetime copy of `s`, allocating only the first time it is seen.
+/// Interned strings are never freed, `None` once they take up [`MAX_INTERNED_BYTES`].
+pub fn intern(s: &str) -> Option<&'static str> {
+    REGISTRY.lock().intern(s)
+}
+
+/// Registers a callsite and returns its id.
+/// Registering the same metadata again returns the same id.
+/// Callsites and their strings are kept for the rest of the process, so this is meant
+/// for log statements, not for tags made up at runtime.
+/// Returns `None` once the registry or the interned strings are full.
+pub fn register(
+    level: LogLevel,
+    tag: Option<&str>,
+    file: &str,
+    line: u32,
+    column: u32,
+    function_name: Option<&str>,
+) -> Option<CallsiteId> {
+    let mut registry = REGISTRY.lock();
+
+    // a full registry can only find callsites, whose strings were interned already
+    let full = registry.len >= CHUNK_SIZE * MAX_CHUNKS;
+    let mut intern = |s: &str| match full {
+        true => registry.strings.get(s).copied(),
+        false => registry.intern(s),
+    };
+
+    let callsite = Callsite {
+        level,
+        tag: match tag {
+            Some(tag) => Some(intern(tag)?),
+            None => None,
+        },
+        file: intern(file)?,
+        line,
+        column,
+        function_name: match function_name {
+            Some(function) => Some(intern(function)?),
+            None => None,
+        },
+    };
+
+    if let Some(id) = registry.ids.get(&callsite) {
+        return Some(*id);
+    }
+
+    let index = registry.len;
+    if full {
+        return None;
+    }
+
+    let chunk_slot = &CHUNKS[index / CHUNK_SIZE];
+    let mut chunk = chunk_slot.load(Ordering::Acquire);
+    if chunk.is_null() {
+        let new_chunk: Box<Chunk> =
+            Box::new([const { AtomicPtr::new(ptr::null_mut()) }; CHUNK_SIZE]);
+        chunk = Box::into_raw(new_chunk);
+        chunk_slot.store(chunk, Ordering::Release);
+    }
+
+    let gate = level_filter::tag_gate(callsite.tag.unwrap_or_default());
+    let leaked = Box::into_raw(Box::new(Registered { callsite, gate }));
+    // SAFETY: chunks are never freed
+    let chunk = unsafe { &*chunk };
+    chunk[index % CHUNK_SIZE].store(leaked, Ordering::Release);
+
+    let id = (index + 1) as CallsiteId;
+    registry.len += 1;
+    registry.ids.insert(callsite, id);
+
+    Some(id)
+}
+
+/// Looks up a registered callsite. This never blocks.
+pub fn get(id: CallsiteId) -> Option<&'static Callsite> {
+    lookup(id).map(|registered| &registered.callsite)
+}
+
+/// Looks up a registered callsite along with the level gate of its tag. This never blocks.
+pub fn get_gated(id: CallsiteId) -> Option<(&'static Callsite, &'static LevelGate)> {
+    lookup(id).map(|registered| (&registered.callsite, registered.gate))
+}
+
+impl Callsite {
+    /// Whether its logs pass the level of its tag, `gate` being the one [`get_gated`] returned
+    #[inline]
+    pub fn enabled(&self, gate: &LevelGate) -> bool {
+        level_filter::gate_allows(gate, self.level)
+    }
+}
+
+fn lookup(id: CallsiteId) -> Option<&'static Registered> {
+    let index = id.checked_sub(1)? as usize;
+
+    let chunk = CHUNKS.get(index / CHUNK_SIZE)?.load(Ordering::Acquire);
+    if chunk.is_null() {
+        return None;
+    }
+
+    // SAFETY: chunks and callsites are leaked and never freed
+    let chunk = unsafe { &*chunk };
+    let callsite = chunk[index % CHUNK_SIZE].load(Ordering::Acquire);
+    unsafe { callsite.as_ref() }
+}
+
+impl CallsiteRegistry {
+    fn intern(&mut self, s: &str) -> Option<&'static str> {
+        if let Some(interned) = self.strings.get(s) {
+            return Some(interned);
+        }
+
+        if self.interned_bytes + s.len() > MAX_INTERNED_BYTES {
+            return None;
+        }
+
+        let interned: &'static str = Box::leak(s.to_owned().into_boxed_str());
+        self.strings.insert(interned);
+        self.interned_bytes += s.len();
+        Some(interned)
+    }
+}
+
+impl LogData {
+    /// Creates a log from a registered callsite. Only the message is owned.
+    pub fn from_callsite(id: CallsiteId, callsite: &'static Callsite, message: String) -> Self {
+        LogData {
+            level: callsite.level,
+            tag: callsite.tag.map(Cow::Borrowed),
+            message,
+            file: Cow::Borrowed(callsite.file),
+            line: callsite.line,
+            column: callsite.column,
+            function_name: callsite.function_name.map(Cow::Borrowed),
+            callsite: Some(id),
+            ..Default::default()
+        }
+    }
+}
@@ -0,0 +1,237 @@
+//! Cheap log timestamps.
+//!
+//! Producers only read the monotonic clock. The logging thread turns that into wall time
+//! and reuses the formatted date until the second changes.
+//!
+//! The monotonic clock stops while the device sleeps, so the logging thread moves the
+//! anchor to the wall clock whenever they drift apart, see [`reanchor`]. Small wall clock
+//! corrections are not followed. Every timestamp keeps the generation of the anchor it
+//! was taken with, so logs still queued when the anchor moves keep their wall time.
+
+use std::{
+    cell::RefCell,
+    fmt::Write,
+    sync::{
+        atomic::{AtomicI64, AtomicU8, Ordering},
+        LazyLock,
+    },
+    time::{Instant, SystemTime, UNIX_EPOCH},
+};
+
+use chrono::{DateTime, Local, TimeZone};
+
+const NANOS_PER_SEC: i64 = 1_000_000_000;
+const TIME_FORMAT: &str = "%Y-%m-%d %H:%M:%S";
+/// Drift between the clocks [`reanchor`] leaves alone
+const REANCHOR_TOLERANCE_NANOS: i64 = 50_000_000;
+
+/// Low bits of a [`Timestamp`] holding the generation of its anchor
+const GENERATION_BITS: u32 = 8;
+/// Anchors kept for timestamps taken before [`reanchor`] moved it, slots are reused after that
+const ANCHOR_GENERATIONS: usize = 1 << GENERATION_BITS;
+
+struct ClockAnchor {
+    instant: Instant,
+    /// Wall time at `instant`, by generation
+    unix_nanos: [AtomicI64; ANCHOR_GENERATIONS],
+    /// Generation timestamps are taken with, moved by [`reanchor`]
+    generation: AtomicU8,
+}
+
+static ANCHOR: LazyLock<ClockAnchor> = LazyLock::new(|| ClockAnchor {
+    instant: Instant::now(),
+    unix_nanos: std::array::from_fn(|_| AtomicI64::new(unix_now())),
+    generation: AtomicU8::new(0),
+});
+
+fn unix_now() -> i64 {
+    SystemTime::now()
+        .duration_since(UNIX_EPOCH)
+        .map(|duration| duration.as_nanos() as i64)
+        .unwrap_or_default()
+}
+
+/// Re-anchors wall time if it drifted from the monotonic clock, which doesn't advance
+/// while the device sleeps. Called by the logging thread before it takes a batch.
+/// Only timestamps taken afterwards use the new anchor.
+pub fn reanchor() {
+    let anchor = &*ANCHOR;
+    let generation = anchor.generation.load(Ordering::Acquire);
+    let elapsed = anchor.instant.elapsed().as_nanos() as i64;
+    let now = unix_now();
+
+    let expected = anchor.unix_nanos[generation as usize].load(Ordering::Relaxed) + elapsed;
+    if (now - expected).abs() > REANCHOR_TOLERANCE_NANOS {
+        let next = generation.wrapping_add(1);
+        anchor.unix_nanos[next as usize].store(now - elapsed, Ordering::Relaxed);
+        // another logging thread may have moved it already, its anchor is as good
+        let _ = anchor.generation.compare_exchange(
+            generation,
+            next,
+            Ordering::Release,
+            Ordering::Relaxed,
+        );
+    }
+}
+
+/// A point in time, in nanoseconds on the process monotonic clock,
+/// along with the generation of the anchor that maps it to wall time.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord, Hash)]
+pub struct Timestamp(u64);
+
+impl Timestamp {
+    #[inline]
+    pub fn now() -> Self {
+        let anchor = &*ANCHOR;
+        let generation = anchor.generation.load(Ordering::Acquire);
+        let nanos = anchor.instant.elapsed().as_nanos() as u64;
+        Timestamp(nanos << GENERATION_BITS | generation as u64)
+    }
+
+    /// Nanoseconds since the process clock anchor
+    pub fn monotonic_nanos(&self) -> u64 {
+        self.0 >> GENERATION_BITS
+    }
+
+    pub fn unix_nanos(&self) -> i64 {
+        let generation = (self.0 & (ANCHOR_GENERATIONS as u64 - 1)) as usize;
+        ANCHOR.unix_nanos[generation].load(Ordering::Relaxed) + self.monotonic_nanos() as i64
+    }
+
+    pub fn unix_seconds(&self) -> i64 {
+        self.unix_nanos().div_euclid(NANOS_PER_SEC)
+    }
+
+    pub fn to_local(&self) -> DateTime<Local> {
+        Local.timestamp_nanos(self.unix_nanos())
+    }
+}
+
+impl Default for Timestamp {
+    fn default() -> Self {
+        Timestamp::now()
+    }
+}
+
+/// Digits shown after the seconds of a timestamp.
+#[repr(u8)]
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub enum TimestampPrecision {
+    #[default]
+    Seconds = 0,
+    Millis = 1,
+    Micros = 2,
+}
+
+impl From<u8> for TimestampPrecision {
+    fn from(value: u8) -> Self {
+        match value {
+            1 => TimestampPrecision::Millis,
+            2 => TimestampPrecision::Micros,
+            _ => TimestampPrecision::Seconds,
+        }
+    }
+}
+
+/// Precision used by every log output
+static PRECISION: AtomicU8 = AtomicU8::new(TimestampPrecision::Seconds as u8);
+
+pub fn set_precision(precision: TimestampPrecision) {
+    PRECISION.store(precision as u8, Ordering::Relaxed);
+}
+
+pub fn precision() -> TimestampPrecision {
+    PRECISION.load(Ordering::Relaxed).into()
+}
+
+/// Formats timestamps, only asking chrono again when the second changes.
+#[derive(Debug)]
+pub struct TimestampFormatter {
+    /// Unix second of the cached prefix
+    second: i64,
+    buffer: String,
+    prefix_len: usize,
+}
+
+impl Default for TimestampFormatter {
+    fn default() -> Self {
+        TimestampFormatter {
+            second: i64::MIN,
+            buffer: String::with_capacity(32),
+            prefix_len: 0,
+        }
+    }
+}
+
+impl TimestampFormatter {
+    pub fn format(&mut self, timestamp: Timestamp, precision: TimestampPrecision) -> &str {
+        self.format_unix(timestamp.unix_nanos(), precision)
+    }
+
+    /// Formats wall time given in nanoseconds since the unix epoch,
+    /// for timestamps read back from a log file
+    pub fn format_unix(&mut self, unix_nanos: i64, precision: TimestampPrecision) -> &str {
+        let second = unix_nanos.div_euclid(NANOS_PER_SEC);
+        let subsec_nanos = unix_nanos.rem_euclid(NANOS_PER_SEC) as u32;
+
+        if second != self.second {
+            self.buffer.clear();
+            let _ = write!(
+                self.buffer,
+                "{}",
+                Local
+                    .timestamp_nanos(second * NANOS_PER_SEC)
+                    .format(TIME_FORMAT)
+            );
+            self.prefix_len = self.buffer.len();
+            self.second = second;
+        }
+
+        self.buffer.truncate(self.prefix_len);
+        match precision {
+            TimestampPrecision::Seconds => {}
+            TimestampPrecision::Millis => {
+                push_fraction(&mut self.buffer, subsec_nanos / 1_000_000, 3)
+            }
+            TimestampPrecision::Micros => push_fraction(&mut self.buffer, subsec_nanos / 1_000, 6),
+        }
+
+        &self.buffer
+    }
+}
+
+/// Appends `.` and `value` zero padded to `digits`
+fn push_fraction(buffer: &mut String, mut value: u32, digits: usize) {
+    let mut fraction = [b'0'; 6];
+    for digit in fraction[..digits].iter_mut().rev() {
+        *digit = b'0' + (value % 10) as u8;
+        value /= 10;
+    }
+
+    buffer.push('.');
+    // only ASCII digits were written
+    buffer.push_str(std::str::from_utf8(&fraction[..digits]).unwrap());
+}
+
+thread_local! {
+    static FORMATTER: RefCell<TimestampFormatter> = RefCell::new(TimestampFormatter::default());
+}
+
+/// Calls `f` with `timestamp` formatted at the configured precision,
+/// using the calling thread's cached formatter.
+pub fn with_formatted<R>(timestamp: Timestamp, f: impl FnOnce(&str) -> R) -> R {
+    let mut f = Some(f);
+    let result = FORMATTER.try_with(|formatter| {
+        let Ok(mut formatter) = formatter.try_borrow_mut() else {
+            return None;
+        };
+        let f = f.take().unwrap();
+        Some(f(formatter.format(timestamp, precision())))
+    });
+
+    match result {
+        Ok(Some(result)) => result,
+        // thread locals are gone or we are nested, format without the cache
+        _ => f.take().unwrap()(TimestampFormatter::default().format(timestamp, precision())),
+    }
+}
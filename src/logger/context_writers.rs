@@ -0,0 +1,237 @@
+//! Context files written by a small pool of threads.
+//!
+//! Each context file belongs to one writer, picked by its slot, and every writer handles
+//! its requests in order, so the logs of a context stay in order. The logging thread keeps
+//! resolving which context a log goes to and writes the global file itself. Writers get
+//! the batch it took from the queue, shared rather than copied, along with the indices of
+//! their logs, and render the headers of those themselves.
+//!
+//! Each writer takes at most [`WRITER_QUEUE_REQUESTS`] requests ahead, past that the logging
+//! thread waits for it, so a stalled disk backs up into the queue and its overflow policy.
+//! Flushes are only waited for when asked to, errors of the others show up on a later one.
+
+use std::{
+    io::{self, Write},
+    sync::{
+        atomic::{AtomicU64, Ordering},
+        mpsc::{self, Receiver, Sender, SyncSender, TryRecvError},
+        Arc,
+    },
+    thread,
+};
+
+use rustc_hash::FxHashMap;
+
+use super::{render::RenderedRecord, rotation::RotatingFile, LogData};
+
+/// Logs of a batch a writer is responsible for, as index into the batch and context slot
+pub type ContextEntries = Vec<(u32, u32)>;
+
+/// Requests a writer may fall behind by before the logging thread waits for it
+pub const WRITER_QUEUE_REQUESTS: usize = 64;
+
+enum WriterRequest {
+    /// Replaces the file of a slot, or closes it with `None`
+    SetContext(usize, Option<RotatingFile>),
+    Write {
+        logs: Arc<Vec<LogData>>,
+        entries: ContextEntries,
+    },
+    /// Flushes every file, finishing them if set, and answers with the first error
+    /// since the last flush
+    Flush { finish: bool },
+}
+
+struct Writer {
+    sender: SyncSender<WriterRequest>,
+    /// Bytes written to the files of this writer, including closed ones
+    written: Arc<AtomicU64>,
+}
+
+/// Handles to the writer threads. They exit once this is dropped, closing their files.
+pub struct ContextWriters {
+    writers: Vec<Writer>,
+    /// Where writers answer flushes
+    flushed: Receiver<io::Result<()>>,
+    /// Flushes sent that weren't answered yet
+    unanswered: usize,
+}
+
+impl ContextWriters {
+    /// Starts `count` writers, splitting messages into lines of at most `max_str_len` bytes
+    pub fn spawn(count: usize, max_str_len: usize) -> io::Result<Self> {
+        let (flushed_sender, flushed) = mpsc::channel();
+
+        let writers = (0..count.max(1))
+            .map(|index| {
+                let (sender, receiver) = mpsc::sync_channel(WRITER_QUEUE_REQUESTS);
+                let written = Arc::new(AtomicU64::new(0));
+
+                let thread_written = Arc::clone(&written);
+                let flushed = flushed_sender.clone();
+                thread::Builder::new()
+                    .name(format!("paper2-context-{index}"))
+                    .spawn(move || writer_thread(receiver, flushed, thread_written, max_str_len))?;
+
+                Ok(Writer { sender, written })
+            })
+            .collect::<io::Result<_>>()?;
+
+        Ok(ContextWriters {
+            writers,
+            flushed,
+            unanswered: 0,
+        })
+    }
+
+    pub fn len(&self) -> usize {
+        self.writers.len()
+    }
+
+    /// The writer that owns the file of `slot`
+    #[inline]
+    pub fn writer_of(&self, slot: usize) -> usize {
+        slot % self.writers.len()
+    }
+
+    fn send(&self, writer: usize, request: WriterRequest) -> io::Result<()> {
+        self.writers[writer]
+            .sender
+            .send(request)
+            .map_err(|_| writer_exited())
+    }
+
+    /// Hands the file of `slot` to its writer, replacing and closing the previous one
+    pub fn set_context(&self, slot: usize, file: Option<RotatingFile>) -> io::Result<()> {
+        self.send(self.writer_of(slot), WriterRequest::SetContext(slot, file))
+    }
+
+    /// Hands each writer its logs of `logs`. `entries` is indexed by writer and left empty
+    pub fn write(
+        &self,
+        logs: &Arc<Vec<LogData>>,
+        entries: &mut [ContextEntries],
+    ) -> io::Result<()> {
+        for (writer, entries) in entries.iter_mut().enumerate() {
+            if entries.is_empty() {
+                continue;
+            }
+
+            let request = WriterRequest::Write {
+                logs: Arc::clone(logs),
+                entries: std::mem::take(entries),
+            };
+            self.send(writer, request)?;
+        }
+
+        Ok(())
+    }
+
+    /// Has every writer flush its files. With `wait`, returns once they are flushed,
+    /// otherwise only collects the answers that already came in.
+    /// Reports the first error a writer answered with since the last call.
+    pub fn flush(&mut self, wait: bool) -> io::Result<()> {
+        self.flush_files(false, wait)
+    }
+
+    /// Like [`Self::flush`], finishing the files with [`RotatingFile::finish`] and waiting
+    pub fn finish(&mut self) -> io::Result<()> {
+        self.flush_files(true, true)
+    }
+
+    fn flush_files(&mut self, finish: bool, wait: bool) -> io::Result<()> {
+        for writer in 0..self.writers.len() {
+            self.send(writer, WriterRequest::Flush { finish })?;
+            self.unanswered += 1;
+        }
+
+        let mut result = Ok(());
+        while self.unanswered > 0 {
+            let flushed = match wait {
+                true => self.flushed.recv().map_err(|_| writer_exited())?,
+                false => match self.flushed.try_recv() {
+                    Ok(flushed) => flushed,
+                    Err(TryRecvError::Empty) => break,
+                    Err(TryRecvError::Disconnected) => return Err(writer_exited()),
+                },
+            };
+
+            self.unanswered -= 1;
+            if result.is_ok() {
+                result = flushed;
+            }
+        }
+
+        result
+    }
+
+    /// Bytes written to every context file so far, as of the last batch each writer finished
+    pub fn bytes_written(&self) -> u64 {
+        self.writers
+            .iter()
+            .map(|writer| writer.written.load(Ordering::Relaxed))
+            .sum()
+    }
+}
+
+fn writer_exited() -> io::Error {
+    io::Error::new(io::ErrorKind::BrokenPipe, "Context writer exited")
+}
+
+fn writer_thread(
+    receiver: Receiver<WriterRequest>,
+    flushed: Sender<io::Result<()>>,
+    written: Arc<AtomicU64>,
+    max_str_len: usize,
+) {
+    let mut files: FxHashMap<usize, RotatingFile> = FxHashMap::default();
+    // bytes written to files that were replaced or closed
+    let mut closed_bytes = 0;
+    // first error since the last flush
+    let mut error: Option<io::Error> = None;
+    let mut arena = String::new();
+
+    for request in receiver {
+        match request {
+            WriterRequest::SetContext(slot, file) => {
+                let replaced = match file {
+                    Some(file) => files.insert(slot, file),
+                    None => files.remove(&slot),
+                };
+                if let Some(replaced) = replaced {
+                    closed_bytes += replaced.total_written();
+                }
+            }
+            WriterRequest::Write { logs, entries } => {
+                for (index, slot) in entries {
+                    let Some(file) = files.get_mut(&(slot as usize)) else {
+                        continue;
+                    };
+
+                    let log = &logs[index as usize];
+                    let record = RenderedRecord::render(log, &mut arena);
+                    let result = file
+                        .rotate_if_due()
+                        .and_then(|()| file.write_compact_record(log, &record, max_str_len));
+
+                    if let Err(e) = result {
+                        error.get_or_insert(e);
+                    }
+                }
+            }
+            WriterRequest::Flush { finish } => {
+                let result = match finish {
+                    true => files.values_mut().try_for_each(RotatingFile::finish),
+                    false => files.values_mut().try_for_each(Write::flush),
+                };
+                let _ = flushed.send(match error.take() {
+                    Some(e) => Err(e),
+                    None => result,
+                });
+            }
+        }
+
+        let total = closed_bytes + files.values().map(RotatingFile::total_written).sum::<u64>();
+        written.store(total, Ordering::Relaxed);
+    }
+}
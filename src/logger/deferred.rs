@@ -0,0 +1,70 @@
+use std::ffi::c_void;
+
+use super::LogData;
+
+/// Appends `len` bytes of rendered UTF-8 to the message passed as `out`.
+/// Invalid UTF-8 is replaced with U+FFFD once rendering is done.
+pub type DeferredWriteFn = unsafe extern "C" fn(out: *mut c_void, data: *const u8, len: usize);
+
+/// Formats the serialized `args` with `format`, handing the result to `write(out, ...)`.
+/// Called on the logging thread.
+pub type DeferredRenderFn = unsafe extern "C" fn(
+    format: *const u8,
+    format_len: usize,
+    args: *const u8,
+    args_len: usize,
+    write: DeferredWriteFn,
+    out: *mut c_void,
+);
+
+/// A message whose formatting was left to the logging thread.
+#[derive(Debug, Clone)]
+pub struct DeferredMessage {
+    /// Format string, must live for the rest of the process
+    pub format: &'static str,
+    /// Arguments as serialized by the producer, only `render` knows their layout
+    pub args: Vec<u8>,
+    pub render: DeferredRenderFn,
+}
+
+unsafe extern "C" fn append_to_message(out: *mut c_void, data: *const u8, len: usize) {
+    if data.is_null() || len == 0 {
+        return;
+    }
+
+    // SAFETY: `out` is the buffer handed to `render` in `DeferredMessage::render_into`
+    unsafe {
+        let message = &mut *(out as *mut Vec<u8>);
+        message.extend_from_slice(std::slice::from_raw_parts(data, len));
+    }
+}
+
+impl DeferredMessage {
+    /// Appends the formatted message to `message`.
+    /// Writes may split characters, so the bytes are only validated at the end.
+    pub fn render_into(&self, message: &mut String) {
+        let mut bytes = std::mem::take(message).into_bytes();
+        unsafe {
+            (self.render)(
+                self.format.as_ptr(),
+                self.format.len(),
+                self.args.as_ptr(),
+                self.args.len(),
+                append_to_message,
+                &mut bytes as *mut Vec<u8> as *mut c_void,
+            );
+        }
+
+        *message = String::from_utf8(bytes)
+            .unwrap_or_else(|err| String::from_utf8_lossy(err.as_bytes()).into_owned());
+    }
+}
+
+impl LogData {
+    /// Formats a deferred message, if there is one, into `message`.
+    pub fn render_deferred(&mut self) {
+        if let Some(deferred) = self.deferred.take() {
+            deferred.render_into(&mut self.message);
+        }
+    }
+}
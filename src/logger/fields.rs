@@ -0,0 +1,125 @@
+//! Typed key-value fields carried alongside a log's message.
+//!
+//! Producers hand the values over as they are. The logging thread renders them, as
+//! `key=value` after the message for text outputs, while JSON lines files and sinks
+//! get them typed.
+
+use std::fmt::{self, Write as _};
+
+use super::LogData;
+
+/// The value of a field, kept typed until the logging thread renders it
+#[derive(Debug, Clone, PartialEq)]
+pub enum FieldValue {
+    Int(i64),
+    UInt(u64),
+    Float(f64),
+    Bool(bool),
+    Str(String),
+}
+
+/// A key-value pair of a structured log
+#[derive(Debug, Clone, PartialEq)]
+pub struct Field {
+    /// Keys are static, they are never copied
+    pub key: &'static str,
+    pub value: FieldValue,
+}
+
+impl Field {
+    pub fn new(key: &'static str, value: impl Into<FieldValue>) -> Self {
+        Field {
+            key,
+            value: value.into(),
+        }
+    }
+}
+
+macro_rules! field_value_from {
+    ($variant:ident($target:ty): $($source:ty),*) => {
+        $(impl From<$source> for FieldValue {
+            fn from(value: $source) -> Self {
+                FieldValue::$variant(value as $target)
+            }
+        })*
+    };
+}
+
+field_value_from!(Int(i64): i8, i16, i32, i64, isize);
+field_value_from!(UInt(u64): u8, u16, u32, u64, usize);
+field_value_from!(Float(f64): f32, f64);
+
+impl From<bool> for FieldValue {
+    fn from(value: bool) -> Self {
+        FieldValue::Bool(value)
+    }
+}
+
+impl From<String> for FieldValue {
+    fn from(value: String) -> Self {
+        FieldValue::Str(value)
+    }
+}
+
+impl From<&str> for FieldValue {
+    fn from(value: &str) -> Self {
+        FieldValue::Str(value.to_owned())
+    }
+}
+
+/// The text form, strings are quoted if they wouldn't read back as one value
+impl fmt::Display for FieldValue {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self {
+            FieldValue::Int(value) => write!(f, "{value}"),
+            FieldValue::UInt(value) => write!(f, "{value}"),
+            FieldValue::Float(value) => write!(f, "{value}"),
+            FieldValue::Bool(value) => write!(f, "{value}"),
+            FieldValue::Str(value)
+                if value.is_empty()
+                    || value
+                        .chars()
+                        .any(|c| c.is_whitespace() || c == '"' || c == '=') =>
+            {
+                write!(f, "{value:?}")
+            }
+            FieldValue::Str(value) => f.write_str(value),
+        }
+    }
+}
+
+impl FieldValue {
+    /// Memory the value holds on to
+    pub fn capacity(&self) -> usize {
+        match self {
+            FieldValue::Str(value) => value.capacity(),
+            _ => 0,
+        }
+    }
+}
+
+impl LogData {
+    /// Appends the fields to `message` as `key=value`, for the text outputs.
+    /// The fields are kept, for the outputs that want them typed.
+    pub fn render_fields(&mut self) {
+        if self.fields.is_empty() || self.fields_start.is_some() {
+            return;
+        }
+
+        self.fields_start = Some(self.message.len());
+        for field in &self.fields {
+            if !self.message.is_empty() {
+                self.message.push(' ');
+            }
+            let _ = write!(self.message, "{}={}", field.key, field.value);
+        }
+    }
+
+    /// The message without the fields rendered into it
+    pub fn bare_message(&self) -> &str {
+        match self.fields_start {
+            Some(start) => &self.message[..start],
+            None => &self.message,
+        }
+    }
+}
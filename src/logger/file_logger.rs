@@ -1,45 +1,450 @@
-use parking_lot::RwLock;
+use std::{
+    fs::File,
+    io::{self, BufWriter, IoSlice, Write},
+    path::Path,
+    sync::{mpsc::Receiver, Arc},
+};
 
-use crate::logger::logger_thread_ctx::LoggerThreadCtx;
+use rustc_hash::FxHashMap;
 
-pub(crate) fn do_log(
-    log: &super::LogData,
-    logger_thread_lock: &RwLock<LoggerThreadCtx>,
-) -> std::io::Result<()> {
-    let mut logger_thread = logger_thread_lock.write();
+#[cfg(all(unix, feature = "mmap"))]
+use crate::logger::mmap_file::MmapFile;
+use crate::{
+    logger::{
+        async_writer::{AsyncFile, FileId, IoWorker},
+        context_writers::{ContextEntries, ContextWriters},
+        render::{RenderBuffer, RenderedRecord},
+        rotation::RotatingFile,
+        trace::{TraceBatch, TraceFile},
+        FileBackend, LogData,
+    },
+    semaphore_lite::SemaphoreLite,
+};
 
-    let global_file = &mut logger_thread.global_file;
-    log.write_to_io(global_file)?;
+/// A global or context log file.
+pub enum LogFile {
+    Buffered(BufWriter<File>),
 
-    let context_file = log
-        .tag
-        .as_ref()
-        .and_then(|tag| logger_thread.context_map.get_mut(tag));
+    #[cfg(all(unix, feature = "mmap"))]
+    Mapped(MmapFile),
 
-    if let Some(context_file) = context_file {
-        log.write_compact_to_io(context_file)?;
+    Async(AsyncFile),
+}
+
+impl LogFile {
+    /// Creates or truncates the file at `path`.
+    /// `io_worker` is required for [`FileBackend::Async`].
+    pub fn create(
+        path: impl AsRef<Path>,
+        backend: FileBackend,
+        io_worker: Option<&IoWorker>,
+    ) -> io::Result<Self> {
+        match backend {
+            FileBackend::Buffered => Ok(LogFile::Buffered(BufWriter::new(File::create(path)?))),
+
+            #[cfg(all(unix, feature = "mmap"))]
+            FileBackend::Mmap { chunk_size } => {
+                Ok(LogFile::Mapped(MmapFile::create(path, chunk_size)?))
+            }
+
+            FileBackend::Async => {
+                let io_worker = io_worker.ok_or_else(|| {
+                    io::Error::new(
+                        io::ErrorKind::InvalidInput,
+                        "Async files need an I/O worker",
+                    )
+                })?;
+                Ok(LogFile::Async(AsyncFile::create(path, io_worker)?))
+            }
+        }
+    }
+
+    /// Flushes the file, cutting off what a mapped file preallocated past the last write
+    pub fn finish(&mut self) -> io::Result<()> {
+        match self {
+            #[cfg(all(unix, feature = "mmap"))]
+            LogFile::Mapped(file) => file.finish(),
+            file => file.flush(),
+        }
+    }
+
+    /// Takes the writes an async file has buffered, to be submitted with the other files.
+    pub fn take_pending(&mut self) -> Option<(FileId, Vec<u8>)> {
+        match self {
+            LogFile::Async(file) => file.take_pending(),
+            _ => None,
+        }
+    }
+}
+
+impl Write for LogFile {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        match self {
+            LogFile::Buffered(file) => file.write(buf),
+            #[cfg(all(unix, feature = "mmap"))]
+            LogFile::Mapped(file) => file.write(buf),
+            LogFile::Async(file) => file.write(buf),
+        }
+    }
+
+    fn write_vectored(&mut self, bufs: &[IoSlice<'_>]) -> io::Result<usize> {
+        match self {
+            LogFile::Buffered(file) => file.write_vectored(bufs),
+            #[cfg(all(unix, feature = "mmap"))]
+            LogFile::Mapped(file) => file.write_vectored(bufs),
+            LogFile::Async(file) => file.write_vectored(bufs),
+        }
     }
 
-    Ok(())
+    fn flush(&mut self) -> io::Result<()> {
+        match self {
+            LogFile::Buffered(file) => file.flush(),
+            #[cfg(all(unix, feature = "mmap"))]
+            LogFile::Mapped(file) => file.flush(),
+            LogFile::Async(file) => file.flush(),
+        }
+    }
+}
+
+/// Changes to the files, sent to the logging thread and applied between batches.
+pub(crate) enum FileControl {
+    /// Starts writing the logs of a tag to a file, replacing its previous one
+    AddContext(Box<str>, RotatingFile),
+    RemoveContext(Box<str>),
+    /// Writes a log outside the batches, signaling once it is flushed
+    Write(Box<LogData>, Arc<SemaphoreLite>),
+    /// Finishes every file once the current batch is written, see [`FileWriters::finish`]
+    Finish(Arc<SemaphoreLite>),
 }
 
-/// Write a batch of logs to the file-backed outputs while holding the write lock only once.
-pub(crate) fn do_log_batch(
-    logs: &[super::LogData],
-    logger_thread_lock: &RwLock<LoggerThreadCtx>,
-) -> std::io::Result<()> {
-    let mut logger_thread = logger_thread_lock.write();
+/// Callsite slot not looked up yet
+const UNRESOLVED: u32 = 0;
+/// Callsite whose tag has no context file
+const NO_CONTEXT: u32 = u32::MAX;
+
+/// The global and context files. Owned by the logging thread, so writing
+/// and flushing them never takes a lock producers could be waiting on.
+pub(crate) struct FileWriters {
+    global_file: RotatingFile,
+
+    /// Context files by slot, unless `writers` own them
+    contexts: Vec<Option<RotatingFile>>,
+    /// Tag -> slot of its context file
+    slots: FxHashMap<Box<str>, usize>,
+    /// Slots removed contexts left, taken by the next ones
+    free_slots: Vec<usize>,
+    slot_count: usize,
 
-    for log in logs {
-        let global_file = &mut logger_thread.global_file;
-        log.write_to_io(global_file)?;
+    /// Threads writing the context files, if configured
+    writers: Option<ContextWriters>,
+    /// Context logs of the current batch, by writer
+    writer_entries: Vec<ContextEntries>,
+    /// Slot + 1 by callsite id, so a callsite's tag is only hashed once.
+    /// Cleared whenever contexts change
+    callsite_slots: Vec<u32>,
 
-        if let Some(tag) = &log.tag {
-            if let Some(context_file) = logger_thread.context_map.get_mut(tag) {
-                log.write_compact_to_io(context_file)?;
+    /// Profiling zones, if a trace file was configured
+    trace: Option<TraceFile>,
+
+    /// Bytes written to context files that were replaced or removed since
+    closed_bytes: u64,
+
+    io_worker: Option<IoWorker>,
+    control: Receiver<FileControl>,
+    /// Senders of [`FileControl::Finish`], answered once the current batch is written
+    finish_requests: Vec<Arc<SemaphoreLite>>,
+}
+
+impl FileWriters {
+    pub fn new(
+        global_file: RotatingFile,
+        trace: Option<TraceFile>,
+        io_worker: Option<IoWorker>,
+        writers: Option<ContextWriters>,
+        control: Receiver<FileControl>,
+    ) -> Self {
+        FileWriters {
+            global_file,
+            contexts: Vec::new(),
+            slots: FxHashMap::default(),
+            free_slots: Vec::new(),
+            slot_count: 0,
+            writer_entries: writers
+                .as_ref()
+                .map_or_else(Vec::new, |writers| vec![Vec::new(); writers.len()]),
+            writers,
+            callsite_slots: Vec::new(),
+            trace,
+            closed_bytes: 0,
+            io_worker,
+            control,
+            finish_requests: Vec::new(),
+        }
+    }
+
+    /// Applies the changes sent since the last call.
+    /// Called after taking a batch, so a context added before a log was queued is in place.
+    pub fn apply_controls(&mut self) -> io::Result<()> {
+        while let Ok(control) = self.control.try_recv() {
+            match control {
+                FileControl::AddContext(tag, file) => self.add_context(tag, file)?,
+                FileControl::RemoveContext(tag) => self.remove_context(&tag)?,
+                FileControl::Write(log, written) => {
+                    let result = self
+                        .write_log(&log)
+                        .and_then(|()| self.flush(&written, true));
+                    if result.is_err() {
+                        // don't leave the sender waiting for its timeout
+                        written.signal();
+                    }
+                    result?;
+                }
+                FileControl::Finish(finished) => self.finish_requests.push(finished),
             }
         }
+
+        Ok(())
+    }
+
+    fn add_context(&mut self, tag: Box<str>, file: RotatingFile) -> io::Result<()> {
+        if let Some(&slot) = self.slots.get(&tag) {
+            return self.set_context(slot, Some(file));
+        }
+
+        let slot = self.free_slots.pop().unwrap_or_else(|| {
+            self.slot_count += 1;
+            self.slot_count - 1
+        });
+        self.slots.insert(tag, slot);
+        self.callsite_slots.clear();
+        self.set_context(slot, Some(file))
+    }
+
+    fn remove_context(&mut self, tag: &str) -> io::Result<()> {
+        let Some(slot) = self.slots.remove(tag) else {
+            return Ok(());
+        };
+
+        self.free_slots.push(slot);
+        self.callsite_slots.clear();
+        self.set_context(slot, None)
+    }
+
+    /// Replaces the file of `slot`, wherever it is written
+    fn set_context(&mut self, slot: usize, file: Option<RotatingFile>) -> io::Result<()> {
+        if let Some(writers) = &self.writers {
+            return writers.set_context(slot, file);
+        }
+
+        if slot >= self.contexts.len() {
+            self.contexts.resize_with(slot + 1, || None);
+        }
+        if let Some(replaced) = std::mem::replace(&mut self.contexts[slot], file) {
+            self.closed_bytes += replaced.total_written();
+        }
+
+        Ok(())
+    }
+
+    /// Bytes written to every log file so far
+    pub fn bytes_written(&self) -> u64 {
+        self.closed_bytes
+            + self.global_file.total_written()
+            + self
+                .contexts
+                .iter()
+                .flatten()
+                .map(RotatingFile::total_written)
+                .sum::<u64>()
+            + self
+                .writers
+                .as_ref()
+                .map_or(0, ContextWriters::bytes_written)
     }
 
-    Ok(())
+    /// Appends profiling zones to the trace file, if there is one.
+    /// A broken trace file is dropped rather than taking the logs down with it
+    pub fn write_trace(&mut self, batch: &TraceBatch) {
+        if let Some(trace) = &mut self.trace {
+            if trace.write_batch(batch).is_err() {
+                self.trace = None;
+            }
+        }
+    }
+
+    /// Slot of the context file for the tag of `log`
+    #[inline]
+    fn context_slot(&mut self, log: &LogData) -> Option<usize> {
+        if self.slots.is_empty() {
+            return None;
+        }
+        let tag = log.tag.as_deref()?;
+
+        let Some(id) = log.callsite else {
+            return self.slots.get(tag).copied();
+        };
+
+        let index = id as usize;
+        if index >= self.callsite_slots.len() {
+            self.callsite_slots.resize(index + 1, UNRESOLVED);
+        }
+
+        match self.callsite_slots[index] {
+            UNRESOLVED => {
+                let slot = self.slots.get(tag).copied();
+                self.callsite_slots[index] = slot.map_or(NO_CONTEXT, |slot| slot as u32 + 1);
+                slot
+            }
+            NO_CONTEXT => None,
+            slot => Some(slot as usize - 1),
+        }
+    }
+
+    /// Writes a single log, not split into lines
+    pub fn write_log(&mut self, log: &LogData) -> io::Result<()> {
+        let mut arena = String::new();
+        let record = RenderedRecord::render(log, &mut arena);
+
+        self.global_file.rotate_if_due()?;
+        self.global_file.write_record(log, &record, 0)?;
+
+        let Some(slot) = self.context_slot(log) else {
+            return Ok(());
+        };
+
+        if let Some(writers) = &self.writers {
+            let mut entries = vec![Vec::new(); writers.len()];
+            entries[writers.writer_of(slot)].push((0, slot as u32));
+            return writers.write(&Arc::new(vec![log.clone()]), &mut entries);
+        }
+
+        if let Some(context_file) = self.contexts[slot].as_mut() {
+            context_file.rotate_if_due()?;
+            context_file.write_compact_record(log, &record, 0)?;
+        }
+
+        Ok(())
+    }
+
+    /// Writes a batch of logs. Messages are split into lines of at most `max_str_len` bytes.
+    /// `rendered` holds the headers of `logs`.
+    /// With context writers, context logs are only collected, [`Self::write_contexts`] hands them over.
+    pub fn write_batch(
+        &mut self,
+        logs: &[LogData],
+        rendered: &RenderBuffer,
+        max_str_len: usize,
+    ) -> io::Result<()> {
+        // logs without a callsite tend to come in runs of one tag
+        let mut previous: Option<(&str, Option<usize>)> = None;
+
+        for (index, (log, record)) in logs.iter().zip(rendered.iter()).enumerate() {
+            let slot = match previous {
+                Some((tag, slot)) if log.callsite.is_none() && log.tag.as_deref() == Some(tag) => {
+                    slot
+                }
+                _ => {
+                    let slot = self.context_slot(log);
+                    previous = log.tag.as_deref().map(|tag| (tag, slot));
+                    slot
+                }
+            };
+
+            let global_file = &mut self.global_file;
+            let mut context_file = match (&self.writers, slot) {
+                (Some(writers), Some(slot)) => {
+                    self.writer_entries[writers.writer_of(slot)].push((index as u32, slot as u32));
+                    None
+                }
+                (None, Some(slot)) => self.contexts[slot].as_mut(),
+                (_, None) => None,
+            };
+
+            global_file.rotate_if_due()?;
+            if let Some(context_file) = context_file.as_mut() {
+                context_file.rotate_if_due()?;
+            }
+
+            global_file.write_record(log, &record, max_str_len)?;
+            if let Some(context_file) = context_file.as_mut() {
+                context_file.write_compact_record(log, &record, max_str_len)?;
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Hands the context logs [`Self::write_batch`] collected to the context writers.
+    /// `logs` must be the batch passed to it.
+    pub fn write_contexts(&mut self, logs: &Arc<Vec<LogData>>) -> io::Result<()> {
+        match &self.writers {
+            Some(writers) => writers.write(logs, &mut self.writer_entries),
+            None => Ok(()),
+        }
+    }
+
+    /// Flushes every file and signals `flushed` once the writes reached the files.
+    /// Context writers are only waited for with `wait_contexts`, otherwise they flush
+    /// their files on their own time and `flushed` doesn't cover them.
+    pub fn flush(&mut self, flushed: &Arc<SemaphoreLite>, wait_contexts: bool) -> io::Result<()> {
+        if let Some(trace) = &mut self.trace {
+            if trace.flush().is_err() {
+                self.trace = None;
+            }
+        }
+
+        // context writers submit their async files before the global file is,
+        // so the I/O thread gets to them first
+        if let Some(writers) = &mut self.writers {
+            writers.flush(wait_contexts)?;
+        }
+
+        if let Some(io_worker) = &self.io_worker {
+            // hand every file to the I/O thread at once, it signals when they are written
+            let pending = std::iter::once(&mut self.global_file)
+                .chain(self.contexts.iter_mut().flatten())
+                .filter_map(RotatingFile::take_pending)
+                .collect();
+
+            return io_worker.submit(pending, Some(Arc::clone(flushed)));
+        }
+
+        self.global_file.flush()?;
+        self.contexts
+            .iter_mut()
+            .flatten()
+            .try_for_each(|file| file.flush())?;
+
+        flushed.signal();
+        Ok(())
+    }
+
+    /// Answers the [`FileControl::Finish`] requests of this batch.
+    /// Called once it is written, so the logs queued before a request are in the files.
+    pub fn finish_requested(&mut self) -> io::Result<()> {
+        if self.finish_requests.is_empty() {
+            return Ok(());
+        }
+
+        let result = self.finish();
+        // don't leave the senders waiting for their timeout
+        self.finish_requests
+            .drain(..)
+            .for_each(|finished| finished.signal());
+        result
+    }
+
+    /// Flushes every file and cuts off what mapped files preallocated, so on disk they end
+    /// where the logs do. The logging thread never exits, so this is its way to close them.
+    pub fn finish(&mut self) -> io::Result<()> {
+        if let Some(writers) = &mut self.writers {
+            writers.finish()?;
+        }
+
+        self.global_file.finish()?;
+        self.contexts
+            .iter_mut()
+            .flatten()
+            .try_for_each(RotatingFile::finish)
+    }
 }
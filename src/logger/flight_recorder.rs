@@ -0,0 +1,474 @@
+//! A crash-safe record of the most recent logs.
+//!
+//! Producers copy every log into a preallocated ring as they queue it, so the lines that
+//! are still queued or sitting in file buffers when the process dies are not lost.
+//! The ring is shared by every producer, which makes it opt-in, see
+//! [`super::LoggerConfig::flight_recorder_slots`].
+//! With the `flight_recorder` feature, [`install_crash_handler`] sets up handlers for
+//! fatal signals that write the ring, a raw backtrace and the memory map to a file with
+//! nothing but async-signal-safe calls, then hand the signal to the previous handler.
+
+use std::sync::atomic::{fence, AtomicI64, AtomicU32, AtomicU64, Ordering};
+
+use crate::log_level::LogLevel;
+
+use super::LogData;
+
+/// Bytes of tag and message kept per record
+pub const SLOT_TEXT_BYTES: usize = 256;
+const SLOT_WORDS: usize = SLOT_TEXT_BYTES / 8;
+/// Longer tags are cut, so they leave room for the message
+const MAX_TAG_BYTES: usize = 32;
+
+struct Slot {
+    /// Odd while being written, otherwise twice the ticket of the record + 2
+    sequence: AtomicU64,
+    unix_nanos: AtomicI64,
+    /// Level, tag length << 8 and text length << 16
+    header: AtomicU32,
+    /// The tag followed by the message, cut to fit
+    text: [AtomicU64; SLOT_WORDS],
+}
+
+impl Slot {
+    fn new() -> Self {
+        Slot {
+            sequence: AtomicU64::new(0),
+            unix_nanos: AtomicI64::new(0),
+            header: AtomicU32::new(0),
+            text: [const { AtomicU64::new(0) }; SLOT_WORDS],
+        }
+    }
+}
+
+/// A fixed ring of the most recent logs, written without locks or allocation.
+/// Once full, the oldest records are overwritten.
+pub struct FlightRecorder {
+    slots: Box<[Slot]>,
+    mask: u64,
+    /// Ticket of the next record
+    next: AtomicU64,
+}
+
+impl FlightRecorder {
+    /// Preallocates room for `capacity` records, rounded up to a power of two.
+    pub fn new(capacity: usize) -> Self {
+        let capacity = capacity.max(1).next_power_of_two();
+
+        FlightRecorder {
+            slots: (0..capacity).map(|_| Slot::new()).collect(),
+            mask: capacity as u64 - 1,
+            next: AtomicU64::new(0),
+        }
+    }
+
+    pub fn capacity(&self) -> usize {
+        self.slots.len()
+    }
+
+    /// Copies `log` into the ring. A deferred message is kept as its format string.
+    #[inline]
+    pub fn record(&self, log: &LogData) {
+        self.record_ticket(self.take_ticket(), log);
+    }
+
+    /// Reserves the next record, which [`Self::record_ticket`] fills in
+    pub(crate) fn take_ticket(&self) -> u64 {
+        self.next.fetch_add(1, Ordering::Relaxed)
+    }
+
+    /// Copies `log` into the slot of `ticket`, unless a later lap has taken it since.
+    pub(crate) fn record_ticket(&self, ticket: u64, log: &LogData) {
+        let slot = &self.slots[(ticket & self.mask) as usize];
+
+        // a writer a whole lap behind still holds the slot, or this writer is the one a lap
+        // behind and the slot already has a newer record. Either way this record is skipped.
+        let sequence = slot.sequence.load(Ordering::Relaxed);
+        if sequence & 1 == 1
+            || sequence > ticket * 2
+            || slot
+                .sequence
+                .compare_exchange(
+                    sequence,
+                    ticket * 2 + 1,
+                    Ordering::Acquire,
+                    Ordering::Relaxed,
+                )
+                .is_err()
+        {
+            return;
+        }
+        fence(Ordering::Release);
+
+        let tag = log.tag.as_deref().unwrap_or_default().as_bytes();
+        let tag = &tag[..floor_char_boundary(tag, MAX_TAG_BYTES)];
+        let message = match (&log.deferred, log.message.is_empty()) {
+            (Some(deferred), true) => deferred.format,
+            _ => log.message.as_str(),
+        }
+        .as_bytes();
+
+        let mut text = [0u8; SLOT_TEXT_BYTES];
+        text[..tag.len()].copy_from_slice(tag);
+        let message = &message[..floor_char_boundary(message, SLOT_TEXT_BYTES - tag.len())];
+        let len = tag.len() + message.len();
+        text[tag.len()..len].copy_from_slice(message);
+
+        for (word, bytes) in slot.text.iter().zip(text[..len].chunks(8)) {
+            let mut value = [0u8; 8];
+            value[..bytes.len()].copy_from_slice(bytes);
+            word.store(u64::from_ne_bytes(value), Ordering::Relaxed);
+        }
+        slot.unix_nanos
+            .store(log.timestamp.unix_nanos(), Ordering::Relaxed);
+        slot.header.store(
+            log.level as u32 | (tag.len() as u32) << 8 | (len as u32) << 16,
+            Ordering::Relaxed,
+        );
+
+        slot.sequence.store(ticket * 2 + 2, Ordering::Release);
+    }
+
+    /// Hands every record still in the ring to `out` as a line of text, oldest first.
+    /// Neither allocates nor locks, so it may run in a signal handler.
+    /// Records being written at the same time are skipped.
+    pub fn dump_with(&self, mut out: impl FnMut(&[u8])) {
+        let end = self.next.load(Ordering::Acquire);
+        let start = end.saturating_sub(self.slots.len() as u64);
+
+        let mut line = LineBuffer::new();
+        for ticket in start..end {
+            let slot = &self.slots[(ticket & self.mask) as usize];
+
+            let sequence = slot.sequence.load(Ordering::Acquire);
+            if sequence != ticket * 2 + 2 {
+                continue;
+            }
+
+            let mut text = [0u8; SLOT_TEXT_BYTES];
+            for (word, bytes) in slot.text.iter().zip(text.chunks_mut(8)) {
+                bytes.copy_from_slice(&word.load(Ordering::Relaxed).to_ne_bytes());
+            }
+            let unix_nanos = slot.unix_nanos.load(Ordering::Relaxed);
+            let header = slot.header.load(Ordering::Relaxed);
+
+            fence(Ordering::Acquire);
+            if slot.sequence.load(Ordering::Relaxed) != sequence {
+                continue;
+            }
+
+            let level = LogLevel::try_from(header as u8).unwrap_or(LogLevel::Info);
+            let tag_len = ((header >> 8) & 0xff) as usize;
+            let len = ((header >> 16) as usize).min(SLOT_TEXT_BYTES);
+
+            line.clear();
+            line.push_bytes(&[level.short() as u8, b' ']);
+            line.push_decimal(unix_nanos.div_euclid(1_000_000_000) as u64, 0);
+            line.push_bytes(b".");
+            line.push_decimal(unix_nanos.rem_euclid(1_000_000_000) as u64, 9);
+            line.push_bytes(b" [");
+            line.push_bytes(if tag_len == 0 {
+                super::log_data::DEFAULT_TAG.as_bytes()
+            } else {
+                &text[..tag_len.min(len)]
+            });
+            line.push_bytes(b"] ");
+            line.push_bytes(&text[tag_len.min(len)..len]);
+            line.push_bytes(b"\n");
+            out(line.as_bytes());
+        }
+    }
+}
+
+/// Largest length `<= max` that doesn't cut `bytes`, which are UTF-8, inside a character
+fn floor_char_boundary(bytes: &[u8], max: usize) -> usize {
+    if bytes.len() <= max {
+        return bytes.len();
+    }
+
+    let mut len = max;
+    // continuation bytes look like 0b10xxxxxx
+    while len > 0 && bytes[len] & 0xc0 == 0x80 {
+        len -= 1;
+    }
+    len
+}
+
+/// A line assembled on the stack
+struct LineBuffer {
+    bytes: [u8; SLOT_TEXT_BYTES + 128],
+    len: usize,
+}
+
+impl LineBuffer {
+    fn new() -> Self {
+        LineBuffer {
+            bytes: [0; SLOT_TEXT_BYTES + 128],
+            len: 0,
+        }
+    }
+
+    fn clear(&mut self) {
+        self.len = 0;
+    }
+
+    fn as_bytes(&self) -> &[u8] {
+        &self.bytes[..self.len]
+    }
+
+    fn push_bytes(&mut self, bytes: &[u8]) {
+        let len = bytes.len().min(self.bytes.len() - self.len);
+        self.bytes[self.len..self.len + len].copy_from_slice(&bytes[..len]);
+        self.len += len;
+    }
+
+    /// `value` in decimal, zero padded to `width` digits
+    fn push_decimal(&mut self, mut value: u64, width: usize) {
+        let mut digits = [0u8; 20];
+        let mut start = digits.len();
+        loop {
+            start -= 1;
+            digits[start] = b'0' + (value % 10) as u8;
+            value /= 10;
+            if start == 0 || (value == 0 && digits.len() - start >= width) {
+                break;
+            }
+        }
+        self.push_bytes(&digits[start..]);
+    }
+
+    /// `value` as `0x` and 16 hex digits
+    #[cfg(all(unix, feature = "flight_recorder"))]
+    fn push_hex(&mut self, value: u64) {
+        let mut digits = *b"0x0000000000000000";
+        for i in 0..16 {
+            let nibble = (value >> ((15 - i) * 4)) & 0xf;
+            digits[2 + i] = b"0123456789abcdef"[nibble as usize];
+        }
+        self.push_bytes(&digits);
+    }
+}
+
+#[cfg(all(unix, feature = "flight_recorder"))]
+pub use crash_handler::{dump_to_fd, install_crash_handler};
+
+#[cfg(all(unix, feature = "flight_recorder"))]
+mod crash_handler {
+    use std::{
+        ffi::{c_int, c_void, CString},
+        io,
+        os::unix::ffi::OsStrExt,
+        path::Path,
+        ptr,
+        sync::{
+            atomic::{AtomicBool, AtomicPtr, Ordering},
+            Arc, OnceLock,
+        },
+    };
+
+    use super::{FlightRecorder, LineBuffer};
+
+    /// Most frames written to a crash dump
+    const MAX_FRAMES: usize = 64;
+
+    const SIGNALS: [(c_int, &str); 5] = [
+        (libc::SIGSEGV, "SIGSEGV"),
+        (libc::SIGBUS, "SIGBUS"),
+        (libc::SIGFPE, "SIGFPE"),
+        (libc::SIGILL, "SIGILL"),
+        (libc::SIGABRT, "SIGABRT"),
+    ];
+
+    /// The recorder dumped on a crash. Never freed, a handler may still be reading it
+    static RECORDER: AtomicPtr<FlightRecorder> = AtomicPtr::new(ptr::null_mut());
+    /// Where the dump goes, never freed either
+    static DUMP_PATH: AtomicPtr<libc::c_char> = AtomicPtr::new(ptr::null_mut());
+    /// The handlers ours replaced, in the order of [`SIGNALS`]
+    static PREVIOUS: OnceLock<[libc::sigaction; SIGNALS.len()]> = OnceLock::new();
+    /// Set by the first crash, so a crash while dumping goes straight to the previous handler
+    static DUMPING: AtomicBool = AtomicBool::new(false);
+
+    /// Dumps `recorder` to `path` when the process receives a fatal signal.
+    /// Calling it again switches to another recorder and path, the handlers are only
+    /// installed once.
+    pub fn install_crash_handler(recorder: &Arc<FlightRecorder>, path: &Path) -> io::Result<()> {
+        let path = CString::new(path.as_os_str().as_bytes())
+            .map_err(|e| io::Error::new(io::ErrorKind::InvalidInput, e))?;
+
+        // the previous ones are leaked, a crashing thread may still use them
+        RECORDER.store(
+            Arc::into_raw(Arc::clone(recorder)) as *mut FlightRecorder,
+            Ordering::Release,
+        );
+        DUMP_PATH.store(path.into_raw(), Ordering::Release);
+
+        // resolves the unwinder now, it may allocate the first time
+        let mut frames = [0usize; 1];
+        capture_backtrace(&mut frames);
+
+        let mut result = Ok(());
+        PREVIOUS.get_or_init(|| {
+            SIGNALS.map(|(signal, _)| unsafe {
+                let mut action: libc::sigaction = std::mem::zeroed();
+                action.sa_sigaction = handle_signal as usize;
+                action.sa_flags = libc::SA_SIGINFO | libc::SA_ONSTACK;
+                libc::sigemptyset(&mut action.sa_mask);
+
+                let mut previous: libc::sigaction = std::mem::zeroed();
+                if libc::sigaction(signal, &action, &mut previous) != 0 {
+                    result = Err(io::Error::last_os_error());
+                }
+                previous
+            })
+        });
+        result
+    }
+
+    /// Writes the records of `recorder` to `fd` with `write(2)`, oldest first.
+    /// Async-signal-safe.
+    pub fn dump_to_fd(recorder: &FlightRecorder, fd: c_int) {
+        recorder.dump_with(|bytes| write_all(fd, bytes));
+    }
+
+    extern "C" fn handle_signal(signal: c_int, info: *mut libc::siginfo_t, _context: *mut c_void) {
+        let index = SIGNALS.iter().position(|(known, _)| *known == signal);
+
+        if !DUMPING.swap(true, Ordering::AcqRel) {
+            let path = DUMP_PATH.load(Ordering::Acquire);
+            if !path.is_null() {
+                let flags = libc::O_WRONLY | libc::O_CREAT | libc::O_TRUNC | libc::O_CLOEXEC;
+                let fd = unsafe { libc::open(path, flags, 0o644) };
+                if fd >= 0 {
+                    let name = index.map_or("signal", |index| SIGNALS[index].1);
+                    write_dump(fd, name, info);
+                    unsafe { libc::close(fd) };
+                }
+            }
+        }
+
+        // hand the signal back, a fault happens again once the handler returns,
+        // a signal sent by someone has to be raised again
+        let previous = index.and_then(|index| PREVIOUS.get().map(|previous| &previous[index]));
+        unsafe {
+            match previous {
+                Some(previous) => libc::sigaction(signal, previous, ptr::null_mut()),
+                None => libc::signal(signal, libc::SIG_DFL) as c_int,
+            };
+
+            if info.is_null() || (*info).si_code <= 0 {
+                libc::raise(signal);
+            }
+        }
+    }
+
+    fn write_dump(fd: c_int, name: &str, info: *const libc::siginfo_t) {
+        let mut line = LineBuffer::new();
+        line.push_bytes(b"*** paper2 crash: ");
+        line.push_bytes(name.as_bytes());
+        // only faults have an address
+        if !info.is_null() && unsafe { (*info).si_code } > 0 {
+            line.push_bytes(b", fault address ");
+            line.push_hex(unsafe { (*info).si_addr() } as u64);
+        }
+        line.push_bytes(b", pid ");
+        line.push_decimal(unsafe { libc::getpid() } as u64, 0);
+        line.push_bytes(b" ***\n\nrecent logs:\n");
+        write_all(fd, line.as_bytes());
+
+        let recorder = RECORDER.load(Ordering::Acquire);
+        if !recorder.is_null() {
+            // SAFETY: installed recorders are never freed
+            dump_to_fd(unsafe { &*recorder }, fd);
+        }
+
+        write_all(fd, b"\nbacktrace:\n");
+        let mut frames = [0usize; MAX_FRAMES];
+        let count = capture_backtrace(&mut frames);
+        for (index, pc) in frames[..count].iter().enumerate() {
+            line.clear();
+            line.push_bytes(b"  #");
+            line.push_decimal(index as u64, 2);
+            line.push_bytes(b" pc ");
+            line.push_hex(*pc as u64);
+            line.push_bytes(b"\n");
+            write_all(fd, line.as_bytes());
+        }
+
+        // resolves the frames offline
+        write_all(fd, b"\nmemory map:\n");
+        copy_file(c"/proc/self/maps".as_ptr(), fd);
+    }
+
+    fn write_all(fd: c_int, mut bytes: &[u8]) {
+        while !bytes.is_empty() {
+            let written = unsafe { libc::write(fd, bytes.as_ptr().cast(), bytes.len()) };
+            if written < 0 && io::Error::last_os_error().kind() == io::ErrorKind::Interrupted {
+                continue;
+            }
+            if written <= 0 {
+                return;
+            }
+            bytes = &bytes[written as usize..];
+        }
+    }
+
+    fn copy_file(path: *const libc::c_char, fd: c_int) {
+        let input = unsafe { libc::open(path, libc::O_RDONLY | libc::O_CLOEXEC) };
+        if input < 0 {
+            return;
+        }
+
+        let mut buffer = [0u8; 1024];
+        loop {
+            let read = unsafe { libc::read(input, buffer.as_mut_ptr().cast(), buffer.len()) };
+            if read <= 0 {
+                break;
+            }
+            write_all(fd, &buffer[..read as usize]);
+        }
+        unsafe { libc::close(input) };
+    }
+
+    #[repr(C)]
+    struct UnwindContext {
+        _private: [u8; 0],
+    }
+
+    type UnwindReasonCode = c_int;
+    const URC_NO_REASON: UnwindReasonCode = 0;
+    const URC_END_OF_STACK: UnwindReasonCode = 5;
+
+    extern "C" {
+        fn _Unwind_Backtrace(
+            trace: extern "C" fn(*mut UnwindContext, *mut c_void) -> UnwindReasonCode,
+            data: *mut c_void,
+        ) -> UnwindReasonCode;
+        fn _Unwind_GetIP(context: *mut UnwindContext) -> usize;
+    }
+
+    struct Frames<'a> {
+        frames: &'a mut [usize],
+        count: usize,
+    }
+
+    extern "C" fn unwind_frame(context: *mut UnwindContext, data: *mut c_void) -> UnwindReasonCode {
+        let frames = unsafe { &mut *(data as *mut Frames) };
+        if frames.count == frames.frames.len() {
+            return URC_END_OF_STACK;
+        }
+
+        let pc = unsafe { _Unwind_GetIP(context) };
+        if pc != 0 {
+            frames.frames[frames.count] = pc;
+            frames.count += 1;
+        }
+        URC_NO_REASON
+    }
+
+    /// Program counters of the calling thread, innermost first
+    fn capture_backtrace(frames: &mut [usize]) -> usize {
+        let mut state = Frames { frames, count: 0 };
+        unsafe { _Unwind_Backtrace(unwind_frame, &mut state as *mut Frames as *mut c_void) };
+        state.count
+    }
+}
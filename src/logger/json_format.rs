@@ -0,0 +1,80 @@
+//! JSON lines log files.
+//!
+//! Every record is one JSON object on a line of its own, with its fields typed:
+//!
+//! ```json
+//! {"time":"2024-01-01 12:00:00","level":"INFO","tag":"Game","file":"game.cpp","line":12,"column":4,"function":"join","message":"player joined","fields":{"id":5,"ms":1.5}}
+//! ```
+//!
+//! `tag`, `function` and `fields` are left out when a record has none.
+
+use std::io::{self, Write};
+
+use super::{fields::FieldValue, render::RenderedRecord, trace::write_json_str, LogData};
+
+/// Writes log records as JSON lines, one encoder per file.
+#[derive(Debug, Default)]
+pub struct JsonEncoder {
+    buffer: Vec<u8>,
+}
+
+impl JsonEncoder {
+    /// Encodes a whole record, messages are never split into lines
+    pub fn encode(&mut self, log: &LogData, record: &RenderedRecord<'_>) -> &[u8] {
+        self.buffer.clear();
+        // writing to a Vec can't fail
+        let _ = write_record(&mut self.buffer, log, record.time());
+        &self.buffer
+    }
+}
+
+/// Writes `log` as a JSON object followed by a newline
+pub fn write_record(out: &mut impl Write, log: &LogData, time: &str) -> io::Result<()> {
+    out.write_all(b"{\"time\":")?;
+    write_json_str(out, time)?;
+    write!(out, ",\"level\":\"{}\"", log.level)?;
+
+    if let Some(tag) = &log.tag {
+        out.write_all(b",\"tag\":")?;
+        write_json_str(out, tag)?;
+    }
+
+    out.write_all(b",\"file\":")?;
+    write_json_str(out, &log.file)?;
+    write!(out, ",\"line\":{},\"column\":{}", log.line, log.column)?;
+
+    if let Some(function_name) = &log.function_name {
+        out.write_all(b",\"function\":")?;
+        write_json_str(out, function_name)?;
+    }
+
+    out.write_all(b",\"message\":")?;
+    write_json_str(out, log.bare_message())?;
+
+    if !log.fields.is_empty() {
+        out.write_all(b",\"fields\":{")?;
+        for (i, field) in log.fields.iter().enumerate() {
+            if i != 0 {
+                out.write_all(b",")?;
+            }
+            write_json_str(out, field.key)?;
+            out.write_all(b":")?;
+            write_value(out, &field.value)?;
+        }
+        out.write_all(b"}")?;
+    }
+
+    out.write_all(b"}\n")
+}
+
+fn write_value(out: &mut impl Write, value: &FieldValue) -> io::Result<()> {
+    match value {
+        FieldValue::Int(value) => write!(out, "{value}"),
+        FieldValue::UInt(value) => write!(out, "{value}"),
+        // JSON has no NaN or infinity
+        FieldValue::Float(value) if !value.is_finite() => out.write_all(b"null"),
+        FieldValue::Float(value) => write!(out, "{value}"),
+        FieldValue::Bool(value) => write!(out, "{value}"),
+        FieldValue::Str(value) => write_json_str(out, value),
+    }
+}
@@ -0,0 +1,180 @@
+//! Runtime level thresholds, checked by producers before a message is formatted.
+//!
+//! Each gate holds the lowest [`LogLevel::severity`] that is let through, so checking
+//! one is a single relaxed load. Tags without their own level follow the global gate.
+//!
+//! Gates are never freed. Checking a tag never creates one, and at most [`MAX_TAG_GATES`]
+//! are created on request, so tags built at runtime can't grow the table forever.
+
+use std::{
+    cell::RefCell,
+    hash::{BuildHasher, BuildHasherDefault},
+    ptr,
+    sync::{
+        atomic::{AtomicU8, AtomicUsize, Ordering},
+        LazyLock,
+    },
+};
+
+use parking_lot::Mutex;
+use rustc_hash::{FxHashMap, FxHasher};
+
+use crate::log_level::LogLevel;
+
+/// Holds the minimum severity that passes. Gates live for the rest of the process.
+pub type LevelGate = AtomicU8;
+
+/// Everything is enabled by default
+static GLOBAL_GATE: LevelGate = AtomicU8::new(LogLevel::Debug.severity());
+
+struct TagGate {
+    gate: &'static LevelGate,
+    /// `None` follows the global level
+    level: Option<LogLevel>,
+}
+
+/// Also serializes updates to [`GLOBAL_GATE`], so inheriting tags never miss one
+static TAG_GATES: LazyLock<Mutex<FxHashMap<&'static str, TagGate>>> =
+    LazyLock::new(Default::default);
+
+/// Gates handed out by [`tag_gate`]. Past this, tags without one share the global gate.
+const MAX_TAG_GATES: usize = 1024;
+
+/// Bumped whenever a gate is created, so cached lookups that found none are redone
+static GATES_CREATED: AtomicUsize = AtomicUsize::new(0);
+
+/// Gates a thread looked up last, by hash of their tag
+const GATE_CACHE_SIZE: usize = 32;
+
+#[derive(Clone, Copy)]
+struct CachedGate {
+    tag_hash: u64,
+    gate: &'static LevelGate,
+    /// [`GATES_CREATED`] when looked up, only checked for the global gate
+    created: usize,
+}
+
+thread_local! {
+    /// Gates never move, so producers keep the ones they used instead of locking [`TAG_GATES`]
+    static GATE_CACHE: RefCell<[Option<CachedGate>; GATE_CACHE_SIZE]> =
+        const { RefCell::new([None; GATE_CACHE_SIZE]) };
+}
+
+pub fn global_gate() -> &'static LevelGate {
+    &GLOBAL_GATE
+}
+
+/// Returns the gate of `tag`, creating it on first use.
+/// An empty tag is the global gate, and so is a new tag once [`MAX_TAG_GATES`] were created.
+pub fn tag_gate(tag: &str) -> &'static LevelGate {
+    if tag.is_empty() {
+        return &GLOBAL_GATE;
+    }
+
+    let mut gates = TAG_GATES.lock();
+    if gates.len() >= MAX_TAG_GATES {
+        return gates
+            .get(tag)
+            .map_or(&GLOBAL_GATE, |tag_gate| tag_gate.gate);
+    }
+    tag_gate_locked(&mut gates, tag).gate
+}
+
+/// The gate of `tag` if it has one, without creating it
+fn find_tag_gate(tag: &str) -> &'static LevelGate {
+    TAG_GATES
+        .lock()
+        .get(tag)
+        .map_or(&GLOBAL_GATE, |tag_gate| tag_gate.gate)
+}
+
+fn tag_gate_locked<'a>(
+    gates: &'a mut FxHashMap<&'static str, TagGate>,
+    tag: &str,
+) -> &'a mut TagGate {
+    if !gates.contains_key(tag) {
+        let tag: &'static str = Box::leak(tag.to_owned().into_boxed_str());
+        let gate: &'static LevelGate =
+            Box::leak(Box::new(AtomicU8::new(GLOBAL_GATE.load(Ordering::Relaxed))));
+        gates.insert(tag, TagGate { gate, level: None });
+        GATES_CREATED.fetch_add(1, Ordering::Relaxed);
+    }
+
+    gates.get_mut(tag).unwrap()
+}
+
+/// Sets the level of every tag that doesn't have its own.
+pub fn set_global_level(level: LogLevel) {
+    let gates = TAG_GATES.lock();
+
+    GLOBAL_GATE.store(level.severity(), Ordering::Relaxed);
+    gates
+        .values()
+        .filter(|tag_gate| tag_gate.level.is_none())
+        .for_each(|tag_gate| tag_gate.gate.store(level.severity(), Ordering::Relaxed));
+}
+
+/// Overrides the level of `tag`. `None` makes it follow the global level again.
+/// The tag always gets a gate of its own, even past [`MAX_TAG_GATES`].
+pub fn set_tag_level(tag: &str, level: Option<LogLevel>) {
+    if tag.is_empty() {
+        if let Some(level) = level {
+            set_global_level(level);
+        }
+        return;
+    }
+
+    let mut gates = TAG_GATES.lock();
+    let tag_gate = tag_gate_locked(&mut gates, tag);
+
+    tag_gate.level = level;
+    let severity = match level {
+        Some(level) => level.severity(),
+        None => GLOBAL_GATE.load(Ordering::Relaxed),
+    };
+    tag_gate.gate.store(severity, Ordering::Relaxed);
+}
+
+pub fn gate_allows(gate: &LevelGate, level: LogLevel) -> bool {
+    level != LogLevel::Off && level.severity() >= gate.load(Ordering::Relaxed)
+}
+
+/// The gate of `tag`, or the global gate if it has none. Never creates one.
+/// Uses the gates this thread looked up before when it can.
+pub fn cached_tag_gate(tag: &str) -> &'static LevelGate {
+    if tag.is_empty() {
+        return &GLOBAL_GATE;
+    }
+
+    let tag_hash = BuildHasherDefault::<FxHasher>::default().hash_one(tag);
+    let index = tag_hash as usize % GATE_CACHE_SIZE;
+    GATE_CACHE
+        .try_with(|cache| {
+            let mut cache = cache.borrow_mut();
+            let created = GATES_CREATED.load(Ordering::Relaxed);
+            match cache[index] {
+                Some(cached)
+                    if cached.tag_hash == tag_hash
+                        && (!ptr::eq(cached.gate, &GLOBAL_GATE) || cached.created == created) =>
+                {
+                    cached.gate
+                }
+                _ => {
+                    let gate = find_tag_gate(tag);
+                    cache[index] = Some(CachedGate {
+                        tag_hash,
+                        gate,
+                        created,
+                    });
+                    gate
+                }
+            }
+        })
+        .unwrap_or_else(|_| find_tag_gate(tag))
+}
+
+/// Whether a log with this level and tag should be produced at all.
+/// Checked by producers before anything is copied or formatted.
+pub fn is_enabled(level: LogLevel, tag: Option<&str>) -> bool {
+    gate_allows(cached_tag_gate(tag.unwrap_or_default()), level)
+}
@@ -0,0 +1,82 @@
+use memchr::memchr;
+
+/// Splits a message into the pieces written as separate log lines.
+///
+/// Lines are split at `\n`, then cut into segments of at most `max_len` bytes
+/// on UTF-8 boundaries. Empty lines produce no segment. A `max_len` of 0 never cuts.
+///
+/// Segments borrow the message, nothing is allocated.
+pub fn segments(message: &str, max_len: usize) -> Segments<'_> {
+    let max_len = if max_len == 0 { usize::MAX } else { max_len };
+
+    Segments {
+        line: "",
+        remaining: Some(message),
+        max_len,
+    }
+}
+
+/// Whether a message is written as a single unchanged line,
+/// which is the case for nearly every log.
+#[inline]
+pub fn is_single_segment(message: &str, max_len: usize) -> bool {
+    !message.is_empty()
+        && (max_len == 0 || message.len() <= max_len)
+        && memchr(b'\n', message.as_bytes()).is_none()
+}
+
+#[derive(Debug, Clone)]
+pub struct Segments<'a> {
+    /// Rest of the line being cut
+    line: &'a str,
+    /// Everything after the current line, `None` once the last line was taken
+    remaining: Option<&'a str>,
+    max_len: usize,
+}
+
+impl<'a> Iterator for Segments<'a> {
+    type Item = &'a str;
+
+    fn next(&mut self) -> Option<&'a str> {
+        while self.line.is_empty() {
+            let remaining = self.remaining?;
+
+            match memchr(b'\n', remaining.as_bytes()) {
+                Some(end) => {
+                    self.line = &remaining[..end];
+                    self.remaining = Some(&remaining[end + 1..]);
+                }
+                None => {
+                    self.line = remaining;
+                    self.remaining = None;
+                }
+            }
+        }
+
+        let (segment, rest) = self.line.split_at(cut_index(self.line, self.max_len));
+        self.line = rest;
+        Some(segment)
+    }
+}
+
+/// Largest char boundary at or below `max_len`.
+/// Never returns 0 for a non-empty line, so a char wider than `max_len` stays whole.
+fn cut_index(line: &str, max_len: usize) -> usize {
+    if line.len() <= max_len {
+        return line.len();
+    }
+
+    let mut index = max_len;
+    while index > 0 && !line.is_char_boundary(index) {
+        index -= 1;
+    }
+
+    if index == 0 {
+        index = max_len;
+        while !line.is_char_boundary(index) {
+            index += 1;
+        }
+    }
+
+    index
+}
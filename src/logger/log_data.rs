@@ -1,20 +1,37 @@
-use chrono::{DateTime, Local};
+use std::borrow::Cow;
 
 use crate::log_level::LogLevel;
 
+use super::{
+    callsite::CallsiteId, clock::Timestamp, deferred::DeferredMessage, fields::Field,
+    render::RenderedRecord,
+};
+
 pub const DEFAULT_TAG: &str = "GLOBAL";
 
 #[derive(Debug, Clone)]
 pub struct LogData {
     pub level: LogLevel,
-    pub tag: Option<String>,
+    pub tag: Option<Cow<'static, str>>,
     pub message: String,
-    pub timestamp: DateTime<Local>,
+    /// Captured by the producer, turned into wall time when written
+    pub timestamp: Timestamp,
 
-    pub file: String,
+    pub file: Cow<'static, str>,
     pub line: u32,
     pub column: u32,
-    pub function_name: Option<String>,
+    pub function_name: Option<Cow<'static, str>>,
+
+    /// The callsite this log came from, if it was registered
+    pub callsite: Option<CallsiteId>,
+
+    /// Formatting left to the logging thread, rendered into `message`
+    pub deferred: Option<DeferredMessage>,
+
+    /// Typed key-value pairs, rendered after the message by the logging thread
+    pub fields: Vec<Field>,
+    /// Where the fields rendered into `message` start, once they are
+    pub fields_start: Option<usize>,
 }
 
 impl LogData {
@@ -29,56 +46,74 @@ impl LogData {
     ) -> Self {
         Self {
             level,
-            tag,
+            tag: tag.map(Cow::Owned),
             message,
-            timestamp: Local::now(),
-            file,
+            timestamp: Timestamp::now(),
+            file: Cow::Owned(file),
             line,
             column,
-            function_name,
+            function_name: function_name.map(Cow::Owned),
+            callsite: None,
+            deferred: None,
+            fields: Vec::new(),
+            fields_start: None,
         }
     }
 
     pub fn format(&self) -> String {
-        format!(
-            "{level} {time} [{tag}] [{file}:{line}:{column} @ {function_name}] {message}",
-            level = self.level,
-            time = self.timestamp.format("%Y-%m-%d %H:%M:%S"),
-            tag = self.tag.as_deref().unwrap_or(DEFAULT_TAG),
-            message = self.message,
-            line = self.line,
-            column = self.column,
-            file = self.file,
-            function_name = self.function_name.as_deref().unwrap_or("default")
-        )
+        let mut arena = String::new();
+        RenderedRecord::render(self, &mut arena).format_line(self, &self.message)
     }
 
     pub fn write_to_io(&self, writer: &mut impl std::io::Write) -> std::io::Result<()> {
-        writeln!(
-            writer,
-            "{level} {time} [{tag}] [{file}:{line}:{column} @ {function_name}] {message}",
-            level = self.level.short(),
-            time = self.timestamp.format("%Y-%m-%d %H:%M:%S"),
-            tag = self.tag.as_deref().unwrap_or(DEFAULT_TAG),
-            message = self.message,
-            line = self.line,
-            column = self.column,
-            file = self.file,
-            function_name = self.function_name.as_deref().unwrap_or("default")
-        )
+        let mut arena = String::new();
+        RenderedRecord::render(self, &mut arena).write_line(writer, &self.message)
     }
+
     pub fn write_compact_to_io(&self, writer: &mut impl std::io::Write) -> std::io::Result<()> {
-        writeln!(
-            writer,
-            "{level} {time} [{file}:{line}:{column} @ {function_name}] {message}",
-            level = self.level.short(),
-            time = self.timestamp.format("%Y-%m-%d %H:%M:%S"),
-            message = self.message,
-            line = self.line,
-            column = self.column,
-            file = self.file,
-            function_name = self.function_name.as_deref().unwrap_or("default")
-        )
+        let mut arena = String::new();
+        RenderedRecord::render(self, &mut arena).write_compact_line(writer, &self.message)
+    }
+
+    /// Roughly the memory a queued record holds on to, for the queue's byte limit
+    pub fn approximate_size(&self) -> usize {
+        fn owned(string: &Cow<'static, str>) -> usize {
+            match string {
+                Cow::Owned(string) => string.capacity(),
+                Cow::Borrowed(_) => 0,
+            }
+        }
+
+        size_of::<LogData>()
+            + self.message.capacity()
+            + self.tag.as_ref().map_or(0, owned)
+            + owned(&self.file)
+            + self.function_name.as_ref().map_or(0, owned)
+            + self.deferred.as_ref().map_or(0, |deferred| deferred.args.capacity())
+            + self.fields.capacity() * size_of::<Field>()
+            + self
+                .fields
+                .iter()
+                .map(|field| field.value.capacity())
+                .sum::<usize>()
+    }
+
+    /// Copies everything but the message, for outputs that need a separate record per line.
+    pub fn clone_without_message(&self) -> LogData {
+        LogData {
+            level: self.level,
+            tag: self.tag.clone(),
+            message: String::new(),
+            timestamp: self.timestamp,
+            file: self.file.clone(),
+            line: self.line,
+            column: self.column,
+            function_name: self.function_name.clone(),
+            callsite: self.callsite,
+            deferred: None,
+            fields: self.fields.clone(),
+            fields_start: None,
+        }
     }
 }
 impl Default for LogData {
@@ -87,11 +122,15 @@ impl Default for LogData {
             level: LogLevel::Info,
             tag: None,
             message: String::new(),
-            timestamp: Local::now(),
-            file: String::new(),
+            timestamp: Timestamp::now(),
+            file: Cow::Borrowed(""),
             line: 0,
             column: 0,
             function_name: None,
+            callsite: None,
+            deferred: None,
+            fields: Vec::new(),
+            fields_start: None,
         }
     }
 }
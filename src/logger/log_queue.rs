@@ -0,0 +1,465 @@
+use std::{
+    cell::{Cell, RefCell},
+    sync::{
+        atomic::{fence, AtomicBool, AtomicU32, AtomicU64, AtomicUsize, Ordering},
+        Arc,
+    },
+    time::Duration,
+};
+
+use parking_lot::{Condvar, Mutex};
+
+use crate::{log_level::LogLevel, ring_buffer::SpscRing, semaphore_lite::SemaphoreLite};
+
+use super::{LogData, OverflowPolicy, QueueMode};
+
+/// Blocked producers check the limits again at least this often
+const BLOCK_RECHECK: Duration = Duration::from_millis(10);
+
+/// How much the queue may hold and what happens past that.
+/// A limit of 0 means none.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct QueueLimits {
+    pub max_records: usize,
+    pub max_bytes: usize,
+    pub overflow: OverflowPolicy,
+}
+
+impl QueueLimits {
+    /// Whether the queue keeps track of its size at all
+    fn is_bounded(&self) -> bool {
+        self.overflow != OverflowPolicy::Unbounded && (self.max_records != 0 || self.max_bytes != 0)
+    }
+
+    /// Whether `records` and `bytes` exceed the limits scaled by `numerator / denominator`
+    fn exceeded(&self, records: usize, bytes: usize, numerator: usize, denominator: usize) -> bool {
+        let over =
+            |value: usize, limit: usize| limit != 0 && value * denominator > limit * numerator;
+        over(records, self.max_records) || over(bytes, self.max_bytes)
+    }
+}
+
+/// Used to tell apart rings belonging to different queues in the same thread.
+static NEXT_QUEUE_ID: AtomicUsize = AtomicUsize::new(0);
+
+/// The ring of one producer thread
+struct ProducerRing {
+    ring: SpscRing<LogData>,
+    /// Set while logs this thread spilled wait in the shared queue.
+    /// The thread keeps spilling until the consumer took them, so later logs
+    /// can't overtake them through the ring.
+    spilled: AtomicBool,
+}
+
+thread_local! {
+    /// Rings owned by the current thread, keyed by queue id.
+    /// Dropping these on thread exit lets the consumer retire them once drained.
+    static PRODUCER_RINGS: RefCell<Vec<(usize, Arc<ProducerRing>)>> = const { RefCell::new(Vec::new()) };
+
+    /// Set on the logging thread, which must never block on its own queue
+    static IS_CONSUMER: Cell<bool> = const { Cell::new(false) };
+}
+
+/// Whether the calling thread drains a queue, see [`LogQueue::register_consumer`]
+pub(crate) fn is_consumer() -> bool {
+    IS_CONSUMER.try_with(Cell::get).unwrap_or(false)
+}
+
+/// The queue between log producers and the logging thread.
+///
+/// In [`QueueMode::Locked`] every producer pushes into one mutex protected Vec.
+/// In [`QueueMode::PerThreadRing`] each producer thread gets its own lock-free ring
+/// and only touches the shared Vec when its ring is full. Either way, the logs of
+/// one thread come out in the order it queued them.
+pub struct LogQueue {
+    id: usize,
+    mode: QueueMode,
+
+    /// Semaphore to indicate new log entries
+    semaphore: SemaphoreLite,
+
+    /// Shared queue. In ring mode, this only holds overflow.
+    locked: Mutex<Vec<LogData>>,
+    /// What `locked` shrinks back to in [`LogQueue::trim`]
+    initial_capacity: usize,
+
+    /// Every producer ring, only locked on registration and by the consumer
+    rings: Mutex<Vec<Arc<ProducerRing>>>,
+
+    /// Whether the consumer is (about to be) asleep
+    parked: AtomicBool,
+
+    limits: QueueLimits,
+    /// Logs and bytes queued, only tracked when bounded
+    queued_records: AtomicUsize,
+    queued_bytes: AtomicUsize,
+    /// Logs dropped since the queue was created
+    dropped: AtomicU64,
+    /// `dropped` as of the last [`LogQueue::take_dropped`]
+    reported_dropped: AtomicU64,
+    /// Counts logs offered while sampling
+    sample_counter: AtomicU32,
+    /// Wakes producers blocked on a full queue
+    space_lock: Mutex<()>,
+    space_freed: Condvar,
+}
+
+impl LogQueue {
+    pub fn new(mode: QueueMode, initial_capacity: usize) -> Self {
+        Self::with_limits(mode, initial_capacity, QueueLimits::default())
+    }
+
+    pub fn with_limits(mode: QueueMode, initial_capacity: usize, limits: QueueLimits) -> Self {
+        LogQueue {
+            id: NEXT_QUEUE_ID.fetch_add(1, Ordering::Relaxed),
+            mode,
+            semaphore: SemaphoreLite::new(),
+            locked: Mutex::new(Vec::with_capacity(initial_capacity)),
+            initial_capacity,
+            rings: Mutex::new(Vec::new()),
+            parked: AtomicBool::new(false),
+            limits,
+            queued_records: AtomicUsize::new(0),
+            queued_bytes: AtomicUsize::new(0),
+            dropped: AtomicU64::new(0),
+            reported_dropped: AtomicU64::new(0),
+            sample_counter: AtomicU32::new(0),
+            space_lock: Mutex::new(()),
+            space_freed: Condvar::new(),
+        }
+    }
+
+    pub fn mode(&self) -> QueueMode {
+        self.mode
+    }
+
+    /// The shared locked queue.
+    pub fn locked_queue(&self) -> &Mutex<Vec<LogData>> {
+        &self.locked
+    }
+
+    pub(crate) fn semaphore(&self) -> &SemaphoreLite {
+        &self.semaphore
+    }
+
+    /// Marks the calling thread as the one draining the queue.
+    /// Logs it queues itself are dropped instead of blocking on a full queue.
+    pub fn register_consumer(&self) {
+        IS_CONSUMER.with(|is_consumer| is_consumer.set(true));
+    }
+
+    /// Wakes the consumer even if nothing was queued, to pick up other work.
+    pub(crate) fn wake(&self) {
+        self.semaphore.signal();
+    }
+
+    pub fn limits(&self) -> QueueLimits {
+        self.limits
+    }
+
+    /// Logs dropped by the overflow policy since the last call
+    pub fn take_dropped(&self) -> u64 {
+        let dropped = self.dropped.load(Ordering::Relaxed);
+        dropped.saturating_sub(self.reported_dropped.swap(dropped, Ordering::Relaxed))
+    }
+
+    /// Logs dropped by the overflow policy since the queue was created
+    pub fn total_dropped(&self) -> u64 {
+        self.dropped.load(Ordering::Relaxed)
+    }
+
+    /// Queues a single entry. This is thread-safe.
+    pub fn push(&self, log_data: LogData) {
+        if self.limits.is_bounded() && !self.admit(&log_data) {
+            self.dropped.fetch_add(1, Ordering::Relaxed);
+            return;
+        }
+
+        match self.mode {
+            QueueMode::Locked => {
+                self.locked.lock().push(log_data);
+                self.semaphore.signal();
+            }
+            QueueMode::PerThreadRing { capacity } => {
+                self.push_ring(log_data, capacity);
+                self.wake_if_parked();
+            }
+        }
+    }
+
+    /// Queues several entries at once. This is thread-safe.
+    pub fn push_many(&self, log_data: impl Iterator<Item = LogData>) {
+        if self.limits.is_bounded() {
+            // every entry has to be admitted on its own
+            log_data.for_each(|log_data| self.push(log_data));
+            return;
+        }
+
+        match self.mode {
+            QueueMode::Locked => {
+                self.locked.lock().extend(log_data);
+                self.semaphore.signal();
+            }
+            QueueMode::PerThreadRing { capacity } => {
+                for log_data in log_data {
+                    self.push_ring(log_data, capacity);
+                }
+                self.wake_if_parked();
+            }
+        }
+    }
+
+    /// Pushes into the calling thread's ring, registering it on first use.
+    /// Spills into the shared queue if the ring is full or thread locals are gone.
+    fn push_ring(&self, log_data: LogData, capacity: usize) {
+        let mut log_data = Some(log_data);
+
+        let _ = PRODUCER_RINGS.try_with(|rings| {
+            let mut rings = rings.borrow_mut();
+
+            let index = match rings.iter().position(|(id, _)| *id == self.id) {
+                Some(index) => index,
+                None => {
+                    let ring = Arc::new(ProducerRing {
+                        ring: SpscRing::with_capacity(capacity),
+                        spilled: AtomicBool::new(false),
+                    });
+                    self.rings.lock().push(Arc::clone(&ring));
+                    rings.push((self.id, ring));
+                    rings.len() - 1
+                }
+            };
+            let producer = &rings[index].1;
+
+            // only this thread sets the flag, so it can't miss its own spill
+            if !producer.spilled.load(Ordering::Acquire) {
+                // SAFETY: a ring is only ever pushed to from the thread that owns it
+                match unsafe { producer.ring.push(log_data.take().unwrap()) } {
+                    Ok(()) => return,
+                    Err(full) => log_data = Some(full),
+                }
+            }
+
+            let mut locked = self.locked.lock();
+            producer.spilled.store(true, Ordering::Release);
+            locked.push(log_data.take().unwrap());
+        });
+
+        // without thread locals there is no ring to stay in order with
+        if let Some(log_data) = log_data {
+            self.locked.lock().push(log_data);
+        }
+    }
+
+    /// Reserves room for `log_data` according to the overflow policy.
+    /// Returns false if it should be dropped.
+    fn admit(&self, log_data: &LogData) -> bool {
+        let size = log_data.approximate_size();
+
+        loop {
+            // reserve first, so racing producers can't overshoot the limits together
+            let records = self.queued_records.fetch_add(1, Ordering::AcqRel) + 1;
+            let bytes = self.queued_bytes.fetch_add(size, Ordering::AcqRel) + size;
+
+            let admitted = match self.limits.overflow {
+                OverflowPolicy::Sample { one_in } if self.limits.exceeded(records, bytes, 1, 2) => {
+                    !self.limits.exceeded(records, bytes, 1, 1)
+                        && self.sample_counter.fetch_add(1, Ordering::Relaxed) % one_in.max(1) == 0
+                }
+                _ if !self.limits.exceeded(records, bytes, 1, 1) => true,
+
+                OverflowPolicy::DropBelowLevel { keep }
+                    if log_data.level.severity() >= keep.severity() =>
+                {
+                    self.evict_below(keep);
+                    let records = self.queued_records.load(Ordering::Acquire);
+                    let bytes = self.queued_bytes.load(Ordering::Acquire);
+                    !self.limits.exceeded(records, bytes, 1, 1)
+                }
+                // a log larger than the whole limit would wait forever
+                OverflowPolicy::Block if records == 1 => true,
+                _ => false,
+            };
+
+            if admitted {
+                return true;
+            }
+
+            self.release(1, size);
+
+            // the logging thread would wait on itself
+            if self.limits.overflow != OverflowPolicy::Block || is_consumer() {
+                return false;
+            }
+
+            // wait for the consumer to make room, the timeout covers a missed wakeup
+            self.wake_consumer();
+            let mut guard = self.space_lock.lock();
+            self.space_freed.wait_for(&mut guard, BLOCK_RECHECK);
+        }
+    }
+
+    /// Drops queued logs below `keep`, oldest first, until the queue is back at its limits.
+    /// Only the shared queue is searched.
+    fn evict_below(&self, keep: LogLevel) {
+        let mut locked = self.locked.lock();
+
+        let mut evicted = (0, 0);
+        locked.retain(|log_data| {
+            let records = self.queued_records.load(Ordering::Relaxed) - evicted.0;
+            let bytes = self.queued_bytes.load(Ordering::Relaxed) - evicted.1;
+            if log_data.level.severity() >= keep.severity()
+                || !self.limits.exceeded(records, bytes, 1, 1)
+            {
+                return true;
+            }
+
+            evicted.0 += 1;
+            evicted.1 += log_data.approximate_size();
+            false
+        });
+        drop(locked);
+
+        self.dropped.fetch_add(evicted.0 as u64, Ordering::Relaxed);
+        self.release(evicted.0, evicted.1);
+    }
+
+    /// Returns room taken by logs that left the queue
+    fn release(&self, records: usize, bytes: usize) {
+        self.queued_records.fetch_sub(records, Ordering::AcqRel);
+        self.queued_bytes.fetch_sub(bytes, Ordering::AcqRel);
+    }
+
+    fn wake_consumer(&self) {
+        match self.mode {
+            QueueMode::Locked => self.semaphore.signal(),
+            QueueMode::PerThreadRing { .. } => self.wake_if_parked(),
+        }
+    }
+
+    /// Signals the consumer, but only if it went to sleep.
+    fn wake_if_parked(&self) {
+        // pairs with the fence in `wait_for_logs`
+        fence(Ordering::SeqCst);
+        if self.parked.load(Ordering::Relaxed) {
+            self.semaphore.signal();
+        }
+    }
+
+    /// Moves every queued entry into a batch.
+    /// In locked mode the shared Vec is swapped with `replacement`,
+    /// in ring mode the rings and overflow are appended to `replacement`.
+    pub fn take_batch(&self, replacement: Vec<LogData>) -> Vec<LogData> {
+        let batch = self.drain_into(replacement);
+
+        if self.limits.is_bounded() && !batch.is_empty() {
+            let bytes = batch.iter().map(LogData::approximate_size).sum();
+            self.release(batch.len(), bytes);
+
+            if self.limits.overflow == OverflowPolicy::Block {
+                let _guard = self.space_lock.lock();
+                self.space_freed.notify_all();
+            }
+        }
+
+        batch
+    }
+
+    fn drain_into(&self, replacement: Vec<LogData>) -> Vec<LogData> {
+        match self.mode {
+            QueueMode::Locked => std::mem::replace(&mut *self.locked.lock(), replacement),
+            QueueMode::PerThreadRing { .. } => {
+                let mut batch = replacement;
+                let mut rings = self.rings.lock();
+
+                // SAFETY: the consumer side is serialized by the `rings` lock
+                let drain = |producer: &ProducerRing, batch: &mut Vec<LogData>| {
+                    while let Some(log_data) = unsafe { producer.ring.pop() } {
+                        batch.push(log_data);
+                    }
+                };
+
+                for producer in rings.iter() {
+                    drain(producer, &mut batch);
+                }
+
+                let mut locked = self.locked.lock();
+                for producer in rings.iter() {
+                    if producer.spilled.load(Ordering::Acquire) {
+                        // the thread stopped pushing to its ring when it spilled,
+                        // whatever it pushed since the drain above is older
+                        drain(producer, &mut batch);
+                        producer.spilled.store(false, Ordering::Release);
+                    }
+                }
+                batch.append(&mut locked);
+                drop(locked);
+
+                // retire rings whose producer thread has exited
+                rings.retain(|producer| {
+                    Arc::strong_count(producer) > 1 || !producer.ring.is_empty()
+                });
+                batch
+            }
+        }
+    }
+
+    /// Shrinks the shared Vec back to its initial capacity after a burst grew it
+    pub fn trim(&self) {
+        self.locked.lock().shrink_to(self.initial_capacity);
+    }
+
+    pub fn is_empty(&self) -> bool {
+        if !self.locked.lock().is_empty() {
+            return false;
+        }
+
+        match self.mode {
+            QueueMode::Locked => true,
+            QueueMode::PerThreadRing { .. } => self
+                .rings
+                .lock()
+                .iter()
+                .all(|producer| producer.ring.is_empty()),
+        }
+    }
+
+    /// Blocks the consumer until there is something to drain.
+    pub fn wait_for_logs(&self) {
+        self.wait_for_logs_until(None);
+    }
+
+    /// Blocks the consumer until there is something to drain or `timeout` passed.
+    pub fn wait_for_logs_timeout(&self, timeout: Duration) {
+        self.wait_for_logs_until(Some(timeout));
+    }
+
+    fn wait_for_logs_until(&self, timeout: Option<Duration>) {
+        let wait = || match timeout {
+            Some(timeout) => self.semaphore.wait_timeout(timeout),
+            None => self.semaphore.wait(),
+        };
+
+        match self.mode {
+            QueueMode::Locked => {
+                if self.is_empty() {
+                    wait();
+                }
+            }
+            QueueMode::PerThreadRing { .. } => {
+                self.parked.store(true, Ordering::Relaxed);
+                // pairs with the fence in `wake_if_parked`
+                fence(Ordering::SeqCst);
+
+                if self.is_empty() {
+                    wait();
+                }
+                self.parked.store(false, Ordering::Relaxed);
+            }
+        }
+    }
+
+    pub fn wait_timeout(&self, duration: Duration) {
+        self.semaphore.wait_timeout(duration);
+    }
+}
@@ -2,6 +2,8 @@
 
 use crate::{log_level::LogLevel, Result};
 
+use super::render::RenderedRecord;
+
 use std::ffi::{CStr, CString};
 
 // assert tracing is not enabled
@@ -68,37 +70,40 @@ thread_local! {
 }
 
 pub(crate) fn do_log(log: &super::log_data::LogData) -> Result<()> {
-    let message_str = format!(
-        "[{}:{}:{} @ {}] {}",
-        log.file,
-        log.line,
-        log.column,
-        log.function_name.as_deref().unwrap_or(""),
-        log.message.clone()
-    );
+    let mut arena = String::new();
+    do_log_line(log, &RenderedRecord::render(log, &mut arena), &log.message)
+}
+
+/// Writes one line of `log`, prefixed by its rendered location
+pub(crate) fn do_log_line(
+    log: &super::log_data::LogData,
+    record: &RenderedRecord,
+    line: &str,
+) -> Result<()> {
+    let location = record.location();
 
     let priority: Priority = log.level.into();
     CSTRING_BUFFER.with_borrow_mut(|buffer| unsafe {
         let tag = log.tag.as_deref().unwrap_or("default");
 
-        let sizes = tag.len() + log.file.len() + message_str.len() + 3;
-        if buffer.capacity() < sizes {
-            let capacity = buffer.capacity();
-            buffer.reserve(sizes - capacity);
-        }
+        buffer.clear();
+        buffer.reserve(tag.len() + log.file.len() + location.len() + line.len() + 3);
 
         // tag, file, and message are null-terminated
-        buffer.extend(tag.bytes().chain(std::iter::once(b'\0')));
-        buffer.extend(log.file.bytes().chain(std::iter::once(b'\0')));
-        buffer.extend(message_str.bytes().chain(std::iter::once(b'\0')));
+        buffer.extend_from_slice(tag.as_bytes());
+        buffer.push(b'\0');
+        buffer.extend_from_slice(log.file.as_bytes());
+        buffer.push(b'\0');
+        buffer.extend_from_slice(location.as_bytes());
+        buffer.extend_from_slice(line.as_bytes());
+        buffer.push(b'\0');
 
         let tag_len = tag.len() + 1;
         let file_len = tag_len + log.file.len() + 1;
-        let message_len = message_str.len() + 1;
 
         let tag = CStr::from_bytes_with_nul_unchecked(&buffer[0..tag_len]);
         let file = CStr::from_bytes_with_nul_unchecked(&buffer[tag_len..file_len]);
-        let message = CStr::from_bytes_with_nul_unchecked(&buffer[file_len..message_len]);
+        let message = CStr::from_bytes_with_nul_unchecked(&buffer[file_len..]);
 
         #[cfg(feature = "android-api-30")]
         {
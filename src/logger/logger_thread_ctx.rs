@@ -1,33 +1,52 @@
 use std::{
     backtrace::Backtrace,
-    fs::{self, File},
-    io::{BufWriter, Write},
-    panic::PanicHookInfo,
+    fs,
+    panic::{self, AssertUnwindSafe, PanicHookInfo},
     path::PathBuf,
     sync::{
-        atomic::{AtomicBool, Ordering},
+        atomic::{AtomicBool, AtomicU64, Ordering},
+        mpsc::{self, Receiver, SyncSender, TrySendError},
         Arc,
     },
     thread,
-    time::Duration,
+    time::{Duration, Instant},
 };
 
 use crate::{
     log_level::LogLevel,
-    logger::{LogCallback, LogData, LoggerConfig},
+    logger::{
+        clock::{self, Timestamp},
+        flight_recorder::FlightRecorder,
+        log_queue::{LogQueue, QueueLimits},
+        message_pool,
+        profile_stats::{ProfileStats, QUEUE_LATENCY_ZONE},
+        render::RenderBuffer,
+        sink_dispatch::{Sink, SinkDispatcher, SinkFilter},
+        stats::{LoggerMetrics, LoggerStats},
+        trace::TraceBatch,
+        FlushPolicy, LogBatchCallback, LogCallback, LogData, LoggerConfig,
+    },
     semaphore_lite::SemaphoreLite,
     vec_pool::VecPool,
     LoggerError, Result,
 };
-use chrono::Local;
-use itertools::Itertools;
 use parking_lot::{Mutex, RwLock};
+
+#[cfg(feature = "file")]
+use std::sync::mpsc::Sender;
+
 #[cfg(feature = "file")]
-use rustc_hash::FxHashMap;
+use super::{
+    async_writer::IoWorker,
+    context_writers::ContextWriters,
+    file_logger::{FileControl, FileWriters},
+    rotation::RotatingFile,
+    trace::TraceFile,
+};
 
 // Helper macro to reduce repetition when constructing `LogData` and calling `do_log`.
 // The macro performs `format!` internally — pass format-style arguments directly.
-// Usage: log_data_to!(&logger, LogLevel::Error, Some("tag".to_string()), "msg: {}", val);
+// Usage: log_data_to!(&logger, LogLevel::Error, Some("tag".into()), "msg: {}", val);
 macro_rules! log_data_to {
     ($logger:expr, $level:expr, $tag:expr, $($arg:tt)+) => {{
         let message = format!($($arg)+);
@@ -36,25 +55,97 @@ macro_rules! log_data_to {
                 level: $level,
                 tag: $tag,
                 message,
-                timestamp: Local::now(),
-                file: file!().to_string(),
+                timestamp: Timestamp::now(),
+                file: file!().into(),
                 line: line!(),
                 column: column!(),
                 function_name: None,
+                callsite: None,
+                deferred: None,
+                fields: Vec::new(),
+                fields_start: None,
             },
             $logger,
         );
     }};
 }
 
+/// Logs dropped by the queue or missed by sinks are reported at most this often
+const DROP_REPORT_INTERVAL: Duration = Duration::from_secs(1);
+
+/// How long [`do_log`] waits for the logging thread to write its log to the files
+#[cfg(feature = "file")]
+const WRITE_NOW_TIMEOUT: Duration = Duration::from_secs(1);
+
+/// Profiling batches waiting for the logging thread before more are dropped
+const MAX_PENDING_TRACES: usize = 1024;
+
+#[cfg(feature = "file")]
+thread_local! {
+    /// The global and context files, owned by the logging thread while it runs.
+    /// Lets logs made on that thread itself, like the panic hook's, be written right away.
+    static LOG_THREAD_FILES: std::cell::RefCell<Option<FileWriters>> =
+        const { std::cell::RefCell::new(None) };
+}
+
+/// Runs `f` on the files. Only the logging thread has them.
+#[cfg(feature = "file")]
+fn with_files<R>(f: impl FnOnce(&mut FileWriters) -> R) -> R {
+    LOG_THREAD_FILES.with_borrow_mut(|files| {
+        f(files
+            .as_mut()
+            .expect("files are only written by the logging thread"))
+    })
+}
+
+/// The line standing in for logs the queue dropped
+fn dropped_report(dropped: u64) -> LogData {
+    LogData {
+        level: LogLevel::Warn,
+        tag: Some("Paper2".into()),
+        message: format!("Dropped {dropped} logs, the queue was full"),
+        file: file!().into(),
+        line: line!(),
+        column: column!(),
+        ..LogData::default()
+    }
+}
+
+/// The line standing in for profiling batches the logging thread had no room for
+fn traces_dropped_report(dropped: u64) -> LogData {
+    LogData {
+        level: LogLevel::Warn,
+        tag: Some("Paper2".into()),
+        message: format!(
+            "Dropped {dropped} batches of profiling zones, the logging thread fell behind"
+        ),
+        file: file!().into(),
+        line: line!(),
+        column: column!(),
+        ..LogData::default()
+    }
+}
+
+/// The line reporting sinks that fell behind or failed
+fn sink_report(dropped: u64, errors: u64) -> LogData {
+    LogData {
+        level: LogLevel::Warn,
+        tag: Some("Paper2".into()),
+        message: format!("Sinks missed {dropped} logs by falling behind and failed {errors} times"),
+        file: file!().into(),
+        line: line!(),
+        column: column!(),
+        ..LogData::default()
+    }
+}
+
 pub type ThreadSafeLoggerThread = Arc<RwLock<LoggerThreadCtx>>;
 
 pub struct LoggerThreadCtx {
     pub config: LoggerConfig,
 
-    /// Semaphore to indicate new log entries
-    /// Mutex to protect log queue
-    log_queue: Arc<(SemaphoreLite, Mutex<Vec<LogData>>)>,
+    /// Queue of pending log entries, signals new entries
+    log_queue: Arc<LogQueue>,
 
     /// Semaphore to indicate flush completion
     flush_semaphore: Arc<SemaphoreLite>,
@@ -62,25 +153,58 @@ pub struct LoggerThreadCtx {
     /// Whether the logger has been initialized
     inited: AtomicBool,
 
-    /// Global log file
+    /// The global and context files, moved to the logging thread by [`Self::init`].
+    /// Locked only for the move
+    #[cfg(feature = "file")]
+    files: Mutex<Option<FileWriters>>,
+
+    /// Hands context changes to the logging thread, which owns the files
     #[cfg(feature = "file")]
-    pub(super) global_file: BufWriter<File>,
+    file_control: Sender<FileControl>,
 
-    /// Map of context log files. ID -> Log file
+    /// Writes the files for [`super::FileBackend::Async`]
     #[cfg(feature = "file")]
-    pub(super) context_map: FxHashMap<String, BufWriter<File>>,
+    io_worker: Option<IoWorker>,
+
+    /// Additional log sinks, each run by a worker of its own
+    pub(super) sinks: SinkDispatcher,
+
+    /// Copies of the most recent logs, made as they are queued
+    flight_recorder: Option<Arc<FlightRecorder>>,
+
+    /// Counters behind [`Self::stats`]
+    metrics: Arc<LoggerMetrics>,
 
-    /// Additional log sinks
-    pub(super) sinks: Vec<Box<dyn LogCallback>>,
+    /// Hands profiling zones to the logging thread
+    traces: SyncSender<TraceBatch>,
+    /// Profiling batches dropped because the logging thread fell behind
+    traces_dropped: AtomicU64,
+    /// Moved to the logging thread by [`Self::init`]
+    trace_receiver: Mutex<Option<Receiver<TraceBatch>>>,
 }
 
 impl LoggerThreadCtx {
     pub fn new(config: LoggerConfig, log_path: PathBuf) -> Result<Self> {
-        let log_queue = Arc::new((
-            SemaphoreLite::new(),
-            Mutex::new(Vec::with_capacity(config.log_max_buffer_count)),
+        let log_queue = Arc::new(LogQueue::with_limits(
+            config.queue_mode,
+            config.log_max_buffer_count,
+            QueueLimits {
+                max_records: config.log_max_buffer_count,
+                max_bytes: config.queue_max_bytes,
+                overflow: config.overflow_policy,
+            },
         ));
         let flush_semaphore = Arc::new(SemaphoreLite::new());
+        let sinks = SinkDispatcher::new(config.max_string_len);
+        let flight_recorder = (config.flight_recorder_slots != 0)
+            .then(|| Arc::new(FlightRecorder::new(config.flight_recorder_slots)));
+        clock::set_precision(config.timestamp_precision);
+
+        #[cfg(feature = "file")]
+        let io_worker = match config.file_backend {
+            super::FileBackend::Async => Some(IoWorker::spawn()?),
+            _ => None,
+        };
 
         #[cfg(feature = "file")]
         let global_file = {
@@ -102,30 +226,96 @@ impl LoggerThreadCtx {
                 })?;
             }
 
-            let inner = File::create(&log_path).map_err(|e| {
+            RotatingFile::create(
+                log_path.clone(),
+                config.file_backend,
+                io_worker.as_ref(),
+                config.rotation,
+                config.file_format,
+            )
+            .map_err(|e| {
                 LoggerError::IoSpecificError(
                     e,
                     Some("Unable to create global file".to_string()),
                     log_path,
                 )
-            })?;
-            BufWriter::new(inner)
+            })?
+        };
+
+        #[cfg(feature = "file")]
+        let trace_file = match &config.trace_path {
+            Some(path) => Some(TraceFile::create(path).map_err(|e| {
+                LoggerError::IoSpecificError(
+                    e,
+                    Some("Unable to create trace file".to_string()),
+                    path.clone(),
+                )
+            })?),
+            None => None,
+        };
+
+        #[cfg(feature = "file")]
+        let context_writers = match config.context_writer_threads {
+            0 => None,
+            threads => Some(
+                ContextWriters::spawn(threads, config.max_string_len).map_err(|e| {
+                    LoggerError::IoSpecificError(
+                        e,
+                        Some("Unable to start the context writers".to_string()),
+                        config.context_log_path.clone(),
+                    )
+                })?,
+            ),
         };
 
-        Ok(LoggerThreadCtx {
+        #[cfg(feature = "file")]
+        let (file_control, control_receiver) = mpsc::channel();
+        let (traces, trace_receiver) = mpsc::sync_channel(MAX_PENDING_TRACES);
+
+        let logger = LoggerThreadCtx {
             config,
             log_queue,
             flush_semaphore,
             inited: AtomicBool::new(false),
 
             #[cfg(feature = "file")]
-            global_file,
+            files: Mutex::new(Some(FileWriters::new(
+                global_file,
+                trace_file,
+                io_worker.clone(),
+                context_writers,
+                control_receiver,
+            ))),
+
+            #[cfg(feature = "file")]
+            file_control,
 
             #[cfg(feature = "file")]
-            context_map: Default::default(),
+            io_worker,
+
+            sinks,
+            flight_recorder,
+            metrics: Arc::default(),
+            traces,
+            traces_dropped: AtomicU64::new(0),
+            trace_receiver: Mutex::new(Some(trace_receiver)),
+        };
+
+        #[cfg(all(feature = "file", not(feature = "compress")))]
+        if logger.config.rotation.is_enabled() && logger.config.rotation.compress {
+            logger.queue_log(LogData {
+                level: LogLevel::Warn,
+                tag: Some("Paper2".into()),
+                message: "Rotated segments stay uncompressed without the compress feature"
+                    .to_string(),
+                file: file!().into(),
+                line: line!(),
+                column: column!(),
+                ..LogData::default()
+            });
+        }
 
-            sinks: Vec::new(),
-        })
+        Ok(logger)
     }
 
     pub fn init(self, install_panic_hook: bool) -> Result<ThreadSafeLoggerThread> {
@@ -133,10 +323,44 @@ impl LoggerThreadCtx {
             return Err(LoggerError::AlreadyInitialized);
         }
 
+        #[cfg(all(unix, feature = "flight_recorder"))]
+        if let (Some(recorder), Some(path)) = (&self.flight_recorder, &self.config.crash_dump_path)
+        {
+            super::flight_recorder::install_crash_handler(recorder, path).map_err(|e| {
+                LoggerError::IoSpecificError(
+                    e,
+                    Some("Unable to install the crash handler".to_string()),
+                    path.clone(),
+                )
+            })?;
+        }
+
         self.inited.store(true, Ordering::SeqCst);
 
-        let log_queue_clone = Arc::clone(&self.log_queue);
-        let flush_semaphore_clone = Arc::clone(&self.flush_semaphore);
+        let mut log_thread = LogThread {
+            log_queue: Arc::clone(&self.log_queue),
+            flush_semaphore: Arc::clone(&self.flush_semaphore),
+            max_str_len: self.config.max_string_len,
+            flush_policy: self.config.flush_policy,
+            traces: self
+                .trace_receiver
+                .lock()
+                .take()
+                .ok_or(LoggerError::AlreadyInitialized)?,
+            profile: self
+                .config
+                .profile_report_interval
+                .map(|interval| (ProfileStats::default(), interval)),
+            metrics: Arc::clone(&self.metrics),
+            stats_report_interval: self.config.stats_report_interval,
+            trim_idle_after: self.config.trim_idle_after,
+        };
+        #[cfg(feature = "file")]
+        let files = self
+            .files
+            .lock()
+            .take()
+            .ok_or(LoggerError::AlreadyInitialized)?;
         let thread_safe_self: Arc<RwLock<LoggerThreadCtx>> = Arc::new(self.into());
         let thread_safe_self_clone = Arc::clone(&thread_safe_self);
 
@@ -155,22 +379,37 @@ impl LoggerThreadCtx {
         }
 
         thread::spawn(move || {
-            let result = Self::log_thread(
-                log_queue_clone,
-                flush_semaphore_clone.clone(),
-                thread_safe_self_clone.clone(),
-            );
+            #[cfg(feature = "file")]
+            LOG_THREAD_FILES.set(Some(files));
+
+            let result = match panic::catch_unwind(AssertUnwindSafe(|| {
+                log_thread.run(&thread_safe_self_clone)
+            })) {
+                Ok(result) => result,
+                Err(panic) => {
+                    // the panic hook's log, if the files were in use when it ran
+                    #[cfg(feature = "file")]
+                    with_files(|files| {
+                        let _ = files.apply_controls();
+                    });
+                    panic::resume_unwind(panic);
+                }
+            };
 
             // handle log thread dying
             if let Err(e) = result {
-                let _ = Self::flush(&thread_safe_self_clone, &flush_semaphore_clone);
-
-                log_data_to!(
-                    &thread_safe_self_clone,
-                    LogLevel::Error,
-                    Some("Paper2".to_string()),
-                    "Error occurred in logging thread: {e}"
-                );
+                let log = LogData {
+                    level: LogLevel::Error,
+                    tag: Some("Paper2".into()),
+                    message: format!("Error occurred in logging thread: {e}"),
+                    file: file!().into(),
+                    line: line!(),
+                    column: column!(),
+                    ..LogData::default()
+                };
+
+                // written to the files right here, this is the logging thread
+                let _ = do_log(log, &thread_safe_self_clone);
             }
         });
 
@@ -181,35 +420,49 @@ impl LoggerThreadCtx {
         &self.inited
     }
 
+    /// The shared locked queue.
+    /// In [`crate::logger::QueueMode::PerThreadRing`] mode this only holds overflow.
     pub fn get_queue(&self) -> &Mutex<Vec<LogData>> {
-        &self.log_queue.1
+        self.log_queue.locked_queue()
     }
 
-    pub fn get_sinks(&self) -> &Vec<Box<dyn LogCallback>> {
+    pub fn get_sinks(&self) -> &SinkDispatcher {
         &self.sinks
     }
 
     /// Queues a log entry to be written by the logging thread.
     /// This is thread-safe.
     pub fn queue_log(&self, log_data: LogData) {
-        let (sempahore, queue) = self.log_queue.as_ref();
-
-        queue.lock().push(log_data);
-        sempahore.signal();
+        if let Some(recorder) = &self.flight_recorder {
+            recorder.record(&log_data);
+        }
+        self.metrics.record_queued(1);
+        self.log_queue.push(log_data);
     }
 
     /// Queues a log entry to be written by the logging thread.
     /// This is thread-safe.
     pub fn queue_logs(&self, log_data: impl Iterator<Item = LogData>) {
-        let (sempahore, queue) = self.log_queue.as_ref();
-
-        {
-            let mut locked_queue = queue.lock();
-            for log_data in log_data {
-                locked_queue.push(log_data);
+        let recorder = self.flight_recorder.as_deref();
+        let mut queued = 0;
+        self.log_queue.push_many(log_data.inspect(|log| {
+            if let Some(recorder) = recorder {
+                recorder.record(log);
             }
-        }
-        sempahore.signal();
+            queued += 1;
+        }));
+        self.metrics.record_queued(queued);
+    }
+
+    /// The logger's own counters, see [`LoggerStats`]
+    pub fn stats(&self) -> LoggerStats {
+        self.metrics.snapshot(self.log_queue.total_dropped())
+    }
+
+    /// The most recent logs, kept for crash dumps.
+    /// `None` if [`LoggerConfig::flight_recorder_slots`] is 0.
+    pub fn flight_recorder(&self) -> Option<&Arc<FlightRecorder>> {
+        self.flight_recorder.as_ref()
     }
 
     #[cfg(feature = "backtrace")]
@@ -234,189 +487,461 @@ impl LoggerThreadCtx {
         Ok(())
     }
 
-    pub fn add_context(&mut self, tag: &str) -> Result<()> {
+    /// Starts writing the logs of `tag` to their own file.
+    /// The file is created right away, the logging thread picks it up before its next batch.
+    pub fn add_context(&self, tag: &str) -> Result<()> {
         #[cfg(feature = "file")]
         {
             let log_path = self.config.context_log_path.join(tag).with_extension("log");
-            let file = File::create(&log_path).map_err(|e| {
+            let file = RotatingFile::create(
+                log_path.clone(),
+                self.config.file_backend,
+                self.io_worker.as_ref(),
+                self.config.rotation,
+                self.config.file_format,
+            )
+            .map_err(|e| {
                 LoggerError::IoSpecificError(
                     e,
                     Some("Unable to create context file".to_string()),
                     log_path,
                 )
             })?;
-            let file = BufWriter::new(file);
 
-            self.context_map.insert(tag.to_string(), file);
+            self.send_file_control(FileControl::AddContext(tag.into(), file))?;
         }
 
         Ok(())
     }
-    pub fn remove_context(&mut self, tag: &str) {
+
+    pub fn remove_context(&self, tag: &str) {
         #[cfg(feature = "file")]
         {
-            self.context_map.remove(tag);
+            let _ = self.send_file_control(FileControl::RemoveContext(tag.into()));
+        }
+    }
+
+    /// Whether profiling zones are used at all, so producers can skip collecting them.
+    /// Set by [`LoggerConfig::trace_path`] or [`LoggerConfig::profile_report_interval`].
+    pub fn wants_traces(&self) -> bool {
+        self.config.trace_path.is_some() || self.config.profile_report_interval.is_some()
+    }
+
+    /// Hands profiling zones to the logging thread, for the trace file and the zone statistics.
+    /// Dropped unless [`Self::wants_traces`], or counted and dropped if
+    /// [`MAX_PENDING_TRACES`] batches are still waiting.
+    pub fn submit_trace(&self, batch: TraceBatch) {
+        if !self.wants_traces() || batch.events.is_empty() {
+            return;
+        }
+
+        match self.traces.try_send(batch) {
+            Ok(()) => self.log_queue.wake(),
+            Err(TrySendError::Full(_)) => {
+                self.traces_dropped.fetch_add(1, Ordering::Relaxed);
+            }
+            Err(TrySendError::Disconnected(_)) => {}
+        }
+    }
+
+    /// Profiling batches dropped since the last call
+    fn take_traces_dropped(&self) -> u64 {
+        self.traces_dropped.swap(0, Ordering::Relaxed)
+    }
+
+    #[cfg(feature = "file")]
+    fn send_file_control(&self, control: FileControl) -> Result<()> {
+        self.file_control.send(control).map_err(|_| {
+            LoggerError::LogError(
+                "The logging thread exited".to_string(),
+                Backtrace::capture(),
+            )
+        })?;
+        self.log_queue.wake();
+        Ok(())
+    }
+
+    /// Writes `log` to the files outside the batches.
+    /// The logging thread writes it itself, other threads hand it over and get what to wait on.
+    #[cfg(feature = "file")]
+    fn write_files_now(&self, log: LogData) -> Result<Option<Arc<SemaphoreLite>>> {
+        let written = Arc::new(SemaphoreLite::new());
+
+        if super::log_queue::is_consumer() {
+            let result = LOG_THREAD_FILES.try_with(|files| {
+                let mut files = files.try_borrow_mut().ok()?;
+                let files = files.as_mut()?;
+                Some(
+                    files
+                        .write_log(&log)
+                        .and_then(|()| files.flush(&written, true)),
+                )
+            });
+
+            match result {
+                Ok(Some(result)) => result?,
+                // the files are in use further up the stack, as when writing them panicked.
+                // Applied once they are free again
+                _ => self.send_file_control(FileControl::Write(Box::new(log), written))?,
+            }
+            return Ok(None);
+        }
+
+        self.send_file_control(FileControl::Write(Box::new(log), Arc::clone(&written)))?;
+        Ok(Some(written))
+    }
+
+    /// Has the logging thread flush every file and cut off what mapped files preallocated,
+    /// waiting for it. Meant for shutdown, logs written afterwards still reach the files.
+    #[cfg(feature = "file")]
+    pub fn finish_files(&self) -> Result<()> {
+        if super::log_queue::is_consumer() {
+            return Ok(());
         }
+
+        let finished = Arc::new(SemaphoreLite::new());
+        self.send_file_control(FileControl::Finish(Arc::clone(&finished)))?;
+        finished.wait_timeout(WRITE_NOW_TIMEOUT);
+        Ok(())
+    }
+
+    pub fn add_sink<F>(&mut self, sink: F) -> Result<()>
+    where
+        F: LogCallback + 'static,
+    {
+        self.add_filtered_sink(sink, SinkFilter::default())
     }
 
-    pub fn add_sink<F>(&mut self, sink: F)
+    /// Adds a sink that is only called with the lines of logs passing `filter`
+    pub fn add_filtered_sink<F>(&mut self, sink: F, filter: SinkFilter) -> Result<()>
     where
         F: LogCallback + 'static,
     {
-        self.sinks.push(Box::new(sink));
+        Ok(self.sinks.add(Sink::Record(Box::new(sink)), filter)?)
+    }
+
+    /// Adds a sink that is called once per batch, with the lines of every log passing `filter`
+    pub fn add_batch_sink<F>(&mut self, sink: F, filter: SinkFilter) -> Result<()>
+    where
+        F: LogBatchCallback + 'static,
+    {
+        Ok(self.sinks.add(Sink::Batch(Box::new(sink)), filter)?)
+    }
+
+    ///
+    /// Waits indefinitely until the next queue is flushed
+    /// May block until a log is called forth
+    pub fn wait_for_flush(&self) {
+        self.log_queue.semaphore().wait();
+    }
+    pub fn wait_for_flush_timeout(&self, duration: Duration) {
+        self.log_queue.wait_timeout(duration);
     }
+}
+
+/// State only the logging thread touches
+struct LogThread {
+    log_queue: Arc<LogQueue>,
+
+    /// Signaled once the files are flushed
+    flush_semaphore: Arc<SemaphoreLite>,
+
+    /// Copied from the config, so the thread doesn't lock it for every batch
+    max_str_len: usize,
+    flush_policy: FlushPolicy,
+
+    /// Profiling zones handed over by producers
+    traces: Receiver<TraceBatch>,
+    /// Zone statistics and how often they are reported, if enabled
+    profile: Option<(ProfileStats, Duration)>,
+
+    metrics: Arc<LoggerMetrics>,
+    stats_report_interval: Option<Duration>,
+    trim_idle_after: Option<Duration>,
+}
 
+impl LogThread {
     /// The main logging thread function.
     /// Waits for log entries and writes them to the appropriate backends.
     /// This function runs indefinitely until the program exits.
-    fn log_thread(
-        log_queue: Arc<(SemaphoreLite, Mutex<Vec<LogData>>)>,
-        flush_semaphore: Arc<SemaphoreLite>,
-        logger_thread: Arc<RwLock<LoggerThreadCtx>>,
-    ) -> Result<()> {
-        //TODO: Use config max buffer count to limit log batch size
-        let mut log_pool: VecPool<LogData> = VecPool::with_initial_amount(2, 1024);
+    fn run(&mut self, logger_thread: &RwLock<LoggerThreadCtx>) -> Result<()> {
+        let log_queue = Arc::clone(&self.log_queue);
+        let max_str_len = self.max_str_len;
 
-        let (log_semaphore_lite, log_mutex) = log_queue.as_ref();
+        // batches are as large as the queue limits allow
+        log_queue.register_consumer();
+        let mut last_drop_report = Instant::now();
+        let mut last_profile_report = Instant::now();
+        let mut last_stats_report = Instant::now();
 
-        let mut logged = 0;
+        let mut log_pool: VecPool<LogData> = VecPool::with_initial_amount(2, 1024);
+        // headers of the current batch, shared by every output
+        let mut rendered = RenderBuffer::with_capacity(1024);
+        // when the last batch was written, memory is trimmed once idle for long enough
+        let mut last_batch: Option<Instant> = None;
+        // batches context writers and sinks still hold, recycled once they let go
+        let mut in_flight: Vec<Arc<Vec<LogData>>> = Vec::new();
+
+        let flush_policy = self.flush_policy;
+        // what was written since the last flush
+        let mut dirty_since: Option<Instant> = None;
+        let mut dirty_bytes = 0;
+        let mut flush_now = false;
 
         loop {
-            let vec = log_pool.take_vec();
-            // move items from queue to local variable
-            // then resize the vec to 100
-            // preventing an infinite growing log buffer
-            let queue = {
-                let mut locked = log_mutex.lock();
-                std::mem::replace(&mut *locked, vec.to_vec())
-            };
-            logged += queue.len();
+            // time slept since the last batch is missing from the monotonic clock,
+            // logs queued from here on are mapped to wall time with the new anchor
+            clock::reanchor();
+
+            // in locked mode the pooled Vec becomes the shared queue,
+            // and the batch it replaces goes back to the pool once written
+            let mut queue = log_queue.take_batch(log_pool.take());
+            let batch_start = Instant::now();
+            let taken = queue.len() as u64;
+
+            // contexts registered before any of these logs were queued are applied first
+            #[cfg(feature = "file")]
+            with_files(FileWriters::apply_controls)?;
+
+            self.apply_traces();
+            if let Some((stats, interval)) = &mut self.profile {
+                if last_profile_report.elapsed() >= *interval {
+                    queue.extend(stats.take_report());
+                    last_profile_report = Instant::now();
+                }
+            }
+
+            if last_drop_report.elapsed() >= DROP_REPORT_INTERVAL {
+                let dropped = log_queue.take_dropped();
+                if dropped != 0 {
+                    queue.push(dropped_report(dropped));
+                }
+
+                let logger = logger_thread.read();
+                let (sink_dropped, sink_errors) =
+                    (logger.sinks.take_dropped(), logger.sinks.take_errors());
+                let traces_dropped = logger.take_traces_dropped();
+                drop(logger);
+                if sink_dropped != 0 || sink_errors != 0 {
+                    self.metrics.record_sink_report(sink_dropped, sink_errors);
+                    queue.push(sink_report(sink_dropped, sink_errors));
+                }
+                if traces_dropped != 0 {
+                    queue.push(traces_dropped_report(traces_dropped));
+                }
+                last_drop_report = Instant::now();
+            }
+
+            if let Some(interval) = self.stats_report_interval {
+                if last_stats_report.elapsed() >= interval {
+                    let stats = self.metrics.snapshot(log_queue.total_dropped());
+                    queue.push(stats.to_log());
+                    last_stats_report = Instant::now();
+                }
+            }
 
             // if queue is not empty, write the logs
             if !queue.is_empty() {
-                let max_str_len = logger_thread.read().config.max_string_len;
-                // collect the split logs into a vec so we can batch file writes
-                let logs_vec: Vec<LogData> = split_str_into_chunks(queue, max_str_len).collect();
+                // format messages and fields the producers left to us
+                queue.iter_mut().for_each(|log| {
+                    log.render_deferred();
+                    log.render_fields();
+                });
+
+                if let Some((stats, _)) = &mut self.profile {
+                    let now = Timestamp::now().monotonic_nanos();
+                    for log in &queue {
+                        let queued = log.timestamp.monotonic_nanos();
+                        stats.record(QUEUE_LATENCY_ZONE, now.saturating_sub(queued));
+                    }
+                }
+
+                // messages are split into lines by each output, borrowing the record
+                rendered.render_batch(&queue);
+
+                dirty_since.get_or_insert_with(Instant::now);
+                dirty_bytes += queue.iter().map(LogData::approximate_size).sum::<usize>();
+                flush_now |= queue
+                    .iter()
+                    .any(|log| flush_policy.flushes_immediately(log.level));
 
-                // Batch file writes under a single write lock to reduce overhead
+                // the files belong to this thread, writing them takes no lock
                 #[cfg(feature = "file")]
                 {
-                    // write files in batch
-                    super::file_logger::do_log_batch(&logs_vec, &logger_thread)?;
+                    let bytes_written = with_files(|files| {
+                        files.write_batch(&queue, &rendered, max_str_len)?;
+                        std::io::Result::Ok(files.bytes_written())
+                    })?;
+                    self.metrics.set_bytes_written(bytes_written);
                 }
 
                 // Call non-file backends per log (these are typically cheaper and may
                 // require per-log handling).
-                for log in &logs_vec {
-                    #[cfg(all(target_os = "android", feature = "logcat"))]
-                    super::logcat_logger::do_log(log)?;
+                #[cfg(any(
+                    all(target_os = "android", feature = "logcat"),
+                    feature = "stdout",
+                    feature = "tracing"
+                ))]
+                for (log, record) in queue.iter().zip(rendered.iter()) {
+                    for line in super::line_split::segments(&log.message, max_str_len) {
+                        #[cfg(all(target_os = "android", feature = "logcat"))]
+                        super::logcat_logger::do_log_line(log, &record, line)?;
+
+                        #[cfg(feature = "stdout")]
+                        super::stdout_logger::do_log_line(log, &record, line);
+
+                        #[cfg(feature = "tracing")]
+                        super::tracing_logger::do_log_line(log, &record, line)?;
+                    }
+                }
+
+                // context writers and sink workers share the batch, nothing is copied
+                let batch = Arc::new(std::mem::take(&mut queue));
+
+                #[cfg(feature = "file")]
+                with_files(|files| files.write_contexts(&batch))?;
 
-                    #[cfg(feature = "stdout")]
-                    stdout_logger::do_log(log);
+                #[cfg(feature = "sinks")]
+                super::sink_logger::do_log_batch(&batch, logger_thread);
 
-                    #[cfg(feature = "sinks")]
-                    super::sink_logger::do_log(log, &logger_thread)?;
+                in_flight.push(batch);
+                self.metrics.record_batch(taken, batch_start.elapsed());
+                last_batch = Some(Instant::now());
+            }
+            if queue.capacity() != 0 {
+                log_pool.return_vec(queue);
+            }
 
-                    #[cfg(feature = "tracing")]
-                    tracing_logger::do_log(log)?;
+            #[cfg(feature = "file")]
+            with_files(FileWriters::finish_requested)?;
+
+            // producers reuse the message buffers instead of allocating new ones
+            let mut index = 0;
+            while index < in_flight.len() {
+                match Arc::get_mut(&mut in_flight[index]) {
+                    Some(batch) => {
+                        let mut batch = std::mem::take(batch);
+                        in_flight.swap_remove(index);
+
+                        message_pool::recycle(&mut batch);
+                        log_pool.return_vec(batch);
+                    }
+                    None => index += 1,
                 }
             }
 
-            // if no more logs in the pipeline, flush it
-            // or flush every 100 lines to avoid
-            // missing flushes
-            {
-                let is_empty = log_mutex.lock().is_empty();
+            // flush once the policy says so, batches written in between share the flush
+            if let Some(since) = dirty_since {
+                let due = flush_now
+                    || since.elapsed() >= flush_policy.max_latency
+                    || (flush_policy.max_dirty_bytes != 0
+                        && dirty_bytes >= flush_policy.max_dirty_bytes);
 
-                if is_empty || logged >= 100 {
-                    Self::flush(&logger_thread, &flush_semaphore)
+                if due {
+                    let flush_start = Instant::now();
+                    self.flush(flush_now)
                         .map_err(|e| LoggerError::FlushError(Box::new(e)))?;
-                    logged = 0;
+                    self.metrics.record_flush(flush_start.elapsed());
+                    dirty_since = None;
+                    dirty_bytes = 0;
+                    flush_now = false;
+                }
+            }
+
+            // a burst is over once nothing was written for a while,
+            // give back what it grew the pools and buffers to
+            let trim_in = match (last_batch, self.trim_idle_after) {
+                (Some(since), Some(after)) => {
+                    let trim_in = after.saturating_sub(since.elapsed());
+                    if trim_in.is_zero() {
+                        log_pool.trim(2);
+                        log_queue.trim();
+                        rendered.shrink_to(1024);
+                        message_pool::trim();
+                        last_batch = None;
+                        None
+                    } else {
+                        Some(trim_in)
+                    }
                 }
+                _ => None,
+            };
+
+            // only sleep if the queue is empty, and no longer than the pending flush,
+            // the next report or the next trim allows
+            let flush_in =
+                dirty_since.map(|since| flush_policy.max_latency.saturating_sub(since.elapsed()));
+            let profile_in = self
+                .profile
+                .as_ref()
+                .map(|(_, interval)| interval.saturating_sub(last_profile_report.elapsed()));
+            let stats_in = self
+                .stats_report_interval
+                .map(|interval| interval.saturating_sub(last_stats_report.elapsed()));
+            match flush_in
+                .into_iter()
+                .chain(profile_in)
+                .chain(stats_in)
+                .chain(trim_in)
+                .min()
+            {
+                Some(timeout) => log_queue.wait_for_logs_timeout(timeout),
+                None => log_queue.wait_for_logs(),
             }
-            // only lock if the queue is empty
-            if log_mutex.lock().is_empty() {
-                log_semaphore_lite.wait();
+        }
+    }
+
+    /// Takes in the profiling zones producers handed over
+    fn apply_traces(&mut self) {
+        while let Ok(batch) = self.traces.try_recv() {
+            if let Some((stats, _)) = &mut self.profile {
+                stats.record_batch(&batch);
             }
+
+            #[cfg(feature = "file")]
+            with_files(|files| files.write_trace(&batch));
         }
     }
 
     /// Flushes all log files.
-    /// This is called after all logs in the queue have been processed.
-    /// This function is thread-safe.
-    fn flush(
-        logger_thread: &Arc<RwLock<LoggerThreadCtx>>,
-        flush_semaphore: &Arc<SemaphoreLite>,
-    ) -> std::result::Result<(), std::io::Error> {
-        // flush file
+    /// Called whenever the [`FlushPolicy`] says so. Only waits for the context writers
+    /// when `urgent`, as when a log at the policy's flush level was written.
+    fn flush(&mut self, urgent: bool) -> std::result::Result<(), std::io::Error> {
         #[cfg(feature = "file")]
-        {
-            let mut logger_thread = logger_thread.write();
-            logger_thread.global_file.flush()?;
-            logger_thread
-                .context_map
-                .values_mut()
-                .try_for_each(|file| file.flush())?;
-        }
+        return with_files(|files| files.flush(&self.flush_semaphore, urgent));
 
         // signal flush complete
-        flush_semaphore.signal();
-        Ok(())
-    }
-
-    ///
-    /// Waits indefinitely until the next queue is flushed
-    /// May block until a log is called forth
-    pub fn wait_for_flush(&self) {
-        self.log_queue.0.wait();
-    }
-    pub fn wait_for_flush_timeout(&self, duration: Duration) {
-        self.log_queue.0.wait_timeout(duration);
+        #[cfg(not(feature = "file"))]
+        {
+            let _ = urgent;
+            self.flush_semaphore.signal();
+            Ok(())
+        }
     }
 }
 
-/// Split log message by line endings and then split each line into chunks
-fn split_str_into_chunks(queue: Vec<LogData>, max_str_len: usize) -> impl Iterator<Item = LogData> {
-    queue.into_iter().flat_map(move |log| {
-        // split log message by line endings
-        log.message
-            .split("\n")
-            .flat_map(|s| {
-                // split string into chunks
-                s.chars()
-                    .chunks(max_str_len)
-                    .into_iter()
-                    .map(|chunk| {
-                        let chunk = chunk.collect::<String>();
-                        LogData {
-                            message: chunk,
-                            ..log.clone()
-                        }
-                    })
-                    .collect_vec()
-            })
-            .collect_vec()
-    })
-}
-
 /// Logs a log entry to all enabled backends.
 pub fn do_log(log: LogData, logger_thread: &RwLock<LoggerThreadCtx>) -> Result<()> {
-    use super::*;
-
     #[cfg(all(target_os = "android", feature = "logcat"))]
-    logcat_logger::do_log(&log)?;
+    super::logcat_logger::do_log(&log)?;
 
+    // written by the logging thread, which owns the files
     #[cfg(feature = "file")]
-    file_logger::do_log(&log, logger_thread)?;
+    let written = logger_thread.read().write_files_now(log.clone())?;
 
     #[cfg(feature = "stdout")]
-    stdout_logger::do_log(&log);
+    super::stdout_logger::do_log(&log);
 
     #[cfg(feature = "sinks")]
-    sink_logger::do_log(&log, logger_thread)?;
+    super::sink_logger::do_log(&log, logger_thread);
 
     #[cfg(feature = "tracing")]
-    tracing_logger::do_log(&log)?;
+    super::tracing_logger::do_log(&log)?;
+
+    #[cfg(feature = "file")]
+    if let Some(written) = written {
+        written.wait_timeout(WRITE_NOW_TIMEOUT);
+    }
 
     Ok(())
 }
@@ -441,14 +966,14 @@ pub fn panic_hook(
         log_data_to!(
             &logger_thread,
             LogLevel::Error,
-            Some("panic".to_string()),
+            Some("panic".into()),
             "panicked at '{msg}', {location}"
         );
         if backtrace {
             log_data_to!(
                 &logger_thread,
                 LogLevel::Error,
-                Some("panic".to_string()),
+                Some("panic".into()),
                 "{:?}",
                 Backtrace::force_capture()
             );
@@ -461,7 +986,7 @@ pub fn panic_hook(
             log_data_to!(
                 &logger_thread,
                 LogLevel::Error,
-                Some("panic".to_string()),
+                Some("panic".into()),
                 "{:?}",
                 SpanTrace::capture()
             );
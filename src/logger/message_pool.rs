@@ -0,0 +1,151 @@
+//! Message buffers recycled from the logging thread back to producers.
+//!
+//! Producers allocate the message of every log they queue, and the logging thread is done
+//! with it once the batch is written. Rather than freeing it there, away from the thread
+//! that allocated it, the logging thread hands the buffers back in chunks. A producer takes
+//! a whole chunk into a cache of its own, so the pool is locked once per chunk, not per log.
+
+use std::cell::RefCell;
+
+use parking_lot::Mutex;
+
+use super::LogData;
+
+/// Buffers handed over at once
+const CHUNK_LEN: usize = 32;
+/// Larger buffers are freed, a burst of long messages shouldn't stay pooled
+const MAX_BUFFER_CAPACITY: usize = 1024;
+/// The pool holds at most this many chunks, 2 MiB of buffers
+const MAX_CHUNKS: usize = 64;
+/// Chunks kept by [`trim`]
+const TRIMMED_CHUNKS: usize = 4;
+
+/// Chunks of buffers written logs left behind
+#[derive(Debug, Default)]
+pub struct MessagePool {
+    chunks: Mutex<Vec<Vec<String>>>,
+}
+
+/// The pool every logger recycles into and every producer takes from
+static POOL: MessagePool = MessagePool::new();
+
+thread_local! {
+    /// The chunk this producer takes buffers from
+    static LOCAL: RefCell<Vec<String>> = const { RefCell::new(Vec::new()) };
+}
+
+/// An empty buffer of at least `capacity` bytes, recycled if the pool has one
+pub fn take(capacity: usize) -> String {
+    let recycled = LOCAL
+        .try_with(|local| {
+            let mut local = local.borrow_mut();
+            if local.is_empty() {
+                if let Some(chunk) = POOL.take_chunk() {
+                    *local = chunk;
+                }
+            }
+            local.pop()
+        })
+        .ok()
+        .flatten();
+
+    match recycled {
+        Some(mut buffer) => {
+            buffer.reserve(capacity);
+            buffer
+        }
+        None => String::with_capacity(capacity),
+    }
+}
+
+/// A copy of `message` in a recycled buffer
+pub fn copy(message: &str) -> String {
+    let mut buffer = take(message.len());
+    buffer.push_str(message);
+    buffer
+}
+
+/// Keeps a buffer this thread took but won't queue, for its next [`take`]
+pub fn release(mut buffer: Vec<u8>) {
+    if buffer.capacity() == 0 || buffer.capacity() > MAX_BUFFER_CAPACITY {
+        return;
+    }
+
+    buffer.clear();
+    // empty, so always UTF-8
+    let buffer = String::from_utf8(buffer).unwrap_or_default();
+    let _ = LOCAL.try_with(|local| {
+        let mut local = local.borrow_mut();
+        if local.len() < CHUNK_LEN {
+            local.push(buffer);
+        }
+    });
+}
+
+/// Takes back the messages of a written batch, called by the logging thread
+pub fn recycle(logs: &mut [LogData]) {
+    POOL.recycle(logs);
+}
+
+/// Frees pooled buffers beyond what steady logging needs.
+/// Chunks producers already took are theirs until they use them up.
+pub fn trim() {
+    POOL.trim();
+}
+
+impl MessagePool {
+    pub const fn new() -> Self {
+        MessagePool {
+            chunks: Mutex::new(Vec::new()),
+        }
+    }
+
+    /// Up to [`CHUNK_LEN`] empty buffers
+    pub fn take_chunk(&self) -> Option<Vec<String>> {
+        self.chunks.lock().pop()
+    }
+
+    /// Keeps the message buffers of `logs`, leaving their messages empty.
+    /// Buffers too large to keep and those past the pool's limit are freed.
+    pub fn recycle(&self, logs: &mut [LogData]) {
+        let mut chunks = Vec::new();
+        let mut chunk = Vec::with_capacity(CHUNK_LEN);
+
+        for log in logs {
+            let mut message = std::mem::take(&mut log.message);
+            if message.capacity() == 0 || message.capacity() > MAX_BUFFER_CAPACITY {
+                continue;
+            }
+
+            message.clear();
+            chunk.push(message);
+            if chunk.len() == CHUNK_LEN {
+                chunks.push(std::mem::replace(&mut chunk, Vec::with_capacity(CHUNK_LEN)));
+            }
+        }
+
+        if !chunk.is_empty() {
+            chunks.push(chunk);
+        }
+
+        let mut pool = self.chunks.lock();
+        let room = MAX_CHUNKS.saturating_sub(pool.len());
+        pool.extend(chunks.drain(..room.min(chunks.len())));
+    }
+
+    /// Keeps [`TRIMMED_CHUNKS`] chunks and frees the rest
+    pub fn trim(&self) {
+        let mut pool = self.chunks.lock();
+        let kept = pool.len().min(TRIMMED_CHUNKS);
+        let freed = pool.split_off(kept);
+        pool.shrink_to_fit();
+        drop(pool);
+
+        drop(freed);
+    }
+
+    /// Buffers waiting in the pool, not counting the chunks producers took
+    pub fn pooled(&self) -> usize {
+        self.chunks.lock().iter().map(Vec::len).sum()
+    }
+}
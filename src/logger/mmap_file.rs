@@ -0,0 +1,231 @@
+//! A log file written through a memory mapped window.
+//!
+//! The file grows one preallocated chunk at a time and only the current chunk is mapped.
+//! Writes are plain copies into the mapping, flushing only hints the kernel to start
+//! writeback. The preallocated tail is cut off by [`MmapFile::finish`] and when the file
+//! is dropped; after a crash the file may end with zeroes.
+
+use std::{
+    fs::File,
+    io::{self, IoSlice, Write},
+    os::fd::AsRawFd,
+    path::Path,
+    ptr::{self, NonNull},
+    sync::LazyLock,
+};
+
+static PAGE_SIZE: LazyLock<usize> =
+    LazyLock::new(|| match unsafe { libc::sysconf(libc::_SC_PAGESIZE) } {
+        size if size > 0 => size as usize,
+        _ => 4096,
+    });
+
+pub struct MmapFile {
+    file: File,
+    chunk_size: usize,
+
+    /// Offset of the mapped chunk in the file
+    window_offset: u64,
+    window: NonNull<u8>,
+    /// Unset once [`Self::finish`] unmapped the window, the next write maps it again
+    mapped: bool,
+
+    /// Write position in the window
+    position: usize,
+    /// Everything before this was already handed to msync
+    synced: usize,
+}
+
+// SAFETY: the mapping is owned by this struct and only accessed through `&mut self`
+unsafe impl Send for MmapFile {}
+unsafe impl Sync for MmapFile {}
+
+impl MmapFile {
+    /// Creates or truncates `path`, mapping chunks of at least `chunk_size` bytes.
+    pub fn create(path: impl AsRef<Path>, chunk_size: usize) -> io::Result<Self> {
+        let file = File::options()
+            .read(true)
+            .write(true)
+            .create(true)
+            .truncate(true)
+            .open(path)?;
+
+        let page_size = *PAGE_SIZE;
+        let chunk_size = chunk_size.max(page_size).next_multiple_of(page_size);
+        let window = map_chunk(&file, 0, chunk_size)?;
+
+        Ok(MmapFile {
+            file,
+            chunk_size,
+            window_offset: 0,
+            window,
+            mapped: true,
+            position: 0,
+            synced: 0,
+        })
+    }
+
+    /// Bytes written so far
+    pub fn len(&self) -> u64 {
+        self.window_offset + self.position as u64
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Writes back what was written and cuts off the preallocated tail, so the file ends
+    /// where the logs do. Writing afterwards maps and preallocates the chunk again.
+    pub fn finish(&mut self) -> io::Result<()> {
+        if !self.mapped {
+            return Ok(());
+        }
+
+        self.sync_window();
+        unsafe { libc::munmap(self.window.as_ptr().cast(), self.chunk_size) };
+        self.mapped = false;
+
+        self.file.set_len(self.len())
+    }
+
+    /// Maps the current chunk again after [`Self::finish`]
+    fn remap_window(&mut self) -> io::Result<()> {
+        self.window = map_chunk(&self.file, self.window_offset, self.chunk_size)?;
+        self.mapped = true;
+        Ok(())
+    }
+
+    /// Unmaps the full chunk and maps the next one
+    fn next_window(&mut self) -> io::Result<()> {
+        self.sync_window();
+
+        let next_offset = self.window_offset + self.chunk_size as u64;
+        let window = map_chunk(&self.file, next_offset, self.chunk_size)?;
+
+        unsafe { libc::munmap(self.window.as_ptr().cast(), self.chunk_size) };
+        self.window = window;
+        self.window_offset = next_offset;
+        self.position = 0;
+        self.synced = 0;
+
+        Ok(())
+    }
+
+    /// Starts writeback of everything written since the last call, without waiting for it
+    fn sync_window(&mut self) {
+        if self.position <= self.synced {
+            return;
+        }
+
+        // msync needs a page aligned start
+        let start = self.synced - self.synced % *PAGE_SIZE;
+        unsafe {
+            libc::msync(
+                self.window.as_ptr().add(start).cast(),
+                self.position - start,
+                libc::MS_ASYNC,
+            );
+        }
+        self.synced = self.position;
+    }
+}
+
+/// Preallocates `len` bytes at `offset` and maps them
+fn map_chunk(file: &File, offset: u64, len: usize) -> io::Result<NonNull<u8>> {
+    preallocate(file, offset, len)?;
+
+    let ptr = unsafe {
+        libc::mmap(
+            ptr::null_mut(),
+            len,
+            libc::PROT_READ | libc::PROT_WRITE,
+            libc::MAP_SHARED,
+            file.as_raw_fd(),
+            offset as libc::off_t,
+        )
+    };
+    if ptr == libc::MAP_FAILED {
+        return Err(io::Error::last_os_error());
+    }
+
+    // only written front to back
+    unsafe { libc::madvise(ptr, len, libc::MADV_SEQUENTIAL) };
+
+    NonNull::new(ptr.cast()).ok_or_else(|| io::Error::other("mmap returned null"))
+}
+
+#[cfg(any(target_os = "linux", target_os = "android"))]
+fn preallocate(file: &File, offset: u64, len: usize) -> io::Result<()> {
+    let result = unsafe {
+        libc::fallocate(
+            file.as_raw_fd(),
+            0,
+            offset as libc::off_t,
+            len as libc::off_t,
+        )
+    };
+    if result == 0 {
+        return Ok(());
+    }
+
+    match io::Error::last_os_error() {
+        // not every filesystem can, a sparse file works too
+        e if e.raw_os_error() == Some(libc::EOPNOTSUPP) => file.set_len(offset + len as u64),
+        e => Err(e),
+    }
+}
+
+#[cfg(not(any(target_os = "linux", target_os = "android")))]
+fn preallocate(file: &File, offset: u64, len: usize) -> io::Result<()> {
+    file.set_len(offset + len as u64)
+}
+
+impl Write for MmapFile {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        let mut remaining = buf;
+
+        if !remaining.is_empty() && !self.mapped {
+            self.remap_window()?;
+        }
+
+        while !remaining.is_empty() {
+            if self.position == self.chunk_size {
+                self.next_window()?;
+            }
+
+            let len = remaining.len().min(self.chunk_size - self.position);
+            unsafe {
+                ptr::copy_nonoverlapping(
+                    remaining.as_ptr(),
+                    self.window.as_ptr().add(self.position),
+                    len,
+                );
+            }
+            self.position += len;
+            remaining = &remaining[len..];
+        }
+
+        Ok(buf.len())
+    }
+
+    fn write_vectored(&mut self, bufs: &[IoSlice<'_>]) -> io::Result<usize> {
+        let mut written = 0;
+        for buf in bufs {
+            written += self.write(buf)?;
+        }
+        Ok(written)
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        if self.mapped {
+            self.sync_window();
+        }
+        Ok(())
+    }
+}
+
+impl Drop for MmapFile {
+    fn drop(&mut self) {
+        let _ = self.finish();
+    }
+}
@@ -1,8 +1,39 @@
-use std::path::PathBuf;
+use std::{path::PathBuf, time::Duration};
 
-use crate::Result;
+use crate::{log_level::LogLevel, Result};
 
+use self::clock::TimestampPrecision;
+#[cfg(feature = "file")]
+use self::rotation::RotationPolicy;
+
+#[cfg(feature = "file")]
+pub mod async_writer;
+#[cfg(feature = "file")]
+pub mod context_writers;
+#[cfg(feature = "file")]
+pub mod json_format;
+#[cfg(feature = "file")]
+pub mod binary_format;
+pub mod callsite;
+pub mod clock;
+pub mod deferred;
+pub mod fields;
+pub mod flight_recorder;
+pub mod level_filter;
+pub mod line_split;
+pub mod render;
+pub mod log_queue;
+pub mod message_pool;
+pub mod sink_dispatch;
+pub mod stats;
 pub mod logger_thread_ctx;
+pub mod profile_stats;
+pub mod trace;
+#[cfg(feature = "file")]
+pub mod rotation;
+
+#[cfg(all(unix, feature = "mmap"))]
+pub mod mmap_file;
 
 #[cfg(all(target_os = "android", feature = "logcat"))]
 pub mod logcat_logger;
@@ -24,17 +55,151 @@ mod log_data;
 pub use log_data::LogData;
 
 pub trait LogCallback = Fn(&LogData) -> Result<()> + Send + Sync;
+pub trait LogBatchCallback = Fn(&[sink_dispatch::LogLine<'_>]) -> Result<()> + Send + Sync;
+
+/// How producer threads hand log entries to the logging thread.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub enum QueueMode {
+    /// A single queue shared by every producer, guarded by a mutex.
+    #[default]
+    Locked,
+
+    /// A bounded lock-free ring per producer thread.
+    /// Entries that don't fit in a full ring spill into the shared queue.
+    PerThreadRing { capacity: usize },
+}
+
+/// What happens to new logs while the queue is at its limits.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub enum OverflowPolicy {
+    /// The queue grows without limit
+    #[default]
+    Unbounded,
+
+    /// Producers wait for the logging thread to make room
+    Block,
+
+    /// New logs are dropped
+    DropNewest,
+
+    /// Queued logs below `keep` are dropped, oldest first, to make room.
+    /// New logs below `keep`, or ones there is still no room for, are dropped.
+    /// In [`QueueMode::PerThreadRing`] only the overflow queue can be evicted from.
+    DropBelowLevel { keep: LogLevel },
+
+    /// Once the queue is half full only one in `one_in` logs is kept, when full none are
+    Sample { one_in: u32 },
+}
+
+/// How log files are written.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub enum FileBackend {
+    /// Buffered `write` calls
+    #[default]
+    Buffered,
+
+    /// Copies into a memory mapped file, preallocated `chunk_size` bytes at a time.
+    /// Flushing only starts writeback.
+    #[cfg(all(unix, feature = "mmap"))]
+    Mmap { chunk_size: usize },
+
+    /// Buffers in memory and leaves the writes to a dedicated I/O thread.
+    /// Every file is handed over at once on flush.
+    Async,
+}
 
+/// What log files hold.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub enum FileFormat {
+    /// One line of text per record
+    #[default]
+    Text,
+
+    /// Records in the compact format of `binary_format`, with repeated strings written once.
+    /// Turned back into text by the `paper2_decode` tool.
+    Binary,
+
+    /// One JSON object per record, with its fields typed. See `json_format`
+    JsonLines,
+}
+
+/// When the logging thread flushes the files.
+/// A flush happens as soon as any of the limits is reached.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct FlushPolicy {
+    /// Longest a written log waits to be flushed. Zero flushes after every batch
+    pub max_latency: Duration,
+    /// Flush once roughly this many bytes were written since the last flush. 0 for no limit
+    pub max_dirty_bytes: usize,
+    /// Batches with a log at or above this level are flushed right away.
+    /// [`LogLevel::Off`] leaves every level to the limits above
+    pub flush_level: LogLevel,
+}
+
+impl Default for FlushPolicy {
+    fn default() -> Self {
+        FlushPolicy {
+            max_latency: Duration::from_millis(50),
+            max_dirty_bytes: 256 * 1024,
+            flush_level: LogLevel::Error,
+        }
+    }
+}
+
+impl FlushPolicy {
+    /// Whether `level` is flushed as soon as its batch is written
+    #[inline]
+    pub fn flushes_immediately(&self, level: LogLevel) -> bool {
+        self.flush_level != LogLevel::Off && level.severity() >= self.flush_level.severity()
+    }
+}
 
 #[repr(C)]
 #[derive(Debug, Clone)]
 pub struct LoggerConfig {
     pub max_string_len: usize,
+    /// Initial capacity of the queue, and the most logs it holds with an [`OverflowPolicy`]
     pub log_max_buffer_count: usize,
     pub line_end: char,
+    pub queue_mode: QueueMode,
+    /// Applies once the queue holds `log_max_buffer_count` logs or `queue_max_bytes` bytes
+    pub overflow_policy: OverflowPolicy,
+    /// Memory the queued logs may hold, 0 for no limit. Only enforced with an [`OverflowPolicy`]
+    pub queue_max_bytes: usize,
+    pub timestamp_precision: TimestampPrecision,
+    pub file_backend: FileBackend,
+    pub file_format: FileFormat,
+    pub flush_policy: FlushPolicy,
+    /// Recent logs kept in memory for crash dumps, 0 to keep none.
+    /// Every log queued is then also copied into a slot shared by all threads: an atomic
+    /// ticket, a compare-exchange and up to 256 bytes of copying per log
+    pub flight_recorder_slots: usize,
+    /// Dump the flight recorder to this file when the process crashes.
+    /// Needs `flight_recorder_slots` and the `flight_recorder` feature on unix
+    pub crash_dump_path: Option<PathBuf>,
+    /// Write profiling zones to this file as a Chrome trace. Needs the `file` feature
+    pub trace_path: Option<PathBuf>,
+    /// Log a summary of every profiling zone this often, under the `Profiler` tag.
+    /// Also covers how long logs wait in the queue. `None` keeps no statistics
+    pub profile_report_interval: Option<Duration>,
+    /// Log the logger's own [`stats::LoggerStats`] this often. `None` for never
+    pub stats_report_interval: Option<Duration>,
+    /// Give back the memory a burst of logs left pooled once the logger was idle this long.
+    /// `None` keeps it for the rest of the session
+    pub trim_idle_after: Option<Duration>,
 
     #[cfg(feature = "file")]
     pub context_log_path: PathBuf,
+
+    /// Write context files on this many threads, each owning a share of the contexts.
+    /// 0 writes them on the logging thread, along with the global file.
+    /// Their flushes are only waited for at the [`FlushPolicy::flush_level`]
+    #[cfg(feature = "file")]
+    pub context_writer_threads: usize,
+
+    /// Applies to the global file and every context file
+    #[cfg(feature = "file")]
+    pub rotation: RotationPolicy,
 }
 
 impl Default for LoggerConfig {
@@ -43,9 +208,28 @@ impl Default for LoggerConfig {
             max_string_len: 1024,
             log_max_buffer_count: 100,
             line_end: '\n',
+            queue_mode: QueueMode::Locked,
+            overflow_policy: OverflowPolicy::Unbounded,
+            queue_max_bytes: 0,
+            timestamp_precision: TimestampPrecision::Seconds,
+            file_backend: FileBackend::Buffered,
+            file_format: FileFormat::Text,
+            flush_policy: FlushPolicy::default(),
+            flight_recorder_slots: 0,
+            crash_dump_path: None,
+            trace_path: None,
+            profile_report_interval: None,
+            stats_report_interval: None,
+            trim_idle_after: Some(Duration::from_secs(10)),
 
             #[cfg(feature = "file")]
             context_log_path: PathBuf::from("./logs"),
+
+            #[cfg(feature = "file")]
+            context_writer_threads: 0,
+
+            #[cfg(feature = "file")]
+            rotation: RotationPolicy::default(),
         }
     }
 }
@@ -0,0 +1,213 @@
+//! Per-zone timing statistics.
+//!
+//! Producers only fill their own zone buffers; the logging thread merges the batches
+//! they hand over into one histogram per zone name and logs a summary of each interval.
+
+use std::{fmt::Write, time::Duration};
+
+use rustc_hash::FxHashMap;
+
+use crate::log_level::LogLevel;
+
+use super::{trace::TraceBatch, LogData};
+
+/// Values are bucketed with this many bits below the leading one, about 3% apart
+const SUB_BUCKET_BITS: u32 = 5;
+const SUB_BUCKETS: usize = 1 << SUB_BUCKET_BITS;
+/// Enough buckets for any `u64`
+const BUCKETS: usize = (64 - SUB_BUCKET_BITS as usize + 1) * SUB_BUCKETS;
+
+/// Tag of the summary logs, register it as a context to give them a file of their own
+pub const PROFILER_TAG: &str = "Profiler";
+
+/// Zone the logging thread records the time from queueing a log to writing it under
+pub const QUEUE_LATENCY_ZONE: &str = "paper2 queue latency";
+
+/// A log-linear histogram of nanosecond durations, in the spirit of HdrHistogram.
+/// Percentiles are accurate to about 3%, min and max are exact.
+#[derive(Clone)]
+pub struct Histogram {
+    counts: Box<[u64; BUCKETS]>,
+    count: u64,
+    sum: u128,
+    min: u64,
+    max: u64,
+}
+
+impl Default for Histogram {
+    fn default() -> Self {
+        Histogram {
+            counts: Box::new([0; BUCKETS]),
+            count: 0,
+            sum: 0,
+            min: u64::MAX,
+            max: 0,
+        }
+    }
+}
+
+impl std::fmt::Debug for Histogram {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("Histogram")
+            .field("count", &self.count)
+            .field("min", &self.min())
+            .field("max", &self.max())
+            .finish_non_exhaustive()
+    }
+}
+
+#[inline]
+fn bucket_index(value: u64) -> usize {
+    if value < 2 * SUB_BUCKETS as u64 {
+        return value as usize;
+    }
+
+    let shift = 64 - value.leading_zeros() - (SUB_BUCKET_BITS + 1);
+    (shift as usize + 1) * SUB_BUCKETS + ((value >> shift) as usize - SUB_BUCKETS)
+}
+
+/// The middle of the values that land in `index`
+fn bucket_value(index: usize) -> u64 {
+    if index < 2 * SUB_BUCKETS {
+        return index as u64;
+    }
+
+    let shift = (index / SUB_BUCKETS - 1) as u32;
+    let lowest = ((index % SUB_BUCKETS + SUB_BUCKETS) as u64) << shift;
+    lowest + (1 << shift) / 2
+}
+
+impl Histogram {
+    #[inline]
+    pub fn record(&mut self, nanos: u64) {
+        self.counts[bucket_index(nanos)] += 1;
+        self.count += 1;
+        self.sum += nanos as u128;
+        self.min = self.min.min(nanos);
+        self.max = self.max.max(nanos);
+    }
+
+    pub fn merge(&mut self, other: &Histogram) {
+        self.counts
+            .iter_mut()
+            .zip(other.counts.iter())
+            .for_each(|(count, other)| *count += other);
+        self.count += other.count;
+        self.sum += other.sum;
+        self.min = self.min.min(other.min);
+        self.max = self.max.max(other.max);
+    }
+
+    /// Forgets every value, keeping the buckets allocated
+    pub fn clear(&mut self) {
+        self.counts.fill(0);
+        self.count = 0;
+        self.sum = 0;
+        self.min = u64::MAX;
+        self.max = 0;
+    }
+
+    pub fn count(&self) -> u64 {
+        self.count
+    }
+
+    pub fn min(&self) -> Option<Duration> {
+        (self.count != 0).then(|| Duration::from_nanos(self.min))
+    }
+
+    pub fn max(&self) -> Option<Duration> {
+        (self.count != 0).then(|| Duration::from_nanos(self.max))
+    }
+
+    pub fn mean(&self) -> Option<Duration> {
+        (self.count != 0).then(|| Duration::from_nanos((self.sum / self.count as u128) as u64))
+    }
+
+    /// The duration `quantile` of the values are at or below, e.g. 0.99 for p99
+    pub fn percentile(&self, quantile: f64) -> Option<Duration> {
+        if self.count == 0 {
+            return None;
+        }
+
+        let rank = ((quantile.clamp(0.0, 1.0) * self.count as f64).ceil() as u64).max(1);
+        if rank >= self.count {
+            return self.max();
+        }
+
+        let mut seen = 0;
+        for (index, &count) in self.counts.iter().enumerate() {
+            seen += count;
+            if seen >= rank {
+                let value = bucket_value(index).clamp(self.min, self.max);
+                return Some(Duration::from_nanos(value));
+            }
+        }
+
+        self.max()
+    }
+}
+
+/// A histogram per zone name, merged from the batches threads hand over
+#[derive(Debug, Default)]
+pub struct ProfileStats {
+    zones: FxHashMap<&'static str, Histogram>,
+}
+
+impl ProfileStats {
+    pub fn record(&mut self, zone: &'static str, nanos: u64) {
+        self.zones.entry(zone).or_default().record(nanos);
+    }
+
+    pub fn record_batch(&mut self, batch: &TraceBatch) {
+        for event in &batch.events {
+            self.record(event.name, event.duration_nanos);
+        }
+    }
+
+    pub fn zone(&self, zone: &str) -> Option<&Histogram> {
+        self.zones
+            .get(zone)
+            .filter(|histogram| histogram.count() != 0)
+    }
+
+    /// One log per zone that saw any values, sorted by name.
+    /// The histograms start over, so each report covers the time since the last one.
+    pub fn take_report(&mut self) -> Vec<LogData> {
+        let mut zones: Vec<_> = self
+            .zones
+            .iter_mut()
+            .filter(|(_, histogram)| histogram.count() != 0)
+            .collect();
+        zones.sort_unstable_by_key(|(name, _)| **name);
+
+        zones
+            .into_iter()
+            .map(|(name, histogram)| {
+                let mut message = String::new();
+                let stat = |duration: Option<Duration>| duration.unwrap_or_default();
+                let _ = write!(
+                    message,
+                    "{name}: count {}, min {:?}, mean {:?}, max {:?}, p50 {:?}, p99 {:?}, p999 {:?}",
+                    histogram.count(),
+                    stat(histogram.min()),
+                    stat(histogram.mean()),
+                    stat(histogram.max()),
+                    stat(histogram.percentile(0.5)),
+                    stat(histogram.percentile(0.99)),
+                    stat(histogram.percentile(0.999)),
+                );
+                histogram.clear();
+
+                LogData {
+                    level: LogLevel::Info,
+                    tag: Some(PROFILER_TAG.into()),
+                    message,
+                    file: file!().into(),
+                    line: line!(),
+                    column: column!(),
+                    ..LogData::default()
+                }
+            })
+            .collect()
+    }
+}
@@ -0,0 +1,215 @@
+//! Renders the prefix of each record once, for every output to share.
+//!
+//! A header looks like `I 2024-01-01 12:00:00 [tag] [file:1:2 @ function] `.
+//! The global file writes it whole, context files skip the tag, and the other
+//! outputs pick the parts they need.
+
+use std::{
+    fmt::Write as _,
+    io::{self, IoSlice, Write},
+};
+
+use super::{clock, log_data::DEFAULT_TAG, LogData};
+
+/// Where the parts of one header are in the arena
+#[derive(Debug, Clone, Copy)]
+struct HeaderSpans {
+    start: usize,
+    /// End of `I 2024-01-01 12:00:00 `
+    time_end: usize,
+    /// End of `[tag] `
+    tag_end: usize,
+    end: usize,
+}
+
+/// The rendered header of one record, borrowed from a [`RenderBuffer`].
+#[derive(Debug, Clone, Copy)]
+pub struct RenderedRecord<'a> {
+    header: &'a str,
+    time_len: usize,
+    tag_len: usize,
+}
+
+/// Reusable arena holding the headers of a whole batch.
+#[derive(Debug, Default)]
+pub struct RenderBuffer {
+    arena: String,
+    headers: Vec<HeaderSpans>,
+}
+
+impl RenderBuffer {
+    pub fn with_capacity(records: usize) -> Self {
+        RenderBuffer {
+            arena: String::with_capacity(records * 96),
+            headers: Vec::with_capacity(records),
+        }
+    }
+
+    /// Gives back what a large batch grew the buffers to, down to room for `records` logs
+    pub fn shrink_to(&mut self, records: usize) {
+        self.arena.shrink_to(records * 96);
+        self.headers.shrink_to(records);
+    }
+
+    /// Renders the header of every log, replacing the previous batch.
+    pub fn render_batch(&mut self, logs: &[LogData]) {
+        self.arena.clear();
+        self.headers.clear();
+
+        for log in logs {
+            let spans = clock::with_formatted(log.timestamp, |time| {
+                render_header(log, time, &mut self.arena)
+            });
+            self.headers.push(spans);
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        self.headers.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.headers.is_empty()
+    }
+
+    pub fn get(&self, index: usize) -> Option<RenderedRecord<'_>> {
+        self.headers
+            .get(index)
+            .map(|spans| RenderedRecord::from_spans(&self.arena, *spans))
+    }
+
+    /// Rendered records, in the order of the batch
+    pub fn iter(&self) -> impl Iterator<Item = RenderedRecord<'_>> {
+        self.headers
+            .iter()
+            .map(|spans| RenderedRecord::from_spans(&self.arena, *spans))
+    }
+}
+
+fn render_header(log: &LogData, time: &str, arena: &mut String) -> HeaderSpans {
+    let start = arena.len();
+
+    arena.push(log.level.short());
+    arena.push(' ');
+    arena.push_str(time);
+    arena.push(' ');
+    let time_end = arena.len();
+
+    arena.push('[');
+    arena.push_str(log.tag.as_deref().unwrap_or(DEFAULT_TAG));
+    arena.push_str("] ");
+    let tag_end = arena.len();
+
+    let _ = write!(
+        arena,
+        "[{file}:{line}:{column} @ {function_name}] ",
+        file = log.file,
+        line = log.line,
+        column = log.column,
+        function_name = log.function_name.as_deref().unwrap_or("default")
+    );
+
+    HeaderSpans {
+        start,
+        time_end,
+        tag_end,
+        end: arena.len(),
+    }
+}
+
+impl<'a> RenderedRecord<'a> {
+    fn from_spans(arena: &'a str, spans: HeaderSpans) -> Self {
+        RenderedRecord {
+            header: &arena[spans.start..spans.end],
+            time_len: spans.time_end - spans.start,
+            tag_len: spans.tag_end - spans.time_end,
+        }
+    }
+
+    /// Renders a single record into `arena`, for logs written outside a batch.
+    pub fn render(log: &LogData, arena: &'a mut String) -> Self {
+        arena.clear();
+        let spans = clock::with_formatted(log.timestamp, |time| render_header(log, time, arena));
+        RenderedRecord::from_spans(arena, spans)
+    }
+
+    /// The whole header, up to where the message starts
+    pub fn header(&self) -> &'a str {
+        self.header
+    }
+
+    /// `I 2024-01-01 12:00:00 `
+    pub fn level_time(&self) -> &'a str {
+        &self.header[..self.time_len]
+    }
+
+    /// `2024-01-01 12:00:00`
+    pub fn time(&self) -> &'a str {
+        // the level is a single ASCII letter
+        self.level_time()[2..].trim_end()
+    }
+
+    /// `[tag] `
+    pub fn tag(&self) -> &'a str {
+        &self.header[self.time_len..self.time_len + self.tag_len]
+    }
+
+    /// `[file:1:2 @ function] `
+    pub fn location(&self) -> &'a str {
+        &self.header[self.time_len + self.tag_len..]
+    }
+
+    /// Writes `header message\n`
+    pub fn write_line(&self, writer: &mut impl Write, message: &str) -> io::Result<()> {
+        write_all_vectored(
+            writer,
+            &mut [
+                IoSlice::new(self.header.as_bytes()),
+                IoSlice::new(message.as_bytes()),
+                IoSlice::new(b"\n"),
+            ],
+        )
+    }
+
+    /// Writes the header without the tag, for files that only hold one tag
+    pub fn write_compact_line(&self, writer: &mut impl Write, message: &str) -> io::Result<()> {
+        write_all_vectored(
+            writer,
+            &mut [
+                IoSlice::new(self.level_time().as_bytes()),
+                IoSlice::new(self.location().as_bytes()),
+                IoSlice::new(message.as_bytes()),
+                IoSlice::new(b"\n"),
+            ],
+        )
+    }
+
+    /// The line with the full level name, as printed to stdout and tracing
+    pub fn format_line(&self, log: &LogData, message: &str) -> String {
+        // the header starts with the short level
+        let rest = &self.header[1..];
+
+        let mut line = String::with_capacity(8 + rest.len() + message.len());
+        let _ = write!(line, "{}", log.level);
+        line.push_str(rest);
+        line.push_str(message);
+        line
+    }
+}
+
+/// Writes every slice, retrying short writes.
+pub fn write_all_vectored(writer: &mut impl Write, mut bufs: &mut [IoSlice<'_>]) -> io::Result<()> {
+    // skip leading empty slices
+    IoSlice::advance_slices(&mut bufs, 0);
+
+    while !bufs.is_empty() {
+        match writer.write_vectored(bufs) {
+            Ok(0) => return Err(io::ErrorKind::WriteZero.into()),
+            Ok(written) => IoSlice::advance_slices(&mut bufs, written),
+            Err(e) if e.kind() == io::ErrorKind::Interrupted => {}
+            Err(e) => return Err(e),
+        }
+    }
+
+    Ok(())
+}
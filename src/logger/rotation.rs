@@ -0,0 +1,482 @@
+//! Size and age based rotation of log files.
+//!
+//! A file due for rotation is renamed to `<name>.<unix millis>.log` and a fresh one takes
+//! its place, so the logging thread only pays for a rename. Compressing the rotated segment
+//! and deleting segments past the keep count happens on a low priority maintenance thread.
+
+use std::{
+    fs,
+    io::{self, IoSlice, Write},
+    path::{Path, PathBuf},
+    sync::{
+        mpsc::{self, Sender},
+        Arc, LazyLock, OnceLock,
+    },
+    thread,
+    time::{Duration, Instant, SystemTime, UNIX_EPOCH},
+};
+
+use parking_lot::Mutex;
+use rustc_hash::FxHashSet;
+
+use crate::semaphore_lite::SemaphoreLite;
+
+use super::{
+    async_writer::IoWorker, binary_format::BinaryEncoder, file_logger::LogFile,
+    json_format::JsonEncoder, line_split, render::RenderedRecord, FileBackend, FileFormat, LogData,
+};
+
+/// When log files are rotated and how many rotated segments are kept.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct RotationPolicy {
+    /// Rotate once a file holds this many bytes. 0 for no limit
+    pub max_bytes: u64,
+    /// Rotate a file once it was written to for this long
+    pub max_age: Option<Duration>,
+    /// Rotated segments kept per file, older ones are deleted
+    pub keep: usize,
+    /// Compress rotated segments with zstd. Needs the `compress` feature, on by default with it.
+    /// Without it, setting this only gets a warning logged
+    pub compress: bool,
+}
+
+impl Default for RotationPolicy {
+    fn default() -> Self {
+        RotationPolicy {
+            max_bytes: 0,
+            max_age: None,
+            keep: 5,
+            compress: cfg!(feature = "compress"),
+        }
+    }
+}
+
+impl RotationPolicy {
+    /// Whether files are rotated at all. Without rotation files are truncated on start.
+    pub fn is_enabled(&self) -> bool {
+        self.max_bytes != 0 || self.max_age.is_some()
+    }
+}
+
+/// Every file opened as a log, so none of them is mistaken for a segment of another.
+/// A context named `name.5` writes to `name.5.log`, which looks like segment 5 of `name.log`
+static LOG_FILES: LazyLock<Mutex<FxHashSet<PathBuf>>> = LazyLock::new(Default::default);
+
+/// A log file that rotates itself according to a [`RotationPolicy`].
+pub struct RotatingFile {
+    file: LogFile,
+    path: PathBuf,
+    backend: FileBackend,
+    io_worker: Option<IoWorker>,
+    policy: RotationPolicy,
+    /// Set for [`FileFormat::Binary`], restarted with every file
+    encoder: Option<BinaryEncoder>,
+    /// Set for [`FileFormat::JsonLines`]
+    json: Option<JsonEncoder>,
+
+    /// Bytes written since the file was opened
+    written: u64,
+    /// Bytes written to segments rotated out before
+    rotated: u64,
+    opened: Instant,
+    /// Id of the newest segment, to keep ids increasing within a millisecond
+    last_segment: u64,
+}
+
+impl RotatingFile {
+    /// Creates the file at `path`. With rotation enabled, an existing file is rotated
+    /// out first instead of being truncated.
+    pub fn create(
+        path: PathBuf,
+        backend: FileBackend,
+        io_worker: Option<&IoWorker>,
+        policy: RotationPolicy,
+        format: FileFormat,
+    ) -> io::Result<Self> {
+        LOG_FILES.lock().insert(path.clone());
+
+        let mut last_segment = 0;
+        if policy.is_enabled() {
+            // a previous run may have rotated within the current millisecond
+            last_segment =
+                segments(&path).map_or(0, |segments| segments.first().map_or(0, |(id, _)| *id));
+        }
+
+        if policy.is_enabled() && fs::metadata(&path).is_ok_and(|meta| meta.len() > 0) {
+            last_segment = next_segment_id(last_segment);
+            fs::rename(&path, segment_path(&path, last_segment))?;
+            submit_segment(&path, last_segment, policy, None);
+        }
+
+        let mut file = RotatingFile {
+            file: LogFile::create(&path, backend, io_worker)?,
+            path,
+            backend,
+            io_worker: io_worker.cloned(),
+            policy,
+            encoder: (format == FileFormat::Binary).then(BinaryEncoder::default),
+            json: (format == FileFormat::JsonLines).then(JsonEncoder::default),
+            written: 0,
+            rotated: 0,
+            opened: Instant::now(),
+            last_segment,
+        };
+        file.write_header()?;
+        Ok(file)
+    }
+
+    fn write_header(&mut self) -> io::Result<()> {
+        if let Some(encoder) = &mut self.encoder {
+            let header = encoder.header();
+            self.file.write_all(header)?;
+            self.written += header.len() as u64;
+        }
+        Ok(())
+    }
+
+    /// Writes a record, a line per segment of its message of at most `max_str_len` bytes.
+    /// JSON lines files take the record whole.
+    #[inline]
+    pub fn write_record(
+        &mut self,
+        log: &LogData,
+        record: &RenderedRecord<'_>,
+        max_str_len: usize,
+    ) -> io::Result<()> {
+        if self.write_json(log, record)? {
+            return Ok(());
+        }
+
+        line_split::segments(&log.message, max_str_len)
+            .try_for_each(|line| self.write_line(log, record, line))
+    }
+
+    /// Like [`Self::write_record`], without the tag for files that only hold one tag
+    #[inline]
+    pub fn write_compact_record(
+        &mut self,
+        log: &LogData,
+        record: &RenderedRecord<'_>,
+        max_str_len: usize,
+    ) -> io::Result<()> {
+        if self.write_json(log, record)? {
+            return Ok(());
+        }
+
+        line_split::segments(&log.message, max_str_len)
+            .try_for_each(|line| self.write_compact_line(log, record, line))
+    }
+
+    /// Writes the record as JSON if this is a JSON lines file
+    fn write_json(&mut self, log: &LogData, record: &RenderedRecord<'_>) -> io::Result<bool> {
+        let Some(json) = &mut self.json else {
+            return Ok(false);
+        };
+
+        let encoded = json.encode(log, record);
+        self.file.write_all(encoded)?;
+        self.written += encoded.len() as u64;
+        Ok(true)
+    }
+
+    /// Writes one line of a record with its full header
+    #[inline]
+    fn write_line(
+        &mut self,
+        log: &LogData,
+        record: &RenderedRecord<'_>,
+        line: &str,
+    ) -> io::Result<()> {
+        match &mut self.encoder {
+            Some(encoder) => {
+                let encoded = encoder.encode(log, line);
+                self.file.write_all(encoded)?;
+                self.written += encoded.len() as u64;
+                Ok(())
+            }
+            None => record.write_line(self, line),
+        }
+    }
+
+    /// Writes one line of a record without the tag, for files that only hold one tag.
+    /// Binary records keep the tag, it costs a byte.
+    #[inline]
+    fn write_compact_line(
+        &mut self,
+        log: &LogData,
+        record: &RenderedRecord<'_>,
+        line: &str,
+    ) -> io::Result<()> {
+        match self.encoder {
+            Some(_) => self.write_line(log, record, line),
+            None => record.write_compact_line(self, line),
+        }
+    }
+
+    /// Rotates the file if the policy says so.
+    /// Called between records, so a record never spans two files.
+    #[inline]
+    pub fn rotate_if_due(&mut self) -> io::Result<()> {
+        let due = (self.policy.max_bytes != 0 && self.written >= self.policy.max_bytes)
+            || self
+                .policy
+                .max_age
+                .is_some_and(|max_age| self.written != 0 && self.opened.elapsed() >= max_age);
+
+        if due {
+            self.rotate()?;
+        }
+
+        Ok(())
+    }
+
+    /// Moves the current file to a new segment and starts an empty one.
+    pub fn rotate(&mut self) -> io::Result<()> {
+        self.file.flush()?;
+
+        // the open handle follows the rename, so pending writes still land in the segment
+        let segment = next_segment_id(self.last_segment);
+        fs::rename(&self.path, segment_path(&self.path, segment))?;
+        let file = LogFile::create(&self.path, self.backend, self.io_worker.as_ref())?;
+        drop(std::mem::replace(&mut self.file, file));
+
+        // async writes of the old file may still be queued, the segment is only
+        // touched once the I/O thread got past them
+        let written = match &self.io_worker {
+            Some(io_worker) => {
+                let written = Arc::new(SemaphoreLite::new());
+                io_worker.submit(Vec::new(), Some(Arc::clone(&written)))?;
+                Some(written)
+            }
+            None => None,
+        };
+        submit_segment(&self.path, segment, self.policy, written);
+
+        self.last_segment = segment;
+        self.rotated += self.written;
+        self.written = 0;
+        self.opened = Instant::now();
+        self.write_header()
+    }
+
+    /// Bytes written since the file was created, across rotations
+    pub fn total_written(&self) -> u64 {
+        self.rotated + self.written
+    }
+
+    /// Takes the writes an async file has buffered, to be submitted with the other files.
+    pub fn take_pending(&mut self) -> Option<(super::async_writer::FileId, Vec<u8>)> {
+        self.file.take_pending()
+    }
+}
+
+impl RotatingFile {
+    /// See [`LogFile::finish`]
+    pub fn finish(&mut self) -> io::Result<()> {
+        self.file.finish()
+    }
+}
+
+impl Write for RotatingFile {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        let written = self.file.write(buf)?;
+        self.written += written as u64;
+        Ok(written)
+    }
+
+    fn write_vectored(&mut self, bufs: &[IoSlice<'_>]) -> io::Result<usize> {
+        let written = self.file.write_vectored(bufs)?;
+        self.written += written as u64;
+        Ok(written)
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        self.file.flush()
+    }
+}
+
+/// Unix milliseconds, or one past `last` if the clock didn't move on
+fn next_segment_id(last: u64) -> u64 {
+    let now = SystemTime::now()
+        .duration_since(UNIX_EPOCH)
+        .map(|duration| duration.as_millis() as u64)
+        .unwrap_or_default();
+
+    now.max(last + 1)
+}
+
+/// `logs/name.log` -> `logs/name.<id>.log`
+pub fn segment_path(path: &Path, id: u64) -> PathBuf {
+    let stem = path.file_stem().unwrap_or_default().to_string_lossy();
+    match path.extension() {
+        Some(extension) => {
+            path.with_file_name(format!("{stem}.{id}.{}", extension.to_string_lossy()))
+        }
+        None => path.with_file_name(format!("{stem}.{id}")),
+    }
+}
+
+/// Rotated segments of `path` with their ids, compressed or not, newest first.
+/// Only `<name>.<digits>.log` files are segments, and never files opened as logs themselves.
+pub fn segments(path: &Path) -> io::Result<Vec<(u64, PathBuf)>> {
+    let directory = match path.parent() {
+        Some(parent) if !parent.as_os_str().is_empty() => parent,
+        _ => Path::new("."),
+    };
+    let stem = path.file_stem().unwrap_or_default().to_string_lossy();
+    let prefix = format!("{stem}.");
+    let extension = path
+        .extension()
+        .map(|extension| extension.to_string_lossy());
+
+    let mut segments = Vec::new();
+    for entry in fs::read_dir(directory)? {
+        let entry = entry?;
+        let name = entry.file_name();
+        let Some(rest) = name.to_str().and_then(|name| name.strip_prefix(&prefix)) else {
+            continue;
+        };
+
+        let rest = rest.strip_suffix(".zst").unwrap_or(rest);
+        let id = match &extension {
+            Some(extension) => rest
+                .strip_suffix(extension.as_ref())
+                .and_then(|rest| rest.strip_suffix('.')),
+            None => Some(rest),
+        };
+
+        let Some(id) = id
+            .filter(|id| !id.is_empty() && id.bytes().all(|byte| byte.is_ascii_digit()))
+            .and_then(|id| id.parse::<u64>().ok())
+        else {
+            continue;
+        };
+
+        let segment = entry.path();
+        if !LOG_FILES.lock().contains(&segment) {
+            segments.push((id, segment));
+        }
+    }
+
+    segments.sort_unstable_by(|a, b| b.0.cmp(&a.0));
+    Ok(segments)
+}
+
+/// A rotated segment for the maintenance thread
+struct SegmentJob {
+    path: PathBuf,
+    #[cfg_attr(not(feature = "compress"), allow(dead_code))]
+    segment: u64,
+    policy: RotationPolicy,
+    /// Signaled once every write to the segment is done
+    written: Option<Arc<SemaphoreLite>>,
+}
+
+static MAINTENANCE: OnceLock<Option<Sender<SegmentJob>>> = OnceLock::new();
+
+/// Hands a rotated segment to the maintenance thread, or handles it right away
+/// if the thread can't be started.
+fn submit_segment(
+    path: &Path,
+    segment: u64,
+    policy: RotationPolicy,
+    written: Option<Arc<SemaphoreLite>>,
+) {
+    let job = SegmentJob {
+        path: path.to_path_buf(),
+        segment,
+        policy,
+        written,
+    };
+
+    let sender = MAINTENANCE.get_or_init(|| {
+        let (sender, receiver) = mpsc::channel::<SegmentJob>();
+        thread::Builder::new()
+            .name("paper2-rotate".to_string())
+            .spawn(move || {
+                lower_priority();
+                receiver.into_iter().for_each(process_segment);
+            })
+            .ok()
+            .map(|_| sender)
+    });
+
+    match sender {
+        Some(sender) => {
+            if let Err(mpsc::SendError(job)) = sender.send(job) {
+                process_segment(job);
+            }
+        }
+        None => process_segment(job),
+    }
+}
+
+/// Compresses a segment and deletes the ones past the keep count.
+/// Errors are dropped, there is nowhere left to log them and the segment stays readable.
+fn process_segment(job: SegmentJob) {
+    if let Some(written) = &job.written {
+        written.wait();
+    }
+
+    #[cfg(feature = "compress")]
+    if job.policy.compress {
+        let _ = compress_segment(&segment_path(&job.path, job.segment));
+    }
+
+    let _ = prune_segments(&job.path, job.policy.keep);
+}
+
+/// Deletes every segment of `path` but the newest `keep`
+fn prune_segments(path: &Path, keep: usize) -> io::Result<()> {
+    let segments = segments(path)?;
+
+    // a segment caught mid compression exists twice under the same id
+    let mut kept = 0;
+    let mut last_id = None;
+    for (id, segment) in segments {
+        if last_id != Some(id) {
+            last_id = Some(id);
+            kept += 1;
+        }
+
+        if kept > keep {
+            fs::remove_file(segment)?;
+        }
+    }
+
+    Ok(())
+}
+
+/// Replaces `name.log` with `name.log.zst`
+#[cfg(feature = "compress")]
+fn compress_segment(segment: &Path) -> io::Result<()> {
+    let mut compressed = segment.as_os_str().to_owned();
+    compressed.push(".zst");
+    let compressed = PathBuf::from(compressed);
+
+    let result = (|| {
+        let mut input = fs::File::open(segment)?;
+        let mut encoder = zstd::Encoder::new(fs::File::create(&compressed)?, 3)?;
+        io::copy(&mut input, &mut encoder)?;
+        encoder.finish()?;
+        Ok(())
+    })();
+
+    match result {
+        Ok(()) => fs::remove_file(segment),
+        Err(e) => {
+            let _ = fs::remove_file(&compressed);
+            Err(e)
+        }
+    }
+}
+
+/// Keeps compression from competing with the threads that produce logs
+#[cfg(all(feature = "compress", any(target_os = "linux", target_os = "android")))]
+fn lower_priority() {
+    // on Linux this only applies to the calling thread
+    unsafe { libc::setpriority(libc::PRIO_PROCESS, 0, 10) };
+}
+
+#[cfg(not(all(feature = "compress", any(target_os = "linux", target_os = "android"))))]
+fn lower_priority() {}
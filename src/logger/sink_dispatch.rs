@@ -0,0 +1,217 @@
+//! Runs every sink on a worker thread of its own.
+//!
+//! The logging thread shares each batch with the workers through an `Arc` and never
+//! waits on them: a sink whose queue is full misses the batch and the logs are counted
+//! as dropped. A sink that errors only loses the record it failed on.
+
+use std::{
+    io,
+    sync::{
+        atomic::{AtomicU64, Ordering},
+        mpsc::{self, Receiver, SyncSender, TrySendError},
+        Arc,
+    },
+    thread,
+};
+
+use crate::log_level::LogLevel;
+
+use super::{line_split, LogBatchCallback, LogCallback, LogData};
+
+/// Batches a sink may fall behind by before it starts missing them
+pub const SINK_QUEUE_BATCHES: usize = 64;
+
+/// Which logs a sink receives. Checked before a batch is handed to the sink's worker.
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct SinkFilter {
+    /// Logs below this level are skipped
+    pub min_level: Option<LogLevel>,
+    /// Only logs with this tag are passed on
+    pub tag: Option<String>,
+}
+
+impl SinkFilter {
+    #[inline]
+    pub fn allows(&self, log: &LogData) -> bool {
+        self.min_level
+            .is_none_or(|min_level| log.level.severity() >= min_level.severity())
+            && self
+                .tag
+                .as_deref()
+                .is_none_or(|tag| log.tag.as_deref() == Some(tag))
+    }
+}
+
+/// One line of a log, as handed to batch sinks
+#[derive(Debug, Clone, Copy)]
+pub struct LogLine<'a> {
+    pub log: &'a LogData,
+    /// The line, the whole message if it wasn't split
+    pub message: &'a str,
+}
+
+pub enum Sink {
+    /// Called once per line
+    Record(Box<dyn LogCallback>),
+    /// Called once per batch with every line that passed the filter
+    Batch(Box<dyn LogBatchCallback>),
+}
+
+impl Sink {
+    /// Hands the lines of `logs` that pass `filter` to the sink.
+    /// Returns how many calls failed.
+    fn deliver<'a>(
+        &self,
+        logs: impl IntoIterator<Item = &'a LogData>,
+        filter: &SinkFilter,
+        max_str_len: usize,
+    ) -> u64 {
+        let logs = logs.into_iter().filter(|log| filter.allows(log));
+        let mut errors = 0;
+
+        match self {
+            Sink::Record(sink) => {
+                for log in logs {
+                    if line_split::is_single_segment(&log.message, max_str_len) {
+                        errors += sink(log).is_err() as u64;
+                        continue;
+                    }
+
+                    // one copy reused for every line
+                    let mut line_log = log.clone_without_message();
+                    for line in line_split::segments(&log.message, max_str_len) {
+                        line_log.message.clear();
+                        line_log.message.push_str(line);
+                        errors += sink(&line_log).is_err() as u64;
+                    }
+                }
+            }
+            Sink::Batch(sink) => {
+                let lines: Vec<LogLine> = logs
+                    .flat_map(|log| {
+                        line_split::segments(&log.message, max_str_len)
+                            .map(move |message| LogLine { log, message })
+                    })
+                    .collect();
+
+                if !lines.is_empty() {
+                    errors += sink(&lines).is_err() as u64;
+                }
+            }
+        }
+
+        errors
+    }
+}
+
+struct SinkWorker {
+    sink: Arc<Sink>,
+    filter: Arc<SinkFilter>,
+    sender: SyncSender<Arc<Vec<LogData>>>,
+}
+
+#[derive(Debug, Default)]
+struct SinkStats {
+    dropped: AtomicU64,
+    errors: AtomicU64,
+}
+
+/// The registered sinks and their workers. Workers exit once this is dropped.
+pub struct SinkDispatcher {
+    workers: Vec<SinkWorker>,
+    max_str_len: usize,
+    stats: Arc<SinkStats>,
+}
+
+impl SinkDispatcher {
+    /// Sinks get messages split into lines of at most `max_str_len` bytes
+    pub fn new(max_str_len: usize) -> Self {
+        SinkDispatcher {
+            workers: Vec::new(),
+            max_str_len,
+            stats: Arc::default(),
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        self.workers.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.workers.is_empty()
+    }
+
+    /// Starts a worker for `sink`
+    pub fn add(&mut self, sink: Sink, filter: SinkFilter) -> io::Result<()> {
+        let sink = Arc::new(sink);
+        let filter = Arc::new(filter);
+        let (sender, receiver) = mpsc::sync_channel(SINK_QUEUE_BATCHES);
+
+        let worker_sink = Arc::clone(&sink);
+        let worker_filter = Arc::clone(&filter);
+        let stats = Arc::clone(&self.stats);
+        let max_str_len = self.max_str_len;
+        thread::Builder::new()
+            .name(format!("paper2-sink-{}", self.workers.len()))
+            .spawn(move || {
+                sink_worker(receiver, &worker_sink, &worker_filter, max_str_len, &stats)
+            })?;
+
+        self.workers.push(SinkWorker {
+            sink,
+            filter,
+            sender,
+        });
+        Ok(())
+    }
+
+    /// Shares `batch` with every sink that wants any of it, without waiting on them.
+    pub fn dispatch(&self, batch: Arc<Vec<LogData>>) {
+        for worker in &self.workers {
+            if !batch.iter().any(|log| worker.filter.allows(log)) {
+                continue;
+            }
+
+            match worker.sender.try_send(Arc::clone(&batch)) {
+                Ok(()) => {}
+                Err(TrySendError::Full(batch) | TrySendError::Disconnected(batch)) => {
+                    let dropped = batch.iter().filter(|log| worker.filter.allows(log)).count();
+                    self.stats
+                        .dropped
+                        .fetch_add(dropped as u64, Ordering::Relaxed);
+                }
+            }
+        }
+    }
+
+    /// Calls every sink on the current thread, for logs that can't wait for the workers
+    pub fn deliver_now(&self, log: &LogData) {
+        for worker in &self.workers {
+            let errors = worker.sink.deliver([log], &worker.filter, self.max_str_len);
+            self.stats.errors.fetch_add(errors, Ordering::Relaxed);
+        }
+    }
+
+    /// Logs sinks missed because they fell behind, since the last call
+    pub fn take_dropped(&self) -> u64 {
+        self.stats.dropped.swap(0, Ordering::Relaxed)
+    }
+
+    /// Failed sink calls since the last call
+    pub fn take_errors(&self) -> u64 {
+        self.stats.errors.swap(0, Ordering::Relaxed)
+    }
+}
+
+fn sink_worker(
+    receiver: Receiver<Arc<Vec<LogData>>>,
+    sink: &Sink,
+    filter: &SinkFilter,
+    max_str_len: usize,
+    stats: &SinkStats,
+) {
+    for batch in receiver {
+        let errors = sink.deliver(batch.iter(), filter, max_str_len);
+        stats.errors.fetch_add(errors, Ordering::Relaxed);
+    }
+}
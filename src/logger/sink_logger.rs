@@ -1,17 +1,18 @@
-use crate::Result;
+use std::sync::Arc;
+
 use parking_lot::RwLock;
 
-use super::log_data::LogData;
+use super::{log_data::LogData, logger_thread_ctx::LoggerThreadCtx};
 
-pub(crate) fn do_log(
-    log: &LogData,
-    logger_thread: &RwLock<crate::logger::logger_thread_ctx::LoggerThreadCtx>,
-) -> Result<()> {
-    let sinks = &logger_thread.read().sinks;
+/// Calls the sinks right away, for logs written outside the logging thread's batches.
+pub(crate) fn do_log(log: &LogData, logger_thread: &RwLock<LoggerThreadCtx>) {
+    logger_thread.read().sinks.deliver_now(log);
+}
 
-    for sink in sinks {
-        sink(log)?;
+/// Hands a batch to the sink workers. Sinks get one record per line, like the other outputs.
+pub(crate) fn do_log_batch(logs: &Arc<Vec<LogData>>, logger_thread: &RwLock<LoggerThreadCtx>) {
+    let logger_thread = logger_thread.read();
+    if !logger_thread.sinks.is_empty() {
+        logger_thread.sinks.dispatch(Arc::clone(logs));
     }
-
-    Ok(())
 }
@@ -0,0 +1,184 @@
+//! The logger's own health: how much is queued, dropped and written, and how long the
+//! logging thread spends on batches and flushes.
+//!
+//! Producers only bump the queued count, spread over cache lines so threads logging at
+//! once rarely share one. Everything else is written by the logging thread alone,
+//! so the counters never contend.
+
+use std::{
+    sync::atomic::{AtomicU64, AtomicUsize, Ordering},
+    time::Duration,
+};
+
+use crate::{log_level::LogLevel, ring_buffer::CachePadded};
+
+use super::LogData;
+
+/// A snapshot of the logger's counters, totals since it started.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct LoggerStats {
+    /// Logs handed to the logger
+    pub queued: u64,
+    /// Logs the logging thread wrote
+    pub written: u64,
+    /// Logs the overflow policy dropped
+    pub dropped: u64,
+    /// Logs waiting for the logging thread
+    pub queue_depth: u64,
+
+    /// Batches the logging thread wrote
+    pub batches: u64,
+    /// Time spent writing batches, in nanoseconds
+    pub batch_nanos_total: u64,
+    /// Longest a single batch took, in nanoseconds
+    pub batch_nanos_max: u64,
+
+    /// Bytes written to the log files
+    pub bytes_written: u64,
+
+    pub flushes: u64,
+    /// Time spent flushing, in nanoseconds
+    pub flush_nanos_total: u64,
+    /// Longest a single flush took, in nanoseconds
+    pub flush_nanos_max: u64,
+
+    /// Logs sinks missed because they fell behind
+    pub sink_dropped: u64,
+    /// Failed sink calls
+    pub sink_errors: u64,
+}
+
+impl LoggerStats {
+    /// A single line for the periodic stats log
+    pub fn to_log(&self) -> LogData {
+        let mean = |total: u64, count: u64| Duration::from_nanos(total / count.max(1));
+
+        LogData {
+            level: LogLevel::Info,
+            tag: Some("Paper2".into()),
+            message: format!(
+                "queued {}, written {}, dropped {}, queue depth {}, batches {} (mean {:?}, max {:?}), \
+                 bytes written {}, flushes {} (mean {:?}, max {:?}), sink drops {}, sink errors {}",
+                self.queued,
+                self.written,
+                self.dropped,
+                self.queue_depth,
+                self.batches,
+                mean(self.batch_nanos_total, self.batches),
+                Duration::from_nanos(self.batch_nanos_max),
+                self.bytes_written,
+                self.flushes,
+                mean(self.flush_nanos_total, self.flushes),
+                Duration::from_nanos(self.flush_nanos_max),
+                self.sink_dropped,
+                self.sink_errors,
+            ),
+            file: file!().into(),
+            line: line!(),
+            column: column!(),
+            ..LogData::default()
+        }
+    }
+}
+
+/// The live counters behind [`LoggerStats`]
+#[derive(Debug, Default)]
+pub struct LoggerMetrics {
+    /// The only counter producers write, summed up by [`Self::snapshot`]
+    queued: [CachePadded<AtomicU64>; QUEUED_STRIPES],
+
+    written: AtomicU64,
+    batches: AtomicU64,
+    batch_nanos_total: AtomicU64,
+    batch_nanos_max: AtomicU64,
+    bytes_written: AtomicU64,
+    flushes: AtomicU64,
+    flush_nanos_total: AtomicU64,
+    flush_nanos_max: AtomicU64,
+    sink_dropped: AtomicU64,
+    sink_errors: AtomicU64,
+}
+
+/// Cache lines the queued count is spread over
+const QUEUED_STRIPES: usize = 16;
+
+static NEXT_STRIPE: AtomicUsize = AtomicUsize::new(0);
+
+thread_local! {
+    /// The queued stripe this thread counts on, handed out round robin
+    static QUEUED_STRIPE: usize = NEXT_STRIPE.fetch_add(1, Ordering::Relaxed) % QUEUED_STRIPES;
+}
+
+/// Adds to a counter only the logging thread writes, without a read-modify-write
+#[inline]
+fn add(counter: &AtomicU64, value: u64) {
+    counter.store(counter.load(Ordering::Relaxed) + value, Ordering::Relaxed);
+}
+
+impl LoggerMetrics {
+    #[inline]
+    pub fn record_queued(&self, count: u64) {
+        let stripe = QUEUED_STRIPE.try_with(|stripe| *stripe).unwrap_or(0);
+        self.queued[stripe].fetch_add(count, Ordering::Relaxed);
+    }
+
+    /// Called by the logging thread once a batch is written
+    pub fn record_batch(&self, logs: u64, took: Duration) {
+        let nanos = took.as_nanos() as u64;
+        add(&self.written, logs);
+        add(&self.batches, 1);
+        add(&self.batch_nanos_total, nanos);
+        if nanos > self.batch_nanos_max.load(Ordering::Relaxed) {
+            self.batch_nanos_max.store(nanos, Ordering::Relaxed);
+        }
+    }
+
+    /// Called by the logging thread after each flush
+    pub fn record_flush(&self, took: Duration) {
+        let nanos = took.as_nanos() as u64;
+        add(&self.flushes, 1);
+        add(&self.flush_nanos_total, nanos);
+        if nanos > self.flush_nanos_max.load(Ordering::Relaxed) {
+            self.flush_nanos_max.store(nanos, Ordering::Relaxed);
+        }
+    }
+
+    /// Total bytes in the log files so far
+    pub fn set_bytes_written(&self, bytes: u64) {
+        self.bytes_written.store(bytes, Ordering::Relaxed);
+    }
+
+    pub fn record_sink_report(&self, dropped: u64, errors: u64) {
+        add(&self.sink_dropped, dropped);
+        add(&self.sink_errors, errors);
+    }
+
+    /// Reads every counter. `dropped` comes from the queue, which counts it itself.
+    /// Counters are read one by one, so a snapshot taken while logs are written may be
+    /// off by a batch.
+    pub fn snapshot(&self, dropped: u64) -> LoggerStats {
+        let written = self.written.load(Ordering::Relaxed);
+        let queued = self
+            .queued
+            .iter()
+            .map(|stripe| stripe.load(Ordering::Relaxed))
+            .sum();
+
+        LoggerStats {
+            queued,
+            written,
+            dropped,
+            queue_depth: queued.saturating_sub(written + dropped),
+            batches: self.batches.load(Ordering::Relaxed),
+            batch_nanos_total: self.batch_nanos_total.load(Ordering::Relaxed),
+            batch_nanos_max: self.batch_nanos_max.load(Ordering::Relaxed),
+            bytes_written: self.bytes_written.load(Ordering::Relaxed),
+            flushes: self.flushes.load(Ordering::Relaxed),
+            flush_nanos_total: self.flush_nanos_total.load(Ordering::Relaxed),
+            flush_nanos_max: self.flush_nanos_max.load(Ordering::Relaxed),
+            sink_dropped: self.sink_dropped.load(Ordering::Relaxed),
+            sink_errors: self.sink_errors.load(Ordering::Relaxed),
+        }
+    }
+}
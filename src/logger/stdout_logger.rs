@@ -1,4 +1,4 @@
-use super::LogData;
+use super::{render::RenderedRecord, LogData};
 
 // assert tracing is not enabled
 #[cfg(not(feature = "tracing"))]
@@ -7,3 +7,8 @@ compile_error!("The 'tracing' feature must be enabled to use this logger.");
 pub(crate) fn do_log(log: &LogData) {
     println!("{}", log.format());
 }
+
+/// Prints one line of `log`
+pub(crate) fn do_log_line(log: &LogData, record: &RenderedRecord, line: &str) {
+    println!("{}", record.format_line(log, line));
+}
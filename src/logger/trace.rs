@@ -0,0 +1,112 @@
+//! Profiling zones exported as a Chrome trace.
+//!
+//! Producers collect the zones they timed and hand them to the logging thread in batches,
+//! which appends them to a trace file in the JSON array format of the Chrome trace event
+//! format. The closing `]` is optional in that format, so a file cut short by a crash still
+//! opens in `chrome://tracing` and Perfetto.
+
+#[cfg(feature = "file")]
+use std::{
+    fs::File,
+    io::{self, BufWriter, Write},
+    path::Path,
+};
+
+/// A timed zone, on the clock of the producer that recorded it
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct TraceEvent {
+    /// Zone names are static, they are never copied
+    pub name: &'static str,
+    pub start_nanos: u64,
+    pub duration_nanos: u64,
+}
+
+/// The zones one thread recorded since its last batch
+#[derive(Debug, Clone, Default)]
+pub struct TraceBatch {
+    pub tid: u32,
+    pub events: Vec<TraceEvent>,
+}
+
+/// A trace file, written by the logging thread.
+#[cfg(feature = "file")]
+pub struct TraceFile {
+    file: BufWriter<File>,
+    pid: u32,
+    /// Whether an event was written, the next one needs a separator
+    has_events: bool,
+}
+
+#[cfg(feature = "file")]
+impl TraceFile {
+    /// Creates or truncates the trace file at `path`
+    pub fn create(path: &Path) -> io::Result<Self> {
+        let mut file = BufWriter::new(File::create(path)?);
+        file.write_all(b"[\n")?;
+
+        Ok(TraceFile {
+            file,
+            pid: std::process::id(),
+            has_events: false,
+        })
+    }
+
+    /// Appends every zone of `batch` as a complete event
+    pub fn write_batch(&mut self, batch: &TraceBatch) -> io::Result<()> {
+        for event in &batch.events {
+            if self.has_events {
+                self.file.write_all(b",\n")?;
+            }
+            self.has_events = true;
+
+            // timestamps are in microseconds, the fraction keeps nanoseconds
+            self.file.write_all(b"{\"name\":")?;
+            write_json_str(&mut self.file, event.name)?;
+            write!(
+                self.file,
+                ",\"ph\":\"X\",\"ts\":{}.{:03},\"dur\":{}.{:03},\"pid\":{},\"tid\":{}}}",
+                event.start_nanos / 1000,
+                event.start_nanos % 1000,
+                event.duration_nanos / 1000,
+                event.duration_nanos % 1000,
+                self.pid,
+                batch.tid,
+            )?;
+        }
+
+        Ok(())
+    }
+
+    pub fn flush(&mut self) -> io::Result<()> {
+        self.file.flush()
+    }
+}
+
+/// Writes `s` as a quoted JSON string
+#[cfg(feature = "file")]
+pub fn write_json_str(out: &mut impl Write, s: &str) -> io::Result<()> {
+    out.write_all(b"\"")?;
+
+    let mut plain = 0;
+    for (i, byte) in s.bytes().enumerate() {
+        let escaped: &[u8] = match byte {
+            b'"' => b"\\\"",
+            b'\\' => b"\\\\",
+            b'\n' => b"\\n",
+            b'\r' => b"\\r",
+            b'\t' => b"\\t",
+            0..0x20 => b"",
+            _ => continue,
+        };
+
+        out.write_all(&s.as_bytes()[plain..i])?;
+        match escaped.is_empty() {
+            true => write!(out, "\\u{byte:04x}")?,
+            false => out.write_all(escaped)?,
+        }
+        plain = i + 1;
+    }
+
+    out.write_all(&s.as_bytes()[plain..])?;
+    out.write_all(b"\"")
+}
@@ -2,6 +2,8 @@ use tracing::{debug, error, info, warn};
 
 use crate::log_level::LogLevel;
 
+use super::render::RenderedRecord;
+
 impl From<LogLevel> for tracing::Level {
     fn from(level: LogLevel) -> Self {
         match level {
@@ -17,7 +19,13 @@ impl From<LogLevel> for tracing::Level {
 }
 
 pub fn do_log(log: &super::LogData) -> crate::Result<()> {
-    let message = log.format();
+    let mut arena = String::new();
+    do_log_line(log, &RenderedRecord::render(log, &mut arena), &log.message)
+}
+
+/// Emits one line of `log`
+pub fn do_log_line(log: &super::LogData, record: &RenderedRecord, line: &str) -> crate::Result<()> {
+    let message = record.format_line(log, line);
     match log.level {
         LogLevel::Info => info!("{message}"),
         LogLevel::Warn => warn!("{message}"),
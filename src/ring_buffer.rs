@@ -0,0 +1,110 @@
+use std::{
+    cell::UnsafeCell,
+    mem::MaybeUninit,
+    ops::Deref,
+    sync::atomic::{AtomicUsize, Ordering},
+};
+
+/// Pads and aligns a value to a cache line to avoid false sharing
+/// between the producer and consumer indices.
+#[repr(align(64))]
+#[derive(Debug, Default)]
+pub(crate) struct CachePadded<T>(pub T);
+
+impl<T> Deref for CachePadded<T> {
+    type Target = T;
+
+    fn deref(&self) -> &Self::Target {
+        &self.0
+    }
+}
+
+/// A bounded, lock-free single-producer single-consumer ring buffer.
+///
+/// The ring does not enforce the single producer/consumer contract itself,
+/// which is why `push` and `pop` are unsafe. Callers are expected to keep the
+/// producer side thread-local and serialize the consumer side.
+pub struct SpscRing<T> {
+    buffer: Box<[UnsafeCell<MaybeUninit<T>>]>,
+    mask: usize,
+
+    /// Next slot to read. Only written by the consumer.
+    head: CachePadded<AtomicUsize>,
+    /// Next slot to write. Only written by the producer.
+    tail: CachePadded<AtomicUsize>,
+}
+
+unsafe impl<T: Send> Send for SpscRing<T> {}
+unsafe impl<T: Send> Sync for SpscRing<T> {}
+
+impl<T> SpscRing<T> {
+    /// Creates a ring with at least `capacity` slots, rounded up to a power of two.
+    pub fn with_capacity(capacity: usize) -> Self {
+        let capacity = capacity.max(2).next_power_of_two();
+        let buffer = (0..capacity)
+            .map(|_| UnsafeCell::new(MaybeUninit::uninit()))
+            .collect();
+
+        SpscRing {
+            buffer,
+            mask: capacity - 1,
+            head: CachePadded(AtomicUsize::new(0)),
+            tail: CachePadded(AtomicUsize::new(0)),
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        let tail = self.tail.load(Ordering::Acquire);
+        let head = self.head.load(Ordering::Acquire);
+        tail.wrapping_sub(head)
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Pushes a value, handing it back if the ring is full.
+    ///
+    /// # Safety
+    /// Must only be called from a single producer thread at a time.
+    pub unsafe fn push(&self, value: T) -> Result<(), T> {
+        let tail = self.tail.load(Ordering::Relaxed);
+        let head = self.head.load(Ordering::Acquire);
+
+        if tail.wrapping_sub(head) == self.buffer.len() {
+            return Err(value);
+        }
+
+        let slot = &self.buffer[tail & self.mask];
+        unsafe { (*slot.get()).write(value) };
+        self.tail.store(tail.wrapping_add(1), Ordering::Release);
+
+        Ok(())
+    }
+
+    /// Pops the oldest value, if any.
+    ///
+    /// # Safety
+    /// Must only be called from a single consumer thread at a time.
+    pub unsafe fn pop(&self) -> Option<T> {
+        let head = self.head.load(Ordering::Relaxed);
+        let tail = self.tail.load(Ordering::Acquire);
+
+        if head == tail {
+            return None;
+        }
+
+        let slot = &self.buffer[head & self.mask];
+        let value = unsafe { (*slot.get()).assume_init_read() };
+        self.head.store(head.wrapping_add(1), Ordering::Release);
+
+        Some(value)
+    }
+}
+
+impl<T> Drop for SpscRing<T> {
+    fn drop(&mut self) {
+        // we have exclusive access, drain whatever was left behind
+        while unsafe { self.pop() }.is_some() {}
+    }
+}
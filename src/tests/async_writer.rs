@@ -0,0 +1,113 @@
+use std::{fs, io::Write, path::PathBuf, sync::Arc, thread, time::Duration};
+
+use crate::{
+    log_level::LogLevel,
+    logger::{
+        async_writer::{AsyncFile, IoWorker},
+        FileBackend, LogData,
+    },
+    semaphore_lite::SemaphoreLite,
+    LoggerConfig, LoggerThreadCtx,
+};
+
+#[test]
+fn test_async_files_submitted_together() {
+    let dir = PathBuf::from("./logs/14");
+    fs::create_dir_all(&dir).unwrap();
+
+    let worker = IoWorker::spawn().unwrap();
+    let mut first = AsyncFile::create(dir.join("first.log"), &worker).unwrap();
+    let mut second = AsyncFile::create(dir.join("second.log"), &worker).unwrap();
+
+    for i in 0..100 {
+        writeln!(first, "first {i}").unwrap();
+        writeln!(second, "second {i}").unwrap();
+    }
+
+    let done = Arc::new(SemaphoreLite::new());
+    let pending = [first.take_pending(), second.take_pending()]
+        .into_iter()
+        .flatten()
+        .collect();
+    worker.submit(pending, Some(Arc::clone(&done))).unwrap();
+    done.wait_timeout(Duration::from_secs(5));
+
+    let first_log = fs::read_to_string(dir.join("first.log")).unwrap();
+    let second_log = fs::read_to_string(dir.join("second.log")).unwrap();
+    assert_eq!(first_log.lines().count(), 100);
+    assert_eq!(second_log.lines().last(), Some("second 99"));
+
+    // nothing new to hand over
+    assert!(first.take_pending().is_none());
+}
+
+#[test]
+fn test_logger_with_async_files() {
+    let config = LoggerConfig {
+        max_string_len: 100,
+        log_max_buffer_count: 50,
+        line_end: '\n',
+        file_backend: FileBackend::Async,
+        context_log_path: PathBuf::from("./logs/14"),
+        ..Default::default()
+    };
+    let log_path = config.context_log_path.join("test_log.log");
+
+    let logger = LoggerThreadCtx::new(config, log_path.clone())
+        .unwrap()
+        .init(false)
+        .unwrap();
+    logger.read().add_context("AsyncContext").unwrap();
+
+    for i in 0..200 {
+        logger.read().queue_log(LogData {
+            level: LogLevel::Info,
+            tag: Some("AsyncContext".into()),
+            message: format!("async log {i}"),
+            ..Default::default()
+        });
+    }
+
+    let context_path = PathBuf::from("./logs/14/AsyncContext.log");
+    let mut lines = (0, 0);
+    for _ in 0..200 {
+        thread::sleep(Duration::from_millis(10));
+        let count = |path: &PathBuf| {
+            fs::read_to_string(path)
+                .unwrap_or_default()
+                .lines()
+                .filter(|line| line.contains("async log"))
+                .count()
+        };
+        lines = (count(&log_path), count(&context_path));
+        if lines == (200, 200) {
+            break;
+        }
+    }
+
+    assert_eq!(lines, (200, 200));
+}
+
+#[test]
+fn test_async_submit_waits_for_io_thread() {
+    let dir = PathBuf::from("./logs/14");
+    fs::create_dir_all(&dir).unwrap();
+
+    let worker = IoWorker::spawn().unwrap();
+    let mut file = AsyncFile::create(dir.join("bounded.log"), &worker).unwrap();
+
+    // far more requests than can be pending, submitting waits instead of piling them up
+    for i in 0..1000 {
+        writeln!(file, "bounded {i}").unwrap();
+        let pending = file.take_pending().into_iter().collect();
+        worker.submit(pending, None).unwrap();
+    }
+
+    let done = Arc::new(SemaphoreLite::new());
+    worker.submit(Vec::new(), Some(Arc::clone(&done))).unwrap();
+    done.wait_timeout(Duration::from_secs(5));
+
+    let log = fs::read_to_string(dir.join("bounded.log")).unwrap();
+    assert_eq!(log.lines().count(), 1000);
+    assert_eq!(log.lines().last(), Some("bounded 999"));
+}
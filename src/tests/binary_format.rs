@@ -0,0 +1,198 @@
+use std::{borrow::Cow, fs, io::Cursor, path::PathBuf, thread, time::Duration};
+
+use chrono::TimeZone;
+
+use crate::{
+    log_level::LogLevel,
+    logger::{
+        binary_format::{self, BinaryDecoder, BinaryEncoder, DecodedRecord, RecordFilter},
+        clock::{precision, TimestampFormatter},
+        FileFormat, LogData,
+    },
+    LoggerConfig, LoggerThreadCtx,
+};
+
+fn log(level: LogLevel, tag: Option<&'static str>, message: &str) -> LogData {
+    LogData {
+        level,
+        tag: tag.map(Cow::Borrowed),
+        message: message.to_string(),
+        file: "src/tests/binary_format.rs".into(),
+        line: 12,
+        column: 4,
+        function_name: Some("binary_test".into()),
+        ..Default::default()
+    }
+}
+
+#[test]
+fn test_round_trip_matches_text() {
+    let logs = [
+        log(LogLevel::Info, Some("Binary"), "first"),
+        log(LogLevel::Error, None, "second"),
+        log(LogLevel::Warn, Some("Binary"), "third with ünïcode"),
+    ];
+
+    let mut encoder = BinaryEncoder::default();
+    let mut file = encoder.header().to_vec();
+    for log in &logs {
+        file.extend_from_slice(encoder.encode(log, &log.message));
+    }
+
+    let records = BinaryDecoder::new(Cursor::new(&file))
+        .unwrap()
+        .collect::<Result<Vec<_>, _>>()
+        .unwrap();
+    assert_eq!(records.len(), logs.len());
+
+    let mut formatter = TimestampFormatter::default();
+    for (log, record) in logs.iter().zip(&records) {
+        assert_eq!(record.unix_nanos, log.timestamp.unix_nanos());
+
+        let mut text = Vec::new();
+        record
+            .write_text(&mut text, &mut formatter, precision())
+            .unwrap();
+
+        let mut expected = Vec::new();
+        log.write_to_io(&mut expected).unwrap();
+        assert_eq!(
+            String::from_utf8(text).unwrap(),
+            String::from_utf8(expected).unwrap()
+        );
+    }
+
+    // strings are only defined once
+    let repeated = encoder.encode(&logs[0], &logs[0].message).len();
+    assert!(repeated < 16 + logs[0].message.len());
+}
+
+fn record(level: LogLevel, tag: Option<&str>, unix_nanos: i64) -> DecodedRecord {
+    DecodedRecord {
+        level,
+        unix_nanos,
+        tag: tag.map(Into::into),
+        file: "src/tests/binary_format.rs".into(),
+        line: 12,
+        column: 4,
+        function_name: None,
+        message: "filtered".to_string(),
+    }
+}
+
+#[test]
+fn test_filter_by_level_tag_and_time() {
+    let warn = record(LogLevel::Warn, Some("Binary"), 2_000);
+    let debug = record(LogLevel::Debug, Some("Binary"), 2_000);
+    let untagged = record(LogLevel::Error, None, 2_000);
+
+    let everything = RecordFilter::default();
+    assert!([&warn, &debug, &untagged]
+        .iter()
+        .all(|record| everything.matches(record)));
+
+    let filter = RecordFilter {
+        min_level: Some(LogLevel::Info),
+        tags: vec!["Other".to_string(), "Binary".to_string()],
+        since: Some(1_000),
+        until: Some(3_000),
+    };
+    assert!(filter.matches(&warn));
+    assert!(!filter.matches(&debug));
+    assert!(!filter.matches(&untagged));
+
+    // since is inclusive, until is not
+    assert!(filter.matches(&record(LogLevel::Warn, Some("Binary"), 1_000)));
+    assert!(!filter.matches(&record(LogLevel::Warn, Some("Binary"), 3_000)));
+    assert!(!filter.matches(&record(LogLevel::Warn, Some("Binary"), 999)));
+}
+
+#[test]
+fn test_parse_time() {
+    assert_eq!(
+        binary_format::parse_time("1700000000"),
+        Some(1_700_000_000_000_000_000)
+    );
+    assert_eq!(binary_format::parse_time("-5"), Some(-5_000_000_000));
+
+    let local = binary_format::parse_time("2024-01-01 12:00:00").unwrap();
+    let expected = chrono::Local
+        .with_ymd_and_hms(2024, 1, 1, 12, 0, 0)
+        .earliest()
+        .unwrap();
+    assert_eq!(local, expected.timestamp_nanos_opt().unwrap());
+    assert_eq!(
+        binary_format::parse_time("2024-01-01 12:00:01").unwrap() - local,
+        1_000_000_000
+    );
+
+    assert_eq!(binary_format::parse_time("2024-01-01"), None);
+    assert_eq!(binary_format::parse_time("yesterday"), None);
+    // past what fits in i64 nanoseconds
+    assert_eq!(binary_format::parse_time("10000000000000"), None);
+}
+
+#[test]
+fn test_truncated_file_is_an_error() {
+    let log = log(LogLevel::Info, Some("Binary"), "cut off");
+
+    let mut encoder = BinaryEncoder::default();
+    let mut file = encoder.header().to_vec();
+    file.extend_from_slice(encoder.encode(&log, &log.message));
+    file.truncate(file.len() - 2);
+
+    let mut decoder = BinaryDecoder::new(Cursor::new(&file)).unwrap();
+    assert!(decoder.next_record().is_err());
+
+    assert!(BinaryDecoder::new(Cursor::new(b"not a log")).is_err());
+}
+
+#[test]
+fn test_logger_writes_binary_files() {
+    let dir = PathBuf::from("./logs/16");
+    let _ = fs::remove_dir_all(&dir);
+
+    let config = LoggerConfig {
+        max_string_len: 100,
+        log_max_buffer_count: 50,
+        line_end: '\n',
+        file_format: FileFormat::Binary,
+        context_log_path: dir.clone(),
+        ..Default::default()
+    };
+    let log_path = dir.join("test_log.log");
+
+    let logger = LoggerThreadCtx::new(config, log_path.clone())
+        .unwrap()
+        .init(false)
+        .unwrap();
+    logger.read().add_context("BinaryContext").unwrap();
+
+    for i in 0..100 {
+        logger.read().queue_log(log(
+            LogLevel::Info,
+            Some("BinaryContext"),
+            &format!("binary log {i}"),
+        ));
+    }
+
+    let context_path = dir.join("BinaryContext.log");
+    let mut records = Vec::new();
+    for _ in 0..200 {
+        thread::sleep(Duration::from_millis(10));
+        // the header may not be flushed yet
+        let Ok(decoder) =
+            fs::read(&context_path).and_then(|file| BinaryDecoder::new(Cursor::new(file)))
+        else {
+            continue;
+        };
+        records = decoder.filter_map(Result::ok).collect();
+        if records.len() == 100 {
+            break;
+        }
+    }
+
+    assert_eq!(records.len(), 100);
+    assert_eq!(records[99].message, "binary log 99");
+    assert_eq!(records[0].tag.as_deref(), Some("BinaryContext"));
+}
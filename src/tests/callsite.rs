@@ -0,0 +1,112 @@
+use crate::log_level::LogLevel;
+use crate::logger::{callsite, LogData};
+
+#[test]
+fn test_register_same_callsite_twice() {
+    let first = callsite::register(
+        LogLevel::Info,
+        Some("CallsiteTest"),
+        "src/callsite_test.cpp",
+        10,
+        4,
+        Some("foo"),
+    )
+    .unwrap();
+    let second = callsite::register(
+        LogLevel::Info,
+        Some("CallsiteTest"),
+        "src/callsite_test.cpp",
+        10,
+        4,
+        Some("foo"),
+    )
+    .unwrap();
+    let other_line = callsite::register(
+        LogLevel::Info,
+        Some("CallsiteTest"),
+        "src/callsite_test.cpp",
+        11,
+        4,
+        Some("foo"),
+    )
+    .unwrap();
+
+    assert_ne!(first, 0);
+    assert_eq!(first, second);
+    assert_ne!(first, other_line);
+}
+
+#[test]
+fn test_get_resolves_interned_metadata() {
+    let id = callsite::register(
+        LogLevel::Warn,
+        None,
+        "src/callsite_get.cpp",
+        20,
+        0,
+        None,
+    )
+    .unwrap();
+
+    let callsite = callsite::get(id).unwrap();
+    assert_eq!(callsite.level, LogLevel::Warn);
+    assert_eq!(callsite.tag, None);
+    assert_eq!(callsite.file, "src/callsite_get.cpp");
+    assert_eq!(callsite.line, 20);
+
+    // interned strings are shared
+    assert!(std::ptr::eq(
+        callsite.file,
+        callsite::intern("src/callsite_get.cpp").unwrap()
+    ));
+
+    let log = LogData::from_callsite(id, callsite, "hello".to_string());
+    assert_eq!(log.file, "src/callsite_get.cpp");
+    assert_eq!(log.callsite, Some(id));
+
+    assert!(callsite::get(0).is_none());
+    assert!(callsite::get(u32::MAX).is_none());
+}
+
+#[cfg(feature = "ffi")]
+#[test]
+fn test_message_slot_grow_keeps_prefix() {
+    use crate::ffi::{paper2_grow, paper2_release, paper2_reserve};
+
+    let mut slot = paper2_reserve(8);
+    assert!(slot.capacity >= 8);
+
+    unsafe { std::ptr::copy_nonoverlapping(b"hello".as_ptr(), slot.data, 5) };
+    assert!(unsafe { paper2_grow(&mut slot, 5, 4096) });
+    assert!(slot.capacity >= 4096);
+
+    let prefix = unsafe { std::slice::from_raw_parts(slot.data, 5) };
+    assert_eq!(prefix, b"hello");
+
+    unsafe { paper2_release(slot) };
+}
+
+#[test]
+fn test_gated_callsite_follows_tag_level() {
+    use crate::logger::level_filter;
+
+    let id = callsite::register(
+        LogLevel::Info,
+        Some("CallsiteGated"),
+        "src/callsite_gated.cpp",
+        30,
+        0,
+        None,
+    )
+    .unwrap();
+
+    let (callsite, gate) = callsite::get_gated(id).unwrap();
+    assert!(callsite.enabled(gate));
+    assert!(level_filter::is_enabled(LogLevel::Info, Some("CallsiteGated")));
+
+    // the gate is shared, so the cached one sees the new level too
+    level_filter::set_tag_level("CallsiteGated", Some(LogLevel::Warn));
+    assert!(!callsite.enabled(gate));
+    assert!(!level_filter::is_enabled(LogLevel::Info, Some("CallsiteGated")));
+    assert!(level_filter::is_enabled(LogLevel::Error, Some("CallsiteGated")));
+}
@@ -0,0 +1,73 @@
+use chrono::Local;
+
+use crate::logger::clock::{self, Timestamp, TimestampFormatter, TimestampPrecision};
+
+#[test]
+fn test_timestamp_tracks_wall_clock() {
+    let before = Local::now();
+    let timestamp = Timestamp::now();
+    let after = Local::now();
+
+    let wall = timestamp.to_local();
+    // the anchor is only as precise as the system clock read
+    assert!(wall >= before - chrono::Duration::milliseconds(5));
+    assert!(wall <= after + chrono::Duration::milliseconds(5));
+
+    assert!(Timestamp::now() >= timestamp);
+    assert_eq!(
+        timestamp.unix_seconds(),
+        timestamp.unix_nanos().div_euclid(1_000_000_000)
+    );
+}
+
+#[test]
+fn test_timestamp_keeps_its_anchor() {
+    let timestamp = Timestamp::now();
+    let unix_nanos = timestamp.unix_nanos();
+
+    clock::reanchor();
+    assert_eq!(timestamp.unix_nanos(), unix_nanos);
+    assert!(Timestamp::now().monotonic_nanos() >= timestamp.monotonic_nanos());
+}
+
+#[test]
+fn test_formatter_matches_chrono() {
+    let mut formatter = TimestampFormatter::default();
+    let timestamp = Timestamp::now();
+
+    let expected = timestamp.to_local().format("%Y-%m-%d %H:%M:%S").to_string();
+    assert_eq!(
+        formatter.format(timestamp, TimestampPrecision::Seconds),
+        expected
+    );
+
+    // same second, the cached prefix is reused
+    let millis = formatter
+        .format(timestamp, TimestampPrecision::Millis)
+        .to_string();
+    assert_eq!(millis.len(), expected.len() + 4);
+    assert!(millis.starts_with(&expected));
+    assert_eq!(
+        millis,
+        timestamp
+            .to_local()
+            .format("%Y-%m-%d %H:%M:%S%.3f")
+            .to_string()
+    );
+
+    let micros = formatter
+        .format(timestamp, TimestampPrecision::Micros)
+        .to_string();
+    assert_eq!(
+        micros,
+        timestamp
+            .to_local()
+            .format("%Y-%m-%d %H:%M:%S%.6f")
+            .to_string()
+    );
+
+    assert_eq!(
+        formatter.format(timestamp, TimestampPrecision::Seconds),
+        expected
+    );
+}
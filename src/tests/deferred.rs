@@ -0,0 +1,114 @@
+use std::ffi::c_void;
+use std::path::PathBuf;
+use std::thread;
+use std::time::Duration;
+
+use crate::logger::deferred::{DeferredMessage, DeferredWriteFn};
+use crate::logger::{LogData, LoggerConfig};
+use crate::LoggerThreadCtx;
+
+/// Stands in for the C++ renderer: replaces `{}` with a serialized u32
+unsafe extern "C" fn render_u32(
+    format: *const u8,
+    format_len: usize,
+    args: *const u8,
+    args_len: usize,
+    write: DeferredWriteFn,
+    out: *mut c_void,
+) {
+    let format = unsafe {
+        std::str::from_utf8_unchecked(std::slice::from_raw_parts(format, format_len))
+    };
+    let args = unsafe { std::slice::from_raw_parts(args, args_len) };
+    let value = u32::from_ne_bytes(args.try_into().unwrap());
+
+    let rendered = format.replace("{}", &value.to_string());
+    unsafe { write(out, rendered.as_ptr(), rendered.len()) };
+}
+
+fn deferred_log(value: u32) -> LogData {
+    LogData {
+        deferred: Some(DeferredMessage {
+            format: "deferred value {}",
+            args: value.to_ne_bytes().to_vec(),
+            render: render_u32,
+        }),
+        file: file!().into(),
+        line: line!(),
+        ..Default::default()
+    }
+}
+
+#[test]
+fn test_render_deferred() {
+    let mut log = deferred_log(42);
+    log.render_deferred();
+
+    assert_eq!(log.message, "deferred value 42");
+    assert!(log.deferred.is_none());
+
+    // rendering twice does nothing
+    log.render_deferred();
+    assert_eq!(log.message, "deferred value 42");
+}
+
+/// Writes a character split over two calls, then bytes that are not UTF-8
+unsafe extern "C" fn render_bytes(
+    _format: *const u8,
+    _format_len: usize,
+    _args: *const u8,
+    _args_len: usize,
+    write: DeferredWriteFn,
+    out: *mut c_void,
+) {
+    let e_acute = "é".as_bytes();
+    unsafe {
+        write(out, e_acute.as_ptr(), 1);
+        write(out, e_acute[1..].as_ptr(), 1);
+        write(out, b"\xff!".as_ptr(), 2);
+    }
+}
+
+#[test]
+fn test_render_deferred_checks_utf8() {
+    let mut log = LogData {
+        deferred: Some(DeferredMessage {
+            format: "",
+            args: Vec::new(),
+            render: render_bytes,
+        }),
+        ..Default::default()
+    };
+    log.render_deferred();
+
+    assert_eq!(log.message, "é\u{FFFD}!");
+}
+
+#[test]
+fn test_deferred_rendered_by_log_thread() {
+    let config = LoggerConfig {
+        context_log_path: PathBuf::from("./logs/12"),
+        ..Default::default()
+    };
+    let log_path = config.context_log_path.join("test_log.log");
+
+    let logger = LoggerThreadCtx::new(config, log_path.clone())
+        .unwrap()
+        .init(false)
+        .unwrap();
+
+    logger.read().queue_log(deferred_log(1337));
+
+    let mut found = false;
+    for _ in 0..100 {
+        thread::sleep(Duration::from_millis(10));
+        found = std::fs::read_to_string(&log_path)
+            .unwrap_or_default()
+            .contains("deferred value 1337");
+        if found {
+            break;
+        }
+    }
+
+    assert!(found);
+}
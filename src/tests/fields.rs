@@ -0,0 +1,143 @@
+use std::{borrow::Cow, fs, path::PathBuf, thread, time::Duration};
+
+use crate::{
+    log_level::LogLevel,
+    logger::{
+        fields::{Field, FieldValue},
+        json_format, FileFormat, LogData,
+    },
+    LoggerConfig, LoggerThreadCtx,
+};
+
+fn log(message: &str, fields: Vec<Field>) -> LogData {
+    LogData {
+        level: LogLevel::Info,
+        tag: Some(Cow::Borrowed("Fields")),
+        message: message.to_string(),
+        file: "src/tests/fields.rs".into(),
+        line: 12,
+        column: 4,
+        fields,
+        ..Default::default()
+    }
+}
+
+#[test]
+fn test_render_fields_appends_key_values() {
+    let mut log = log(
+        "player joined",
+        vec![
+            Field::new("id", 5),
+            Field::new("name", "bob smith"),
+            Field::new("ok", true),
+            Field::new("ms", 1.5),
+        ],
+    );
+
+    log.render_fields();
+    assert_eq!(
+        log.message,
+        r#"player joined id=5 name="bob smith" ok=true ms=1.5"#
+    );
+    assert_eq!(log.bare_message(), "player joined");
+
+    // already rendered
+    log.render_fields();
+    assert_eq!(log.bare_message(), "player joined");
+    assert!(log.message.ends_with("ms=1.5"));
+
+    let mut bare = self::log("", vec![Field::new("id", 5u32)]);
+    bare.render_fields();
+    assert_eq!(bare.message, "id=5");
+    assert_eq!(bare.bare_message(), "");
+}
+
+#[test]
+fn test_field_values_quote_when_ambiguous() {
+    assert_eq!(FieldValue::from("plain").to_string(), "plain");
+    assert_eq!(FieldValue::from("").to_string(), r#""""#);
+    assert_eq!(FieldValue::from("a=b").to_string(), r#""a=b""#);
+    assert_eq!(
+        FieldValue::from(r#"say "hi""#).to_string(),
+        r#""say \"hi\"""#
+    );
+    assert_eq!(FieldValue::from(-3i8).to_string(), "-3");
+}
+
+#[test]
+fn test_json_record_keeps_fields_typed() {
+    let mut log = log(
+        "line \"one\"\nline two",
+        vec![
+            Field::new("id", -5),
+            Field::new("count", 7u64),
+            Field::new("ratio", 0.25),
+            Field::new("nan", f64::NAN),
+            Field::new("ok", false),
+            Field::new("name", "bob"),
+        ],
+    );
+    log.render_fields();
+
+    let mut out = Vec::new();
+    json_format::write_record(&mut out, &log, "2024-01-01 12:00:00").unwrap();
+
+    assert_eq!(
+        String::from_utf8(out).unwrap(),
+        concat!(
+            r#"{"time":"2024-01-01 12:00:00","level":"INFO","tag":"Fields","#,
+            r#""file":"src/tests/fields.rs","line":12,"column":4,"#,
+            r#""message":"line \"one\"\nline two","#,
+            r#""fields":{"id":-5,"count":7,"ratio":0.25,"nan":null,"ok":false,"name":"bob"}}"#,
+            "\n"
+        )
+    );
+}
+
+#[test]
+fn test_logger_writes_json_lines() {
+    let dir = PathBuf::from("./logs/26");
+    let _ = fs::remove_dir_all(&dir);
+
+    let config = LoggerConfig {
+        max_string_len: 10,
+        log_max_buffer_count: 50,
+        line_end: '\n',
+        file_format: FileFormat::JsonLines,
+        context_log_path: dir.clone(),
+        ..Default::default()
+    };
+
+    let logger = LoggerThreadCtx::new(config, dir.join("test_log.log"))
+        .unwrap()
+        .init(false)
+        .unwrap();
+    logger.read().add_context("Fields").unwrap();
+
+    for i in 0..50 {
+        logger.read().queue_log(log(
+            "a message longer than max_string_len",
+            vec![Field::new("i", i)],
+        ));
+    }
+
+    let context_path = dir.join("Fields.log");
+    let mut lines = Vec::new();
+    for _ in 0..200 {
+        thread::sleep(Duration::from_millis(10));
+        lines = fs::read_to_string(&context_path)
+            .unwrap_or_default()
+            .lines()
+            .map(str::to_string)
+            .collect();
+        if lines.len() == 50 {
+            break;
+        }
+    }
+
+    // messages aren't split, each record is one line
+    assert_eq!(lines.len(), 50);
+    assert!(lines[0].starts_with(r#"{"time":""#));
+    assert!(lines[49]
+        .ends_with(r#""message":"a message longer than max_string_len","fields":{"i":49}}"#));
+}
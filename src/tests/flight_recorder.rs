@@ -0,0 +1,140 @@
+use std::{sync::Arc, thread};
+
+use crate::{
+    log_level::LogLevel,
+    logger::{flight_recorder::FlightRecorder, LogData},
+};
+
+fn log(tag: Option<&'static str>, message: &str) -> LogData {
+    LogData {
+        level: LogLevel::Warn,
+        tag: tag.map(Into::into),
+        message: message.to_string(),
+        ..Default::default()
+    }
+}
+
+fn dump(recorder: &FlightRecorder) -> Vec<String> {
+    let mut out = Vec::new();
+    recorder.dump_with(|bytes| out.extend_from_slice(bytes));
+    String::from_utf8(out)
+        .unwrap()
+        .lines()
+        .map(str::to_string)
+        .collect()
+}
+
+#[test]
+fn test_keeps_most_recent_records() {
+    let recorder = FlightRecorder::new(6);
+    assert_eq!(recorder.capacity(), 8);
+
+    for i in 0..20 {
+        recorder.record(&log(Some("Recorder"), &format!("record {i}")));
+    }
+
+    let lines = dump(&recorder);
+    assert_eq!(lines.len(), 8);
+    assert!(lines[0].starts_with("W "));
+    assert!(lines[0].ends_with("[Recorder] record 12"));
+    assert!(lines[7].ends_with("[Recorder] record 19"));
+}
+
+#[test]
+fn test_cuts_long_records_on_char_boundaries() {
+    let recorder = FlightRecorder::new(4);
+    recorder.record(&log(None, &"é".repeat(500)));
+
+    let lines = dump(&recorder);
+    assert_eq!(lines.len(), 1);
+    assert!(lines[0].contains("[GLOBAL] é"));
+    assert!(lines[0].len() < 500);
+}
+
+#[test]
+fn test_concurrent_records_stay_whole() {
+    let recorder = Arc::new(FlightRecorder::new(64));
+
+    let handles = (0..4)
+        .map(|t| {
+            let recorder = Arc::clone(&recorder);
+            thread::spawn(move || {
+                for i in 0..10_000 {
+                    recorder.record(&log(Some("Concurrent"), &format!("thread {t} record {i}")));
+                }
+            })
+        })
+        .collect::<Vec<_>>();
+
+    // dumping while producers write only ever skips records, it never mixes them
+    while !handles.iter().all(|handle| handle.is_finished()) {
+        for line in dump(&recorder) {
+            assert!(line.contains("[Concurrent] thread "), "{line}");
+        }
+    }
+    handles
+        .into_iter()
+        .for_each(|handle| handle.join().unwrap());
+    assert_eq!(dump(&recorder).len(), 64);
+}
+
+#[test]
+fn test_late_writer_keeps_newer_record() {
+    let recorder = FlightRecorder::new(4);
+
+    // preempted between taking its ticket and writing, while a full lap is recorded
+    let stale = recorder.take_ticket();
+    for i in 1..=4 {
+        recorder.record(&log(Some("Recorder"), &format!("record {i}")));
+    }
+    recorder.record_ticket(stale, &log(Some("Recorder"), "record 0"));
+
+    let lines = dump(&recorder);
+    assert_eq!(lines.len(), 4);
+    assert!(lines[0].ends_with("[Recorder] record 1"));
+    assert!(lines[3].ends_with("[Recorder] record 4"));
+}
+
+/// Set for the child process [`test_crash_dump`] starts
+#[cfg(all(unix, feature = "flight_recorder"))]
+const CRASH_CHILD_ENV: &str = "PAPER2_CRASH_CHILD";
+
+#[cfg(all(unix, feature = "flight_recorder"))]
+#[test]
+fn test_crash_dump() {
+    use std::{env, fs, os::unix::process::ExitStatusExt, path::PathBuf, process::Command};
+
+    use crate::logger::flight_recorder;
+
+    let dump_path = PathBuf::from("./logs/21/crash.log");
+
+    if env::var_os(CRASH_CHILD_ENV).is_some() {
+        let recorder = Arc::new(FlightRecorder::new(16));
+        recorder.record(&log(Some("Crash"), "the last words"));
+        flight_recorder::install_crash_handler(&recorder, &dump_path).unwrap();
+
+        // a real fault, the handler returns and the previous one ends the process
+        unsafe { std::ptr::null_mut::<u8>().write_volatile(1) };
+        unreachable!();
+    }
+
+    fs::create_dir_all(dump_path.parent().unwrap()).unwrap();
+    let _ = fs::remove_file(&dump_path);
+
+    let status = Command::new(env::current_exe().unwrap())
+        .args([
+            "--exact",
+            "tests::flight_recorder::test_crash_dump",
+            "--nocapture",
+        ])
+        .env(CRASH_CHILD_ENV, "1")
+        .status()
+        .unwrap();
+    assert_eq!(status.signal(), Some(libc::SIGSEGV));
+
+    let dump = fs::read_to_string(&dump_path).unwrap();
+    assert!(dump.starts_with("*** paper2 crash: SIGSEGV, fault address 0x0000000000000000"));
+    assert!(dump.contains("[Crash] the last words"));
+    assert!(dump.contains("backtrace:\n  #00 pc 0x"));
+    assert!(dump.contains("memory map:"));
+}
@@ -0,0 +1,113 @@
+use std::sync::atomic::Ordering;
+
+use crate::log_level::LogLevel;
+use crate::logger::level_filter;
+
+#[test]
+fn test_severity_order() {
+    let levels = [
+        LogLevel::Debug,
+        LogLevel::Info,
+        LogLevel::Warn,
+        LogLevel::Error,
+        LogLevel::Crit,
+        LogLevel::Off,
+    ];
+
+    assert!(levels
+        .windows(2)
+        .all(|pair| pair[0].severity() < pair[1].severity()));
+}
+
+#[test]
+fn test_tag_level_override() {
+    let gate = level_filter::tag_gate("LevelFilterOverride");
+    assert!(std::ptr::eq(
+        gate,
+        level_filter::tag_gate("LevelFilterOverride")
+    ));
+
+    level_filter::set_tag_level("LevelFilterOverride", Some(LogLevel::Warn));
+    assert_eq!(gate.load(Ordering::Relaxed), LogLevel::Warn.severity());
+    assert!(!level_filter::is_enabled(
+        LogLevel::Debug,
+        Some("LevelFilterOverride")
+    ));
+    assert!(!level_filter::is_enabled(
+        LogLevel::Info,
+        Some("LevelFilterOverride")
+    ));
+    assert!(level_filter::is_enabled(
+        LogLevel::Warn,
+        Some("LevelFilterOverride")
+    ));
+    assert!(level_filter::is_enabled(
+        LogLevel::Crit,
+        Some("LevelFilterOverride")
+    ));
+
+    level_filter::set_tag_level("LevelFilterOverride", Some(LogLevel::Off));
+    assert!(!level_filter::is_enabled(
+        LogLevel::Crit,
+        Some("LevelFilterOverride")
+    ));
+    assert!(!level_filter::is_enabled(
+        LogLevel::Off,
+        Some("LevelFilterOverride")
+    ));
+}
+
+#[test]
+fn test_tags_follow_global_level() {
+    let inheriting = level_filter::tag_gate("LevelFilterInherit");
+    level_filter::set_tag_level("LevelFilterPinned", Some(LogLevel::Debug));
+
+    level_filter::set_global_level(LogLevel::Error);
+    assert_eq!(
+        inheriting.load(Ordering::Relaxed),
+        LogLevel::Error.severity()
+    );
+    assert!(!level_filter::is_enabled(LogLevel::Warn, None));
+    assert!(level_filter::is_enabled(
+        LogLevel::Debug,
+        Some("LevelFilterPinned")
+    ));
+
+    // tags created later start at the global level too
+    assert!(!level_filter::is_enabled(
+        LogLevel::Info,
+        Some("LevelFilterLate")
+    ));
+
+    level_filter::set_tag_level("LevelFilterPinned", None);
+    assert!(!level_filter::is_enabled(
+        LogLevel::Debug,
+        Some("LevelFilterPinned")
+    ));
+
+    level_filter::set_global_level(LogLevel::Debug);
+    assert!(level_filter::is_enabled(
+        LogLevel::Debug,
+        Some("LevelFilterInherit")
+    ));
+    assert!(level_filter::is_enabled(LogLevel::Debug, None));
+}
+
+#[test]
+fn test_checking_tag_creates_no_gate() {
+    // follows the global level without a gate, and the cached miss sees the gate made later
+    assert!(level_filter::is_enabled(
+        LogLevel::Info,
+        Some("LevelFilterUnseen")
+    ));
+
+    level_filter::set_tag_level("LevelFilterUnseen", Some(LogLevel::Warn));
+    assert!(!level_filter::is_enabled(
+        LogLevel::Info,
+        Some("LevelFilterUnseen")
+    ));
+    assert!(level_filter::is_enabled(
+        LogLevel::Warn,
+        Some("LevelFilterUnseen")
+    ));
+}
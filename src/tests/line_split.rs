@@ -0,0 +1,43 @@
+use crate::logger::line_split::{is_single_segment, segments};
+
+#[test]
+fn test_single_line_passes_through() {
+    let message = "a short message";
+    assert!(is_single_segment(message, 100));
+
+    let split: Vec<&str> = segments(message, 100).collect();
+    assert_eq!(split, [message]);
+    // borrowed, not copied
+    assert!(std::ptr::eq(split[0], message));
+}
+
+#[test]
+fn test_split_lines_and_chunks() {
+    let message = "first\n\nsecond line\nabcdefghij";
+    assert!(!is_single_segment(message, 100));
+
+    let split: Vec<&str> = segments(message, 4).collect();
+    assert_eq!(
+        split,
+        ["firs", "t", "seco", "nd l", "ine", "abcd", "efgh", "ij"]
+    );
+
+    // 0 means lines are never cut
+    let split: Vec<&str> = segments(message, 0).collect();
+    assert_eq!(split, ["first", "second line", "abcdefghij"]);
+
+    assert_eq!(segments("", 10).count(), 0);
+    assert_eq!(segments("\n\n", 10).count(), 0);
+    assert_eq!(segments("trailing\n", 10).collect::<Vec<_>>(), ["trailing"]);
+}
+
+#[test]
+fn test_split_respects_char_boundaries() {
+    // 'é' is 2 bytes, '🦀' is 4
+    let split: Vec<&str> = segments("aéé", 2).collect();
+    assert_eq!(split, ["a", "é", "é"]);
+
+    // a char wider than the limit is kept whole
+    let split: Vec<&str> = segments("🦀🦀", 3).collect();
+    assert_eq!(split, ["🦀", "🦀"]);
+}
@@ -43,6 +43,7 @@ fn test_log_init() -> Result<()> {
         log_max_buffer_count: 50,
         line_end: '\n',
         context_log_path: PathBuf::from("./logs/1"),
+        ..Default::default()
     };
     let log_path = config.context_log_path.join("test_log.log");
 
@@ -68,6 +69,7 @@ fn test_log_output() -> Result<()> {
         log_max_buffer_count: 50,
         line_end: '\n',
         context_log_path: PathBuf::from("./logs/2"),
+        ..Default::default()
     };
     let log_path = config.context_log_path.join("test_log.log");
 
@@ -79,7 +81,7 @@ fn test_log_output() -> Result<()> {
             level: LogLevel::Info,
             tag: None,
             message: "hi! 5".to_owned(),
-            file: file!().to_string(),
+            file: file!().into(),
             line: line!(),
             column: column!(),
             function_name: None,
@@ -100,6 +102,7 @@ fn test_single_thread_log_spam() -> Result<()> {
         log_max_buffer_count: 50,
         line_end: '\n',
         context_log_path: PathBuf::from("./logs/3"),
+        ..Default::default()
     };
     let log_path = config.context_log_path.join("test_log.log");
 
@@ -112,7 +115,7 @@ fn test_single_thread_log_spam() -> Result<()> {
             level: LogLevel::Debug,
             tag: None,
             message: "Spam logging now!".to_owned(),
-            file: file!().to_string(),
+            file: file!().into(),
             line: line!(),
             column: column!(),
             function_name: None,
@@ -125,7 +128,7 @@ fn test_single_thread_log_spam() -> Result<()> {
                 level: LogLevel::Debug,
                 tag: None,
                 message: format!("log i {i}"),
-                file: file!().to_string(),
+                file: file!().into(),
                 line: line!(),
                 column: column!(),
                 function_name: None,
@@ -148,6 +151,7 @@ fn test_multithread_log_spam() -> Result<()> {
         log_max_buffer_count: 50,
         line_end: '\n',
         context_log_path: PathBuf::from("./logs/4"),
+        ..Default::default()
     };
     let log_path = config.context_log_path.join("test_log.log");
 
@@ -160,7 +164,7 @@ fn test_multithread_log_spam() -> Result<()> {
             level: LogLevel::Debug,
             tag: None,
             message: "Spam logging now!".to_owned(),
-            file: file!().to_string(),
+            file: file!().into(),
             line: line!(),
             column: column!(),
             function_name: None,
@@ -175,7 +179,7 @@ fn test_multithread_log_spam() -> Result<()> {
                         level: LogLevel::Debug,
                         tag: None,
                         message: format!("log i {i}"),
-                        file: file!().to_string(),
+                        file: file!().into(),
                         line: line!(),
                         column: column!(),
                         function_name: None,
@@ -204,6 +208,7 @@ fn test_log_context_output() -> Result<()> {
         log_max_buffer_count: 50,
         line_end: '\n',
         context_log_path: PathBuf::from("./logs/5"),
+        ..Default::default()
     };
     let log_path = config.context_log_path.join("test_log.log");
 
@@ -213,9 +218,9 @@ fn test_log_context_output() -> Result<()> {
     {
         logger.read().queue_log(LogData {
             level: LogLevel::Info,
-            tag: Some("Context".to_string()),
+            tag: Some("Context".into()),
             message: "context hi! 6".to_owned(),
-            file: file!().to_string(),
+            file: file!().into(),
             line: line!(),
             column: column!(),
             function_name: None,
@@ -237,6 +242,7 @@ fn test_log_context_tag_output() -> Result<()> {
         log_max_buffer_count: 50,
         line_end: '\n',
         context_log_path: PathBuf::from("./logs/6"),
+        ..Default::default()
     };
     let log_path = config.context_log_path.join("test_log.log");
 
@@ -247,9 +253,9 @@ fn test_log_context_tag_output() -> Result<()> {
     {
         logger.read().queue_log(LogData {
             level: LogLevel::Info,
-            tag: Some(context.to_string()),
+            tag: Some(context.into()),
             message: "hi this is a context log! 5".to_owned(),
-            file: file!().to_string(),
+            file: file!().into(),
             line: line!(),
             column: column!(),
             function_name: None,
@@ -272,6 +278,7 @@ fn test_utf8() -> Result<()> {
         log_max_buffer_count: 50,
         line_end: '\n',
         context_log_path: PathBuf::from("./logs/7"),
+        ..Default::default()
     };
     let log_path = config.context_log_path.join("test_log.log");
 
@@ -283,7 +290,7 @@ fn test_utf8() -> Result<()> {
             level: LogLevel::Info,
             tag: None,
             message: "£ ह € 한".to_owned(),
-            file: file!().to_string(),
+            file: file!().into(),
             line: line!(),
             column: column!(),
             function_name: None,
@@ -0,0 +1,225 @@
+use std::{fs, path::PathBuf, sync::Arc, thread, time::Duration};
+
+use crate::{
+    log_level::LogLevel,
+    logger::{
+        log_queue::{LogQueue, QueueLimits},
+        LogData, OverflowPolicy, QueueMode,
+    },
+    LoggerConfig, LoggerThreadCtx,
+};
+
+fn log(level: LogLevel, message: String) -> LogData {
+    LogData {
+        level,
+        message,
+        ..Default::default()
+    }
+}
+
+fn bounded(max_records: usize, overflow: OverflowPolicy) -> LogQueue {
+    LogQueue::with_limits(
+        QueueMode::Locked,
+        16,
+        QueueLimits {
+            max_records,
+            max_bytes: 0,
+            overflow,
+        },
+    )
+}
+
+#[test]
+fn test_drop_newest() {
+    let queue = bounded(10, OverflowPolicy::DropNewest);
+    for i in 0..20 {
+        queue.push(log(LogLevel::Info, format!("log {i}")));
+    }
+
+    let batch = queue.take_batch(Vec::new());
+    assert_eq!(batch.len(), 10);
+    assert_eq!(batch[9].message, "log 9");
+    assert_eq!(queue.take_dropped(), 10);
+
+    // room again once drained
+    queue.push(log(LogLevel::Info, "after".to_string()));
+    assert_eq!(queue.take_batch(Vec::new()).len(), 1);
+    assert_eq!(queue.take_dropped(), 0);
+}
+
+#[test]
+fn test_drop_below_level_keeps_warnings() {
+    let queue = bounded(
+        10,
+        OverflowPolicy::DropBelowLevel {
+            keep: LogLevel::Warn,
+        },
+    );
+    for i in 0..10 {
+        queue.push(log(LogLevel::Info, format!("info {i}")));
+    }
+    for i in 0..5 {
+        queue.push(log(LogLevel::Error, format!("error {i}")));
+    }
+    // below the level, nothing is evicted for it
+    queue.push(log(LogLevel::Debug, "debug".to_string()));
+
+    let batch = queue.take_batch(Vec::new());
+    assert_eq!(batch.len(), 10);
+    assert_eq!(batch[0].message, "info 5");
+    assert_eq!(
+        batch
+            .iter()
+            .filter(|log| log.level == LogLevel::Error)
+            .count(),
+        5
+    );
+    assert_eq!(queue.take_dropped(), 6);
+}
+
+#[test]
+fn test_byte_limit() {
+    let message = "x".repeat(1000);
+    let size = log(LogLevel::Info, message.clone()).approximate_size();
+
+    let queue = LogQueue::with_limits(
+        QueueMode::Locked,
+        16,
+        QueueLimits {
+            max_records: 0,
+            max_bytes: size * 4,
+            overflow: OverflowPolicy::DropNewest,
+        },
+    );
+    for _ in 0..10 {
+        queue.push(log(LogLevel::Info, message.clone()));
+    }
+
+    assert_eq!(queue.take_batch(Vec::new()).len(), 4);
+    assert_eq!(queue.take_dropped(), 6);
+}
+
+#[test]
+fn test_sample_keeps_some() {
+    let queue = bounded(10, OverflowPolicy::Sample { one_in: 2 });
+    for i in 0..20 {
+        queue.push(log(LogLevel::Info, format!("log {i}")));
+    }
+
+    let batch = queue.take_batch(Vec::new());
+    // the first half goes in whole, then every other log until full
+    assert_eq!(batch.len(), 10);
+    assert_eq!(batch[5].message, "log 5");
+    assert_eq!(batch[6].message, "log 7");
+    assert_eq!(queue.take_dropped(), 10);
+}
+
+#[test]
+fn test_block_loses_nothing() {
+    let queue = Arc::new(bounded(10, OverflowPolicy::Block));
+
+    let producer = {
+        let queue = Arc::clone(&queue);
+        thread::spawn(move || {
+            for i in 0..500 {
+                queue.push(log(LogLevel::Info, format!("log {i}")));
+            }
+        })
+    };
+
+    let mut received = Vec::new();
+    while received.len() < 500 {
+        let batch = queue.take_batch(Vec::new());
+        assert!(batch.len() <= 10);
+        received.extend(batch);
+        thread::sleep(Duration::from_millis(1));
+    }
+    producer.join().unwrap();
+
+    assert_eq!(received[499].message, "log 499");
+    assert_eq!(queue.take_dropped(), 0);
+}
+
+#[test]
+fn test_ring_overflow_keeps_thread_order() {
+    let queue = Arc::new(LogQueue::new(QueueMode::PerThreadRing { capacity: 8 }, 16));
+
+    let producers: Vec<_> = (0..4)
+        .map(|thread| {
+            let queue = Arc::clone(&queue);
+            thread::spawn(move || {
+                for i in 0..2000 {
+                    queue.push(log(LogLevel::Info, format!("{thread} {i}")));
+                }
+            })
+        })
+        .collect();
+
+    // drain while the tiny rings keep spilling
+    let mut received = Vec::new();
+    while received.len() < 8000 {
+        received.extend(queue.take_batch(Vec::new()));
+    }
+    for producer in producers {
+        producer.join().unwrap();
+    }
+
+    let mut next = [0; 4];
+    for log in &received {
+        let (thread, i) = log.message.split_once(' ').unwrap();
+        let thread: usize = thread.parse().unwrap();
+        assert_eq!(
+            i.parse::<usize>().unwrap(),
+            next[thread],
+            "thread {thread} out of order"
+        );
+        next[thread] += 1;
+    }
+}
+
+#[test]
+fn test_logger_reports_dropped() {
+    let dir = PathBuf::from("./logs/17");
+    let _ = fs::remove_dir_all(&dir);
+
+    let config = LoggerConfig {
+        max_string_len: 100,
+        log_max_buffer_count: 5,
+        line_end: '\n',
+        overflow_policy: OverflowPolicy::DropNewest,
+        context_log_path: dir.clone(),
+        ..Default::default()
+    };
+    let log_path = dir.join("test_log.log");
+
+    let logger = LoggerThreadCtx::new(config, log_path.clone())
+        .unwrap()
+        .init(false)
+        .unwrap();
+
+    logger
+        .read()
+        .queue_logs((0..100).map(|i| log(LogLevel::Info, format!("burst {i}"))));
+
+    // reports go out at most once a second
+    thread::sleep(Duration::from_millis(1100));
+    logger
+        .read()
+        .queue_log(log(LogLevel::Info, "after burst".to_string()));
+
+    let mut report = None;
+    for _ in 0..200 {
+        thread::sleep(Duration::from_millis(10));
+        let contents = fs::read_to_string(&log_path).unwrap_or_default();
+        report = contents
+            .lines()
+            .find(|line| line.contains("Dropped"))
+            .map(str::to_string);
+        if report.is_some() {
+            break;
+        }
+    }
+
+    let report = report.expect("no drop report");
+    assert!(report.starts_with('W'));
+}
@@ -5,7 +5,11 @@ use std::{
     time::Duration,
 };
 
-use crate::{log_level::LogLevel, logger::LogData, LoggerConfig, LoggerThreadCtx};
+use crate::{
+    log_level::LogLevel,
+    logger::{callsite, FlushPolicy, LogData, QueueMode},
+    LoggerConfig, LoggerThreadCtx,
+};
 
 #[test]
 fn test_logger_thread_initialization() {
@@ -14,6 +18,7 @@ fn test_logger_thread_initialization() {
         log_max_buffer_count: 50,
         line_end: '\n',
         context_log_path: PathBuf::from("./logs/9"),
+        ..Default::default()
     };
     let log_path = config.context_log_path.join("test_log.log");
 
@@ -28,6 +33,7 @@ fn test_logger_thread_init() {
         log_max_buffer_count: 50,
         line_end: '\n',
         context_log_path: PathBuf::from("./logs/8"),
+        ..Default::default()
     };
     let log_path = config.context_log_path.join("test_log.log");
 
@@ -45,15 +51,16 @@ fn test_queue_log() {
         log_max_buffer_count: 50,
         line_end: '\n',
         context_log_path: "./logs".into(),
+        ..Default::default()
     };
     let log_path = PathBuf::from("./logs/test_log.log");
 
     let logger_thread = LoggerThreadCtx::new(config, log_path).unwrap();
     logger_thread.queue_log(LogData {
         level: LogLevel::Info,
-        tag: Some("test".to_string()),
+        tag: Some("test".into()),
         message: "This is a test log".to_string(),
-        file: file!().to_string(),
+        file: file!().into(),
         line: line!(),
         column: column!(),
         ..Default::default()
@@ -107,6 +114,7 @@ fn test_log_thread() {
         log_max_buffer_count: 50,
         line_end: '\n',
         context_log_path: "./logs".into(),
+        ..Default::default()
     };
     let log_path = PathBuf::from("./logs/test_log.log");
 
@@ -119,9 +127,9 @@ fn test_log_thread() {
         let logger_thread = logger_thread_clone.read();
         logger_thread.queue_log(LogData {
             level: LogLevel::Info,
-            tag: Some("test".to_string()),
+            tag: Some("test".into()),
             message: "This is a test log".to_string(),
-            file: file!().to_string(),
+            file: file!().into(),
             line: line!(),
             column: column!(),
             ..Default::default()
@@ -135,3 +143,256 @@ fn test_log_thread() {
     let queue = logger_thread.get_queue().lock().len();
     // assert_eq!(queue, 0);
 }
+
+#[test]
+fn test_per_thread_ring_queue() {
+    let config = LoggerConfig {
+        max_string_len: 100,
+        log_max_buffer_count: 50,
+        line_end: '\n',
+        queue_mode: QueueMode::PerThreadRing { capacity: 64 },
+        context_log_path: PathBuf::from("./logs/11"),
+        ..Default::default()
+    };
+    let log_path = config.context_log_path.join("test_log.log");
+
+    let thread_safe_logger = LoggerThreadCtx::new(config, log_path.clone())
+        .unwrap()
+        .init(false)
+        .unwrap();
+
+    // more logs than the rings can hold, so some spill into the shared queue
+    let handles = (0..4)
+        .map(|t| {
+            let logger = Arc::clone(&thread_safe_logger);
+            thread::spawn(move || {
+                for i in 0..1000 {
+                    logger.read().queue_log(LogData {
+                        level: LogLevel::Info,
+                        message: format!("ring log {t} {i}"),
+                        file: file!().into(),
+                        line: line!(),
+                        column: column!(),
+                        ..Default::default()
+                    });
+                }
+            })
+        })
+        .collect::<Vec<_>>();
+
+    for handle in handles {
+        handle.join().unwrap();
+    }
+
+    let mut lines = 0;
+    for _ in 0..200 {
+        thread::sleep(Duration::from_millis(10));
+        lines = std::fs::read_to_string(&log_path)
+            .unwrap_or_default()
+            .lines()
+            .filter(|line| line.contains("ring log"))
+            .count();
+        if lines == 4000 {
+            break;
+        }
+    }
+
+    assert_eq!(lines, 4000);
+}
+
+/// Polls `path` until it holds `needle`
+fn wait_for_line(path: &std::path::Path, needle: &str) -> String {
+    let mut content = String::new();
+    for _ in 0..200 {
+        content = std::fs::read_to_string(path).unwrap_or_default();
+        if content.contains(needle) {
+            break;
+        }
+        thread::sleep(Duration::from_millis(10));
+    }
+    content
+}
+
+#[test]
+fn test_context_slots() {
+    let config = LoggerConfig {
+        max_string_len: 100,
+        log_max_buffer_count: 50,
+        line_end: '\n',
+        context_log_path: PathBuf::from("./logs/19"),
+        ..Default::default()
+    };
+    let log_path = config.context_log_path.join("test_log.log");
+
+    let logger = LoggerThreadCtx::new(config, log_path.clone())
+        .unwrap()
+        .init(false)
+        .unwrap();
+
+    let id = callsite::register(LogLevel::Info, Some("SlotA"), file!(), line!(), 0, None).unwrap();
+    let callsite_log =
+        |message: &str| LogData::from_callsite(id, callsite::get(id).unwrap(), message.to_string());
+    let tagged_log = |tag: &'static str, message: &str| LogData {
+        level: LogLevel::Info,
+        tag: Some(tag.into()),
+        message: message.to_string(),
+        ..Default::default()
+    };
+
+    // registration is applied before the logs queued after it
+    logger.read().add_context("SlotA").unwrap();
+    logger.read().queue_log(callsite_log("a by callsite"));
+    logger.read().queue_log(tagged_log("SlotA", "a by tag"));
+
+    let slot_a = log_path.with_file_name("SlotA.log");
+    let content = wait_for_line(&slot_a, "a by tag");
+    assert!(content.contains("a by callsite"));
+    assert!(content.contains("a by tag"));
+
+    // the freed slot goes to the next context, the cached callsite must not follow it
+    logger.read().remove_context("SlotA");
+    logger.read().add_context("SlotB").unwrap();
+    logger.read().queue_log(callsite_log("a after removal"));
+    logger.read().queue_log(tagged_log("SlotB", "b by tag"));
+
+    let content = wait_for_line(&log_path.with_file_name("SlotB.log"), "b by tag");
+    assert!(content.contains("b by tag"));
+    assert!(!content.contains("a after removal"));
+    assert!(!std::fs::read_to_string(&slot_a)
+        .unwrap()
+        .contains("a after removal"));
+    assert!(wait_for_line(&log_path, "a after removal").contains("a after removal"));
+}
+
+#[test]
+fn test_flush_policy() {
+    let config = LoggerConfig {
+        max_string_len: 100,
+        log_max_buffer_count: 50,
+        line_end: '\n',
+        flush_policy: FlushPolicy {
+            max_latency: Duration::from_secs(60),
+            max_dirty_bytes: 0,
+            flush_level: LogLevel::Error,
+        },
+        context_log_path: PathBuf::from("./logs/20"),
+        ..Default::default()
+    };
+    let log_path = config.context_log_path.join("test_log.log");
+
+    let logger = LoggerThreadCtx::new(config, log_path.clone())
+        .unwrap()
+        .init(false)
+        .unwrap();
+
+    let log = |level: LogLevel, message: &str| LogData {
+        level,
+        message: message.to_string(),
+        ..Default::default()
+    };
+
+    // well below the latency limit, the info log stays buffered
+    logger
+        .read()
+        .queue_log(log(LogLevel::Info, "not flushed yet"));
+    thread::sleep(Duration::from_millis(200));
+    assert!(!std::fs::read_to_string(&log_path)
+        .unwrap()
+        .contains("not flushed yet"));
+
+    // an error takes everything written before it along
+    logger
+        .read()
+        .queue_log(log(LogLevel::Error, "flushed right away"));
+    let content = wait_for_line(&log_path, "flushed right away");
+    assert!(content.contains("not flushed yet"));
+    assert!(content.contains("flushed right away"));
+}
+
+#[test]
+fn test_context_writers_keep_order() {
+    let config = LoggerConfig {
+        max_string_len: 100,
+        log_max_buffer_count: 50,
+        line_end: '\n',
+        context_writer_threads: 2,
+        context_log_path: PathBuf::from("./logs/25"),
+        ..Default::default()
+    };
+    let log_path = config.context_log_path.join("test_log.log");
+
+    let logger = LoggerThreadCtx::new(config, log_path.clone())
+        .unwrap()
+        .init(false)
+        .unwrap();
+
+    let tags = ["ShardA", "ShardB", "ShardC"];
+    for tag in tags {
+        logger.read().add_context(tag).unwrap();
+    }
+
+    for i in 0..200 {
+        for tag in tags {
+            logger.read().queue_log(LogData {
+                level: LogLevel::Info,
+                tag: Some(tag.into()),
+                message: format!("{tag} message {i}"),
+                ..Default::default()
+            });
+        }
+    }
+
+    for tag in tags {
+        let content = wait_for_line(
+            &log_path.with_file_name(format!("{tag}.log")),
+            &format!("{tag} message 199"),
+        );
+        let numbers: Vec<usize> = content
+            .lines()
+            .map(|line| {
+                assert!(line.contains(tag), "{line}");
+                line.rsplit(' ').next().unwrap().parse().unwrap()
+            })
+            .collect();
+        assert_eq!(numbers, (0..200).collect::<Vec<_>>());
+    }
+
+    let global = wait_for_line(&log_path, "ShardC message 199");
+    assert_eq!(global.lines().count(), 600);
+}
+
+#[test]
+fn test_do_log_on_consumer_thread_reaches_files() {
+    use crate::logger::{log_queue::LogQueue, logger_thread_ctx::do_log};
+
+    let config = LoggerConfig {
+        line_end: '\n',
+        context_log_path: PathBuf::from("./logs/27"),
+        ..Default::default()
+    };
+    let log_path = config.context_log_path.join("test_log.log");
+
+    let logger = LoggerThreadCtx::new(config, log_path.clone())
+        .unwrap()
+        .init(false)
+        .unwrap();
+
+    // a thread that drains a queue can't wait on the logging thread, nothing may be lost
+    let consumer_logger = Arc::clone(&logger);
+    thread::spawn(move || {
+        LogQueue::new(QueueMode::Locked, 0).register_consumer();
+        do_log(
+            LogData {
+                level: LogLevel::Error,
+                message: "logged by a consumer".to_string(),
+                ..Default::default()
+            },
+            &consumer_logger,
+        )
+        .unwrap();
+    })
+    .join()
+    .unwrap();
+
+    assert!(wait_for_line(&log_path, "logged by a consumer").contains("logged by a consumer"));
+}
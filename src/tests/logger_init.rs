@@ -9,6 +9,7 @@ fn test_logger_initialization() {
         log_max_buffer_count: 50,
         line_end: '\n',
         context_log_path: "./logs/10".into(),
+        ..Default::default()
     };
     let log_path = config.context_log_path.join("test_log.log");
 
@@ -30,6 +31,7 @@ fn test_logger_config() {
         log_max_buffer_count: 100,
         line_end: '\r',
         context_log_path: "./logs/1".into(),
+        ..Default::default()
     };
     let log_path = config.context_log_path.join("test_log.log");
 
@@ -45,6 +47,7 @@ fn test_logger_thread_safe() {
         log_max_buffer_count: 50,
         line_end: '\n',
         context_log_path: "./logs/1".into(),
+        ..Default::default()
     };
     let log_path = config.context_log_path.join("test_log.log");
 
@@ -0,0 +1,73 @@
+use crate::logger::message_pool::{self, MessagePool};
+use crate::logger::LogData;
+
+fn log_with_capacity(capacity: usize) -> LogData {
+    let mut message = String::with_capacity(capacity);
+    message.push_str("recycled");
+
+    LogData {
+        message,
+        file: file!().into(),
+        line: line!(),
+        ..Default::default()
+    }
+}
+
+#[test]
+fn test_recycle_keeps_small_buffers_in_chunks() {
+    let pool = MessagePool::new();
+
+    let mut logs: Vec<LogData> = (0..40).map(|_| log_with_capacity(128)).collect();
+    logs.push(log_with_capacity(64 * 1024));
+    logs.push(LogData::default());
+    pool.recycle(&mut logs);
+
+    // the messages are taken, only the small ones are kept
+    assert!(logs.iter().all(|log| log.message.is_empty()));
+    assert_eq!(pool.pooled(), 40);
+
+    let mut taken = 0;
+    while let Some(chunk) = pool.take_chunk() {
+        assert!(chunk.len() <= 32);
+        assert!(chunk
+            .iter()
+            .all(|buffer| buffer.is_empty() && buffer.capacity() >= 128));
+        taken += chunk.len();
+    }
+    assert_eq!(taken, 40);
+}
+
+#[test]
+fn test_trim_frees_chunks_past_the_limit() {
+    let pool = MessagePool::new();
+
+    for _ in 0..10 {
+        let mut logs: Vec<LogData> = (0..32).map(|_| log_with_capacity(64)).collect();
+        pool.recycle(&mut logs);
+    }
+    assert_eq!(pool.pooled(), 320);
+
+    pool.trim();
+    assert_eq!(pool.pooled(), 4 * 32);
+}
+
+#[test]
+fn test_take_has_requested_capacity() {
+    let buffer = message_pool::take(300);
+    assert!(buffer.is_empty());
+    assert!(buffer.capacity() >= 300);
+
+    assert_eq!(message_pool::copy("hello pool"), "hello pool");
+}
+
+#[test]
+fn test_release_keeps_buffer_for_this_thread() {
+    let mut buffer = Vec::with_capacity(700);
+    buffer.extend_from_slice(b"unqueued");
+    let data = buffer.as_ptr();
+    message_pool::release(buffer);
+
+    let taken = message_pool::take(16);
+    assert!(taken.is_empty());
+    assert_eq!(taken.as_ptr(), data);
+}
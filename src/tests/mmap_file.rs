@@ -0,0 +1,68 @@
+use std::{
+    fs,
+    io::{IoSlice, Write},
+    path::PathBuf,
+};
+
+use crate::logger::mmap_file::MmapFile;
+
+#[test]
+fn test_mmap_file_writes_across_chunks() {
+    let dir = PathBuf::from("./logs/13");
+    fs::create_dir_all(&dir).unwrap();
+    let path = dir.join("mapped.log");
+
+    let line = "I 2024-01-01 00:00:00 [Mmap] a line long enough to span pages\n";
+    let mut expected = String::new();
+
+    {
+        // rounded up to a page, so this spans many chunks
+        let mut file = MmapFile::create(&path, 1).unwrap();
+        for i in 0..500 {
+            let number = i.to_string();
+            file.write_vectored(&[
+                IoSlice::new(number.as_bytes()),
+                IoSlice::new(line.as_bytes()),
+            ])
+            .unwrap();
+            expected.push_str(&number);
+            expected.push_str(line);
+
+            if i % 100 == 0 {
+                file.flush().unwrap();
+            }
+        }
+        assert_eq!(file.len(), expected.len() as u64);
+    }
+
+    // the preallocated tail is gone once dropped
+    assert_eq!(fs::read_to_string(&path).unwrap(), expected);
+}
+
+#[test]
+fn test_mmap_file_empty() {
+    let dir = PathBuf::from("./logs/13");
+    fs::create_dir_all(&dir).unwrap();
+    let path = dir.join("empty.log");
+
+    drop(MmapFile::create(&path, 64 * 1024).unwrap());
+    assert_eq!(fs::metadata(&path).unwrap().len(), 0);
+}
+
+#[test]
+fn test_mmap_file_finish_keeps_writing() {
+    let dir = PathBuf::from("./logs/13");
+    fs::create_dir_all(&dir).unwrap();
+    let path = dir.join("finished.log");
+
+    let mut file = MmapFile::create(&path, 64 * 1024).unwrap();
+    file.write_all(b"first\n").unwrap();
+    file.finish().unwrap();
+
+    // the file ends where the logs do while it is still open
+    assert_eq!(fs::read_to_string(&path).unwrap(), "first\n");
+
+    file.write_all(b"second\n").unwrap();
+    file.finish().unwrap();
+    assert_eq!(fs::read_to_string(&path).unwrap(), "first\nsecond\n");
+}
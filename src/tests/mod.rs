@@ -1,5 +1,26 @@
+mod async_writer;
+mod binary_format;
+mod callsite;
+mod clock;
+mod deferred;
+#[cfg(feature = "file")]
+mod fields;
+mod flight_recorder;
+mod level_filter;
+mod line_split;
 mod log;
+mod log_queue;
+mod message_pool;
+mod profile_stats;
 mod logger_impl;
 mod logger_init;
+#[cfg(all(unix, feature = "mmap"))]
+mod mmap_file;
+mod render;
+mod rotation;
+mod ring_buffer;
 mod semaphore_lite;
+mod sinks;
+mod stats;
+mod trace;
 mod vec_pool;
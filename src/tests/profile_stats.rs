@@ -0,0 +1,146 @@
+use std::{path::PathBuf, thread, time::Duration};
+
+use crate::{
+    logger::{
+        profile_stats::{Histogram, ProfileStats, PROFILER_TAG, QUEUE_LATENCY_ZONE},
+        trace::{TraceBatch, TraceEvent},
+        LogData,
+    },
+    LoggerConfig, LoggerThreadCtx,
+};
+
+fn assert_close(actual: Option<Duration>, expected: u64) {
+    let actual = actual.unwrap().as_nanos() as f64;
+    let expected = expected as f64;
+    assert!(
+        (actual - expected).abs() <= expected * 0.04,
+        "{actual} is not within 4% of {expected}"
+    );
+}
+
+#[test]
+fn test_histogram_percentiles() {
+    let mut histogram = Histogram::default();
+    assert_eq!(histogram.percentile(0.5), None);
+
+    for nanos in 1..=100_000 {
+        histogram.record(nanos);
+    }
+
+    assert_eq!(histogram.count(), 100_000);
+    assert_eq!(histogram.min(), Some(Duration::from_nanos(1)));
+    assert_eq!(histogram.max(), Some(Duration::from_nanos(100_000)));
+    assert_eq!(histogram.mean(), Some(Duration::from_nanos(50_000)));
+    assert_close(histogram.percentile(0.5), 50_000);
+    assert_close(histogram.percentile(0.99), 99_000);
+    assert_close(histogram.percentile(0.999), 99_900);
+
+    // small values are exact, huge ones still land in a bucket
+    let mut histogram = Histogram::default();
+    histogram.record(3);
+    histogram.record(u64::MAX);
+    assert_eq!(histogram.percentile(0.5), Some(Duration::from_nanos(3)));
+    assert_eq!(
+        histogram.percentile(1.0),
+        Some(Duration::from_nanos(u64::MAX))
+    );
+}
+
+#[test]
+fn test_histogram_merge() {
+    let mut a = Histogram::default();
+    let mut b = Histogram::default();
+    (0..1000).for_each(|_| a.record(1_000));
+    (0..1000).for_each(|_| b.record(1_000_000));
+
+    a.merge(&b);
+    assert_eq!(a.count(), 2000);
+    assert_close(a.percentile(0.25), 1_000);
+    assert_close(a.percentile(0.75), 1_000_000);
+
+    a.clear();
+    assert_eq!(a.count(), 0);
+    assert_eq!(a.min(), None);
+}
+
+#[test]
+fn test_report_covers_one_interval() {
+    let mut stats = ProfileStats::default();
+    stats.record_batch(&TraceBatch {
+        tid: 1,
+        events: vec![
+            TraceEvent {
+                name: "update",
+                start_nanos: 0,
+                duration_nanos: 2_000_000,
+            },
+            TraceEvent {
+                name: "physics",
+                start_nanos: 0,
+                duration_nanos: 500_000,
+            },
+        ],
+    });
+
+    let report = stats.take_report();
+    assert_eq!(report.len(), 2);
+    assert_eq!(report[0].tag.as_deref(), Some(PROFILER_TAG));
+    assert!(report[0]
+        .message
+        .starts_with("physics: count 1, min 500µs, mean 500µs, max 500µs"));
+    assert!(report[1].message.starts_with("update: count 1"));
+
+    // nothing happened since
+    assert!(stats.take_report().is_empty());
+}
+
+#[test]
+fn test_profile_report() {
+    let config = LoggerConfig {
+        max_string_len: 200,
+        log_max_buffer_count: 50,
+        line_end: '\n',
+        profile_report_interval: Some(Duration::from_millis(100)),
+        context_log_path: PathBuf::from("./logs/23"),
+        ..Default::default()
+    };
+    let log_path = config.context_log_path.join("test_log.log");
+
+    let logger = LoggerThreadCtx::new(config, log_path.clone())
+        .unwrap()
+        .init(false)
+        .unwrap();
+
+    logger.read().queue_log(LogData {
+        message: "measured".to_string(),
+        ..Default::default()
+    });
+    logger.read().submit_trace(TraceBatch {
+        tid: 1,
+        events: vec![TraceEvent {
+            name: "frame",
+            start_nanos: 0,
+            duration_nanos: 16_000_000,
+        }],
+    });
+
+    // the report is due without any further logs
+    let mut content = String::new();
+    for _ in 0..200 {
+        content = std::fs::read_to_string(&log_path).unwrap_or_default();
+        if content.contains("frame: count 1") && content.contains(QUEUE_LATENCY_ZONE) {
+            break;
+        }
+        thread::sleep(Duration::from_millis(10));
+    }
+
+    let report = |zone: &str| {
+        content
+            .lines()
+            .find(|line| line.contains(&format!("] {zone}: count 1,")))
+            .unwrap_or_else(|| panic!("no report for {zone} in {content}"))
+    };
+    assert!(report("frame").contains("[Profiler]"));
+    assert!(report("frame").contains("min 16ms, mean 16ms, max 16ms"));
+    assert!(report(QUEUE_LATENCY_ZONE).contains("[Profiler]"));
+}
@@ -0,0 +1,67 @@
+use crate::log_level::LogLevel;
+use crate::logger::{
+    clock,
+    render::{RenderBuffer, RenderedRecord},
+    LogData,
+};
+
+fn test_log(tag: Option<&str>, message: &str) -> LogData {
+    LogData::new(
+        LogLevel::Warn,
+        tag.map(str::to_string),
+        message.to_string(),
+        "src/render.cpp".to_string(),
+        12,
+        3,
+        Some("render".to_string()),
+    )
+}
+
+#[test]
+fn test_rendered_parts() {
+    let log = test_log(Some("Render"), "hello");
+    let time = clock::with_formatted(log.timestamp, str::to_string);
+
+    let mut arena = String::new();
+    let record = RenderedRecord::render(&log, &mut arena);
+
+    assert_eq!(record.level_time(), format!("W {time} "));
+    assert_eq!(record.tag(), "[Render] ");
+    assert_eq!(record.location(), "[src/render.cpp:12:3 @ render] ");
+
+    let mut global = Vec::new();
+    record.write_line(&mut global, "hello").unwrap();
+    assert_eq!(
+        String::from_utf8(global).unwrap(),
+        format!("W {time} [Render] [src/render.cpp:12:3 @ render] hello\n")
+    );
+
+    let mut compact = Vec::new();
+    record.write_compact_line(&mut compact, "hello").unwrap();
+    assert_eq!(
+        String::from_utf8(compact).unwrap(),
+        format!("W {time} [src/render.cpp:12:3 @ render] hello\n")
+    );
+
+    assert_eq!(
+        record.format_line(&log, "hello"),
+        format!("WARN {time} [Render] [src/render.cpp:12:3 @ render] hello")
+    );
+    assert_eq!(log.format(), record.format_line(&log, "hello"));
+}
+
+#[test]
+fn test_render_buffer_reuse() {
+    let logs = vec![test_log(None, "first"), test_log(Some("Other"), "second")];
+
+    let mut rendered = RenderBuffer::with_capacity(2);
+    rendered.render_batch(&logs);
+    assert_eq!(rendered.len(), 2);
+    assert_eq!(rendered.get(0).unwrap().tag(), "[GLOBAL] ");
+    assert_eq!(rendered.get(1).unwrap().tag(), "[Other] ");
+
+    rendered.render_batch(&logs[1..]);
+    assert_eq!(rendered.len(), 1);
+    assert_eq!(rendered.iter().next().unwrap().tag(), "[Other] ");
+    assert!(rendered.get(1).is_none());
+}
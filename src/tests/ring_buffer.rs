@@ -0,0 +1,80 @@
+use std::sync::Arc;
+use std::thread;
+
+use crate::ring_buffer::SpscRing;
+
+#[test]
+fn test_capacity_rounds_to_power_of_two() {
+    let ring: SpscRing<u32> = SpscRing::with_capacity(100);
+    assert!(ring.is_empty());
+
+    let mut pushed = 0;
+    while unsafe { ring.push(pushed) }.is_ok() {
+        pushed += 1;
+    }
+    assert_eq!(pushed, 128);
+}
+
+#[test]
+fn test_push_pop_in_order() {
+    let ring = SpscRing::with_capacity(4);
+
+    unsafe {
+        for i in 0..4 {
+            assert!(ring.push(i).is_ok());
+        }
+        // full, value is handed back
+        assert_eq!(ring.push(4), Err(4));
+        assert_eq!(ring.len(), 4);
+
+        for i in 0..4 {
+            assert_eq!(ring.pop(), Some(i));
+        }
+        assert_eq!(ring.pop(), None);
+    }
+}
+
+#[test]
+fn test_drop_releases_remaining() {
+    let value = Arc::new(());
+    {
+        let ring = SpscRing::with_capacity(8);
+        for _ in 0..5 {
+            unsafe { ring.push(Arc::clone(&value)).unwrap() };
+        }
+    }
+
+    assert_eq!(Arc::strong_count(&value), 1);
+}
+
+#[test]
+fn test_producer_consumer_threads() {
+    let ring = Arc::new(SpscRing::with_capacity(64));
+    let count = 100_000u64;
+
+    let producer = {
+        let ring = Arc::clone(&ring);
+        thread::spawn(move || {
+            for i in 0..count {
+                let mut value = i;
+                while let Err(v) = unsafe { ring.push(value) } {
+                    value = v;
+                    thread::yield_now();
+                }
+            }
+        })
+    };
+
+    let mut expected = 0;
+    while expected < count {
+        match unsafe { ring.pop() } {
+            Some(value) => {
+                assert_eq!(value, expected);
+                expected += 1;
+            }
+            None => thread::yield_now(),
+        }
+    }
+
+    producer.join().unwrap();
+}
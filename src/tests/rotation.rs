@@ -0,0 +1,187 @@
+use std::{fs, io::Write, path::PathBuf, thread, time::Duration};
+
+use crate::{
+    log_level::LogLevel,
+    logger::{
+        rotation::{self, RotatingFile, RotationPolicy},
+        FileBackend, FileFormat, LogData,
+    },
+    LoggerConfig, LoggerThreadCtx,
+};
+
+/// Segments are pruned in the background
+fn wait_for_segments(path: &PathBuf, expected: usize) -> usize {
+    let mut count = 0;
+    for _ in 0..200 {
+        count = rotation::segments(path).unwrap().len();
+        if count == expected {
+            break;
+        }
+        thread::sleep(Duration::from_millis(10));
+    }
+    count
+}
+
+#[test]
+fn test_rotates_by_size_and_keeps_newest() {
+    let dir = PathBuf::from("./logs/15/size");
+    let _ = fs::remove_dir_all(&dir);
+    fs::create_dir_all(&dir).unwrap();
+    let path = dir.join("rotating.log");
+
+    let policy = RotationPolicy {
+        max_bytes: 100,
+        keep: 2,
+        compress: false,
+        ..Default::default()
+    };
+    let mut file = RotatingFile::create(
+        path.clone(),
+        FileBackend::Buffered,
+        None,
+        policy,
+        FileFormat::Text,
+    )
+    .unwrap();
+
+    for i in 0..20 {
+        file.rotate_if_due().unwrap();
+        writeln!(file, "line number {i:04} padded to be long enough").unwrap();
+    }
+    file.flush().unwrap();
+
+    assert_eq!(wait_for_segments(&path, 2), 2);
+
+    // the newest segment holds the lines right before the current file
+    let current = fs::read_to_string(&path).unwrap();
+    assert!(current.starts_with("line number 0018"));
+    let (_, newest) = &rotation::segments(&path).unwrap()[0];
+    let newest = fs::read_to_string(newest).unwrap();
+    assert_eq!(
+        newest.lines().last(),
+        Some("line number 0017 padded to be long enough")
+    );
+}
+
+#[test]
+fn test_existing_file_rotated_on_start() {
+    let dir = PathBuf::from("./logs/15/start");
+    let _ = fs::remove_dir_all(&dir);
+    fs::create_dir_all(&dir).unwrap();
+    let path = dir.join("restarted.log");
+    fs::write(&path, "previous run\n").unwrap();
+
+    let policy = RotationPolicy {
+        max_age: Some(Duration::from_secs(3600)),
+        compress: false,
+        ..Default::default()
+    };
+    let file = RotatingFile::create(
+        path.clone(),
+        FileBackend::Buffered,
+        None,
+        policy,
+        FileFormat::Text,
+    )
+    .unwrap();
+    drop(file);
+
+    assert_eq!(wait_for_segments(&path, 1), 1);
+    let (_, segment) = &rotation::segments(&path).unwrap()[0];
+    assert_eq!(fs::read_to_string(segment).unwrap(), "previous run\n");
+    assert!(fs::read_to_string(&path).unwrap().is_empty());
+}
+
+#[test]
+fn test_logger_rotates_context_files() {
+    let dir = PathBuf::from("./logs/15/logger");
+    let _ = fs::remove_dir_all(&dir);
+
+    let config = LoggerConfig {
+        max_string_len: 100,
+        log_max_buffer_count: 50,
+        line_end: '\n',
+        context_log_path: dir.clone(),
+        rotation: RotationPolicy {
+            max_bytes: 1024,
+            keep: 3,
+            compress: true,
+            ..Default::default()
+        },
+        ..Default::default()
+    };
+    let log_path = dir.join("test_log.log");
+
+    let logger = LoggerThreadCtx::new(config, log_path.clone())
+        .unwrap()
+        .init(false)
+        .unwrap();
+    logger.read().add_context("Rotated").unwrap();
+
+    for i in 0..500 {
+        logger.read().queue_log(LogData {
+            level: LogLevel::Info,
+            tag: Some("Rotated".into()),
+            message: format!("rotated log {i}"),
+            ..Default::default()
+        });
+    }
+
+    let context_path = dir.join("Rotated.log");
+    for _ in 0..200 {
+        let done = fs::read_to_string(&context_path)
+            .unwrap_or_default()
+            .contains("rotated log 499");
+        if done {
+            break;
+        }
+        thread::sleep(Duration::from_millis(10));
+    }
+
+    assert!(fs::metadata(&context_path).unwrap().len() <= 1024 + 200);
+    assert_eq!(wait_for_segments(&context_path, 3), 3);
+    assert_eq!(wait_for_segments(&log_path, 3), 3);
+
+    #[cfg(feature = "compress")]
+    {
+        let mut compressed = false;
+        for _ in 0..200 {
+            compressed = rotation::segments(&context_path)
+                .unwrap()
+                .iter()
+                .all(|(_, path)| path.extension().is_some_and(|ext| ext == "zst"));
+            if compressed {
+                break;
+            }
+            thread::sleep(Duration::from_millis(10));
+        }
+        assert!(compressed);
+    }
+}
+
+#[test]
+fn test_segments_skip_other_logs() {
+    let dir = PathBuf::from("./logs/15/names");
+    let _ = fs::remove_dir_all(&dir);
+    fs::create_dir_all(&dir).unwrap();
+    let path = dir.join("Game.log");
+
+    // a context named `Game.5` and files that only look like segments
+    let _context = RotatingFile::create(
+        dir.join("Game.5.log"),
+        FileBackend::Buffered,
+        None,
+        RotationPolicy::default(),
+        FileFormat::Text,
+    )
+    .unwrap();
+    for name in ["Game.+7.log", "Game..log", "Game.1700000000000.log"] {
+        fs::write(dir.join(name), "").unwrap();
+    }
+
+    let segments = rotation::segments(&path).unwrap();
+    assert_eq!(
+        segments,
+        [(1700000000000, dir.join("Game.1700000000000.log"))]
+    );
+}
@@ -0,0 +1,153 @@
+use std::{
+    fs,
+    path::PathBuf,
+    sync::{
+        atomic::{AtomicUsize, Ordering},
+        Arc,
+    },
+    thread,
+    time::{Duration, Instant},
+};
+
+use crate::{
+    log_level::LogLevel,
+    logger::{sink_dispatch::SinkFilter, LogData},
+    LoggerConfig, LoggerError, LoggerThreadCtx, ThreadSafeLoggerThread,
+};
+
+fn start_logger(dir: &str) -> (ThreadSafeLoggerThread, PathBuf) {
+    let dir = PathBuf::from(dir);
+    let _ = fs::remove_dir_all(&dir);
+
+    let config = LoggerConfig {
+        max_string_len: 10,
+        log_max_buffer_count: 50,
+        line_end: '\n',
+        context_log_path: dir.clone(),
+        ..Default::default()
+    };
+    let log_path = dir.join("test_log.log");
+
+    let logger = LoggerThreadCtx::new(config, log_path.clone())
+        .unwrap()
+        .init(false)
+        .unwrap();
+    (logger, log_path)
+}
+
+fn log(level: LogLevel, tag: &'static str, message: String) -> LogData {
+    LogData {
+        level,
+        tag: Some(tag.into()),
+        message,
+        ..Default::default()
+    }
+}
+
+fn wait_until(condition: impl Fn() -> bool) -> bool {
+    let start = Instant::now();
+    while start.elapsed() < Duration::from_secs(5) {
+        if condition() {
+            return true;
+        }
+        thread::sleep(Duration::from_millis(10));
+    }
+    false
+}
+
+#[test]
+fn test_slow_sink_does_not_stall_files() {
+    let (logger, log_path) = start_logger("./logs/18/slow");
+
+    let calls = Arc::new(AtomicUsize::new(0));
+    let sink_calls = Arc::clone(&calls);
+    logger
+        .write()
+        .add_sink(move |_: &LogData| {
+            sink_calls.fetch_add(1, Ordering::Relaxed);
+            thread::sleep(Duration::from_millis(50));
+            Err(LoggerError::LogError(
+                "unreachable server".to_string(),
+                std::backtrace::Backtrace::disabled(),
+            ))
+        })
+        .unwrap();
+
+    for i in 0..100 {
+        logger
+            .read()
+            .queue_log(log(LogLevel::Info, "Slow", format!("log {i}")));
+    }
+
+    // the sink alone would need 5 seconds
+    let start = Instant::now();
+    let written = wait_until(|| {
+        fs::read_to_string(&log_path)
+            .unwrap_or_default()
+            .contains("log 99")
+    });
+    assert!(written);
+    assert!(start.elapsed() < Duration::from_secs(2));
+
+    // failing calls don't stop the sink
+    assert!(wait_until(|| calls.load(Ordering::Relaxed) > 1));
+}
+
+#[test]
+fn test_filtered_and_batch_sinks() {
+    let (logger, _) = start_logger("./logs/18/filtered");
+
+    let warnings = Arc::new(AtomicUsize::new(0));
+    let sink_warnings = Arc::clone(&warnings);
+    logger
+        .write()
+        .add_filtered_sink(
+            move |log: &LogData| {
+                assert!(log.level.severity() >= LogLevel::Warn.severity());
+                assert_eq!(log.tag.as_deref(), Some("Net"));
+                sink_warnings.fetch_add(1, Ordering::Relaxed);
+                Ok(())
+            },
+            SinkFilter {
+                min_level: Some(LogLevel::Warn),
+                tag: Some("Net".to_string()),
+            },
+        )
+        .unwrap();
+
+    let lines = Arc::new(AtomicUsize::new(0));
+    let batch_lines = Arc::clone(&lines);
+    logger
+        .write()
+        .add_batch_sink(
+            move |batch| {
+                assert!(batch.iter().all(|line| line.message.len() <= 10));
+                batch_lines.fetch_add(batch.len(), Ordering::Relaxed);
+                Ok(())
+            },
+            SinkFilter::default(),
+        )
+        .unwrap();
+
+    for level in [
+        LogLevel::Debug,
+        LogLevel::Info,
+        LogLevel::Warn,
+        LogLevel::Error,
+    ] {
+        for tag in ["Net", "Disk"] {
+            logger
+                .read()
+                .queue_log(log(level, tag, "short".to_string()));
+        }
+    }
+    // split into three lines of at most 10 bytes
+    logger.read().queue_log(log(
+        LogLevel::Info,
+        "Disk",
+        "0123456789abcdefghij\nend".to_string(),
+    ));
+
+    assert!(wait_until(|| lines.load(Ordering::Relaxed) == 11));
+    assert!(wait_until(|| warnings.load(Ordering::Relaxed) == 2));
+}
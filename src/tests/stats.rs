@@ -0,0 +1,97 @@
+use std::{path::PathBuf, thread, time::Duration};
+
+use crate::{
+    log_level::LogLevel,
+    logger::{LogData, OverflowPolicy},
+    LoggerConfig, LoggerThreadCtx,
+};
+
+#[test]
+fn test_logger_stats() {
+    let config = LoggerConfig {
+        max_string_len: 100,
+        log_max_buffer_count: 50,
+        line_end: '\n',
+        stats_report_interval: Some(Duration::from_millis(100)),
+        context_log_path: PathBuf::from("./logs/24"),
+        ..Default::default()
+    };
+    let log_path = config.context_log_path.join("test_log.log");
+
+    let logger = LoggerThreadCtx::new(config, log_path.clone())
+        .unwrap()
+        .init(false)
+        .unwrap();
+
+    let log = |level: LogLevel, message: String| LogData {
+        level,
+        message,
+        ..Default::default()
+    };
+    logger
+        .read()
+        .queue_logs((0..99).map(|i| log(LogLevel::Info, format!("log {i}"))));
+    logger
+        .read()
+        .queue_log(log(LogLevel::Error, "flushed".to_string()));
+
+    let mut stats = logger.read().stats();
+    for _ in 0..200 {
+        stats = logger.read().stats();
+        if stats.written == 100 && stats.flushes != 0 {
+            break;
+        }
+        thread::sleep(Duration::from_millis(10));
+    }
+
+    assert_eq!(stats.queued, 100);
+    assert_eq!(stats.written, 100);
+    assert_eq!(stats.dropped, 0);
+    assert_eq!(stats.queue_depth, 0);
+    assert!(stats.batches >= 1);
+    assert!(stats.batch_nanos_max >= stats.batch_nanos_total / stats.batches);
+    assert!(stats.flushes >= 1);
+    assert!(stats.bytes_written > 0);
+
+    // the periodic line goes out without further logs
+    let mut content = String::new();
+    for _ in 0..200 {
+        content = std::fs::read_to_string(&log_path).unwrap_or_default();
+        if content.contains("[Paper2]") && content.contains("queued 100, written 100") {
+            break;
+        }
+        thread::sleep(Duration::from_millis(10));
+    }
+    assert!(
+        content.contains("queued 100, written 100, dropped 0, queue depth 0"),
+        "{content}"
+    );
+}
+
+#[test]
+fn test_stats_count_drops() {
+    let config = LoggerConfig {
+        max_string_len: 100,
+        log_max_buffer_count: 10,
+        line_end: '\n',
+        overflow_policy: OverflowPolicy::DropNewest,
+        context_log_path: PathBuf::from("./logs/24"),
+        ..Default::default()
+    };
+    let log_path = config.context_log_path.join("drops.log");
+
+    // not started, so nothing leaves the queue
+    let logger = LoggerThreadCtx::new(config, log_path).unwrap();
+    for i in 0..25 {
+        logger.queue_log(LogData {
+            message: format!("log {i}"),
+            ..Default::default()
+        });
+    }
+
+    let stats = logger.stats();
+    assert_eq!(stats.queued, 25);
+    assert_eq!(stats.dropped, 15);
+    assert_eq!(stats.queue_depth, 10);
+    assert_eq!(stats.written, 0);
+}
@@ -0,0 +1,82 @@
+use std::{path::PathBuf, thread, time::Duration};
+
+use crate::{
+    log_level::LogLevel,
+    logger::{
+        trace::{write_json_str, TraceBatch, TraceEvent},
+        LogData,
+    },
+    LoggerConfig, LoggerThreadCtx,
+};
+
+#[test]
+fn test_json_str_escapes() {
+    let mut out = Vec::new();
+    write_json_str(&mut out, "plain \"quoted\" back\\slash\nnew\u{1}line é").unwrap();
+
+    assert_eq!(
+        String::from_utf8(out).unwrap(),
+        r#""plain \"quoted\" back\\slash\nnew\u0001line é""#
+    );
+}
+
+#[test]
+fn test_trace_file() {
+    let config = LoggerConfig {
+        max_string_len: 100,
+        log_max_buffer_count: 50,
+        line_end: '\n',
+        context_log_path: PathBuf::from("./logs/22"),
+        trace_path: Some(PathBuf::from("./logs/22/trace.json")),
+        ..Default::default()
+    };
+    std::fs::create_dir_all(&config.context_log_path).unwrap();
+    let log_path = config.context_log_path.join("test_log.log");
+    let trace_path = config.trace_path.clone().unwrap();
+
+    let logger = LoggerThreadCtx::new(config, log_path)
+        .unwrap()
+        .init(false)
+        .unwrap();
+
+    logger.read().submit_trace(TraceBatch {
+        tid: 7,
+        events: vec![
+            TraceEvent {
+                name: "outer",
+                start_nanos: 1_000_000,
+                duration_nanos: 2_500_250,
+            },
+            TraceEvent {
+                name: "inner",
+                start_nanos: 1_500_000,
+                duration_nanos: 1_000,
+            },
+        ],
+    });
+
+    // errors are flushed right away, along with the trace
+    logger.read().queue_log(LogData {
+        level: LogLevel::Error,
+        message: "flush".to_string(),
+        ..Default::default()
+    });
+
+    let mut content = String::new();
+    for _ in 0..200 {
+        content = std::fs::read_to_string(&trace_path).unwrap_or_default();
+        if content.contains("inner") {
+            break;
+        }
+        thread::sleep(Duration::from_millis(10));
+    }
+
+    let pid = std::process::id();
+    assert_eq!(
+        content,
+        format!(
+            "[\n{{\"name\":\"outer\",\"ph\":\"X\",\"ts\":1000.000,\"dur\":2500.250,\"pid\":{pid},\"tid\":7}},\n\
+             {{\"name\":\"inner\",\"ph\":\"X\",\"ts\":1500.000,\"dur\":1.000,\"pid\":{pid},\"tid\":7}}"
+        )
+    );
+}
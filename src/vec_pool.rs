@@ -47,6 +47,22 @@ impl<T> VecPool<T> {
         VecPoolGuard { vec, pool: self }
     }
 
+    /// Takes a Vec out of the pool, hand it back with [`VecPool::return_vec`]
+    pub fn take(&mut self) -> Vec<T> {
+        self.pool
+            .pop_front()
+            .unwrap_or_else(|| Vec::with_capacity(self.inner_capacity))
+    }
+
+    /// Keeps at most `amount` Vecs and shrinks them back to the inner capacity
+    pub fn trim(&mut self, amount: usize) {
+        self.pool.truncate(amount);
+        self.pool.shrink_to_fit();
+        for vec in &mut self.pool {
+            vec.shrink_to(self.inner_capacity);
+        }
+    }
+
     pub fn resize_all(&mut self, new_capacity: usize) {
         self.inner_capacity = new_capacity;
         for vec in &mut self.pool {